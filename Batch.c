@@ -0,0 +1,590 @@
+#include "Bus.h"
+#include "Batch.h"
+#include "Cartridge.h"
+#include "Movie.h"
+#include "Platform.h"
+#include "Rom_index.h"
+#include "Recompiler.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef GAMEBOY_THREAD_INSTANCES
+#error The batch runner needs the core built with GAMEBOY_THREAD_INSTANCES
+#endif
+
+// Scheduling: the jobs are split into one contiguous range per worker. A worker runs its range from the
+// front, and when it runs out it steals the back half of another worker's range. Jobs can take very
+// different times (frame counts, ROMs that halt), stealing keeps all the workers busy until the end.
+#define BATCH_MAX_LINE 8192
+#define BATCH_MAX_PENDING_PER_WORKER 2
+
+typedef struct {
+	PLATFORM_MUTEX* lock;
+	int head;	// Next job to run
+	int tail;	// One past the last job
+} BATCH_DEQUE;
+
+typedef struct {
+	char* path;
+	uint8_t* image;
+	long size;
+	uint8_t error;
+} BATCH_ROM;
+
+typedef struct BATCH_OUTPUT {
+	struct BATCH_OUTPUT* next;
+	int job;
+	uint8_t* ram;
+	size_t ram_size;
+	uint32_t* screen;
+	uint64_t* hashes;
+	uint64_t hash_count;
+} BATCH_OUTPUT;
+
+typedef struct {
+	BATCH_JOB* jobs;
+	BATCH_RESULT* results;
+	int count;
+
+	BATCH_ROM* roms;
+	int rom_count;
+	int* job_rom;
+
+	BATCH_DEQUE* deques;
+	int n_workers;
+
+	// I/O stage, protected by io_lock
+	PLATFORM_MUTEX* io_lock;
+	PLATFORM_COND* io_wake;
+	PLATFORM_COND* io_space;
+	BATCH_OUTPUT* io_first;
+	BATCH_OUTPUT* io_last;
+	int io_pending;
+	int io_max_pending;
+	bool io_done;
+} BATCH_CONTEXT;
+
+typedef struct {
+	BATCH_CONTEXT* ctx;
+	int index;
+} BATCH_WORKER;
+
+static char* batch_strdup(char* s)
+{
+	size_t len = strlen(s) + 1;
+	char* copy = (char*)malloc(len);
+	if (copy != NULL)
+		memcpy(copy, s, len);
+	return copy;
+}
+
+static uint8_t batch_parse_line(char* line, BATCH_JOB* job)
+{
+	memset(job, 0, sizeof(BATCH_JOB));
+	bool first = true;
+	char* p = line;
+	while (*p != '\0')
+	{
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '\0')
+			break;
+		char* token = p;
+		while (*p != '\0' && *p != ' ' && *p != '\t')
+			p++;
+		if (*p != '\0')
+			*p++ = '\0';
+
+		if (first)
+		{
+			job->rom = batch_strdup(token);
+			first = false;
+			continue;
+		}
+		char* value = strchr(token, '=');
+		if (value == NULL)
+			return BATCH_ERR_MANIFEST;
+		*value++ = '\0';
+		if (strcmp(token, "frames") == 0)
+			job->frames = strtoull(value, NULL, 10);
+		else if (strcmp(token, "movie") == 0)
+			job->movie = batch_strdup(value);
+		else if (strcmp(token, "random") == 0)
+			job->random_seed = (uint32_t)strtoul(value, NULL, 10);
+		else if (strcmp(token, "ram") == 0)
+			job->ram_out = batch_strdup(value);
+		else if (strcmp(token, "screen") == 0)
+			job->screen_out = batch_strdup(value);
+		else if (strcmp(token, "hashes") == 0)
+			job->hashes_out = batch_strdup(value);
+		else if (strcmp(token, "recomp") == 0)
+			job->recomp = batch_strdup(value);
+		else
+			return BATCH_ERR_MANIFEST;
+	}
+	return job->rom != NULL && job->frames > 0 ? BATCH_OK : BATCH_ERR_MANIFEST;
+}
+
+static void batch_job_free(BATCH_JOB* job)
+{
+	free(job->rom);
+	free(job->movie);
+	free(job->ram_out);
+	free(job->screen_out);
+	free(job->hashes_out);
+	free(job->recomp);
+}
+
+uint8_t batch_manifest_load(char* filename, BATCH_JOB** jobs, int* count)
+{
+	*jobs = NULL;
+	*count = 0;
+	FILE* manifest = fopen(filename, "r");
+	if (manifest == NULL)
+		return BATCH_ERR_FILE_OPEN;
+
+	char* line = (char*)malloc(BATCH_MAX_LINE);
+	if (line == NULL)
+	{
+		fclose(manifest);
+		return BATCH_ERR_ALLOC;
+	}
+	uint8_t res = BATCH_OK;
+	int capacity = 0;
+	while (res == BATCH_OK && fgets(line, BATCH_MAX_LINE, manifest) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		char* p = line;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '\0' || *p == '#')
+			continue;
+
+		if (*count == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 64;
+			BATCH_JOB* grown = (BATCH_JOB*)realloc(*jobs, capacity * sizeof(BATCH_JOB));
+			if (grown == NULL)
+			{
+				res = BATCH_ERR_ALLOC;
+				break;
+			}
+			*jobs = grown;
+		}
+		res = batch_parse_line(p, &(*jobs)[*count]);
+		(*count)++;
+	}
+	free(line);
+	fclose(manifest);
+	if (res != BATCH_OK)
+	{
+		batch_manifest_free(*jobs, *count);
+		*jobs = NULL;
+		*count = 0;
+	}
+	return res;
+}
+
+void batch_manifest_free(BATCH_JOB* jobs, int count)
+{
+	for (int i = 0; i < count; i++)
+		batch_job_free(&jobs[i]);
+	free(jobs);
+}
+
+// Every distinct ROM is read once, the workers share the images
+static uint8_t batch_roms_load(BATCH_CONTEXT* ctx)
+{
+	ctx->roms = (BATCH_ROM*)calloc(ctx->count, sizeof(BATCH_ROM));
+	ctx->job_rom = (int*)malloc(ctx->count * sizeof(int));
+	if (ctx->roms == NULL || ctx->job_rom == NULL)
+		return BATCH_ERR_ALLOC;
+
+	for (int i = 0; i < ctx->count; i++)
+	{
+		int r;
+		for (r = 0; r < ctx->rom_count; r++)
+		{
+			if (strcmp(ctx->roms[r].path, ctx->jobs[i].rom) == 0)
+				break;
+		}
+		if (r == ctx->rom_count)
+		{
+			BATCH_ROM* rom = &ctx->roms[ctx->rom_count++];
+			rom->path = ctx->jobs[i].rom;
+			rom->error = cart_file_read(rom->path, &rom->image, &rom->size);
+		}
+		ctx->job_rom[i] = r;
+	}
+	return BATCH_OK;
+}
+
+static int batch_next(BATCH_CONTEXT* ctx, int worker)
+{
+	BATCH_DEQUE* own = &ctx->deques[worker];
+	platform_mutex_lock(own->lock);
+	int job = own->head < own->tail ? own->head++ : -1;
+	platform_mutex_unlock(own->lock);
+	if (job >= 0)
+		return job;
+
+	for (int i = 1; i < ctx->n_workers; i++)
+	{
+		BATCH_DEQUE* victim = &ctx->deques[(worker + i) % ctx->n_workers];
+		platform_mutex_lock(victim->lock);
+		int first = victim->head + (victim->tail - victim->head) / 2;
+		int last = victim->tail;
+		if (first < last)
+			victim->tail = first;
+		platform_mutex_unlock(victim->lock);
+		if (first >= last)
+			continue;
+
+		// Run the first stolen job, the rest can be stolen in turn
+		platform_mutex_lock(own->lock);
+		own->head = first + 1;
+		own->tail = last;
+		platform_mutex_unlock(own->lock);
+		return first;
+	}
+	return -1;
+}
+
+static uint64_t batch_screen_hash()
+{
+	return rom_hash64((uint8_t*)gameboy_get_screen(), 160 * 144 * sizeof(uint32_t));
+}
+
+// xorshift32, never 0 for a seed that isn't 0
+static uint32_t batch_random(uint32_t* state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static void batch_output_queue(BATCH_CONTEXT* ctx, BATCH_OUTPUT* out)
+{
+	platform_mutex_lock(ctx->io_lock);
+	while (ctx->io_pending >= ctx->io_max_pending)
+		platform_cond_wait(ctx->io_space, ctx->io_lock);
+	out->next = NULL;
+	if (ctx->io_last != NULL)
+		ctx->io_last->next = out;
+	else
+		ctx->io_first = out;
+	ctx->io_last = out;
+	ctx->io_pending++;
+	platform_cond_signal(ctx->io_wake);
+	platform_mutex_unlock(ctx->io_lock);
+}
+
+static void batch_job(BATCH_CONTEXT* ctx, int index)
+{
+	BATCH_JOB* job = &ctx->jobs[index];
+	BATCH_RESULT* result = &ctx->results[index];
+	BATCH_ROM* rom = &ctx->roms[ctx->job_rom[index]];
+	memset(result, 0, sizeof(BATCH_RESULT));
+	if (rom->error != 0)
+	{
+		result->status = BATCH_ERR_CART;
+		result->detail = rom->error;
+		return;
+	}
+
+	// The machine of this worker is reused, only the cartridge is swapped
+	gameboy_movie_stop();
+	gameboy_cart_unload();
+	uint8_t res = gameboy_cart_load_shared(rom->image, rom->size);
+	if (res != 0)
+	{
+		result->status = BATCH_ERR_CART;
+		result->detail = res;
+		return;
+	}
+	if (job->recomp != NULL && (res = gameboy_recomp_load(job->recomp)) != RECOMP_OK)
+	{
+		result->status = BATCH_ERR_RECOMP;
+		result->detail = res;
+		return;
+	}
+	gameboy_reset(true);
+	if (job->movie != NULL && (res = gameboy_movie_play(job->movie)) != MOVIE_OK)
+	{
+		result->status = BATCH_ERR_MOVIE;
+		result->detail = res;
+		return;
+	}
+
+	BATCH_OUTPUT* out = NULL;
+	if (job->ram_out != NULL || job->screen_out != NULL || job->hashes_out != NULL)
+	{
+		out = (BATCH_OUTPUT*)calloc(1, sizeof(BATCH_OUTPUT));
+		if (out == NULL || (job->hashes_out != NULL &&
+			(out->hashes = (uint64_t*)malloc(job->frames * sizeof(uint64_t))) == NULL))
+		{
+			free(out);
+			result->status = BATCH_ERR_ALLOC;
+			return;
+		}
+		out->job = index;
+	}
+
+	uint32_t random_state = job->random_seed;
+	uint8_t pressed = 0;
+	uint64_t start_clock = clock_count;
+	uint64_t start = platform_time_ns();
+	for (uint64_t f = 0; f < job->frames; f++)
+	{
+		// Random policy: now and then a button changes, at the start of a frame
+		if (random_state != 0 && (batch_random(&random_state) & 0x07) == 0)
+		{
+			uint8_t button = batch_random(&random_state) % 8;
+			pressed ^= 1 << button;
+			gameboy_joypad_input(button, (pressed >> button) & 1);
+		}
+
+		gameboy_run_frame();
+		if (out != NULL && out->hashes != NULL)
+			out->hashes[out->hash_count++] = batch_screen_hash();
+	}
+	result->run_ns = platform_time_ns() - start;
+	result->frames = job->frames;
+	result->clocks = clock_count - start_clock;
+	result->final_hash = batch_screen_hash();
+	if (out == NULL)
+		return;
+
+	if (job->ram_out != NULL)
+	{
+		BUS_STATE bus;
+		bus_state_save(&bus);
+		uint8_t* cart_rom;
+		uint8_t* cart_ram = NULL;
+		int cart_rom_size;
+		int cart_ram_size = 0;
+		if (cart_mapper_get_memory(&cart_rom, &cart_rom_size, &cart_ram, &cart_ram_size) != 0 || cart_ram == NULL)
+			cart_ram_size = 0;
+		out->ram_size = sizeof bus.wram + cart_ram_size;
+		out->ram = (uint8_t*)malloc(out->ram_size);
+		if (out->ram != NULL)
+		{
+			memcpy(out->ram, bus.wram, sizeof bus.wram);
+			if (cart_ram_size > 0)
+				memcpy(out->ram + sizeof bus.wram, cart_ram, cart_ram_size);
+		}
+	}
+	if (job->screen_out != NULL)
+	{
+		out->screen = (uint32_t*)malloc(160 * 144 * sizeof(uint32_t));
+		if (out->screen != NULL)
+			memcpy(out->screen, gameboy_get_screen(), 160 * 144 * sizeof(uint32_t));
+	}
+	if ((job->ram_out != NULL && out->ram == NULL) || (job->screen_out != NULL && out->screen == NULL))
+		result->status = BATCH_ERR_ALLOC;
+	batch_output_queue(ctx, out);
+}
+
+static void batch_worker(void* arg)
+{
+	BATCH_WORKER* worker = (BATCH_WORKER*)arg;
+	int job;
+	while ((job = batch_next(worker->ctx, worker->index)) >= 0)
+		batch_job(worker->ctx, job);
+	gameboy_movie_stop();
+	gameboy_cart_unload();
+}
+
+static bool batch_write_file(char* filename, uint8_t* data, size_t size)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+		return false;
+	bool ok = fwrite(data, 1, size, file) == size;
+	if (fclose(file) != 0)
+		ok = false;
+	return ok;
+}
+
+static bool batch_write_screen(char* filename, uint32_t* screen)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+		return false;
+	uint8_t row[160 * 3];
+	bool ok = fprintf(file, "P6\n160 144\n255\n") > 0;
+	for (int y = 0; ok && y < 144; y++)
+	{
+		// Screen pixels are 0x00BBGGRR
+		for (int x = 0; x < 160; x++)
+		{
+			uint32_t pixel = screen[y * 160 + x];
+			row[x * 3] = (uint8_t)pixel;
+			row[x * 3 + 1] = (uint8_t)(pixel >> 8);
+			row[x * 3 + 2] = (uint8_t)(pixel >> 16);
+		}
+		ok = fwrite(row, 1, sizeof row, file) == sizeof row;
+	}
+	if (fclose(file) != 0)
+		ok = false;
+	return ok;
+}
+
+static bool batch_write_hashes(char* filename, uint64_t* hashes, uint64_t count)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == NULL)
+		return false;
+	bool ok = true;
+	for (uint64_t i = 0; ok && i < count; i++)
+		ok = fprintf(file, "%016llx\n", (unsigned long long)hashes[i]) > 0;
+	if (fclose(file) != 0)
+		ok = false;
+	return ok;
+}
+
+static void batch_io(void* arg)
+{
+	BATCH_CONTEXT* ctx = (BATCH_CONTEXT*)arg;
+	platform_mutex_lock(ctx->io_lock);
+	while (true)
+	{
+		while (ctx->io_first == NULL && !ctx->io_done)
+			platform_cond_wait(ctx->io_wake, ctx->io_lock);
+		BATCH_OUTPUT* out = ctx->io_first;
+		if (out == NULL)
+			break;
+		ctx->io_first = out->next;
+		if (ctx->io_first == NULL)
+			ctx->io_last = NULL;
+		ctx->io_pending--;
+		platform_cond_signal(ctx->io_space);
+		platform_mutex_unlock(ctx->io_lock);
+
+		BATCH_JOB* job = &ctx->jobs[out->job];
+		bool ok = true;
+		if (out->ram != NULL)
+			ok = batch_write_file(job->ram_out, out->ram, out->ram_size) && ok;
+		if (out->screen != NULL)
+			ok = batch_write_screen(job->screen_out, out->screen) && ok;
+		if (out->hashes != NULL)
+			ok = batch_write_hashes(job->hashes_out, out->hashes, out->hash_count) && ok;
+		if (!ok && ctx->results[out->job].status == BATCH_OK)
+			ctx->results[out->job].status = BATCH_ERR_FILE_WRITE;
+		free(out->ram);
+		free(out->screen);
+		free(out->hashes);
+		free(out);
+
+		platform_mutex_lock(ctx->io_lock);
+	}
+	platform_mutex_unlock(ctx->io_lock);
+}
+
+static void batch_context_free(BATCH_CONTEXT* ctx)
+{
+	if (ctx->deques != NULL)
+	{
+		for (int i = 0; i < ctx->n_workers; i++)
+		{
+			if (ctx->deques[i].lock != NULL)
+				platform_mutex_free(ctx->deques[i].lock);
+		}
+		free(ctx->deques);
+	}
+	if (ctx->roms != NULL)
+	{
+		for (int i = 0; i < ctx->rom_count; i++)
+			free(ctx->roms[i].image);
+		free(ctx->roms);
+	}
+	free(ctx->job_rom);
+	if (ctx->io_lock != NULL)
+		platform_mutex_free(ctx->io_lock);
+	if (ctx->io_wake != NULL)
+		platform_cond_free(ctx->io_wake);
+	if (ctx->io_space != NULL)
+		platform_cond_free(ctx->io_space);
+}
+
+uint8_t batch_run(BATCH_JOB* jobs, int count, int n_threads, BATCH_RESULT* results)
+{
+	BATCH_CONTEXT ctx;
+	memset(&ctx, 0, sizeof ctx);
+	ctx.jobs = jobs;
+	ctx.results = results;
+	ctx.count = count;
+	if (count == 0)
+		return BATCH_OK;
+
+	if (n_threads <= 0)
+		n_threads = platform_cpu_count();
+	if (n_threads > count)
+		n_threads = count;
+	ctx.n_workers = n_threads;
+	ctx.io_max_pending = n_threads * BATCH_MAX_PENDING_PER_WORKER;
+
+	uint8_t res = batch_roms_load(&ctx);
+	ctx.deques = (BATCH_DEQUE*)calloc(n_threads, sizeof(BATCH_DEQUE));
+	ctx.io_lock = platform_mutex_create();
+	ctx.io_wake = platform_cond_create();
+	ctx.io_space = platform_cond_create();
+	if (res != BATCH_OK || ctx.deques == NULL || ctx.io_lock == NULL || ctx.io_wake == NULL || ctx.io_space == NULL)
+	{
+		batch_context_free(&ctx);
+		return BATCH_ERR_ALLOC;
+	}
+	for (int i = 0; i < n_threads; i++)
+	{
+		ctx.deques[i].head = (int)((long long)count * i / n_threads);
+		ctx.deques[i].tail = (int)((long long)count * (i + 1) / n_threads);
+		ctx.deques[i].lock = platform_mutex_create();
+		if (ctx.deques[i].lock == NULL)
+		{
+			batch_context_free(&ctx);
+			return BATCH_ERR_ALLOC;
+		}
+	}
+
+	BATCH_WORKER* workers = (BATCH_WORKER*)malloc(n_threads * sizeof(BATCH_WORKER));
+	PLATFORM_THREAD** threads = (PLATFORM_THREAD**)calloc(n_threads, sizeof(PLATFORM_THREAD*));
+	PLATFORM_THREAD* io_thread = NULL;
+	if (workers == NULL || threads == NULL)
+		res = BATCH_ERR_ALLOC;
+	else if ((io_thread = platform_thread_create(batch_io, &ctx)) == NULL)
+		res = BATCH_ERR_THREAD;
+	for (int i = 0; res == BATCH_OK && i < n_threads; i++)
+	{
+		workers[i].ctx = &ctx;
+		workers[i].index = i;
+		threads[i] = platform_thread_create(batch_worker, &workers[i]);
+		if (threads[i] == NULL)
+		{
+			// The workers that started steal the jobs of the ones that didn't
+			if (i == 0)
+				res = BATCH_ERR_THREAD;
+			break;
+		}
+	}
+	for (int i = 0; threads != NULL && i < n_threads; i++)
+	{
+		if (threads[i] != NULL)
+			platform_thread_join(threads[i]);
+	}
+
+	if (io_thread != NULL)
+	{
+		platform_mutex_lock(ctx.io_lock);
+		ctx.io_done = true;
+		platform_cond_signal(ctx.io_wake);
+		platform_mutex_unlock(ctx.io_lock);
+		platform_thread_join(io_thread);
+	}
+	free(workers);
+	free(threads);
+	batch_context_free(&ctx);
+	return res;
+}
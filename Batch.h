@@ -0,0 +1,63 @@
+#ifndef BATCH_CODE
+#define BATCH_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Headless batch runner.
+// Runs a list of jobs (a ROM, input from a movie or a random policy, a number of frames and the outputs
+// to write) on a pool of worker threads. Every worker keeps its own machine for all the jobs it runs, so
+// the core has to be built with GAMEBOY_THREAD_INSTANCES. Each distinct ROM is read once and shared by
+// all the workers. The outputs are written by a separate I/O thread, so the workers never wait on the disk.
+// Many instances of one game run as separate jobs. They aren't stepped together in vector lanes: the CPU,
+// the PPU, the timer and DMA interleave on every T-cycle through the state of their own machine.
+//
+// Manifest: one job per line, blank lines and lines starting with # are skipped.
+// <rom> frames=<n> [movie=<file>] [random=<seed>] [ram=<file>] [screen=<file>] [hashes=<file>] [recomp=<file>]
+//		movie:	input movie to play (it has to be recorded from the same ROM)
+//		random:	random button presses and releases, seeded, so the run is the same every time
+//		ram:	WRAM followed by the cartridge RAM at the end of the run
+//		screen:	the last frame, binary PPM
+//		hashes:	hash of the screen at the end of every frame, one per line
+//		recomp:	recompiled code of the ROM to run (gbrecomp), only load modules you built yourself
+// Paths can't contain spaces.
+typedef struct {
+	char* rom;
+	uint64_t frames;
+	char* movie;
+	uint32_t random_seed;	// 0 - no random input
+	char* ram_out;
+	char* screen_out;
+	char* hashes_out;
+	char* recomp;
+} BATCH_JOB;
+
+typedef struct {
+	uint8_t status;			// BATCH_ERRORS
+	uint8_t detail;			// Error code of the module that failed (cartridge, movie, recompiled code)
+	uint64_t frames;
+	uint64_t clocks;
+	uint64_t final_hash;	// Hash of the last frame
+	uint64_t run_ns;		// Emulation time, without loading the ROM and writing the outputs
+} BATCH_RESULT;
+
+uint8_t batch_manifest_load(char* filename, BATCH_JOB** jobs, int* count);
+void batch_manifest_free(BATCH_JOB* jobs, int count);
+
+// results has an entry for every job. n_threads 0 - one per processor
+uint8_t batch_run(BATCH_JOB* jobs, int count, int n_threads, BATCH_RESULT* results);
+
+enum BATCH_ERRORS {
+	BATCH_OK = 0,
+	BATCH_ERR_FILE_OPEN,
+	BATCH_ERR_FILE_WRITE,
+	BATCH_ERR_MANIFEST,
+	BATCH_ERR_ALLOC,
+	BATCH_ERR_THREAD,
+	BATCH_ERR_CART,
+	BATCH_ERR_MOVIE,
+	BATCH_ERR_RECOMP
+};
+
+#endif // BATCH_CODE
@@ -0,0 +1,63 @@
+#include "Batch.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <string.h>
+
+// Command line front end for the batch runner
+//	gbbatch <manifest> [threads]
+// Prints a CSV line per job to stdout, the totals go to stderr.
+
+static int usage()
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "\tgbbatch <manifest> [threads]\n");
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+		return usage();
+	int n_threads = argc > 2 ? atoi(argv[2]) : 0;
+
+	BATCH_JOB* jobs;
+	int count;
+	uint8_t res = batch_manifest_load(argv[1], &jobs, &count);
+	if (res != BATCH_OK)
+	{
+		fprintf(stderr, "Loading the manifest failed: %d\n", res);
+		return 1;
+	}
+	BATCH_RESULT* results = (BATCH_RESULT*)calloc(count ? count : 1, sizeof(BATCH_RESULT));
+	if (results == NULL)
+	{
+		batch_manifest_free(jobs, count);
+		return 1;
+	}
+
+	uint64_t start = platform_time_ns();
+	res = batch_run(jobs, count, n_threads, results);
+	uint64_t wall_ns = platform_time_ns() - start;
+	if (res != BATCH_OK)
+		fprintf(stderr, "Batch failed: %d\n", res);
+
+	int failed = 0;
+	uint64_t clocks = 0;
+	printf("job,rom,status,detail,frames,clocks,run_ms,final_hash\n");
+	for (int i = 0; i < count; i++)
+	{
+		BATCH_RESULT* r = &results[i];
+		printf("%d,%s,%d,%d,%llu,%llu,%.3f,%016llx\n", i, jobs[i].rom, r->status, r->detail,
+			(unsigned long long)r->frames, (unsigned long long)r->clocks, r->run_ns / 1e6,
+			(unsigned long long)r->final_hash);
+		if (r->status != BATCH_OK)
+			failed++;
+		clocks += r->clocks;
+	}
+	fprintf(stderr, "%d jobs, %d failed, %.3f s, %.1f emulated MHz\n", count, failed, wall_ns / 1e9,
+		wall_ns ? clocks * 1e3 / wall_ns : 0.0);
+
+	free(results);
+	batch_manifest_free(jobs, count);
+	return res == BATCH_OK && failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,285 @@
+#include "Bench.h"
+#include "Cartridge.h"
+#include <string.h>
+
+// Code is written with a few helpers instead of an assembler, so the ROMs need nothing outside the tree.
+// Every ROM starts at $0150 (the entry point jumps there) and keeps its data from $0200 on.
+#define BENCH_CODE_START 0x0150
+#define BENCH_DATA_START 0x0200
+
+typedef struct {
+	uint8_t* rom;
+	uint16_t pc;
+} BENCH_ASM;
+
+static void emit(BENCH_ASM* a, int count, const uint8_t* bytes)
+{
+	memcpy(a->rom + a->pc, bytes, count);
+	a->pc += count;
+}
+
+#define OP(a, ...) do { const uint8_t op_bytes[] = { __VA_ARGS__ }; emit(a, sizeof op_bytes, op_bytes); } while (0)
+
+// Relative jumps back to a label
+static void jr(BENCH_ASM* a, uint8_t opcode, uint16_t label)
+{
+	OP(a, opcode, (uint8_t)(int8_t)(label - (a->pc + 2)));
+}
+
+#define JR 0x18
+#define JR_NZ 0x20
+
+// memcpy(dest, src, count) with count up to 256, through the bus
+static void copy_loop(BENCH_ASM* a, uint16_t dest, uint16_t src, uint8_t count)
+{
+	OP(a, 0x21, (uint8_t)src, src >> 8);		// LD HL,src
+	OP(a, 0x11, (uint8_t)dest, dest >> 8);		// LD DE,dest
+	OP(a, 0x0E, count);							// LD C,count
+	uint16_t loop = a->pc;
+	OP(a, 0x2A);								// LD A,(HL+)
+	OP(a, 0x12);								// LD (DE),A
+	OP(a, 0x13);								// INC DE
+	OP(a, 0x0D);								// DEC C
+	jr(a, JR_NZ, loop);
+}
+
+// Waits for V-Blank and turns the LCD off, so VRAM and OAM can be written
+static void lcd_off(BENCH_ASM* a)
+{
+	uint16_t wait = a->pc;
+	OP(a, 0xF0, 0x44);							// LDH A,(LY)
+	OP(a, 0xFE, 144);							// CP 144
+	jr(a, JR_NZ, wait);
+	OP(a, 0xAF);								// XOR A
+	OP(a, 0xE0, 0x40);							// LDH (LCDC),A
+}
+
+// Enables the interrupts in ie and sleeps in HALT forever
+static void halt_loop(BENCH_ASM* a, uint8_t ie)
+{
+	OP(a, 0x3E, ie);							// LD A,ie
+	OP(a, 0xE0, 0xFF);							// LDH (IE),A
+	OP(a, 0xAF);								// XOR A
+	OP(a, 0xE0, 0x0F);							// LDH (IF),A
+	OP(a, 0xFB);								// EI
+	uint16_t loop = a->pc;
+	OP(a, 0x76);								// HALT
+	OP(a, 0x00);								// NOP
+	jr(a, JR, loop);
+}
+
+static void build_alu(BENCH_ASM* a)
+{
+	OP(a, 0xF3);								// DI
+	OP(a, 0x06, 0x01);							// LD B,$01
+	uint16_t loop = a->pc;
+	OP(a, 0x80);								// ADD A,B
+	OP(a, 0xA9);								// XOR C
+	OP(a, 0x0C);								// INC C
+	OP(a, 0x07);								// RLCA
+	OP(a, 0xCE, 0x37);							// ADC A,$37
+	OP(a, 0x92);								// SUB D
+	OP(a, 0x1D);								// DEC E
+	OP(a, 0xE6, 0xF7);							// AND $F7
+	OP(a, 0xB5);								// OR L
+	OP(a, 0xBC);								// CP H
+	OP(a, 0xCB, 0x37);							// SWAP A
+	OP(a, 0x27);								// DAA
+	OP(a, 0x09);								// ADD HL,BC
+	jr(a, JR, loop);
+}
+
+static void build_memcopy(BENCH_ASM* a)
+{
+	// 4KB of ROM to WRAM, over and over
+	OP(a, 0xF3);								// DI
+	uint16_t outer = a->pc;
+	OP(a, 0x21, 0x00, 0x04);					// LD HL,$0400
+	OP(a, 0x11, 0x00, 0xC0);					// LD DE,$C000
+	OP(a, 0x01, 0x00, 0x10);					// LD BC,$1000
+	uint16_t inner = a->pc;
+	OP(a, 0x2A);								// LD A,(HL+)
+	OP(a, 0x12);								// LD (DE),A
+	OP(a, 0x13);								// INC DE
+	OP(a, 0x0B);								// DEC BC
+	OP(a, 0x78);								// LD A,B
+	OP(a, 0xB1);								// OR C
+	jr(a, JR_NZ, inner);
+	jr(a, JR, outer);
+}
+
+static void build_halt(BENCH_ASM* a)
+{
+	halt_loop(a, 0x01);
+}
+
+static void build_sprites(BENCH_ASM* a)
+{
+	// 40 sprites, 10 per row of 16 lines, with a solid tile
+	for (int i = 0; i < 40; i++)
+	{
+		uint8_t* sprite = a->rom + BENCH_DATA_START + i * 4;
+		sprite[0] = (uint8_t)(16 + (i / 10) * 16);
+		sprite[1] = (uint8_t)(8 + (i % 10) * 12);
+		sprite[2] = 0x00;
+		sprite[3] = (i & 1) ? 0x20 : 0x00;		// Every other one flipped
+	}
+	memset(a->rom + BENCH_DATA_START + 160, 0xFF, 32);
+
+	OP(a, 0xF3);								// DI
+	lcd_off(a);
+	copy_loop(a, 0xFE00, BENCH_DATA_START, 160);
+	copy_loop(a, 0x8000, BENCH_DATA_START + 160, 32);
+	OP(a, 0x3E, 0x97);							// LD A,$97 (LCD, OBJ 8x16, OBJ, BG)
+	OP(a, 0xE0, 0x40);							// LDH (LCDC),A
+	halt_loop(a, 0x01);
+}
+
+static void build_window(BENCH_ASM* a)
+{
+	// STAT handler: toggle the window and move it, on every H-Blank
+	BENCH_ASM handler = { a->rom, 0x0048 };
+	OP(&handler, 0xF5);							// PUSH AF
+	OP(&handler, 0xF0, 0x40);					// LDH A,(LCDC)
+	OP(&handler, 0xEE, 0x20);					// XOR $20
+	OP(&handler, 0xE0, 0x40);					// LDH (LCDC),A
+	OP(&handler, 0xF0, 0x4B);					// LDH A,(WX)
+	OP(&handler, 0xC6, 0x03);					// ADD A,3
+	OP(&handler, 0xE0, 0x4B);					// LDH (WX),A
+	OP(&handler, 0xF1);							// POP AF
+	OP(&handler, 0xD9);							// RETI
+
+	// Tiles with a pattern, so the window and the background differ
+	memset(a->rom + BENCH_DATA_START, 0xAA, 16);
+	memset(a->rom + BENCH_DATA_START + 16, 0x55, 16);
+
+	OP(a, 0xF3);								// DI
+	lcd_off(a);
+	copy_loop(a, 0x8000, BENCH_DATA_START, 32);
+	OP(a, 0x21, 0x00, 0x9C);					// LD HL,$9C00 (window map)
+	OP(a, 0x3E, 0x01);							// LD A,1
+	OP(a, 0x0E, 0x00);							// LD C,0 (256 tiles)
+	uint16_t fill = a->pc;
+	OP(a, 0x22);								// LD (HL+),A
+	OP(a, 0x0D);								// DEC C
+	jr(a, JR_NZ, fill);
+	OP(a, 0xAF);								// XOR A
+	OP(a, 0xE0, 0x4A);							// LDH (WY),A
+	OP(a, 0x3E, 0x07);							// LD A,7
+	OP(a, 0xE0, 0x4B);							// LDH (WX),A
+	OP(a, 0x3E, 0x08);							// LD A,$08 (H-Blank interrupt)
+	OP(a, 0xE0, 0x41);							// LDH (STAT),A
+	OP(a, 0x3E, 0xF1);							// LD A,$F1 (LCD, window map $9C00, window, BG)
+	OP(a, 0xE0, 0x40);							// LDH (LCDC),A
+	halt_loop(a, 0x02);
+}
+
+static void build_mbc1(BENCH_ASM* a)
+{
+	// Every bank starts with its number, the sum keeps the reads from being skipped
+	for (int bank = 1; bank < 16; bank++)
+		a->rom[bank * 0x4000] = (uint8_t)bank;
+
+	OP(a, 0xF3);								// DI
+	uint16_t outer = a->pc;
+	OP(a, 0x06, 0x01);							// LD B,1
+	uint16_t loop = a->pc;
+	OP(a, 0x78);								// LD A,B
+	OP(a, 0xEA, 0x00, 0x20);					// LD ($2000),A
+	OP(a, 0xFA, 0x00, 0x40);					// LD A,($4000)
+	OP(a, 0x81);								// ADD A,C
+	OP(a, 0x4F);								// LD C,A
+	OP(a, 0x04);								// INC B
+	OP(a, 0x78);								// LD A,B
+	OP(a, 0xFE, 16);							// CP 16
+	jr(a, JR_NZ, loop);
+	OP(a, 0xAF);								// XOR A
+	OP(a, 0xEA, 0x00, 0x60);					// LD ($6000),A (mode)
+	OP(a, 0xEA, 0x00, 0x40);					// LD ($4000),A (upper bits)
+	jr(a, JR, outer);
+}
+
+static void build_oamdma(BENCH_ASM* a)
+{
+	// The DMA routine has to run from HRAM
+	static const uint8_t routine[] = {
+		0xE0, 0x46,								// LDH (DMA),A
+		0x3E, 0x28,								// LD A,40
+		0x3D,									// DEC A
+		0x20, 0xFD,								// JR NZ,-3
+		0xC9									// RET
+	};
+	memcpy(a->rom + BENCH_DATA_START, routine, sizeof routine);
+
+	OP(a, 0xF3);								// DI
+	copy_loop(a, 0xFF80, BENCH_DATA_START, sizeof routine);
+	uint16_t loop = a->pc;
+	OP(a, 0x3E, 0xC0);							// LD A,$C0
+	OP(a, 0xCD, 0x80, 0xFF);					// CALL $FF80
+	jr(a, JR, loop);
+}
+
+typedef struct {
+	char* name;
+	void(*build)(BENCH_ASM* a);
+	uint8_t cart_type;
+	uint8_t rom_size;							// GAMEBOY_CART_ROM_SIZE
+} BENCH_WORKLOAD;
+
+static const BENCH_WORKLOAD workloads[] = {
+	{ "alu", build_alu, CART_ROM_ONLY, CART_ROM_32K },
+	{ "memcopy", build_memcopy, CART_ROM_ONLY, CART_ROM_32K },
+	{ "halt", build_halt, CART_ROM_ONLY, CART_ROM_32K },
+	{ "sprites", build_sprites, CART_ROM_ONLY, CART_ROM_32K },
+	{ "window", build_window, CART_ROM_ONLY, CART_ROM_32K },
+	{ "mbc1", build_mbc1, CART_MBC1, CART_ROM_256K },
+	{ "oamdma", build_oamdma, CART_ROM_ONLY, CART_ROM_32K }
+};
+
+int bench_count()
+{
+	return sizeof workloads / sizeof workloads[0];
+}
+
+char* bench_name(int index)
+{
+	if (index < 0 || index >= bench_count())
+		return NULL;
+	return workloads[index].name;
+}
+
+uint8_t bench_rom_build(int index, uint8_t** image, size_t* size)
+{
+	if (index < 0 || index >= bench_count())
+		return BENCH_ERR_INDEX;
+	const BENCH_WORKLOAD* w = &workloads[index];
+	size_t rom_size = (size_t)32 * 1024 << w->rom_size;
+	uint8_t* rom = (uint8_t*)calloc(rom_size, 1);
+	if (rom == NULL)
+		return BENCH_ERR_ALLOC;
+
+	// Header: the entry point jumps to the code, the rest is only what the cartridge loader checks
+	BENCH_ASM a = { rom, 0x0100 };
+	OP(&a, 0x00);								// NOP
+	OP(&a, 0xC3, (uint8_t)BENCH_CODE_START, BENCH_CODE_START >> 8);	// JP $0150
+	snprintf((char*)rom + 0x0134, 16, "BENCH %s", w->name);
+	rom[0x0147] = w->cart_type;
+	rom[0x0148] = w->rom_size;
+	rom[0x0149] = CART_RAM_NONE;
+
+	// Interrupt vectors that aren't used return right away
+	for (uint16_t vector = 0x0040; vector <= 0x0060; vector += 8)
+		rom[vector] = 0xD9;						// RETI
+
+	a.pc = BENCH_CODE_START;
+	w->build(&a);
+
+	uint8_t checksum = 0;
+	for (int i = 0x0134; i <= 0x014C; i++)
+		checksum = checksum - rom[i] - 1;
+	rom[0x014D] = checksum;
+
+	*image = rom;
+	*size = rom_size;
+	return BENCH_OK;
+}
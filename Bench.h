@@ -0,0 +1,30 @@
+#ifndef BENCH_CODE
+#define BENCH_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Benchmark workloads.
+// Small ROMs built in memory, each one keeping one part of the machine busy, so the results don't depend
+// on any ROM outside the tree and are the same on every run:
+//	alu:		arithmetic and logic in a tight loop
+//	memcopy:	copying ROM to WRAM, every byte through the bus
+//	halt:		idle in HALT, woken up by the V-Blank interrupt
+//	sprites:	10 sprites (8x16) on every line of the top half of the screen
+//	window:		the window turned on and off and moved on every H-Blank
+//	mbc1:		switching ROM banks as fast as possible
+//	oamdma:		back to back OAM DMA from a routine in HRAM
+int bench_count();
+char* bench_name(int index);
+
+// Builds the ROM of a workload into a new buffer, freed by the caller
+uint8_t bench_rom_build(int index, uint8_t** image, size_t* size);
+
+enum BENCH_ERRORS {
+	BENCH_OK = 0,
+	BENCH_ERR_INDEX,
+	BENCH_ERR_ALLOC
+};
+
+#endif // BENCH_CODE
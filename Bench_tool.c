@@ -0,0 +1,100 @@
+#include "Bus.h"
+#include "Bench.h"
+#include "Rom_index.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <string.h>
+
+// Runs the benchmark workloads and prints the results as JSON
+//	gbbench [-frames N] [-runs N] [-only name]
+// Every run starts from a reset and a few frames of warm up. The fastest of the runs is reported. The
+// state hash covers the whole machine and tells if a change also changed what the emulator does, the
+// screen hash alone doesn't since most workloads never turn the LCD on.
+
+#define CPU_HZ 4194304.0
+#define WARMUP_FRAMES 10
+
+static int usage()
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "\tgbbench [-frames N] [-runs N] [-only name]\n");
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t frames = 600;
+	int runs = 3;
+	char* only = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+			return usage();
+		else if (strcmp(argv[i], "-frames") == 0)
+			frames = strtoull(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-runs") == 0)
+			runs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-only") == 0)
+			only = argv[++i];
+		else
+			return usage();
+	}
+	if (frames == 0 || runs <= 0)
+		return usage();
+
+	printf("{\n\t\"frames\": %llu,\n\t\"runs\": %d,\n\t\"workloads\": [", (unsigned long long)frames, runs);
+	int failed = 0;
+	bool first = true;
+	for (int w = 0; w < bench_count(); w++)
+	{
+		if (only != NULL && strcmp(only, bench_name(w)) != 0)
+			continue;
+		uint8_t* image;
+		size_t size;
+		uint8_t res = bench_rom_build(w, &image, &size);
+		if (res == BENCH_OK && (res = gameboy_cart_load_shared(image, size)) != 0)
+			free(image);
+		if (res != 0)
+		{
+			fprintf(stderr, "%s: loading failed: %d\n", bench_name(w), res);
+			failed++;
+			continue;
+		}
+
+		size_t state_size = gameboy_state_size();
+		uint8_t* state = malloc(state_size);
+		uint64_t best_ns = UINT64_MAX;
+		uint64_t clocks = 0;
+		uint64_t hash = 0;
+		uint64_t state_hash = 0;
+		for (int r = 0; r < runs; r++)
+		{
+			gameboy_reset(true);
+			for (int f = 0; f < WARMUP_FRAMES; f++)
+				gameboy_run_frame();
+			uint64_t start_clock = clock_count;
+			uint64_t start = platform_time_ns();
+			for (uint64_t f = 0; f < frames; f++)
+				gameboy_run_frame();
+			uint64_t run_ns = platform_time_ns() - start;
+			if (run_ns < best_ns)
+				best_ns = run_ns;
+			clocks = clock_count - start_clock;
+			hash = rom_hash64((uint8_t*)gameboy_get_screen(), 160 * 144 * sizeof(uint32_t));
+			if (state != NULL && gameboy_state_save(state, state_size) == 0)
+				state_hash = rom_hash64(state, state_size);
+		}
+		gameboy_cart_unload();
+		free(state);
+		free(image);
+
+		double seconds = best_ns / 1e9;
+		printf("%s\n\t\t{ \"name\": \"%s\", \"clocks\": %llu, \"ms\": %.3f, \"emulated_mhz\": %.3f, \"fps\": %.1f, "
+			"\"ns_per_frame\": %.0f, \"realtime\": %.2f, \"screen_hash\": \"%016llx\", \"state_hash\": \"%016llx\" }",
+			first ? "" : ",", bench_name(w), (unsigned long long)clocks, best_ns / 1e6, clocks / seconds / 1e6, frames / seconds,
+			(double)best_ns / frames, clocks / CPU_HZ / seconds, (unsigned long long)hash, (unsigned long long)state_hash);
+		first = false;
+	}
+	printf("\n\t]\n}\n");
+	return failed ? 1 : 0;
+}
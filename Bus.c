@@ -2,10 +2,18 @@
 #include "Sharp_LR35902.h"
 #include "Ppu.h"
 #include "Cartridge.h"
-#include "Emulator_GUI.h"
 #include "Dma.h"
 #include "Timer.h"
 #include "Joypad.h"
+#include "Savestate.h"
+#include "Rewind.h"
+#include "Movie.h"
+#include "Opcode_profile.h"
+#include "Guest_profile.h"
+#include "Host_timing.h"
+#include "Trace.h"
+#include "Disassembly.h"
+#include "Recompiler.h"
 
 
 // GameBoy variants:
@@ -221,35 +229,76 @@ static uint8_t bootrom[256] = {
 };
 
 // Work RAM: C000 - DFFF
-static uint8_t wram[8192];
+static GB_INSTANCE uint8_t wram[8192];
 
 // IF - Interrupt flag register: FF0F
-static uint8_t IF = 0x00;
+static GB_INSTANCE uint8_t IF = 0x00;
 
 // Boot ROM disabled: FF50
-static uint8_t BOOTROM_REG = 0x00;
+static GB_INSTANCE uint8_t BOOTROM_REG = 0x00;
 
 // High RAM: FF80 - FFFE
-static uint8_t hram[127];
+static GB_INSTANCE uint8_t hram[127];
 
 // IE - Interrupt enable register: FFFF
-static uint8_t IE = 0x00;
+static GB_INSTANCE uint8_t IE = 0x00;
+
+// Interrupt controller: IF & IE, set on every change of either
+GB_INSTANCE uint8_t int_pending = 0x00;
 
 // DMA occuring
-static bool dma_transfer = false;
-static uint8_t dma_count = 0x00;
+static GB_INSTANCE bool dma_transfer = false;
+static GB_INSTANCE uint8_t dma_count = 0x00;
+
+// Bulk OAM DMA (GB_FAST_BULK_DMA)
+// The transfer copies a byte on every M-cycle the CPU runs. Nothing can change the source while it runs
+// (the CPU can only write to HRAM), so instead of the 160 bus round trips, the bytes are copied in runs
+// when OAM is read (the PPU, the CPU or a save state), and the rest at the end of the transfer. The bus
+// only keeps the clock of the last byte, which moves on while the CPU is halted, as the transfer waits
+// for it. dma_count is the bytes copied so far.
+// VRAM sources depend on the PPU mode at the time of every byte, those go byte by byte, as do transfers
+// with debugger watches.
+GB_INSTANCE bool dma_lazy = false;
+static GB_INSTANCE uint64_t dma_end_clock = 0;
+
+// Screen buffer, in the GDI COLORREF layout (0x00BBGGRR) that the GUI blits as is
+#define SCREEN_RGB(r, g, b) ((uint32_t)(r) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16))
+static GB_INSTANCE uint32_t rgb_screen_buffer[160 * 144];
+
+// Set by the PPU on V-Blank, the end of frame work waits for the clock to finish
+static GB_INSTANCE bool frame_ended = false;
 
-// Screen buffer
-static uint32_t rgb_screen_buffer[160 * 144];
+// Debugger breakpoints and watches, a bit per address
+static GB_INSTANCE uint32_t breakpoint_map[0x10000 / 32];
+static GB_INSTANCE uint32_t watch_map[2][0x10000 / 32];	// Read, write
+static GB_INSTANCE int watch_count = 0;
+static GB_INSTANCE bool watch_fired = false;
+static GB_INSTANCE uint16_t watch_addr = 0x0000;
+static GB_INSTANCE uint8_t watch_kind = 0;
+
+// Fused instructions (GB_FAST_FUSED): where the current run stops, 0 outside of runs and in runs that
+// stop on instructions, and the clock the CPU holds the machine to
+static GB_INSTANCE uint64_t run_limit = 0;
+static GB_INSTANCE uint64_t quiet_hold = 0;
 
 // Define globals
-bool cpu_halt = false;
-bool cpu_int_check = false;
-uint64_t clock_count = 0;
+GB_INSTANCE bool cpu_halt = false;
+GB_INSTANCE bool cpu_int_check = false;
+GB_INSTANCE uint64_t clock_count = 0;
+GB_INSTANCE uint64_t frame_count = 0;
+GB_INSTANCE uint32_t fast_paths = GB_FAST_DEFAULT;
+
+// The recompiled code only runs the game: not the boot ROM, and not while watches look at every access
+static void bus_recomp_update()
+{
+	recomp_enable((fast_paths & GB_FAST_RECOMPILED) && watch_count == 0 && BOOTROM_REG);
+}
 
 
 int gameboy_reset(bool bootskip)
 {
+	OPPROF_INIT();
+
 	// Reset memory
 	memset(wram, 0, sizeof wram);
 	memset(hram, 0, sizeof hram);
@@ -261,20 +310,26 @@ int gameboy_reset(bool bootskip)
 	cpu_halt = false;
 	cpu_int_check = false;
 	clock_count = 0;
+	frame_count = 0;
+	frame_ended = false;
+	quiet_hold = 0;
 
 	// Reset registers
 	IF = 0x00;
 	
 	BOOTROM_REG = 0x00;
 	IE = 0x00;
+	int_pending = 0x00;
 	
 	if (bootskip)
 	{
 		BOOTROM_REG = 0x01;
 	}
+	bus_recomp_update();
 	cpu_reset(bootskip);
 	dma_transfer = false;
 	dma_count = 0x00;
+	dma_lazy = false;
 	dma_reset();
 	if (ppu_reset(bootskip) != 0)
 	{
@@ -286,23 +341,214 @@ int gameboy_reset(bool bootskip)
 	return 0;
 }
 
-void gameboy_clock()
+// The clock, with and without the host timing. timed is a constant in both calls, so each one gets its
+// own copy of the clock without the branches of the other.
+#ifdef _MSC_VER
+#define BUS_CLOCK_INLINE __forceinline
+#else
+#define BUS_CLOCK_INLINE inline __attribute__((always_inline))
+#endif
+
+static BUS_CLOCK_INLINE void bus_clock(const bool timed)
 {
-	
+	uint64_t tick = 0;
+	uint64_t now = 0;
+	if (timed)
+		tick = HTIME_NOW();
+
+	// Queued joypad input and movie playback
+	if (clock_count >= movie_next_clock && clock_count >= quiet_hold)
+		movie_clock();
+
 	if (!cpu_halt && (clock_count) % 4 == 0)
 	{
+		OPPROF_START(clock_start);
 		cpu_clock();
+		OPPROF_END_CLOCK(clock_start);
+		if (timed)
+		{
+			now = HTIME_NOW();
+			htime_ticks[HTIME_CPU] += now - tick;
+			tick = now;
+		}
 		if (dma_transfer)
 		{
-			dma_clock();
-			dma_count++;
-			if (dma_count == 160)
-				dma_transfer = false;
+			if (dma_lazy)
+			{
+				if (clock_count >= dma_end_clock)
+				{
+					bus_dma_sync(clock_count + 1);
+					dma_lazy = false;
+					dma_transfer = false;
+				}
+			}
+			else
+			{
+				dma_clock();
+				dma_count++;
+				if (dma_count == 160)
+					dma_transfer = false;
+			}
+			if (timed)
+			{
+				now = HTIME_NOW();
+				htime_ticks[HTIME_DMA] += now - tick;
+				tick = now;
+			}
 		}
 	}
-	timer_clock();
+	else if (dma_lazy && clock_count % 4 == 0)
+	{
+		// Halted, the transfer waits for the CPU
+		bus_dma_sync(clock_count);
+		dma_end_clock += 4;
+	}
+	if (clock_count >= timer_next_clock)
+		timer_clock();
+	if (timed)
+	{
+		now = HTIME_NOW();
+		htime_ticks[HTIME_TIMER] += now - tick;
+		tick = now;
+	}
 	ppu_clock();
+	if (timed)
+		htime_ticks[HTIME_PPU] += HTIME_NOW() - tick;
 	clock_count++;
+
+	if (frame_ended)
+	{
+		frame_ended = false;
+		frame_count++;
+		cart_persist_frame();
+		rewind_frame();
+		movie_frame();
+		if (timed)
+			htime_frame();
+	}
+}
+
+void gameboy_clock()
+{
+	if (htime_enabled)
+		bus_clock(true);
+	else
+		bus_clock(false);
+}
+
+void gameboy_fast_paths_set(uint32_t paths)
+{
+	// A bulk transfer that is running finishes byte by byte
+	if (dma_lazy && !(paths & GB_FAST_BULK_DMA))
+	{
+		bus_dma_sync(clock_count);
+		dma_lazy = false;
+	}
+	fast_paths = paths;
+	timer_set_lazy((paths & GB_FAST_LAZY_TIMER) != 0);
+	bus_recomp_update();
+}
+
+uint32_t gameboy_fast_paths()
+{
+	return fast_paths;
+}
+
+uint64_t gameboy_run_frame()
+{
+	uint64_t start = clock_count;
+	gameboy_run(70224, GB_STOP_FRAME);
+	return clock_count - start;
+}
+
+static uint8_t bus_run(uint64_t limit, uint8_t stop_mask)
+{
+	uint64_t frame = frame_count;
+	bool check_inst = stop_mask & (GB_STOP_INSTRUCTION | GB_STOP_BREAKPOINT);
+	watch_fired = false;
+	while (true)
+	{
+		gameboy_clock();
+		if (watch_fired && (stop_mask & GB_STOP_WATCH))
+			return GB_STOP_WATCH;
+
+		// Instructions end with an M-cycle
+		if (check_inst && clock_count % 4 == 0 && (cpu_halt || cpu_cycles_left() == 0))
+		{
+			uint16_t pc = cpu_get_pc();
+			if ((stop_mask & GB_STOP_BREAKPOINT) && !cpu_halt && (breakpoint_map[pc >> 5] >> (pc & 31) & 1))
+				return GB_STOP_BREAKPOINT;
+			if (stop_mask & GB_STOP_INSTRUCTION)
+				return GB_STOP_INSTRUCTION;
+		}
+		if (frame_count != frame && (stop_mask & GB_STOP_FRAME))
+			return GB_STOP_FRAME;
+		if (clock_count >= limit)
+			return GB_STOP_BUDGET;
+	}
+}
+
+uint8_t gameboy_run(uint64_t budget, uint8_t stop_mask)
+{
+	uint64_t limit = budget != 0 ? clock_count + budget : UINT64_MAX;
+	run_limit = (stop_mask & (GB_STOP_INSTRUCTION | GB_STOP_BREAKPOINT)) ? 0 : limit;
+	uint8_t stop = bus_run(limit, stop_mask);
+	run_limit = 0;
+	return stop;
+}
+
+// The instructions have to end by the clock the run stops on, and by the next clock the timer, the PPU
+// (and with it the frame end) or the movie has something to do on. Their own accesses only reach plain
+// memory.
+uint64_t bus_quiet_until()
+{
+	if (!(fast_paths & GB_FAST_FUSED) || watch_count != 0 || dma_transfer)
+		return 0;
+	uint64_t until = run_limit;
+	if (timer_next_clock < until)
+		until = timer_next_clock;
+	if (movie_next_clock < until)
+		until = movie_next_clock;
+	uint32_t ppu = ppu_quiet_clocks();
+	if (ppu != UINT32_MAX && clock_count + ppu < until)
+		until = clock_count + ppu;
+	return until;
+}
+
+void bus_quiet_hold(uint64_t clock)
+{
+	quiet_hold = clock;
+}
+
+uint8_t* bus_plain_memory(uint16_t addr, uint16_t* len)
+{
+	if (addr >= 0xC000 && addr <= 0xDFFF)
+	{
+		*len = 0xE000 - addr;
+		return &wram[addr - 0xC000];
+	}
+	if (addr >= 0xFF80 && addr <= 0xFFFE)
+	{
+		*len = 0xFFFF - addr;
+		return &hram[addr - 0xFF80];
+	}
+	uint8_t* vram = vram_span(addr);
+	if (vram != NULL)
+		*len = 0xA000 - addr;
+	return vram;
+}
+
+uint8_t bus_peek(uint16_t addr)
+{
+	if (addr <= 0x7FFF)
+	{
+		if (!BOOTROM_REG && addr < 0x0100)
+			return bootrom[addr];
+		return cart_mapper_read(addr);
+	}
+	if (addr >= 0xFF40 && addr <= 0xFF4B)
+		return ppu_register_read(addr);
+	return 0xFF;
 }
 
 void gameboy_mclock()
@@ -318,13 +564,133 @@ uint8_t gameboy_cart_load(char* filename)
 	return cart_load(filename);
 }
 
+uint8_t gameboy_cart_load_shared(uint8_t* image, size_t size)
+{
+	return cart_load_shared(image, size);
+}
+
 uint8_t gameboy_cart_unload()
 {
 	return cart_unload();
 }
 
-uint8_t bus_write(uint16_t addr, uint8_t data, uint8_t device)
+uint8_t gameboy_recomp_load(char* filename)
+{
+	uint8_t* rom;
+	int rom_size;
+	uint8_t* ram;
+	int ram_size;
+	if (cart_mapper_get_memory(&rom, &rom_size, &ram, &ram_size) != 0)
+		return RECOMP_ERR_NO_CART;
+	return recomp_load(filename, rom, rom_size);
+}
+
+void bus_frame_end()
+{
+	frame_ended = true;
+}
+
+void bus_state_save(BUS_STATE* state)
 {
+	// Saved as the byte by byte transfer would have it
+	if (dma_lazy)
+		bus_dma_sync(clock_count);
+	state->clock_count = clock_count;
+	memcpy(state->wram, wram, sizeof wram);
+	memcpy(state->hram, hram, sizeof hram);
+	state->IF = IF;
+	state->BOOTROM_REG = BOOTROM_REG;
+	state->IE = IE;
+	state->dma_transfer = dma_transfer;
+	state->dma_count = dma_count;
+	state->cpu_halt = cpu_halt;
+	state->cpu_int_check = cpu_int_check;
+}
+
+void bus_state_load(BUS_STATE* state)
+{
+	clock_count = state->clock_count;
+	memcpy(wram, state->wram, sizeof wram);
+	memcpy(hram, state->hram, sizeof hram);
+	IF = state->IF;
+	BOOTROM_REG = state->BOOTROM_REG;
+	bus_recomp_update();
+	IE = state->IE;
+	int_pending = IF & IE;
+	dma_transfer = state->dma_transfer;
+	dma_count = state->dma_count;
+	// A transfer in the state finishes byte by byte
+	dma_lazy = false;
+	quiet_hold = 0;
+	cpu_halt = state->cpu_halt;
+	cpu_int_check = state->cpu_int_check;
+}
+
+static uint8_t bus_read_device(uint16_t addr, uint8_t device);
+
+// A write to IF wakes the CPU and has it check for interrupts
+static void bus_if_write(uint8_t data)
+{
+	if (cpu_halt)
+		cpu_halt = false;
+	cpu_int_check = true;
+	IF = data;
+	int_pending = IF & IE;
+}
+
+// Devices set their flag in IF, and the CPU clears the one it's about to call. Both are writes to IF,
+// blocked by a running OAM DMA like the other writes.
+void bus_int_request(uint8_t flags)
+{
+	if (!dma_transfer)
+		bus_if_write(IF | flags);
+}
+
+void bus_int_acknowledge(uint8_t flags)
+{
+	if (!dma_transfer)
+		bus_if_write(IF & ~flags);
+}
+
+// Copy the bytes of the bulk transfer that were due before clock
+void bus_dma_sync(uint64_t clock)
+{
+	uint8_t done = clock > dma_end_clock ? 160 : (uint8_t)(159 - (dma_end_clock - clock) / 4);
+	if (done <= dma_count)
+		return;
+	uint8_t size = done - dma_count;
+	uint16_t addr = dma_source();
+	if (addr >= 0xC000 && addr <= 0xF19F)
+		oam_dma_copy(dma_count, &wram[(addr - 0xC000) & 0x1FFF], size);
+	else
+	{
+		uint8_t buffer[160];
+		for (uint8_t i = 0; i < size; i++)
+			buffer[i] = (uint16_t)(addr + i) <= 0xF19F ? bus_read_device(addr + i, DEV_DMA) : 0xFF;
+		oam_dma_copy(dma_count, buffer, size);
+	}
+	dma_advance(size);
+	dma_count = done;
+}
+
+// Debugger watches, only the accesses the program makes
+static void bus_watch_check(uint16_t addr, uint8_t kind, uint8_t device)
+{
+	if ((device == DEV_CPU || device == DEV_DMA) && (watch_map[kind >> 1][addr >> 5] >> (addr & 31) & 1))
+	{
+		watch_fired = true;
+		watch_addr = addr;
+		watch_kind = kind;
+	}
+}
+
+// The mapper, VRAM, OAM and the IO registers, the bus paths that the host timing times
+#define BUS_SLOW_PATH(addr) ((addr) < 0xC000 || ((addr) >= 0xFE00 && (addr) <= 0xFF7F))
+
+static uint8_t bus_write_device(uint16_t addr, uint8_t data, uint8_t device)
+{
+	if (watch_count != 0)
+		bus_watch_check(addr, GB_WATCH_WRITE, device);
 	if (!dma_transfer || device == DEV_DMA)
 	{
 		if (addr >= 0x0000 && addr <= 0x7FFF)
@@ -369,10 +735,7 @@ uint8_t bus_write(uint16_t addr, uint8_t data, uint8_t device)
 				timer_register_write(addr, data);
 				break;
 			case 0xFF0F:
-				if (cpu_halt)
-					cpu_halt = false;
-				cpu_int_check = true;
-				IF = data;
+				bus_if_write(data);
 				break;
 			case 0xFF40:
 			case 0xFF41:
@@ -384,6 +747,9 @@ uint8_t bus_write(uint16_t addr, uint8_t data, uint8_t device)
 				{
 					dma_transfer = true;
 					dma_count = 0;
+					// The first byte is copied on the next M-cycle of the CPU, this one if the CPU wrote it
+					dma_lazy = (fast_paths & GB_FAST_BULK_DMA) && watch_count == 0 && (data < 0x80 || data > 0x9F);
+					dma_end_clock = ((clock_count + 3) & ~(uint64_t)3) + 4 * 159;
 				}
 			case 0xFF47:
 			case 0xFF48:
@@ -394,7 +760,10 @@ uint8_t bus_write(uint16_t addr, uint8_t data, uint8_t device)
 				break;
 			case 0xFF50:
 				if (!BOOTROM_REG)
+				{
 					BOOTROM_REG = data;
+					bus_recomp_update();
+				}
 				break;
 			default:
 				break;
@@ -408,6 +777,7 @@ uint8_t bus_write(uint16_t addr, uint8_t data, uint8_t device)
 		if (data != IE && data != 0)
 			cpu_int_check = true;
 		IE = data;
+		int_pending = IF & IE;
 		}
 	}
 	if (addr >= 0xFF80 && addr <= 0xFFFE)
@@ -419,8 +789,22 @@ uint8_t bus_write(uint16_t addr, uint8_t data, uint8_t device)
 	return 0;
 }
 
-uint8_t bus_read(uint16_t addr, uint8_t device)
+uint8_t bus_write(uint16_t addr, uint8_t data, uint8_t device)
+{
+	if (htime_enabled && BUS_SLOW_PATH(addr))
+	{
+		uint64_t start = HTIME_NOW();
+		uint8_t res = bus_write_device(addr, data, device);
+		htime_ticks[HTIME_BUS] += HTIME_NOW() - start;
+		return res;
+	}
+	return bus_write_device(addr, data, device);
+}
+
+static uint8_t bus_read_device(uint16_t addr, uint8_t device)
 {
+	if (watch_count != 0)
+		bus_watch_check(addr, GB_WATCH_READ, device);
 	if (addr >= 0x0000 && addr <= 0x7FFF)
 	{
 		if (!BOOTROM_REG && addr < 0x0100)
@@ -443,6 +827,8 @@ uint8_t bus_read(uint16_t addr, uint8_t device)
 		return wram[addr - 0xE000];
 	else if (addr >= 0xFE00 && addr <= 0xFE9F)
 	{
+		if (dma_lazy)
+			bus_dma_sync(clock_count);
 		return oam_read(addr);
 	}
 	// IO registers
@@ -488,6 +874,18 @@ uint8_t bus_read(uint16_t addr, uint8_t device)
 		return 0xFF;
 }
 
+uint8_t bus_read(uint16_t addr, uint8_t device)
+{
+	if (htime_enabled && BUS_SLOW_PATH(addr))
+	{
+		uint64_t start = HTIME_NOW();
+		uint8_t data = bus_read_device(addr, device);
+		htime_ticks[HTIME_BUS] += HTIME_NOW() - start;
+		return data;
+	}
+	return bus_read_device(addr, device);
+}
+
 void gameboy_cpu_stats(uint16_t* af, uint16_t* bc, uint16_t* de, uint16_t* hl, uint16_t* sp, uint16_t* pc, bool* ime, uint8_t* stat_opcode, 
 	uint8_t* stat_cycles, uint8_t* stat_fetched, uint16_t* stat_fetched16, uint8_t* cb_op, uint16_t* stat_stackbase)
 {
@@ -507,9 +905,53 @@ void gameboy_cpu_stats(uint16_t* af, uint16_t* bc, uint16_t* de, uint16_t* hl, u
 		stat_stackbase);
 }
 
-uint8_t gameboy_cpu_disassemble_inst(uint16_t inst_pointer, wchar_t* disassembled_inst, int strlen)
+void gameboy_breakpoint_set(uint16_t addr, bool enabled)
 {
-	return disassemble_inst(inst_pointer, disassembled_inst, strlen);
+	if (enabled)
+		breakpoint_map[addr >> 5] |= 1u << (addr & 31);
+	else
+		breakpoint_map[addr >> 5] &= ~(1u << (addr & 31));
+}
+
+void gameboy_breakpoint_clear()
+{
+	memset(breakpoint_map, 0, sizeof breakpoint_map);
+}
+
+void gameboy_watch_set(uint16_t addr, uint8_t kind)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		uint32_t bit = 1u << (addr & 31);
+		bool was_set = watch_map[i][addr >> 5] & bit;
+		bool set = kind & (1 << i);
+		if (set)
+			watch_map[i][addr >> 5] |= bit;
+		else
+			watch_map[i][addr >> 5] &= ~bit;
+		watch_count += set - was_set;
+	}
+	bus_recomp_update();
+}
+
+void gameboy_watch_clear()
+{
+	memset(watch_map, 0, sizeof watch_map);
+	watch_count = 0;
+	bus_recomp_update();
+}
+
+void gameboy_watch_hit(uint16_t* addr, uint8_t* kind)
+{
+	if (addr != NULL)
+		*addr = watch_addr;
+	if (kind != NULL)
+		*kind = watch_kind;
+}
+
+uint8_t gameboy_cpu_disassemble_inst(uint16_t inst_pointer, char* disassembled_inst, int len)
+{
+	return disassemble_inst(inst_pointer, disassembled_inst, len);
 }
 
 void gameboy_screen_set_pixel(int x, int y, COLOR2BIT color2bit)
@@ -519,7 +961,7 @@ void gameboy_screen_set_pixel(int x, int y, COLOR2BIT color2bit)
 		return;
 	}
 	// 00 - white #f0f0f0, 01 - light gray #a0a0a0, 10 - dark gray #505050, 11 - black #000000
-	rgb_screen_buffer[160 * y + x] = RGB(0x50 * (~color2bit & 0x03), 0x50 * (~color2bit & 0x03), 0x50 * (~color2bit & 0x03));
+	rgb_screen_buffer[160 * y + x] = SCREEN_RGB(0x50 * (~color2bit & 0x03), 0x50 * (~color2bit & 0x03), 0x50 * (~color2bit & 0x03));
 }
 
 void gameboy_screen_on()
@@ -538,7 +980,7 @@ void gameboy_screen_off()
 {
 	for (int i = 0; i < 160 * 144; i++)
 	{
-		rgb_screen_buffer[i] = RGB(255, 255, 255);
+		rgb_screen_buffer[i] = SCREEN_RGB(255, 255, 255);
 	}
 }
 
@@ -564,7 +1006,7 @@ void gameboy_ppu_stats(uint8_t* lcdc, uint8_t* stat, uint8_t* scy, uint8_t* scx,
 
 uint8_t gameboy_joypad_input(uint8_t button, bool bPressed)
 {
-	return joypad_button_press(button, bPressed);
+	return movie_input(button, bPressed);
 }
 
 uint8_t gameboy_cartridge_stats(int nTitle, char* title, uint8_t* type, uint8_t* rom_size, uint8_t* ram_size, 
@@ -577,3 +1019,166 @@ uint8_t gameboy_cartridge_save(char* filename)
 {
 	return cart_mapper_save(filename);
 }
+
+uint8_t gameboy_cartridge_autosave_start(char* filename)
+{
+	return cart_mapper_autosave_start(filename);
+}
+
+uint8_t gameboy_cartridge_autosave_stop()
+{
+	return cart_mapper_autosave_stop();
+}
+
+
+size_t gameboy_state_size()
+{
+	return state_size();
+}
+
+uint8_t gameboy_state_save(uint8_t* buffer, size_t size)
+{
+	return state_save(buffer, size);
+}
+
+uint8_t gameboy_state_load(uint8_t* buffer, size_t size)
+{
+	return state_load(buffer, size);
+}
+
+uint8_t gameboy_rewind_start(size_t budget, int keyframe_interval)
+{
+	return rewind_start(budget, keyframe_interval);
+}
+
+void gameboy_rewind_stop()
+{
+	rewind_stop();
+}
+
+int gameboy_rewind_available()
+{
+	return rewind_available();
+}
+
+uint8_t gameboy_rewind_step_back(int frames)
+{
+	return rewind_step_back(frames);
+}
+
+uint8_t gameboy_movie_record_start(int keyframe_interval)
+{
+	return movie_record_start(keyframe_interval);
+}
+
+uint8_t gameboy_movie_record_stop(char* filename)
+{
+	return movie_record_stop(filename);
+}
+
+uint8_t gameboy_movie_play(char* filename)
+{
+	return movie_play(filename);
+}
+
+uint8_t gameboy_movie_seek(uint64_t clock)
+{
+	return movie_seek(clock);
+}
+
+void gameboy_movie_stop()
+{
+	movie_stop();
+}
+
+uint8_t gameboy_movie_mode()
+{
+	return movie_mode();
+}
+
+uint64_t gameboy_movie_length()
+{
+	return movie_length();
+}
+
+uint8_t gameboy_fork(MACHINE_FORK** fork)
+{
+	return fork_create(fork);
+}
+
+uint8_t gameboy_fork_load(MACHINE_FORK* fork)
+{
+	return fork_load(fork);
+}
+
+void gameboy_fork_free(MACHINE_FORK* fork)
+{
+	fork_free(fork);
+}
+
+uint8_t gameboy_profile_start()
+{
+	return gprof_start();
+}
+
+void gameboy_profile_stop()
+{
+	gprof_stop();
+}
+
+uint8_t gameboy_profile_load_symbols(char* filename)
+{
+	return gprof_load_symbols(filename);
+}
+
+uint8_t gameboy_profile_write(char* filename)
+{
+	return gprof_write_folded(filename);
+}
+
+uint8_t gameboy_timing_start(int frames_kept)
+{
+	return htime_start(frames_kept);
+}
+
+void gameboy_timing_stop()
+{
+	htime_stop();
+}
+
+uint8_t gameboy_timing_write(char* filename, uint8_t format)
+{
+	return htime_write(filename, format);
+}
+
+uint8_t gameboy_trace_start(char* filename, int chunks)
+{
+	return trace_start(filename, chunks);
+}
+
+uint8_t gameboy_trace_stop()
+{
+	return trace_stop();
+}
+
+uint8_t gameboy_trace_save(char* filename)
+{
+	return trace_save(filename);
+}
+
+uint8_t gameboy_disassemble(char* cache_dir, char* listing)
+{
+	uint8_t* rom;
+	int rom_size;
+	uint8_t* ram;
+	int ram_size;
+	if (cart_mapper_get_memory(&rom, &rom_size, &ram, &ram_size) != 0 || rom == NULL)
+		return DISASM_ERR_FILE_READ;
+	DISASM_CFG* cfg;
+	uint8_t res = disasm_cached(cache_dir, rom, rom_size, &cfg);
+	if (res != DISASM_OK)
+		return res;
+	res = disasm_write_listing(cfg, rom, listing);
+	disasm_free(cfg);
+	return res;
+}
\ No newline at end of file
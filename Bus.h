@@ -6,6 +6,21 @@
 #include <stdbool.h>
 #include <string.h>
 
+// Machine state. The emulator runs one machine, so this is empty. Tools that run a machine on every
+// thread (the batch runner) define GAMEBOY_THREAD_INSTANCES, which makes every variable that holds the
+// machine state thread local. A machine is then only driven by the thread that created it.
+#ifdef GAMEBOY_THREAD_INSTANCES
+#ifdef _MSC_VER
+#define GB_INSTANCE __declspec(thread)
+#else
+#define GB_INSTANCE _Thread_local
+#endif
+#else
+#define GB_INSTANCE
+#endif
+
+#include "Fork.h"
+
 // Gameboy reset
 int gameboy_reset(bool bootskip);
 
@@ -13,12 +28,72 @@ int gameboy_reset(bool bootskip);
 void gameboy_clock();
 void gameboy_mclock();
 
+// Run until the end of the frame (the V-Blank), or for a frame's worth of clocks while the LCD is off.
+// Returns the number of clocks run.
+uint64_t gameboy_run_frame();
+
+// Run until one of the events in stop_mask happens, or for budget clocks (0 - no budget).
+// Runs at least one clock, and returns the GB_STOP_* event it stopped for.
+uint8_t gameboy_run(uint64_t budget, uint8_t stop_mask);
+
+enum GAMEBOY_STOP_REASONS {
+	GB_STOP_BUDGET = (1 << 0),		// Always checked when there's a budget
+	GB_STOP_FRAME = (1 << 1),		// The PPU entered V-Blank
+	GB_STOP_INSTRUCTION = (1 << 2),	// An instruction finished (or an M-cycle passed in HALT)
+	GB_STOP_BREAKPOINT = (1 << 3),	// The next instruction is at a breakpoint
+	GB_STOP_WATCH = (1 << 4)		// A watched address was read or written by the CPU or the DMA
+};
+
+// Breakpoints and watches, any number of addresses
+void gameboy_breakpoint_set(uint16_t addr, bool enabled);
+void gameboy_breakpoint_clear();
+
+// kind is GB_WATCH_READ and/or GB_WATCH_WRITE, 0 removes the watch
+void gameboy_watch_set(uint16_t addr, uint8_t kind);
+void gameboy_watch_clear();
+
+// The access that fired the last GB_STOP_WATCH
+void gameboy_watch_hit(uint16_t* addr, uint8_t* kind);
+
+enum GAMEBOY_WATCH_KINDS {
+	GB_WATCH_READ = (1 << 0),
+	GB_WATCH_WRITE = (1 << 1)
+};
+
 // Gameboy load and unload cartridge
 uint8_t gameboy_cart_load(char* filename);
+uint8_t gameboy_cart_load_shared(uint8_t* image, size_t size);
 uint8_t gameboy_cart_unload();
 
+// Load the recompiled code of the cartridge (Recompiler.h). Only ever on request: the module is a native
+// library and opening it runs its code, so only load modules you built yourself.
+uint8_t gameboy_recomp_load(char* filename);
+
 // Global clock counter
-extern uint64_t clock_count;
+extern GB_INSTANCE uint64_t clock_count;
+
+// Frames since reset, goes up at the end of the clock the PPU entered V-Blank in
+extern GB_INSTANCE uint64_t frame_count;
+
+// Fast paths
+// Shortcuts that give the same results as the accurate emulation with less work, each one behind a
+// GB_FAST_* flag that the devices check. A fast path is only turned on by default once gbcheck (Diffcheck.h)
+// finds no difference between it and the accurate path. The flags aren't part of the save states.
+extern GB_INSTANCE uint32_t fast_paths;
+
+void gameboy_fast_paths_set(uint32_t paths);
+uint32_t gameboy_fast_paths();
+
+enum GAMEBOY_FAST_PATHS {
+	GB_FAST_NONE = 0,
+	GB_FAST_LAZY_TIMER = (1 << 0),	// DIV and TIMA worked out when they're read, see Timer.c
+	GB_FAST_BULK_DMA = (1 << 1),	// OAM DMA copied in runs when OAM is looked at, see Bus.c
+	GB_FAST_RECOMPILED = (1 << 2),	// Instructions from the recompiled code of the game if it has one, see Recompiler.h
+	GB_FAST_FUSED = (1 << 3)		// Common instruction sequences and loops run in one go, see Sharp_LR35902.c
+};
+
+// The fast paths gbcheck has passed, what the machine starts with
+#define GB_FAST_DEFAULT (GB_FAST_LAZY_TIMER | GB_FAST_BULK_DMA | GB_FAST_RECOMPILED | GB_FAST_FUSED)
 
 // Bus write
 uint8_t bus_write(uint16_t addr, uint8_t data, uint8_t device);
@@ -26,6 +101,44 @@ uint8_t bus_write(uint16_t addr, uint8_t data, uint8_t device);
 // Bus read
 uint8_t bus_read(uint16_t addr, uint8_t device);
 
+// Called by the PPU when it enters V-Blank, once per frame
+void bus_frame_end();
+
+// Bus part of the save states: memory that isn't owned by a device and the global flags
+typedef struct {
+	uint64_t clock_count;
+	uint8_t wram[8192];
+	uint8_t hram[127];
+	uint8_t IF;
+	uint8_t BOOTROM_REG;
+	uint8_t IE;
+	bool dma_transfer;
+	uint8_t dma_count;
+	bool cpu_halt;
+	bool cpu_int_check;
+	uint8_t reserved[2];
+} BUS_STATE;
+
+void bus_state_save(BUS_STATE* state);
+void bus_state_load(BUS_STATE* state);
+
+// Bulk OAM DMA (GB_FAST_BULK_DMA): while dma_lazy is set, OAM only holds the bytes copied so far, and
+// whoever looks at it first copies the bytes the transfer would have written before clock
+extern GB_INSTANCE bool dma_lazy;
+void bus_dma_sync(uint64_t clock);
+
+// Fused instructions (GB_FAST_FUSED): the CPU may run the instructions that end by bus_quiet_until in
+// one go, since up to that clock nothing but the CPU looks at the machine: the run doesn't stop on
+// the way, and the timer, the PPU and the movie have nothing to do. Input from the GUI waits for the
+// clock the CPU holds the machine to. bus_plain_memory is the memory that nothing else looks at in
+// the meantime (WRAM, HRAM, VRAM outside of mode 3), with the bytes from addr to its end in len.
+// bus_peek reads the ROM (the boot ROM while it's mapped) and the PPU registers as the CPU sees them,
+// without the watches and the host timing, for the bytes the CPU looks at before it runs anything.
+uint64_t bus_quiet_until();
+void bus_quiet_hold(uint64_t clock);
+uint8_t* bus_plain_memory(uint16_t addr, uint16_t* len);
+uint8_t bus_peek(uint16_t addr);
+
 // Devices
 enum DEVICES {
 	DEV_CPU,
@@ -37,7 +150,7 @@ enum DEVICES {
 };
 
 // CPU halt flag
-extern bool cpu_halt;
+extern GB_INSTANCE bool cpu_halt;
 
 // Interrupt flags
 enum INT_FLAGS {
@@ -45,19 +158,28 @@ enum INT_FLAGS {
 	INT_LCDSTAT = (1 << 1),
 	INT_TIMER = (1 << 2),
 	INT_SERIAL = (1 << 3),
-	INT_JOYPAD = (1 << 4)
+	INT_JOYPAD = (1 << 4),
+	INT_ALL = 0x1F
 };
 
 // IE and IF registers' addresses
 #define IE_ADDR 0xFFFF
 #define IF_ADDR 0xFF0F
 
+// Interrupt controller
+// IF and IE stay with the bus, and int_pending holds IF & IE so the CPU can pick the interrupt to call
+// without reading them. Devices request interrupts and the CPU acknowledges them here instead of with
+// a read-modify-write of IF through the bus, with the same effects as that write.
+extern GB_INSTANCE uint8_t int_pending;
+void bus_int_request(uint8_t flags);
+void bus_int_acknowledge(uint8_t flags);
+
 // CPU stats
 void gameboy_cpu_stats(uint16_t* af, uint16_t* bc, uint16_t* de, uint16_t* hl, uint16_t* sp, uint16_t* pc,
 	bool* ime, uint8_t* stat_opcode, uint8_t* stat_cycles, uint8_t* stat_fetched, uint16_t* stat_fetched16, 
 	uint8_t* cb_op, uint16_t* stat_stackbase);
 
-uint8_t gameboy_cpu_disassemble_inst(uint16_t inst_pointer, wchar_t* disassembled_inst, int strlen);
+uint8_t gameboy_cpu_disassemble_inst(uint16_t inst_pointer, char* disassembled_inst, int len);
 
 // Screen related
 typedef uint8_t COLOR2BIT;
@@ -81,6 +203,7 @@ enum GAMEBOY_JOYPAD_BUTTONS {
 	GB_JOYPAD_A
 };
 
+// Queued, the emulation thread applies it at the start of its next clock
 uint8_t gameboy_joypad_input(uint8_t button, bool bPressed);
 
 // Cartrdge errors
@@ -155,4 +278,85 @@ enum GAMEBOY_CART_RAM_SIZE {
 };
 
 uint8_t gameboy_cartridge_save(char* filename);
+
+// Background saving of the cartridge RAM (battery carts only). The RAM pages that changed during a frame
+// are handed to a worker thread at the end of the frame, so saving never blocks the emulation.
+// The last flush happens on gameboy_cart_unload (or on stop).
+uint8_t gameboy_cartridge_autosave_start(char* filename);
+uint8_t gameboy_cartridge_autosave_stop();
+
+// Save states
+// The whole machine (CPU, PPU, timer, DMA, joypad, memory, mapper registers and cartridge RAM) in one blob.
+// The ROM isn't part of it, so a state can only be loaded back with the same cartridge in.
+size_t gameboy_state_size();
+uint8_t gameboy_state_save(uint8_t* buffer, size_t size);
+uint8_t gameboy_state_load(uint8_t* buffer, size_t size);
+
+enum GAMEBOY_STATE_ERRORS {
+	STATE_OK = 0,
+	STATE_ERR_SIZE,
+	STATE_ERR_FORMAT,
+	STATE_ERR_VERSION,
+	STATE_ERR_CART
+};
+
+// Rewind
+// Keeps the last frames in a memory budget (in bytes) as compressed differences between frames, with a
+// full frame every keyframe_interval frames. Stepping back restores the machine and the screen.
+// Errors are the REWIND_ERRORS in Rewind.h.
+uint8_t gameboy_rewind_start(size_t budget, int keyframe_interval);
+void gameboy_rewind_stop();
+int gameboy_rewind_available();
+uint8_t gameboy_rewind_step_back(int frames);
+
+// Input movies
+// Records the joypad transitions with the clock they happened at, and a save state every keyframe_interval
+// frames. Playing starts from the state the recording started at and repeats the run exactly, the live
+// input is ignored until the movie ends. Seeking takes a clock_count between the start and the end of
+// the movie. record_stop with a NULL filename keeps the recording in memory only.
+// Modes and errors are in Movie.h.
+uint8_t gameboy_movie_record_start(int keyframe_interval);
+uint8_t gameboy_movie_record_stop(char* filename);
+uint8_t gameboy_movie_play(char* filename);
+uint8_t gameboy_movie_seek(uint64_t clock);
+void gameboy_movie_stop();
+uint8_t gameboy_movie_mode();
+uint64_t gameboy_movie_length();
+
+// Forks
+// A fork is a copy of the machine that can be loaded back any number of times, taken in microseconds.
+// Forks share the memory pages they have in common, see Fork.h for the errors.
+uint8_t gameboy_fork(MACHINE_FORK** fork);
+uint8_t gameboy_fork_load(MACHINE_FORK* fork);
+void gameboy_fork_free(MACHINE_FORK* fork);
+
+// Guest profiler
+// Charges the emulated clocks to the functions of the game along their call stacks, and writes them as
+// folded stacks for flamegraph tools. Symbols are RGBDS .sym files, errors are in Guest_profile.h.
+uint8_t gameboy_profile_start();
+void gameboy_profile_stop();
+uint8_t gameboy_profile_load_symbols(char* filename);
+uint8_t gameboy_profile_write(char* filename);
+
+// Host timing
+// The host time spent in the CPU, the DMA, the timer, the PPU and the bus, per frame, for the last
+// frames_kept frames. Written as CSV or JSON (HTIME_CSV, HTIME_JSON), the frames can also be read one
+// by one through Host_timing.h.
+uint8_t gameboy_timing_start(int frames_kept);
+void gameboy_timing_stop();
+uint8_t gameboy_timing_write(char* filename, uint8_t format);
+
+// Execution traces
+// Every instruction with the registers, and every CPU write, in a compact binary file written in the
+// background. With a NULL filename the last chunks (64KB each) are kept in memory until gameboy_trace_save.
+// Reading and comparing traces is in Trace.h, errors too.
+uint8_t gameboy_trace_start(char* filename, int chunks);
+uint8_t gameboy_trace_stop();
+uint8_t gameboy_trace_save(char* filename);
+
+// Disassembly of the whole ROM
+// Listing of the basic blocks of the loaded ROM, found by following its code paths without running it.
+// The analysis is cached in cache_dir (not cached if NULL) by the hash of the ROM, errors and the blocks
+// themselves are in Disassembly.h.
+uint8_t gameboy_disassemble(char* cache_dir, char* listing);
 #endif // BUS_CODE
\ No newline at end of file
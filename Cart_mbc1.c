@@ -1,4 +1,5 @@
 #include "Cart_mbc1.h"
+#include "Rom_index.h"
 
 // Memory map:
 // 0000 - 3FFF: Normally contains ROM bank 00 (first 16KB), could have banks 20/40/60 in 
@@ -57,56 +58,46 @@
 
 // Static variables
 // Consts
-static uint8_t mbc1_romsize_code = 0x00;
-static uint8_t mbc1_ramsize_code = 0x00;
-static int mbc1_romsize = 0;
-static int mbc1_ramsize;
+static GB_INSTANCE uint8_t mbc1_romsize_code = 0x00;
+static GB_INSTANCE uint8_t mbc1_ramsize_code = 0x00;
+static GB_INSTANCE int mbc1_romsize = 0;
+static GB_INSTANCE int mbc1_ramsize;
 
 // ROM and RAM
-static uint8_t* rom = NULL;
-static uint8_t* ram = NULL;
+static GB_INSTANCE uint8_t* rom = NULL;	// Belongs to the caller (the ROM registry)
+static GB_INSTANCE uint8_t* ram = NULL;
 
 // Registers
-static uint8_t ram_enable = 0x00;
-static uint8_t rom_bank = 0x00;
-static uint8_t rom_bank_2 = 0x00;
-static uint8_t mode = 0x00;
+static GB_INSTANCE uint8_t ram_enable = 0x00;
+static GB_INSTANCE uint8_t rom_bank = 0x00;
+static GB_INSTANCE uint8_t rom_bank_2 = 0x00;
+static GB_INSTANCE uint8_t mode = 0x00;
 
-uint8_t cart_mbc1_init(uint8_t romsize, uint8_t ramsize, int file_size, uint8_t* temp_rom, uint8_t cart_type)
+uint8_t cart_mbc1_init(uint8_t romsize, uint8_t ramsize, int file_size, uint8_t* temp_rom, uint8_t cart_type, uint8_t* rom_image)
 {
 	mbc1_romsize_code = romsize;
 	mbc1_ramsize_code = ramsize;
 	mbc1_romsize = 32LL * 1024LL * (long long)pow(2, mbc1_romsize_code);
 	mbc1_ramsize = 2LL * 1024LL * (long long)pow(4, mbc1_ramsize_code - 1);
 
-	rom = (uint8_t*)calloc(mbc1_romsize, sizeof(uint8_t));
-	
-	if (rom == NULL)
-		return 1;
-	int res = memcpy_s(rom, mbc1_romsize, temp_rom, mbc1_romsize);
-	if (res != 0)
-	{
-		free(rom);
-		return 1;
-	}
+	rom = rom_image;
 	if (mbc1_ramsize_code)
 	{
 		ram = (uint8_t*)calloc(mbc1_ramsize, sizeof(uint8_t));
 		if (ram == NULL)
 		{
-			free(rom);
+			cart_mbc1_free();
 			return 1;
 		}
 		else if (cart_type == CART_MBC1_RAM_BATTERY && file_size > 32LL * 1024LL * pow(2, romsize))
 		{
 			// Load RAM from save
-			int res = memcpy_s(ram, mbc1_ramsize, temp_rom + mbc1_romsize, file_size - mbc1_romsize);
-			if (res != 0)
+			if (file_size - mbc1_romsize > mbc1_ramsize)
 			{
-				free(rom);
-				free(ram);
+				cart_mbc1_free();
 				return 1;
 			}
+			memcpy(ram, temp_rom + mbc1_romsize, file_size - mbc1_romsize);
 		}
 	}
 	else
@@ -118,11 +109,7 @@ uint8_t cart_mbc1_init(uint8_t romsize, uint8_t ramsize, int file_size, uint8_t*
 
 void cart_mbc1_free()
 {
-	if (rom != NULL)
-	{
-		free(rom);
-		rom = NULL;
-	}
+	rom = NULL;
 	if (ram != NULL)
 	{
 		free(ram);
@@ -157,6 +144,48 @@ uint8_t cart_mbc1_save(FILE* save_file)
 	return 0;
 }
 
+uint8_t cart_mbc1_get_memory(uint8_t** rom_out, int* rom_size, uint8_t** ram_out, int* ram_size)
+{
+	if (rom_out != NULL)
+		*rom_out = rom;
+	if (rom_size != NULL)
+		*rom_size = mbc1_romsize;
+	if (ram_out != NULL)
+		*ram_out = ram;
+	if (ram_size != NULL)
+		*ram_size = ram != NULL ? mbc1_ramsize : 0;
+	return 0;
+}
+
+// Save states: the 4 registers followed by the RAM
+int cart_mbc1_state_size()
+{
+	return 4 + (ram != NULL ? mbc1_ramsize : 0);
+}
+
+void cart_mbc1_state_save(uint8_t* state)
+{
+	state[0] = ram_enable;
+	state[1] = rom_bank;
+	state[2] = rom_bank_2;
+	state[3] = mode;
+	if (ram != NULL)
+		memcpy(state + 4, ram, mbc1_ramsize);
+}
+
+void cart_mbc1_state_load(uint8_t* state)
+{
+	ram_enable = state[0];
+	rom_bank = state[1];
+	rom_bank_2 = state[2];
+	mode = state[3];
+	if (ram != NULL)
+	{
+		memcpy(ram, state + 4, mbc1_ramsize);
+		cart_persist_mark_range(0, mbc1_ramsize);
+	}
+}
+
 uint8_t cart_mbc1_write(uint16_t addr, uint8_t data)
 {
 	if (addr >= 0x0000 && addr <= 0x1FFF)
@@ -184,12 +213,16 @@ uint8_t cart_mbc1_write(uint16_t addr, uint8_t data)
 			{
 				// If mode is 0 or mode is 1 and RAM size is less than 32KB then RAM banking is disabled
 				if (!(mbc1_ramsize_code == CART_RAM_2K && addr >= 0xA800))
+				{
 					ram[addr - 0xA000] = data;
+					cart_persist_mark(addr - 0xA000);
+				}
 			}
 			else
 			{
 				// If mode is 1 and RAM size == 32KB RAM banking is enabled
 				ram[(addr - 0xA000) + (RAMBANK_SIZE * (rom_bank_2 & 0x03))] = data;
+				cart_persist_mark((addr - 0xA000) + (RAMBANK_SIZE * (rom_bank_2 & 0x03)));
 			}
 		}
 	}
@@ -252,11 +285,27 @@ uint8_t cart_mbc1_read(uint16_t addr)
 
 uint16_t cart_mbc1_compute_global_checksum()
 { 
-	uint16_t global_checksum = 0;
-	for (int i = 0; i < mbc1_romsize; i++)
+	return rom_global_checksum(rom, mbc1_romsize);
+}
+
+uint16_t cart_mbc1_rom_bank(uint16_t addr)
+{
+	// Same mapping as cart_mbc1_read
+	if (addr <= 0x3FFF)
 	{
-		if (i != 0x14E && i != 0x014F)
-			global_checksum += rom[i];
+		if ((mode & 0x01) == 0x01 && mbc1_romsize_code == CART_ROM_1M)
+			return (rom_bank_2 & 0x01) << 5;
+		else if ((mode & 0x01) == 0x01 && mbc1_romsize_code == CART_ROM_2M)
+			return (rom_bank_2 & 0x03) << 5;
+		else
+			return 0;
+	}
+	else
+	{
+		uint8_t bank_num = rom_bank & 0x1F;
+		if (bank_num == 0x00)
+			bank_num++;
+		bank_num |= ((rom_bank_2 & 0x03) << 5);
+		return (uint8_t)(bank_num & (uint8_t)~(0xFF << (mbc1_romsize_code + 1)));
 	}
-	return global_checksum;
-}
\ No newline at end of file
+}
@@ -2,14 +2,20 @@
 #define MBC1
 #include "Cartridge.h"
 
-uint8_t cart_mbc1_init(uint8_t romsize, uint8_t ramsize, int file_size, uint8_t* temp_rom, uint8_t cart_type);
+// The ROM is read from rom_image, which stays owned by the caller. temp_rom is the whole file, for the save after the ROM.
+uint8_t cart_mbc1_init(uint8_t romsize, uint8_t ramsize, int file_size, uint8_t* temp_rom, uint8_t cart_type, uint8_t* rom_image);
 void cart_mbc1_free();
 void cart_mbc1_reset();
 uint8_t cart_mbc1_save(FILE* save_file);
+uint8_t cart_mbc1_get_memory(uint8_t** rom_out, int* rom_size, uint8_t** ram_out, int* ram_size);
+int cart_mbc1_state_size();
+void cart_mbc1_state_save(uint8_t* state);
+void cart_mbc1_state_load(uint8_t* state);
 
 uint8_t cart_mbc1_write(uint16_t addr, uint8_t data);
 uint8_t cart_mbc1_read(uint16_t addr);
 
 uint16_t cart_mbc1_compute_global_checksum();
+uint16_t cart_mbc1_rom_bank(uint16_t addr);
 
 #endif // MBC1
\ No newline at end of file
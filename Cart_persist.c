@@ -0,0 +1,286 @@
+#include "Cart_persist.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <string.h>
+
+// The save file has the same layout as the one gameboy_cartridge_save writes: the ROM followed by the RAM,
+// so it can be loaded back with gameboy_cart_load.
+//
+// The emulation thread never waits on the disk. At the end of a frame it copies the dirty pages to a free
+// queue slot, which takes microseconds. If the worker is behind and all the slots are taken, the pages are
+// simply left dirty and go out with a later frame, so consecutive writes to the same page get coalesced.
+// The worker drains the whole queue at once into its own image of the RAM, and then writes and syncs only
+// the pages that changed.
+
+#define PERSIST_PAGE_SHIFT 9
+#define PERSIST_PAGE_SIZE (1 << PERSIST_PAGE_SHIFT)
+#define PERSIST_MAX_RAM (128 * 1024)
+#define PERSIST_MAX_PAGES (PERSIST_MAX_RAM >> PERSIST_PAGE_SHIFT)
+#define PERSIST_QUEUE_LEN 8
+
+typedef struct {
+	int page_count;
+	uint16_t pages[PERSIST_MAX_PAGES];
+	uint8_t* data;	// page_count pages one after the other
+} PERSIST_JOB;
+
+// Static variables
+// Emulation thread side
+static bool persist_active = false;
+static uint8_t persist_dirty[PERSIST_MAX_PAGES];
+static bool persist_any_dirty = false;
+static uint8_t* persist_ram = NULL;
+static int persist_ram_size = 0;
+static int persist_pages = 0;
+
+// Shared, protected by persist_lock
+static PLATFORM_MUTEX* persist_lock = NULL;
+static PLATFORM_COND* persist_wake = NULL;		// Worker has something to do
+static PLATFORM_COND* persist_space = NULL;		// A queue slot was freed
+static PERSIST_JOB persist_queue[PERSIST_QUEUE_LEN];
+static int persist_head = 0;
+static int persist_count = 0;
+static bool persist_stop_req = false;
+static uint8_t persist_error = PERSIST_OK;
+
+// Worker side
+static PLATFORM_THREAD* persist_thread = NULL;
+static char* persist_filename = NULL;
+static uint8_t* persist_rom = NULL;
+static int persist_rom_size = 0;
+static uint8_t* persist_image = NULL;
+static uint8_t persist_image_dirty[PERSIST_MAX_PAGES];
+
+static void persist_free()
+{
+	for (int i = 0; i < PERSIST_QUEUE_LEN; i++)
+	{
+		free(persist_queue[i].data);
+		persist_queue[i].data = NULL;
+	}
+	free(persist_image);
+	free(persist_filename);
+	persist_image = NULL;
+	persist_filename = NULL;
+	platform_cond_free(persist_wake);
+	platform_cond_free(persist_space);
+	platform_mutex_free(persist_lock);
+	persist_wake = NULL;
+	persist_space = NULL;
+	persist_lock = NULL;
+}
+
+static uint8_t persist_write_pages(FILE* save_file)
+{
+	int page = 0;
+	while (page < persist_pages)
+	{
+		if (!persist_image_dirty[page])
+		{
+			page++;
+			continue;
+		}
+
+		// Write a run of dirty pages at once
+		int first = page;
+		while (page < persist_pages && persist_image_dirty[page])
+		{
+			persist_image_dirty[page] = 0;
+			page++;
+		}
+		int offset = first * PERSIST_PAGE_SIZE;
+		int len = page * PERSIST_PAGE_SIZE;
+		if (len > persist_ram_size)
+			len = persist_ram_size;
+		len -= offset;
+		if (fseek(save_file, persist_rom_size + offset, SEEK_SET) != 0)
+			return PERSIST_ERR_FILE_WRITE;
+		if (fwrite(persist_image + offset, 1, len, save_file) != (size_t)len)
+			return PERSIST_ERR_FILE_WRITE;
+	}
+	return platform_file_sync(save_file) == 0 ? PERSIST_OK : PERSIST_ERR_FILE_WRITE;
+}
+
+static void persist_worker(void* arg)
+{
+	uint8_t res = PERSIST_OK;
+	FILE* save_file = fopen(persist_filename, "wb+");
+	if (save_file == NULL)
+		res = PERSIST_ERR_FILE_OPEN;
+	else if (fwrite(persist_rom, 1, persist_rom_size, save_file) != (size_t)persist_rom_size)
+		res = PERSIST_ERR_FILE_WRITE;
+	else
+		res = persist_write_pages(save_file); // Whole RAM image, all pages start dirty
+
+	platform_mutex_lock(persist_lock);
+	while (res == PERSIST_OK)
+	{
+		while (persist_count == 0 && !persist_stop_req)
+			platform_cond_wait(persist_wake, persist_lock);
+		if (persist_count == 0 && persist_stop_req)
+			break;
+
+		// Coalesce every queued job into the image, later jobs win
+		while (persist_count > 0)
+		{
+			PERSIST_JOB* job = &persist_queue[persist_head];
+			for (int i = 0; i < job->page_count; i++)
+			{
+				uint16_t p = job->pages[i];
+				int len = PERSIST_PAGE_SIZE;
+				if ((p + 1) * PERSIST_PAGE_SIZE > persist_ram_size)
+					len = persist_ram_size - p * PERSIST_PAGE_SIZE;
+				memcpy(persist_image + p * PERSIST_PAGE_SIZE, job->data + i * PERSIST_PAGE_SIZE, len);
+				persist_image_dirty[p] = 1;
+			}
+			job->page_count = 0;
+			persist_head = (persist_head + 1) % PERSIST_QUEUE_LEN;
+			persist_count--;
+		}
+		platform_cond_broadcast(persist_space);
+
+		// Do the slow part without holding the lock
+		platform_mutex_unlock(persist_lock);
+		res = persist_write_pages(save_file);
+		platform_mutex_lock(persist_lock);
+	}
+	persist_error = res;
+	// Don't leave the emulation thread waiting for space if the worker failed
+	persist_count = 0;
+	platform_cond_broadcast(persist_space);
+	platform_mutex_unlock(persist_lock);
+
+	if (save_file != NULL)
+		fclose(save_file);
+}
+
+uint8_t cart_persist_start(char* filename, uint8_t* rom, int rom_size, uint8_t* ram, int ram_size)
+{
+	if (persist_active)
+		return PERSIST_ERR_RUNNING;
+	if (ram == NULL || ram_size <= 0 || ram_size > PERSIST_MAX_RAM)
+		return PERSIST_ERR_NO_RAM;
+
+	persist_ram = ram;
+	persist_ram_size = ram_size;
+	persist_pages = (ram_size + PERSIST_PAGE_SIZE - 1) >> PERSIST_PAGE_SHIFT;
+	persist_rom = rom;
+	persist_rom_size = rom_size;
+	persist_head = 0;
+	persist_count = 0;
+	persist_stop_req = false;
+	persist_error = PERSIST_OK;
+	persist_any_dirty = false;
+	memset(persist_dirty, 0, sizeof persist_dirty);
+
+	// Allocate everything up front so the frame hand-off never allocates
+	bool alloc_ok = true;
+	for (int i = 0; i < PERSIST_QUEUE_LEN; i++)
+	{
+		persist_queue[i].page_count = 0;
+		persist_queue[i].data = (uint8_t*)malloc(persist_pages * PERSIST_PAGE_SIZE);
+		if (persist_queue[i].data == NULL)
+			alloc_ok = false;
+	}
+	persist_image = (uint8_t*)malloc(ram_size);
+	persist_filename = (char*)malloc(strlen(filename) + 1);
+	persist_lock = platform_mutex_create();
+	persist_wake = platform_cond_create();
+	persist_space = platform_cond_create();
+	if (!alloc_ok || persist_image == NULL || persist_filename == NULL || persist_lock == NULL ||
+		persist_wake == NULL || persist_space == NULL)
+	{
+		persist_free();
+		return PERSIST_ERR_ALLOC;
+	}
+	strcpy(persist_filename, filename);
+
+	// The first write is the whole RAM
+	memcpy(persist_image, ram, ram_size);
+	memset(persist_image_dirty, 1, persist_pages);
+
+	persist_thread = platform_thread_create(persist_worker, NULL);
+	if (persist_thread == NULL)
+	{
+		persist_free();
+		return PERSIST_ERR_THREAD;
+	}
+	persist_active = true;
+	return PERSIST_OK;
+}
+
+// Copy the dirty pages into the slot at the tail of the queue. Must be called with the lock held
+// and a free slot.
+static void persist_enqueue()
+{
+	PERSIST_JOB* job = &persist_queue[(persist_head + persist_count) % PERSIST_QUEUE_LEN];
+	job->page_count = 0;
+	for (int p = 0; p < persist_pages; p++)
+	{
+		if (!persist_dirty[p])
+			continue;
+		persist_dirty[p] = 0;
+		int len = PERSIST_PAGE_SIZE;
+		if ((p + 1) * PERSIST_PAGE_SIZE > persist_ram_size)
+			len = persist_ram_size - p * PERSIST_PAGE_SIZE;
+		memcpy(job->data + job->page_count * PERSIST_PAGE_SIZE, persist_ram + p * PERSIST_PAGE_SIZE, len);
+		job->pages[job->page_count++] = (uint16_t)p;
+	}
+	persist_any_dirty = false;
+	persist_count++;
+	platform_cond_signal(persist_wake);
+}
+
+void cart_persist_frame()
+{
+	if (!persist_active || !persist_any_dirty)
+		return;
+
+	platform_mutex_lock(persist_lock);
+	// Back-pressure: if the worker is behind, keep the pages dirty and try again next frame
+	if (persist_count < PERSIST_QUEUE_LEN && persist_error == PERSIST_OK)
+		persist_enqueue();
+	platform_mutex_unlock(persist_lock);
+}
+
+void cart_persist_mark(int ram_offset)
+{
+	if (persist_active)
+	{
+		persist_dirty[ram_offset >> PERSIST_PAGE_SHIFT] = 1;
+		persist_any_dirty = true;
+	}
+}
+
+void cart_persist_mark_range(int ram_offset, int size)
+{
+	for (int offset = ram_offset & ~(PERSIST_PAGE_SIZE - 1); offset < ram_offset + size; offset += PERSIST_PAGE_SIZE)
+		cart_persist_mark(offset);
+}
+
+uint8_t cart_persist_stop()
+{
+	if (!persist_active)
+		return PERSIST_OK;
+
+	// Final flush, here it's fine to wait for the disk
+	platform_mutex_lock(persist_lock);
+	if (persist_any_dirty)
+	{
+		while (persist_count == PERSIST_QUEUE_LEN && persist_error == PERSIST_OK)
+			platform_cond_wait(persist_space, persist_lock);
+		if (persist_error == PERSIST_OK)
+			persist_enqueue();
+	}
+	persist_stop_req = true;
+	platform_cond_signal(persist_wake);
+	platform_mutex_unlock(persist_lock);
+
+	platform_thread_join(persist_thread);
+	persist_thread = NULL;
+	persist_active = false;
+
+	uint8_t res = persist_error;
+	persist_free();
+	return res;
+}
@@ -0,0 +1,27 @@
+#ifndef CART_PERSIST
+#define CART_PERSIST
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Background persistence of the cartridge RAM.
+// The mappers mark the RAM pages they write to, and at the end of every frame the dirty pages are copied
+// and handed to a worker thread, which coalesces them and writes them to the save file.
+uint8_t cart_persist_start(char* filename, uint8_t* rom, int rom_size, uint8_t* ram, int ram_size);
+uint8_t cart_persist_stop();
+void cart_persist_frame();
+void cart_persist_mark(int ram_offset);
+void cart_persist_mark_range(int ram_offset, int size);
+
+enum CART_PERSIST_ERRORS {
+	PERSIST_OK = 0,
+	PERSIST_ERR_RUNNING,
+	PERSIST_ERR_NO_RAM,
+	PERSIST_ERR_ALLOC,
+	PERSIST_ERR_THREAD,
+	PERSIST_ERR_FILE_OPEN,
+	PERSIST_ERR_FILE_WRITE
+};
+
+#endif // CART_PERSIST
@@ -1,46 +1,40 @@
 #include "Cart_rom_only.h"
+#include "Rom_index.h"
 
 // Initialize static variables
-static uint8_t* rom = NULL;
-static uint8_t* ram = NULL;
-static uint8_t ro_romsize = 0x00;
-static uint8_t ro_ramsize = 0x00;
+static GB_INSTANCE uint8_t* rom = NULL;	// Belongs to the caller (the ROM registry)
+static GB_INSTANCE uint8_t* ram = NULL;
+static GB_INSTANCE uint8_t ro_romsize = 0x00;
+static GB_INSTANCE uint8_t ro_ramsize = 0x00;
+static GB_INSTANCE int ro_ram_bytes = 0;
 
 // Initialize ROM and RAM
-uint8_t cart_rom_only_init(uint8_t romsize, uint8_t ramsize, uint8_t* temp_rom)
+uint8_t cart_rom_only_init(uint8_t romsize, uint8_t ramsize, uint8_t* rom_image)
 {
 	ro_romsize = romsize;
 	ro_ramsize = ramsize;
-	rom = (uint8_t*)calloc(32 * 1024, sizeof(uint8_t));
-	if (rom == NULL)
-		return 1;
-	int res = memcpy_s(rom, 32 * 1024, temp_rom, 32 * 1024);
-	if (res != 0)
-	{
-		free(rom);
-		return 1;
-	}
+	rom = rom_image;
 	if (ramsize)
 	{
-		ram = (uint8_t*)calloc(ramsize - 1 ? 8 * 1024 : 2 * 1024, sizeof(uint8_t));
+		ro_ram_bytes = ramsize - 1 ? 8 * 1024 : 2 * 1024;
+		ram = (uint8_t*)calloc(ro_ram_bytes, sizeof(uint8_t));
 		if (ram == NULL)
 		{
-			free(rom);
+			cart_rom_only_free();
 			return 1;
 		}
 	}
 	else
+	{
+		ro_ram_bytes = 0;
 		ram = NULL;
+	}
 	return 0;
 }
 
 void cart_rom_only_free()
 {
-	if (rom != NULL)
-	{
-		free(rom);
-		rom = NULL;
-	}
+	rom = NULL;
 	if (ram != NULL)
 	{
 		free(ram);
@@ -52,6 +46,40 @@ void cart_rom_only_reset()
 {
 }
 
+uint8_t cart_rom_only_get_memory(uint8_t** rom_out, int* rom_size, uint8_t** ram_out, int* ram_size)
+{
+	if (rom_out != NULL)
+		*rom_out = rom;
+	if (rom_size != NULL)
+		*rom_size = 32 * 1024;
+	if (ram_out != NULL)
+		*ram_out = ram;
+	if (ram_size != NULL)
+		*ram_size = ro_ram_bytes;
+	return 0;
+}
+
+// Save states: there are no registers, only the RAM
+int cart_rom_only_state_size()
+{
+	return ro_ram_bytes;
+}
+
+void cart_rom_only_state_save(uint8_t* state)
+{
+	if (ram != NULL)
+		memcpy(state, ram, ro_ram_bytes);
+}
+
+void cart_rom_only_state_load(uint8_t* state)
+{
+	if (ram != NULL)
+	{
+		memcpy(ram, state, ro_ram_bytes);
+		cart_persist_mark_range(0, ro_ram_bytes);
+	}
+}
+
 uint8_t cart_rom_only_write(uint16_t addr, uint8_t data)
 {
 	if (addr >= 0x000 && addr <= 0x7FFF)
@@ -65,6 +93,7 @@ uint8_t cart_rom_only_write(uint16_t addr, uint8_t data)
 			if (!(ro_ramsize == CART_RAM_2K && addr >= 0xA800))
 			{
 				ram[addr - 0xA000] = data;
+				cart_persist_mark(addr - 0xA000);
 			}
 		}
 	}
@@ -92,11 +121,11 @@ uint8_t cart_rom_only_read(uint16_t addr)
 
 uint16_t cart_rom_only_compute_global_checksum()
 {
-	uint16_t global_checksum = 0;
-	for (int i = 0; i < 32 * 1024; i++)
-	{
-		if (i != 0x14E && i != 0x014F)
-			global_checksum += rom[i];
-	}
-	return global_checksum;
+	return rom_global_checksum(rom, 32 * 1024);
+}
+
+
+uint16_t cart_rom_only_rom_bank(uint16_t addr)
+{
+	return addr >= 0x4000 ? 1 : 0;
 }
@@ -2,13 +2,19 @@
 #define ROM_ONLY
 #include "Cartridge.h"
 
-uint8_t cart_rom_only_init(uint8_t romsize, uint8_t ramsize, uint8_t* temp_rom);
+// The ROM is read from rom_image, which stays owned by the caller
+uint8_t cart_rom_only_init(uint8_t romsize, uint8_t ramsize, uint8_t* rom_image);
 void cart_rom_only_free();
 void cart_rom_only_reset();
+uint8_t cart_rom_only_get_memory(uint8_t** rom_out, int* rom_size, uint8_t** ram_out, int* ram_size);
+int cart_rom_only_state_size();
+void cart_rom_only_state_save(uint8_t* state);
+void cart_rom_only_state_load(uint8_t* state);
 
 uint8_t cart_rom_only_write(uint16_t addr, uint8_t data);
 uint8_t cart_rom_only_read(uint16_t addr);
 
 uint16_t cart_rom_only_compute_global_checksum();
+uint16_t cart_rom_only_rom_bank(uint16_t addr);
 
 #endif // ROM_ONLY
\ No newline at end of file
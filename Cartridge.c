@@ -1,4 +1,5 @@
 #include "Cartridge.h"
+#include "Recompiler.h"
 
 // Cartridge ROM structure
 // 0000 - 00FF: Various
@@ -71,98 +72,169 @@
 // For MBC2, 0x00 must be specified even though it has RAM of 2 MB.
 
 // Initialize static variables
-static uint8_t romtype = 0x00;
-static uint8_t romsize = 0x00;
-static uint8_t ramsize = 0x00;
-static uint8_t(*cart_write)(uint16_t addr, uint8_t data) = NULL;
-static uint8_t(*cart_read)(uint16_t addr) = NULL;
-static void(*cart_free)() = NULL;
-static void(*cart_reset)() = NULL;
-static uint16_t(*cart_compute_global_checksum)() = NULL;
-static uint8_t(*cart_save)(FILE* save_file) = NULL;
-bool cart_loaded = false;
+static GB_INSTANCE uint8_t romtype = 0x00;
+static GB_INSTANCE uint8_t romsize = 0x00;
+static GB_INSTANCE uint8_t ramsize = 0x00;
+static GB_INSTANCE uint8_t(*cart_write)(uint16_t addr, uint8_t data) = NULL;
+static GB_INSTANCE uint8_t(*cart_read)(uint16_t addr) = NULL;
+static GB_INSTANCE void(*cart_free)() = NULL;
+static GB_INSTANCE void(*cart_reset)() = NULL;
+static GB_INSTANCE uint16_t(*cart_compute_global_checksum)() = NULL;
+static GB_INSTANCE uint16_t(*cart_rom_bank)(uint16_t addr) = NULL;
+static GB_INSTANCE uint8_t(*cart_save)(FILE* save_file) = NULL;
+static GB_INSTANCE uint8_t(*cart_memory)(uint8_t** rom_out, int* rom_size, uint8_t** ram_out, int* ram_size) = NULL;
+static GB_INSTANCE int(*cart_state_size)() = NULL;
+static GB_INSTANCE void(*cart_state_save)(uint8_t* state) = NULL;
+static GB_INSTANCE void(*cart_state_load)(uint8_t* state) = NULL;
+GB_INSTANCE bool cart_loaded = false;
+static GB_INSTANCE ROM_IMAGE* rom_image = NULL;	// Registry image of the ROM, NULL if the caller owns it
 
-uint8_t cart_load(char* filename)
+// Checks the header fields that don't depend on the file size
+static uint8_t cart_header_check(uint8_t* header)
 {
-	// Check that there isn't a loaded cartridge already in
-	if (cart_loaded)
-		return CARTERR_LOADED_ALREADY; // Cartridge loaded already
+	uint8_t type = header[0x0147];
+	uint8_t rom_code = header[0x0148];
+	uint8_t ram_code = header[0x0149];
 
-	uint8_t* temp_rom;
-	FILE* romfile;
-	long file_size;
-
-	// Open ROM file
-	errno_t res = fopen_s(&romfile, filename, "rb");
-	if (res != 0 || romfile == NULL)
-		return CARTERR_FILE_OPEN_ERROR; // Error opening file
+	if (type == CART_ROM_ONLY)
+	{
+		// Should be 32 KB ROM and up to 8K RAM
+		if (rom_code != CART_ROM_32K)
+			return CARTERR_ROM_SIZE_ERROR; // ROM size header error
+		else if (ram_code > CART_RAM_8K)
+			return CARTERR_RAM_SIZE_ERROR; // RAM size header error
+	}
+	else if (type >= CART_MBC1 && type <= CART_MBC1_RAM_BATTERY)
+	{
+		// Should have up to 2MB of ROM and up to 32KB of RAM
+		// Types:
+		// CART_MBC1
+		// CART_MBC1_RAM
+		// CART_MBC1_RAM_BATTERY
+		if (rom_code > CART_ROM_2M)
+			return CARTERR_ROM_SIZE_ERROR; // ROM size header error
+		else if (ram_code > CART_RAM_32K) // Not specifying having RAM is ok by me 
+			return CARTERR_RAM_SIZE_ERROR; // RAM size header error
+	}
+	else
+	{
+		return CARTERR_CART_NOT_SUPPORTED; // Not supported
+	}
+	return 0;
+}
 
+// Reads a plain ROM file into a new buffer
+static uint8_t cart_read_file(FILE* romfile, uint8_t** temp_rom, long* file_size)
+{
 	// obtain file size:
 	fseek(romfile, 0, SEEK_END);
-	file_size = ftell(romfile);
+	*file_size = ftell(romfile);
 	rewind(romfile);
 
 	// File size must be at least 32KB
-	if (file_size < 32 * 1024)
+	if (*file_size < 32 * 1024)
 		return CARTERR_FILE_TOO_SMALL; // File is too small
 
 	// allocate memory to contain the whole file:
-	temp_rom = (uint8_t*)malloc(sizeof (uint8_t) * file_size);
-	if (temp_rom == NULL)
+	*temp_rom = (uint8_t*)malloc(sizeof (uint8_t) * *file_size);
+	if (*temp_rom == NULL)
 		return CARTERR_ALLOC_ERROR; // Error allocating memory
 
 	// copy the file into the buffer:
-	size_t result = fread(temp_rom, 1, file_size, romfile);
-	if (result != file_size)
+	size_t result = fread(*temp_rom, 1, *file_size, romfile);
+	if (result != *file_size)
+	{
+		free(*temp_rom);
+		*temp_rom = NULL;
 		return CARTERR_FILE_READ_ERROR; // Error reading file
+	}
+	return 0;
+}
 
-	// Close file
-	fclose(romfile);
+// Inflates a .gz or .zip ROM straight into memory. The header is checked as soon as it
+// comes out of the decompressor, so an unsupported cartridge stops the decompression early.
+static uint8_t cart_inflate_file(FILE* romfile, uint8_t** temp_rom, long* file_size)
+{
+	INFLATE_CHECK check = { 0x0150, cart_header_check, 0 };
+	size_t out_size;
+	uint8_t res = inflate_file(romfile, CART_MAX_FILE_SIZE, &check, temp_rom, &out_size);
+	switch (res)
+	{
+		case INFLATE_OK:
+			break;
+		case INFLATE_ERR_ABORTED:
+			return check.result;
+		case INFLATE_ERR_ALLOC:
+			return CARTERR_ALLOC_ERROR;
+		case INFLATE_ERR_SIZE:
+			return CARTERR_FILE_SIZE_ERROR;
+		default:
+			return CARTERR_FILE_READ_ERROR;
+	}
+	*file_size = (long)out_size;
+	if (*file_size < 32 * 1024)
+	{
+		free(*temp_rom);
+		*temp_rom = NULL;
+		return CARTERR_FILE_TOO_SMALL; // File is too small
+	}
+	return 0;
+}
+
+// Gets the ROM part of the file from the registry, unless the caller keeps the image
+static uint8_t cart_rom_acquire(uint8_t* temp_rom, long rom_bytes, bool shared, uint8_t** rom_data)
+{
+	if (shared)
+	{
+		*rom_data = temp_rom;
+		return 0;
+	}
+	if (rom_registry_acquire(temp_rom, rom_bytes, &rom_image) != ROMREG_OK)
+		return CARTERR_ALLOC_ERROR;
+	*rom_data = rom_image->data;
+	return 0;
+}
+
+// Sets up the mapper for a ROM image that's already in memory
+static uint8_t cart_load_image(uint8_t* temp_rom, long file_size, bool shared)
+{
+	uint8_t* rom_data;
 
-	// The whole file is now loaded in temp_rom
 	// Check for correct 
 	romtype = temp_rom[0x0147];
 	romsize = temp_rom[0x0148];
 	ramsize = temp_rom[0x0149];
-	uint8_t type_error = 0x00;
+	uint8_t type_error = cart_header_check(temp_rom);
 
-	if (romtype == CART_ROM_ONLY)
+	if (type_error == 0 && romtype == CART_ROM_ONLY)
 	{
-		// Should be 32 KB ROM and up to 8K RAM
-		if (romsize != CART_ROM_32K)
-			type_error = CARTERR_ROM_SIZE_ERROR; // ROM size header error
-		else if (ramsize > CART_RAM_8K)
-			type_error = CARTERR_RAM_SIZE_ERROR; // RAM size header error
-		else if (file_size != 32 * 1024)
+		if (file_size != 32 * 1024)
 			type_error = CARTERR_FILE_SIZE_ERROR; // File size error
-		else
+		else if ((type_error = cart_rom_acquire(temp_rom, 32 * 1024, shared, &rom_data)) == 0)
 		{
-			cart_rom_only_init(romsize, ramsize, temp_rom);
+			cart_rom_only_init(romsize, ramsize, rom_data);
 			cart_write = &cart_rom_only_write;
 			cart_read = &cart_rom_only_read;
 			cart_free = &cart_rom_only_free;
 			cart_reset = &cart_rom_only_reset;
 			cart_compute_global_checksum = &cart_rom_only_compute_global_checksum;
+			cart_rom_bank = &cart_rom_only_rom_bank;
 			cart_save = NULL;
+			cart_memory = &cart_rom_only_get_memory;
+			cart_state_size = &cart_rom_only_state_size;
+			cart_state_save = &cart_rom_only_state_save;
+			cart_state_load = &cart_rom_only_state_load;
 			cart_loaded = true;
 		}
 	}
-	else if (romtype >= CART_MBC1 && romtype <= CART_MBC1_RAM_BATTERY)
+	else if (type_error == 0)
 	{
-		// Should have up to 2MB of ROM and up to 32KB of RAM
-		// Types:
-		// CART_MBC1
-		// CART_MBC1_RAM
-		// CART_MBC1_RAM_BATTERY
-		if (romsize > CART_ROM_2M)
-			type_error = CARTERR_ROM_SIZE_ERROR; // ROM size header error
-		else if (ramsize > CART_RAM_32K) // Not specifying having RAM is ok by me 
-			type_error = CARTERR_RAM_SIZE_ERROR; // RAM size header error
-		else if (file_size < 32LL * 1024LL * pow(2, romsize))
+		// MBC1
+		if (file_size < 32LL * 1024LL * pow(2, romsize))
 			type_error = CARTERR_FILE_SIZE_ERROR; // File size error
-		else
+		else if ((type_error = cart_rom_acquire(temp_rom, 32L * 1024L << romsize, shared, &rom_data)) == 0)
 		{
-			uint8_t res = cart_mbc1_init(romsize, ramsize, file_size, temp_rom, romtype);
+			uint8_t res = cart_mbc1_init(romsize, ramsize, file_size, temp_rom, romtype, rom_data);
 			if (res != 0)
 				type_error = CARTERR_ALLOC_ERROR;
 			cart_write = cart_mbc1_write;
@@ -170,27 +242,91 @@ uint8_t cart_load(char* filename)
 			cart_free = cart_mbc1_free;
 			cart_reset = cart_mbc1_reset;
 			cart_compute_global_checksum = cart_mbc1_compute_global_checksum;
+			cart_rom_bank = cart_mbc1_rom_bank;
 			cart_save = cart_mbc1_save;
+			cart_memory = cart_mbc1_get_memory;
+			cart_state_size = cart_mbc1_state_size;
+			cart_state_save = cart_mbc1_state_save;
+			cart_state_load = cart_mbc1_state_load;
 			cart_loaded = true;
 		}
 	}
+	return type_error;
+}
+
+uint8_t cart_file_read(char* filename, uint8_t** image, long* image_size)
+{
+	uint8_t* temp_rom = NULL;
+	FILE* romfile;
+	long file_size = 0;
+
+	// Open ROM file
+	romfile = fopen(filename, "rb");
+	if (romfile == NULL)
+		return CARTERR_FILE_OPEN_ERROR; // Error opening file
+
+	// Compressed files are recognized by their magic, not by their extension
+	uint8_t magic[4] = { 0 };
+	size_t magic_len = fread(magic, 1, sizeof magic, romfile);
+	uint8_t read_error;
+	if (inflate_format(magic, magic_len) != INFLATE_FORMAT_NONE)
+		read_error = cart_inflate_file(romfile, &temp_rom, &file_size);
 	else
-	{
-		type_error = CARTERR_CART_NOT_SUPPORTED; // Not supported
-	}
-	
+		read_error = cart_read_file(romfile, &temp_rom, &file_size);
+
+	// Close file
+	fclose(romfile);
+	if (read_error != 0)
+		return read_error;
+
+	*image = temp_rom;
+	*image_size = file_size;
+	return 0;
+}
+
+uint8_t cart_load(char* filename)
+{
+	// Check that there isn't a loaded cartridge already in
+	if (cart_loaded)
+		return CARTERR_LOADED_ALREADY; // Cartridge loaded already
+
+	uint8_t* temp_rom = NULL;
+	long file_size = 0;
+	uint8_t read_error = cart_file_read(filename, &temp_rom, &file_size);
+	if (read_error != 0)
+		return read_error;
+
+	// The whole file is now loaded in temp_rom. The mapper gets the ROM from the registry, so
+	// machines that load the same game share it.
+	uint8_t type_error = cart_load_image(temp_rom, file_size, false);
 
 	// terminate
 	free(temp_rom);
 	return type_error;
 }
 
+uint8_t cart_load_shared(uint8_t* image, size_t size)
+{
+	if (cart_loaded)
+		return CARTERR_LOADED_ALREADY; // Cartridge loaded already
+	if (size < 32 * 1024)
+		return CARTERR_FILE_TOO_SMALL; // File is too small
+	if (size > CART_MAX_FILE_SIZE)
+		return CARTERR_FILE_SIZE_ERROR;
+	return cart_load_image(image, (long)size, true);
+}
+
 uint8_t cart_unload()
 {
 	if (cart_loaded)
 	{
+		// Final flush of the background save before the RAM goes away
+		cart_persist_stop();
+		recomp_unload();
 		(*cart_free)();
 		cart_loaded = false;
+		rom_registry_release(rom_image);
+		rom_image = NULL;
 	}
 	return 0;
 }
@@ -216,6 +352,14 @@ void cart_mapper_reset()
 		(*cart_reset)();
 }
 
+uint16_t cart_mapper_rom_bank(uint16_t addr)
+{
+	if (cart_loaded && addr <= 0x7FFF)
+		return (*cart_rom_bank)(addr);
+	else
+		return 0;
+}
+
 uint16_t cart_mapper_compute_global_checksum() 
 {
 	if (cart_loaded)
@@ -224,10 +368,8 @@ uint16_t cart_mapper_compute_global_checksum()
 		return 0xFFFF;
 }
 
-uint8_t cart_mapper_save(char* filename)
+static bool cart_has_battery()
 {
-	if (!cart_loaded)
-		return 1;
 	switch (romtype)
 	{
 		case CART_MBC1_RAM_BATTERY:
@@ -241,20 +383,67 @@ uint8_t cart_mapper_save(char* filename)
 		case CART_MBC7_SENSOR_RUMBLE_RAM_BATTERY:
 		case CART_HUC1_RAM_BATTERY:
 			// You can save
-			break;
+			return true;
 		default:
-			return 1; // Cart doesn't have a RAM with battery
+			return false; // Cart doesn't have a RAM with battery
 	}
+}
+
+uint8_t cart_mapper_save(char* filename)
+{
+	if (!cart_loaded || !cart_has_battery())
+		return 1;
 	if (cart_save == NULL)
 		return 1;
-	FILE* save_file;
-	errno_t res = fopen_s(&save_file, filename, "wb");
-	if (res != 0)
+	FILE* save_file = fopen(filename, "wb");
+	if (save_file == NULL)
 		return 1;
 	uint8_t ress = (*cart_save)(save_file);
 	return ress;
 }
 
+uint8_t cart_mapper_get_memory(uint8_t** rom_out, int* rom_size, uint8_t** ram_out, int* ram_size)
+{
+	if (!cart_loaded)
+		return 1;
+	return (*cart_memory)(rom_out, rom_size, ram_out, ram_size);
+}
+
+int cart_mapper_state_size()
+{
+	if (!cart_loaded)
+		return 0;
+	return (*cart_state_size)();
+}
+
+void cart_mapper_state_save(uint8_t* state)
+{
+	if (cart_loaded)
+		(*cart_state_save)(state);
+}
+
+void cart_mapper_state_load(uint8_t* state)
+{
+	if (cart_loaded)
+		(*cart_state_load)(state);
+}
+
+uint8_t cart_mapper_autosave_start(char* filename)
+{
+	if (!cart_loaded || !cart_has_battery())
+		return PERSIST_ERR_NO_RAM;
+	uint8_t* rom_ptr;
+	uint8_t* ram_ptr;
+	int rom_len, ram_len;
+	cart_mapper_get_memory(&rom_ptr, &rom_len, &ram_ptr, &ram_len);
+	return cart_persist_start(filename, rom_ptr, rom_len, ram_ptr, ram_len);
+}
+
+uint8_t cart_mapper_autosave_stop()
+{
+	return cart_persist_stop();
+}
+
 uint8_t cart_get_stats(int nTitle, char* title, uint8_t* type, uint8_t* rom_size, uint8_t* ram_size, uint8_t* japan, 
 	bool* header_chck, bool* global_check)
 {
@@ -279,7 +468,7 @@ uint8_t cart_get_stats(int nTitle, char* title, uint8_t* type, uint8_t* rom_size
 		{
 			tmp_title[i] = cart_mapper_read(0x0134 + i);
 		}
-		strncpy_s(title, nTitle, tmp_title, _TRUNCATE);
+		snprintf(title, nTitle, "%s", tmp_title);
 	}
 	if (type != NULL)
 		*type = cart_mapper_read(0x147);
@@ -9,9 +9,22 @@
 #include "Bus.h"
 #include "Cart_rom_only.h"
 #include "Cart_mbc1.h"
+#include "Cart_persist.h"
+#include "Inflate.h"
+#include "Rom_registry.h"
 
-// Load ROM file based on type, ROM and RAM size
+// Largest ROM (8MB) with a save appended to it (128KB)
+#define CART_MAX_FILE_SIZE (8 * 1024 * 1024 + 128 * 1024)
+
+// Load ROM file based on type, ROM and RAM size. The file can also be a .gz or a .zip
 uint8_t cart_load(char* filename);
+
+// Read a ROM file (plain, gzip or zip) into a new buffer, freed by the caller
+uint8_t cart_file_read(char* filename, uint8_t** image, long* image_size);
+
+// Load a ROM image that stays owned by the caller, instead of going through the ROM registry. The image
+// is only read, so any number of machines can share it, and it has to outlive them (until cart_unload).
+uint8_t cart_load_shared(uint8_t* image, size_t size);
 uint8_t cart_unload();
 
 // Mapper read and write
@@ -21,9 +34,22 @@ uint8_t cart_mapper_read(uint16_t addr);
 // Reset
 void cart_mapper_reset();
 
+// ROM bank mapped at addr ($0000 - $7FFF), numbered like RGBDS does (ROMX of a 32KB ROM is bank 1)
+uint16_t cart_mapper_rom_bank(uint16_t addr);
+
 uint16_t cart_mapper_compute_global_checksum();
 
 uint8_t cart_mapper_save(char* filename);
+uint8_t cart_mapper_get_memory(uint8_t** rom_out, int* rom_size, uint8_t** ram_out, int* ram_size);
+
+// Mapper registers and RAM for save states
+int cart_mapper_state_size();
+void cart_mapper_state_save(uint8_t* state);
+void cart_mapper_state_load(uint8_t* state);
+
+// Background saving of the cartridge RAM
+uint8_t cart_mapper_autosave_start(char* filename);
+uint8_t cart_mapper_autosave_stop();
 
 uint8_t cart_get_stats(int nTitle, char* title, uint8_t* type, uint8_t* rom_size, uint8_t* ram_size,
 	uint8_t* japan, bool* header_chck, bool* global_check);
@@ -0,0 +1,304 @@
+#include "Bus.h"
+#include "Diffcheck.h"
+#include "Sharp_LR35902.h"
+#include "Ppu.h"
+#include "Timer.h"
+#include "Trace.h"
+#include <stdio.h>
+
+#define DIFFCHECK_SCREEN_SIZE (160 * 144 * sizeof(uint32_t))
+#define DIFFCHECK_BUTTONS_UNKNOWN 0xFFFF
+
+// What is compared, taken from the save state parts of the devices
+typedef struct {
+	CPU_STATE cpu;
+	PPU_STATE ppu;
+	BUS_STATE bus;
+	TIMER_STATE timer;
+	uint32_t screen[160 * 144];
+} DIFFCHECK_SNAPSHOT;
+
+typedef struct {
+	uint32_t paths;
+	MACHINE_FORK* fork;			// After the last step, NULL while that's the match
+	MACHINE_FORK* match_fork;	// The last time the sides were the same
+	uint32_t* screen;
+	uint32_t* match_screen;
+} DIFFCHECK_SIDE;
+
+struct DIFFCHECK {
+	DIFFCHECK_SIDE sides[2];
+	DIFFCHECK_SNAPSHOT* snapshots[2];
+	uint16_t buttons;			// Held in the state of the last step
+	uint16_t match_buttons;
+	uint64_t match_clock;
+
+	// The last step, for diffcheck_trace
+	uint8_t step_buttons;
+	uint32_t step_instructions;
+};
+
+static void side_free(DIFFCHECK_SIDE* side)
+{
+	fork_free(side->fork);
+	fork_free(side->match_fork);
+	free(side->screen);
+	free(side->match_screen);
+	side->fork = NULL;
+	side->match_fork = NULL;
+	side->screen = NULL;
+	side->match_screen = NULL;
+}
+
+uint8_t diffcheck_create(uint32_t accurate_paths, uint32_t candidate_paths, DIFFCHECK** checker)
+{
+	DIFFCHECK* c = (DIFFCHECK*)calloc(1, sizeof(DIFFCHECK));
+	if (c == NULL)
+		return DIFFCHECK_ERR_ALLOC;
+	c->sides[DIFFCHECK_ACCURATE].paths = accurate_paths;
+	c->sides[DIFFCHECK_CANDIDATE].paths = candidate_paths;
+	c->buttons = DIFFCHECK_BUTTONS_UNKNOWN;
+	c->match_buttons = DIFFCHECK_BUTTONS_UNKNOWN;
+	c->match_clock = clock_count;
+	for (int i = 0; i < 2; i++)
+	{
+		DIFFCHECK_SIDE* side = &c->sides[i];
+		side->screen = (uint32_t*)malloc(DIFFCHECK_SCREEN_SIZE);
+		side->match_screen = (uint32_t*)malloc(DIFFCHECK_SCREEN_SIZE);
+		c->snapshots[i] = (DIFFCHECK_SNAPSHOT*)malloc(sizeof(DIFFCHECK_SNAPSHOT));
+		if (side->screen == NULL || side->match_screen == NULL || c->snapshots[i] == NULL ||
+			fork_create(&side->match_fork) != FORK_OK)
+		{
+			diffcheck_free(c);
+			return DIFFCHECK_ERR_ALLOC;
+		}
+		memcpy(side->match_screen, gameboy_get_screen(), DIFFCHECK_SCREEN_SIZE);
+	}
+	*checker = c;
+	return DIFFCHECK_OK;
+}
+
+void diffcheck_free(DIFFCHECK* checker)
+{
+	if (checker == NULL)
+		return;
+	for (int i = 0; i < 2; i++)
+	{
+		side_free(&checker->sides[i]);
+		free(checker->snapshots[i]);
+	}
+	free(checker);
+}
+
+static void side_restore(DIFFCHECK_SIDE* side, bool last_match)
+{
+	if (last_match || side->fork == NULL)
+	{
+		fork_load(side->match_fork);
+		memcpy(gameboy_get_screen(), side->match_screen, DIFFCHECK_SCREEN_SIZE);
+	}
+	else
+	{
+		fork_load(side->fork);
+		memcpy(gameboy_get_screen(), side->screen, DIFFCHECK_SCREEN_SIZE);
+	}
+	gameboy_fast_paths_set(side->paths);
+}
+
+static void apply_buttons(uint16_t held, uint8_t buttons)
+{
+	for (uint8_t button = GB_JOYPAD_UP; button <= GB_JOYPAD_A; button++)
+	{
+		bool pressed = (buttons >> button) & 1;
+		if (held == DIFFCHECK_BUTTONS_UNKNOWN || ((held >> button) & 1) != pressed)
+			gameboy_joypad_input(button, pressed);
+	}
+}
+
+// Run the accurate side for the step, or the candidate up to target
+static void side_run(uint8_t side, uint32_t instructions, uint64_t* target)
+{
+	if (side == DIFFCHECK_ACCURATE)
+	{
+		if (instructions == 0)
+			gameboy_run_frame();
+		else
+		{
+			for (uint32_t i = 0; i < instructions; i++)
+				gameboy_run(0, GB_STOP_INSTRUCTION);
+		}
+		*target = clock_count;
+	}
+	else
+	{
+		while (clock_count < *target)
+			gameboy_run(*target - clock_count, 0);
+	}
+}
+
+static void snapshot_take(DIFFCHECK_SNAPSHOT* s)
+{
+	cpu_state_save(&s->cpu);
+	ppu_state_save(&s->ppu);
+	bus_state_save(&s->bus);
+	timer_state_save(&s->timer);
+	memcpy(s->screen, gameboy_get_screen(), DIFFCHECK_SCREEN_SIZE);
+}
+
+static bool diff_value(DIFFCHECK_RESULT* r, char* name, uint32_t a, uint32_t b)
+{
+	if (a == b)
+		return false;
+	snprintf(r->component, sizeof(r->component), "%s", name);
+	r->addr = 0;
+	r->accurate = a;
+	r->candidate = b;
+	return true;
+}
+
+static bool diff_bytes(DIFFCHECK_RESULT* r, char* name, uint8_t* a, uint8_t* b, size_t len, uint16_t base)
+{
+	if (memcmp(a, b, len) == 0)
+		return false;
+	size_t i = 0;
+	while (a[i] == b[i])
+		i++;
+	snprintf(r->component, sizeof(r->component), "%s", name);
+	r->addr = (uint16_t)(base + i);
+	r->accurate = a[i];
+	r->candidate = b[i];
+	return true;
+}
+
+// Finds the first difference, in the order a bug usually shows up in
+static bool snapshot_compare(DIFFCHECK_SNAPSHOT* a, DIFFCHECK_SNAPSHOT* b, DIFFCHECK_RESULT* r)
+{
+	if (diff_value(r, "PC", a->cpu.PC, b->cpu.PC) || diff_value(r, "SP", a->cpu.SP, b->cpu.SP) ||
+		diff_value(r, "AF", a->cpu.AF, b->cpu.AF) || diff_value(r, "BC", a->cpu.BC, b->cpu.BC) ||
+		diff_value(r, "DE", a->cpu.DE, b->cpu.DE) || diff_value(r, "HL", a->cpu.HL, b->cpu.HL) ||
+		diff_value(r, "IME", a->cpu.IME, b->cpu.IME) || diff_value(r, "HALT", a->bus.cpu_halt, b->bus.cpu_halt) ||
+		diff_value(r, "IF", a->bus.IF, b->bus.IF) || diff_value(r, "IE", a->bus.IE, b->bus.IE))
+		return true;
+
+	if (diff_value(r, "DIV", a->timer.DIV, b->timer.DIV) || diff_value(r, "TIMA", a->timer.TIMA, b->timer.TIMA) ||
+		diff_value(r, "TMA", a->timer.TMA, b->timer.TMA) || diff_value(r, "TAC", a->timer.TAC, b->timer.TAC))
+		return true;
+
+	if (diff_value(r, "LCDC", a->ppu.LCDC, b->ppu.LCDC) || diff_value(r, "STAT", a->ppu.STAT, b->ppu.STAT) ||
+		diff_value(r, "LY", a->ppu.LY, b->ppu.LY) || diff_value(r, "LYC", a->ppu.LYC, b->ppu.LYC) ||
+		diff_value(r, "SCY", a->ppu.SCY, b->ppu.SCY) || diff_value(r, "SCX", a->ppu.SCX, b->ppu.SCX) ||
+		diff_value(r, "WY", a->ppu.WY, b->ppu.WY) || diff_value(r, "WX", a->ppu.WX, b->ppu.WX) ||
+		diff_value(r, "BGP", a->ppu.BGP, b->ppu.BGP) || diff_value(r, "OBP0", a->ppu.OBP0, b->ppu.OBP0) ||
+		diff_value(r, "OBP1", a->ppu.OBP1, b->ppu.OBP1))
+		return true;
+
+	if (diff_bytes(r, "OAM", a->ppu.oam, b->ppu.oam, sizeof(a->ppu.oam), 0xFE00) ||
+		diff_bytes(r, "VRAM", a->ppu.vram, b->ppu.vram, sizeof(a->ppu.vram), 0x8000) ||
+		diff_bytes(r, "WRAM", a->bus.wram, b->bus.wram, sizeof(a->bus.wram), 0xC000) ||
+		diff_bytes(r, "HRAM", a->bus.hram, b->bus.hram, sizeof(a->bus.hram), 0xFF80))
+		return true;
+
+	if (memcmp(a->screen, b->screen, DIFFCHECK_SCREEN_SIZE) != 0)
+	{
+		int i = 0;
+		while (a->screen[i] == b->screen[i])
+			i++;
+		snprintf(r->component, sizeof(r->component), "screen");
+		r->addr = (uint16_t)i;
+		r->accurate = a->screen[i];
+		r->candidate = b->screen[i];
+		return true;
+	}
+	return false;
+}
+
+// Keep the machine as it is now as the state of the side after the step
+static uint8_t side_keep(DIFFCHECK_SIDE* side)
+{
+	MACHINE_FORK* now;
+	if (fork_create(&now) != FORK_OK)
+		return DIFFCHECK_ERR_ALLOC;
+	fork_free(side->fork);
+	side->fork = now;
+	memcpy(side->screen, gameboy_get_screen(), DIFFCHECK_SCREEN_SIZE);
+	return DIFFCHECK_OK;
+}
+
+uint8_t diffcheck_step(DIFFCHECK* checker, uint8_t buttons, uint32_t instructions, DIFFCHECK_RESULT* result)
+{
+	uint64_t target = 0;
+	checker->step_buttons = buttons;
+	checker->step_instructions = instructions;
+	for (uint8_t i = DIFFCHECK_ACCURATE; i <= DIFFCHECK_CANDIDATE; i++)
+	{
+		DIFFCHECK_SIDE* side = &checker->sides[i];
+		side_restore(side, false);
+		apply_buttons(checker->buttons, buttons);
+		side_run(i, instructions, &target);
+		snapshot_take(checker->snapshots[i]);
+		if (side_keep(side) != DIFFCHECK_OK)
+			return DIFFCHECK_ERR_ALLOC;
+	}
+	checker->buttons = buttons;
+
+	DIFFCHECK_RESULT r;
+	memset(&r, 0, sizeof r);
+	if (snapshot_compare(checker->snapshots[DIFFCHECK_ACCURATE], checker->snapshots[DIFFCHECK_CANDIDATE], &r))
+	{
+		r.clock = target;
+		r.last_match_clock = checker->match_clock;
+		for (int i = 0; i < 2; i++)
+		{
+			CPU_STATE* cpu = &checker->snapshots[i]->cpu;
+			r.regs[i][0] = cpu->AF;
+			r.regs[i][1] = cpu->BC;
+			r.regs[i][2] = cpu->DE;
+			r.regs[i][3] = cpu->HL;
+			r.regs[i][4] = cpu->SP;
+			r.regs[i][5] = cpu->PC;
+		}
+		if (result != NULL)
+			*result = r;
+		return DIFFCHECK_DIVERGED;
+	}
+
+	// Still the same, this is the new point to go back to
+	for (int i = 0; i < 2; i++)
+	{
+		DIFFCHECK_SIDE* side = &checker->sides[i];
+		uint32_t* screen = side->match_screen;
+		fork_free(side->match_fork);
+		side->match_fork = side->fork;
+		side->match_screen = side->screen;
+		side->fork = NULL;
+		side->screen = screen;
+	}
+	checker->match_buttons = buttons;
+	checker->match_clock = target;
+	return DIFFCHECK_OK;
+}
+
+uint8_t diffcheck_load(DIFFCHECK* checker, uint8_t side, bool last_match)
+{
+	if (side > DIFFCHECK_CANDIDATE)
+		return DIFFCHECK_ERR_SIDE;
+	side_restore(&checker->sides[side], last_match);
+	return DIFFCHECK_OK;
+}
+
+uint8_t diffcheck_trace(DIFFCHECK* checker, char* accurate_trace, char* candidate_trace)
+{
+	char* files[2] = { accurate_trace, candidate_trace };
+	uint64_t target = 0;
+	for (uint8_t i = DIFFCHECK_ACCURATE; i <= DIFFCHECK_CANDIDATE; i++)
+	{
+		side_restore(&checker->sides[i], true);
+		apply_buttons(checker->match_buttons, checker->step_buttons);
+		if (trace_start(files[i], 4) != TRACE_OK)
+			return DIFFCHECK_ERR_TRACE;
+		side_run(i, checker->step_instructions, &target);
+		if (trace_stop() != TRACE_OK)
+			return DIFFCHECK_ERR_TRACE;
+	}
+	return DIFFCHECK_OK;
+}
@@ -0,0 +1,58 @@
+#ifndef DIFFCHECK_CODE
+#define DIFFCHECK_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Differential checking of the fast paths.
+// Two copies of the machine start from the same state, one with the accurate set of fast paths and one
+// with the candidate set (gameboy_fast_paths_set). They are stepped with the same input, a frame or a
+// number of instructions at a time, and after every step they are compared: the CPU registers, IF and IE,
+// the timer and PPU registers, OAM, VRAM, WRAM, HRAM and the screen. The candidate always runs to the
+// clock the accurate side stopped at, so the two are compared at the same point in time.
+// Only what the game can see is compared, so fast paths are free to keep their own internal state.
+// The copies are forks, and the machine is a scratch area while stepping.
+typedef struct DIFFCHECK DIFFCHECK;
+
+// The first difference found by a step
+typedef struct {
+	uint64_t clock;					// Where the step stopped
+	uint64_t last_match_clock;		// Where the sides were last the same
+	char component[16];				// "PC", "IF", "LY", "VRAM", "screen", ...
+	uint16_t addr;					// Address in memory, or the pixel on the screen
+	uint32_t accurate;
+	uint32_t candidate;
+	uint16_t regs[2][6];			// AF, BC, DE, HL, SP and PC of both sides
+} DIFFCHECK_RESULT;
+
+enum DIFFCHECK_SIDES {
+	DIFFCHECK_ACCURATE = 0,
+	DIFFCHECK_CANDIDATE
+};
+
+// Both sides start from the current state of the machine
+uint8_t diffcheck_create(uint32_t accurate_paths, uint32_t candidate_paths, DIFFCHECK** checker);
+void diffcheck_free(DIFFCHECK* checker);
+
+// Run both sides for a frame (instructions 0) or for instructions instructions of the accurate side.
+// buttons has a bit for every held button (1 << GB_JOYPAD_*). Returns DIFFCHECK_DIVERGED with the
+// result filled in when the sides differ.
+uint8_t diffcheck_step(DIFFCHECK* checker, uint8_t buttons, uint32_t instructions, DIFFCHECK_RESULT* result);
+
+// Load a side into the machine (with its screen), as of the last step or of the last time the sides matched
+uint8_t diffcheck_load(DIFFCHECK* checker, uint8_t side, bool last_match);
+
+// Run the last step again on both sides from where they last matched, with an execution trace of each
+// (see Trace.h), to find the instruction they went apart at
+uint8_t diffcheck_trace(DIFFCHECK* checker, char* accurate_trace, char* candidate_trace);
+
+enum DIFFCHECK_ERRORS {
+	DIFFCHECK_OK = 0,
+	DIFFCHECK_DIVERGED,
+	DIFFCHECK_ERR_ALLOC,
+	DIFFCHECK_ERR_SIDE,
+	DIFFCHECK_ERR_TRACE
+};
+
+#endif // DIFFCHECK_CODE
@@ -0,0 +1,167 @@
+#include "Bus.h"
+#include "Diffcheck.h"
+#include "Trace.h"
+#include "Sharp_LR35902.h"
+#include "Recompiler.h"
+#include <stdio.h>
+#include <string.h>
+
+// Differential checker, the fast paths against the accurate emulation
+//	gbcheck <rom> [-frames N] [-every N] [-fast mask] [-accurate mask] [-trace prefix] [-recomp file]
+//	-frames:	frames to run (default 600)
+//	-every:		compare every N instructions instead of every frame
+//	-fast:		GB_FAST_* flags of the candidate (default all of them)
+//	-accurate:	GB_FAST_* flags of the reference (default none)
+//	-trace:		on a difference, trace the step it was found in into prefix.accurate and prefix.candidate
+//				and show the first instruction where they differ
+//	-recomp:	recompiled code of the ROM (gbrecomp) for GB_FAST_RECOMPILED
+// Exits with 1 if the two differ.
+
+static int usage()
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "\tgbcheck <rom> [-frames N] [-every N] [-fast mask] [-accurate mask] [-trace prefix] [-recomp file]\n");
+	return 2;
+}
+
+static void print_trace_event(char* side, TRACE_EVENT* e)
+{
+	if (e->kind == TRACE_EVENT_END)
+		printf("\t%s: end of the step\n", side);
+	else if (e->kind == TRACE_EVENT_WRITE)
+		printf("\t%s: write (%04X) <- %02X\n", side, e->addr, e->data);
+	else
+	{
+		char name[32];
+		cpu_opcode_name(e->opcode, false, name, sizeof(name));
+		printf("\t%s: clock %llu PC=%04X %-16s AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X\n", side,
+			(unsigned long long)e->clock, e->pc, name, e->af, e->bc, e->de, e->hl, e->sp);
+	}
+}
+
+static int trace_step(DIFFCHECK* checker, char* prefix)
+{
+	char files[2][512];
+	snprintf(files[0], sizeof(files[0]), "%s.accurate", prefix);
+	snprintf(files[1], sizeof(files[1]), "%s.candidate", prefix);
+	uint8_t res = diffcheck_trace(checker, files[0], files[1]);
+	if (res != DIFFCHECK_OK)
+	{
+		fprintf(stderr, "Tracing the step failed: %d\n", res);
+		return 1;
+	}
+
+	TRACE_DIFF diff;
+	res = trace_diff(files[0], files[1], &diff);
+	if (res != TRACE_OK)
+	{
+		fprintf(stderr, "Reading the traces failed: %d\n", res);
+		return 1;
+	}
+	if (!diff.diverged)
+		printf("The instructions of the step are the same, the difference is outside the CPU\n");
+	else
+	{
+		printf("First instruction that differs, after %llu events of the step:\n", (unsigned long long)diff.events);
+		print_trace_event("accurate ", &diff.a);
+		print_trace_event("candidate", &diff.b);
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+		return usage();
+	uint64_t frames = 600;
+	uint32_t every = 0;
+	uint32_t candidate = 0xFFFFFFFF;
+	uint32_t accurate = GB_FAST_NONE;
+	char* trace_prefix = NULL;
+	char* recomp = NULL;
+	for (int i = 2; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+			return usage();
+		else if (strcmp(argv[i], "-frames") == 0)
+			frames = strtoull(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-every") == 0)
+			every = (uint32_t)strtoul(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-fast") == 0)
+			candidate = (uint32_t)strtoul(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-accurate") == 0)
+			accurate = (uint32_t)strtoul(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-trace") == 0)
+			trace_prefix = argv[++i];
+		else if (strcmp(argv[i], "-recomp") == 0)
+			recomp = argv[++i];
+		else
+			return usage();
+	}
+
+	uint8_t res = gameboy_cart_load(argv[1]);
+	if (res != 0)
+	{
+		fprintf(stderr, "Loading the cartridge failed: %d\n", res);
+		return 2;
+	}
+	if (recomp != NULL && (res = gameboy_recomp_load(recomp)) != RECOMP_OK)
+	{
+		fprintf(stderr, "Loading the recompiled code failed: %d\n", res);
+		gameboy_cart_unload();
+		return 2;
+	}
+	gameboy_reset(true);
+
+	DIFFCHECK* checker;
+	if ((res = diffcheck_create(accurate, candidate, &checker)) != DIFFCHECK_OK)
+	{
+		fprintf(stderr, "Starting the checker failed: %d\n", res);
+		gameboy_cart_unload();
+		return 2;
+	}
+
+	int ret = 0;
+	uint64_t steps = 0;
+	DIFFCHECK_RESULT result;
+	// frame_count goes up on both sides, the clock is the one of the side that ran last
+	while (ret == 0 && clock_count < frames * 70224)
+	{
+		res = diffcheck_step(checker, 0, every, &result);
+		steps++;
+		if (res == DIFFCHECK_DIVERGED)
+		{
+			printf("Difference in %s", result.component);
+			if (strcmp(result.component, "screen") == 0)
+				printf(" at %d,%d", result.addr % 160, result.addr / 160);
+			else if (result.addr != 0)
+				printf(" at $%04X", result.addr);
+			printf(": accurate %X, candidate %X\n", result.accurate, result.candidate);
+			printf("Found at clock %llu (frame %llu, step %llu), the same at clock %llu\n",
+				(unsigned long long)result.clock, (unsigned long long)(result.clock / 70224), (unsigned long long)steps,
+				(unsigned long long)result.last_match_clock);
+			char* names[6] = { "AF", "BC", "DE", "HL", "SP", "PC" };
+			for (int side = 0; side < 2; side++)
+			{
+				printf("\t%s:", side == DIFFCHECK_ACCURATE ? "accurate " : "candidate");
+				for (int r = 0; r < 6; r++)
+					printf(" %s=%04X", names[r], result.regs[side][r]);
+				printf("\n");
+			}
+			if (trace_prefix != NULL)
+				trace_step(checker, trace_prefix);
+			ret = 1;
+		}
+		else if (res != DIFFCHECK_OK)
+		{
+			fprintf(stderr, "Step failed: %d\n", res);
+			ret = 2;
+		}
+	}
+	if (ret == 0)
+		printf("Same for %llu clocks (%llu steps)\n", (unsigned long long)clock_count, (unsigned long long)steps);
+
+	diffcheck_free(checker);
+	gameboy_cart_unload();
+	return ret;
+}
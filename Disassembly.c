@@ -0,0 +1,459 @@
+#include "Disassembly.h"
+#include "Bus.h"
+#include "Sharp_LR35902.h"
+#include "Rom_index.h"
+#include <stdio.h>
+#include <string.h>
+
+// Marks on the ROM bytes
+#define MARK_CODE	(1 << 0)	// An instruction starts here
+#define MARK_LEADER	(1 << 1)	// A block starts here (a target, or the instruction after a branch)
+
+#define DISASM_INITIAL_BANK 1
+#define DISASM_BLOCK_BYTES 13
+
+static const uint8_t disasm_magic[8] = { 'G', 'B', 'C', 'F', 'G', 0, 0, 1 };
+
+// Where code starts: the entry point, the RST vectors and the interrupt routines
+static const uint16_t disasm_entries[] = {
+	0x0100, 0x0000, 0x0008, 0x0010, 0x0018, 0x0020, 0x0028, 0x0030, 0x0038, 0x0040, 0x0048, 0x0050, 0x0058, 0x0060
+};
+
+// Code to follow, with the bank that is selected there
+typedef struct {
+	uint16_t bank;
+	uint16_t addr;
+	uint16_t selected;
+} DISASM_PATH;
+
+typedef struct {
+	uint8_t* rom;
+	size_t size;
+	uint16_t banks;
+	uint8_t* marks;
+	uint16_t* bank0_targets;	// Bank of the target of the jumps in bank 0 to $4000 - $7FFF
+	DISASM_PATH* paths;
+	int path_count;
+	int path_capacity;
+} DISASM_WALK;
+
+
+static long disasm_offset(DISASM_WALK* w, uint16_t bank, uint16_t addr)
+{
+	long offset = addr < 0x4000 ? addr : (long)bank * 0x4000 + (addr - 0x4000);
+	return offset < (long)w->size ? offset : -1;
+}
+
+// Bank of an address the code at bank goes to, DISASM_NO_BANK if it's not in the ROM
+static uint16_t disasm_target_bank(uint16_t bank, uint16_t selected, uint16_t target)
+{
+	if (target >= 0x8000)
+		return DISASM_NO_BANK;
+	if (target < 0x4000)
+		return 0;
+	return bank != 0 ? bank : selected;
+}
+
+// How an instruction changes the flow, DISASM_EXIT_FALL if it doesn't
+static uint8_t disasm_flow(uint8_t* bytes, uint16_t addr, uint16_t* target)
+{
+	uint8_t opcode = bytes[0];
+	switch (opcode)
+	{
+	case 0x18:
+		*target = addr + 2 + (int8_t)bytes[1];
+		return DISASM_EXIT_JUMP;
+	case 0x20: case 0x28: case 0x30: case 0x38:
+		*target = addr + 2 + (int8_t)bytes[1];
+		return DISASM_EXIT_BRANCH;
+	case 0xC3:
+		*target = bytes[1] | (bytes[2] << 8);
+		return DISASM_EXIT_JUMP;
+	case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+		*target = bytes[1] | (bytes[2] << 8);
+		return DISASM_EXIT_BRANCH;
+	case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+		*target = bytes[1] | (bytes[2] << 8);
+		return DISASM_EXIT_CALL;
+	case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+		*target = opcode & 0x38;
+		return DISASM_EXIT_CALL;
+	case 0xC9: case 0xD9:
+		return DISASM_EXIT_RET;
+	case 0xC0: case 0xC8: case 0xD0: case 0xD8:
+		return DISASM_EXIT_RET_COND;
+	case 0xE9:
+		return DISASM_EXIT_INDIRECT;
+	case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+		return DISASM_EXIT_INVALID;
+	default:
+		return DISASM_EXIT_FALL;
+	}
+}
+
+static bool disasm_push(DISASM_WALK* w, uint16_t bank, uint16_t addr, uint16_t selected)
+{
+	long offset = disasm_offset(w, bank, addr);
+	if (offset < 0)
+		return true;
+	w->marks[offset] |= MARK_LEADER;
+	if (w->marks[offset] & MARK_CODE)
+		return true;
+	if (w->path_count == w->path_capacity)
+	{
+		int capacity = w->path_capacity ? w->path_capacity * 2 : 256;
+		DISASM_PATH* paths = realloc(w->paths, capacity * sizeof(DISASM_PATH));
+		if (paths == NULL)
+			return false;
+		w->paths = paths;
+		w->path_capacity = capacity;
+	}
+	w->paths[w->path_count++] = (DISASM_PATH){ bank, addr, selected };
+	return true;
+}
+
+// Mark every instruction the code paths reach
+static bool disasm_follow(DISASM_WALK* w)
+{
+	while (w->path_count > 0)
+	{
+		DISASM_PATH p = w->paths[--w->path_count];
+		bool a_known = false;
+		uint8_t a = 0;
+		while (true)
+		{
+			long offset = disasm_offset(w, p.bank, p.addr);
+			if (offset < 0 || (w->marks[offset] & MARK_CODE))
+				break;
+			uint8_t len = cpu_opcode_length(w->rom[offset]);
+			// Instructions that would run into the next bank end the path
+			if ((p.addr & 0x3FFF) + len > 0x4000 || offset + len > (long)w->size)
+				break;
+			w->marks[offset] |= MARK_CODE;
+			uint8_t* bytes = &w->rom[offset];
+
+			// The ROM bank the code selects, for the jumps from bank 0
+			if (bytes[0] == 0x3E)
+			{
+				a = bytes[1];
+				a_known = true;
+			}
+			else if (bytes[0] == 0xEA && a_known && bytes[2] >= 0x20 && bytes[2] <= 0x3F)
+			{
+				// Like MBC1, bank 0 selects bank 1
+				p.selected = (a & 0x1F) % w->banks;
+				if (p.selected == 0)
+					p.selected = DISASM_INITIAL_BANK;
+			}
+			else if (bytes[0] != 0xE0 && bytes[0] != 0xEA)
+				a_known = false;
+
+			uint16_t target = 0;
+			uint8_t exit = disasm_flow(bytes, p.addr, &target);
+			uint16_t next = p.addr + len;
+			if (exit == DISASM_EXIT_JUMP || exit == DISASM_EXIT_BRANCH || exit == DISASM_EXIT_CALL)
+			{
+				uint16_t target_bank = disasm_target_bank(p.bank, p.selected, target);
+				if (p.bank == 0)
+					w->bank0_targets[offset] = target_bank;
+				if (target_bank != DISASM_NO_BANK && !disasm_push(w, target_bank, target, p.selected))
+					return false;
+			}
+			if (exit == DISASM_EXIT_FALL)
+			{
+				p.addr = next;
+				continue;
+			}
+			// The code after a conditional exit, or after a call returns
+			if (exit == DISASM_EXIT_BRANCH || exit == DISASM_EXIT_CALL || exit == DISASM_EXIT_RET_COND)
+			{
+				if (!disasm_push(w, p.bank, next, p.selected))
+					return false;
+			}
+			break;
+		}
+	}
+	return true;
+}
+
+static int disasm_block_compare(const void* a, const void* b)
+{
+	const DISASM_BLOCK* x = a;
+	const DISASM_BLOCK* y = b;
+	uint32_t kx = (uint32_t)x->bank << 16 | x->addr;
+	uint32_t ky = (uint32_t)y->bank << 16 | y->addr;
+	return kx < ky ? -1 : kx > ky;
+}
+
+// Cut the marked instructions into blocks
+static bool disasm_blocks(DISASM_WALK* w, DISASM_CFG* cfg)
+{
+	int capacity = 0;
+	DISASM_BLOCK* block = NULL;
+	for (long offset = 0; offset < (long)w->size; offset++)
+	{
+		if (!(w->marks[offset] & MARK_CODE))
+			continue;
+		uint16_t bank = offset < 0x4000 ? 0 : (uint16_t)(offset / 0x4000);
+		uint16_t addr = offset < 0x4000 ? (uint16_t)offset : (uint16_t)(0x4000 + offset % 0x4000);
+
+		// A new block at a leader, or where the last one ended
+		if (block == NULL || (w->marks[offset] & MARK_LEADER) || block->exit != DISASM_EXIT_FALL ||
+			block->bank != bank || block->addr + block->size != addr)
+		{
+			if (cfg->count == capacity)
+			{
+				capacity = capacity ? capacity * 2 : 1024;
+				DISASM_BLOCK* blocks = realloc(cfg->blocks, capacity * sizeof(DISASM_BLOCK));
+				if (blocks == NULL)
+					return false;
+				cfg->blocks = blocks;
+			}
+			block = &cfg->blocks[cfg->count++];
+			*block = (DISASM_BLOCK){ bank, addr, 0, 0, DISASM_EXIT_FALL, DISASM_NO_BANK, 0 };
+		}
+
+		uint8_t len = cpu_opcode_length(w->rom[offset]);
+		uint16_t target = 0;
+		block->exit = disasm_flow(&w->rom[offset], addr, &target);
+		block->size += len;
+		block->instructions++;
+		if (block->exit == DISASM_EXIT_JUMP || block->exit == DISASM_EXIT_BRANCH || block->exit == DISASM_EXIT_CALL)
+		{
+			block->target = target;
+			block->target_bank = bank == 0 ? w->bank0_targets[offset] : disasm_target_bank(bank, bank, target);
+		}
+		offset += len - 1;
+
+		// Code that doesn't go on to the next instruction
+		long next = offset + 1;
+		if (block->exit == DISASM_EXIT_FALL && (next >= (long)w->size || next % 0x4000 == 0 || !(w->marks[next] & MARK_CODE)))
+			block->exit = DISASM_EXIT_END;
+	}
+	return true;
+}
+
+uint8_t disasm_analyze(uint8_t* rom, size_t size, DISASM_CFG** cfg)
+{
+	DISASM_WALK w = { 0 };
+	w.rom = rom;
+	w.size = size;
+	w.banks = (uint16_t)((size + 0x3FFF) / 0x4000);
+	if (w.banks < 2)
+		w.banks = 2;
+	w.marks = calloc(size, 1);
+	w.bank0_targets = calloc(0x4000, sizeof(uint16_t));
+	DISASM_CFG* c = calloc(1, sizeof(DISASM_CFG));
+	if (w.marks == NULL || w.bank0_targets == NULL || c == NULL)
+	{
+		free(w.marks);
+		free(w.bank0_targets);
+		free(c);
+		return DISASM_ERR_ALLOC;
+	}
+	c->hash = rom_hash64(rom, size);
+	c->rom_size = (uint32_t)size;
+
+	bool ok = true;
+	for (int i = 0; ok && i < (int)(sizeof(disasm_entries) / sizeof(disasm_entries[0])); i++)
+		ok = disasm_push(&w, 0, disasm_entries[i], DISASM_INITIAL_BANK) && disasm_follow(&w);
+	ok = ok && disasm_blocks(&w, c);
+	free(w.paths);
+	free(w.marks);
+	free(w.bank0_targets);
+	if (!ok)
+	{
+		disasm_free(c);
+		return DISASM_ERR_ALLOC;
+	}
+	qsort(c->blocks, c->count, sizeof(DISASM_BLOCK), disasm_block_compare);
+	*cfg = c;
+	return DISASM_OK;
+}
+
+void disasm_free(DISASM_CFG* cfg)
+{
+	if (cfg == NULL)
+		return;
+	free(cfg->blocks);
+	free(cfg);
+}
+
+DISASM_BLOCK* disasm_block_at(DISASM_CFG* cfg, uint16_t bank, uint16_t addr)
+{
+	if (addr < 0x4000)
+		bank = 0;
+	uint32_t key = (uint32_t)bank << 16 | addr;
+	int lo = 0;
+	int hi = cfg->count - 1;
+	DISASM_BLOCK* found = NULL;
+	// The last block that starts at or before the address
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		DISASM_BLOCK* b = &cfg->blocks[mid];
+		if (((uint32_t)b->bank << 16 | b->addr) <= key)
+		{
+			found = b;
+			lo = mid + 1;
+		}
+		else
+			hi = mid - 1;
+	}
+	if (found == NULL || found->bank != bank || addr >= found->addr + found->size)
+		return NULL;
+	return found;
+}
+
+static void put_le(uint8_t* p, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t get_le(uint8_t* p, int bytes)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= (uint64_t)p[i] << (8 * i);
+	return value;
+}
+
+// File: magic, ROM hash and size, the number of blocks, then the blocks, all little endian
+uint8_t disasm_save(DISASM_CFG* cfg, char* filename)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+		return DISASM_ERR_FILE_OPEN;
+	uint8_t header[24];
+	memcpy(header, disasm_magic, 8);
+	put_le(header + 8, cfg->hash, 8);
+	put_le(header + 16, cfg->rom_size, 4);
+	put_le(header + 20, (uint32_t)cfg->count, 4);
+	bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+	for (int i = 0; ok && i < cfg->count; i++)
+	{
+		DISASM_BLOCK* b = &cfg->blocks[i];
+		uint8_t data[DISASM_BLOCK_BYTES];
+		put_le(data, b->bank, 2);
+		put_le(data + 2, b->addr, 2);
+		put_le(data + 4, b->size, 2);
+		put_le(data + 6, b->instructions, 2);
+		data[8] = b->exit;
+		put_le(data + 9, b->target_bank, 2);
+		put_le(data + 11, b->target, 2);
+		ok = fwrite(data, sizeof(data), 1, file) == 1;
+	}
+	if (fclose(file) != 0)
+		ok = false;
+	return ok ? DISASM_OK : DISASM_ERR_FILE_WRITE;
+}
+
+uint8_t disasm_load(char* filename, uint8_t* rom, size_t size, DISASM_CFG** cfg)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+		return DISASM_ERR_FILE_OPEN;
+	uint8_t header[24];
+	if (fread(header, sizeof(header), 1, file) != 1 || memcmp(header, disasm_magic, 8) != 0)
+	{
+		fclose(file);
+		return DISASM_ERR_FORMAT;
+	}
+	if (get_le(header + 8, 8) != rom_hash64(rom, size) || get_le(header + 16, 4) != size)
+	{
+		fclose(file);
+		return DISASM_ERR_STALE;
+	}
+
+	DISASM_CFG* c = calloc(1, sizeof(DISASM_CFG));
+	uint32_t count = (uint32_t)get_le(header + 20, 4);
+	if (c == NULL || count > size || (count > 0 && (c->blocks = malloc(count * sizeof(DISASM_BLOCK))) == NULL))
+	{
+		free(c);
+		fclose(file);
+		return DISASM_ERR_ALLOC;
+	}
+	c->hash = get_le(header + 8, 8);
+	c->rom_size = (uint32_t)size;
+	c->count = (int)count;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint8_t data[DISASM_BLOCK_BYTES];
+		if (fread(data, sizeof(data), 1, file) != 1)
+		{
+			disasm_free(c);
+			fclose(file);
+			return DISASM_ERR_FILE_READ;
+		}
+		c->blocks[i] = (DISASM_BLOCK){ (uint16_t)get_le(data, 2), (uint16_t)get_le(data + 2, 2),
+			(uint16_t)get_le(data + 4, 2), (uint16_t)get_le(data + 6, 2), data[8],
+			(uint16_t)get_le(data + 9, 2), (uint16_t)get_le(data + 11, 2) };
+	}
+	fclose(file);
+	*cfg = c;
+	return DISASM_OK;
+}
+
+uint8_t disasm_cached(char* cache_dir, uint8_t* rom, size_t size, DISASM_CFG** cfg)
+{
+	if (cache_dir == NULL)
+		return disasm_analyze(rom, size, cfg);
+	char filename[1024];
+	snprintf(filename, sizeof(filename), "%s/%016llx.gbcfg", cache_dir, (unsigned long long)rom_hash64(rom, size));
+	if (disasm_load(filename, rom, size, cfg) == DISASM_OK)
+		return DISASM_OK;
+	uint8_t res = disasm_analyze(rom, size, cfg);
+	if (res != DISASM_OK)
+		return res;
+	// A cache that can't be written only costs the next run the analysis
+	disasm_save(*cfg, filename);
+	return DISASM_OK;
+}
+
+static char* disasm_exit_names[] = {
+	"falls through", "jump", "branch", "call", "return", "conditional return", "indirect jump", "invalid opcode", "end of code"
+};
+
+uint8_t disasm_write_listing(DISASM_CFG* cfg, uint8_t* rom, char* filename)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == NULL)
+		return DISASM_ERR_FILE_OPEN;
+	fprintf(file, "; %d blocks, ROM hash %016llx\n", cfg->count, (unsigned long long)cfg->hash);
+	for (int i = 0; i < cfg->count; i++)
+	{
+		DISASM_BLOCK* b = &cfg->blocks[i];
+		fprintf(file, "\n%02X:%04X:\t\t; %s", b->bank, b->addr, disasm_exit_names[b->exit]);
+		if (b->exit == DISASM_EXIT_JUMP || b->exit == DISASM_EXIT_BRANCH || b->exit == DISASM_EXIT_CALL)
+		{
+			if (b->target_bank == DISASM_NO_BANK)
+				fprintf(file, " to %s:%04X", b->target >= 0x8000 ? "RAM" : "??", b->target);
+			else
+				fprintf(file, " to %02X:%04X", b->target_bank, b->target);
+		}
+		fprintf(file, "\n");
+
+		long offset = b->addr < 0x4000 ? b->addr : (long)b->bank * 0x4000 + (b->addr - 0x4000);
+		uint16_t addr = b->addr;
+		for (int n = 0; n < b->instructions; n++)
+		{
+			char text[160];
+			uint8_t len = disassemble_bytes(&rom[offset], addr, text, sizeof(text));
+			fprintf(file, "\t%04X  ", addr);
+			for (int j = 0; j < 3; j++)
+			{
+				if (j < len)
+					fprintf(file, "%02X ", rom[offset + j]);
+				else
+					fprintf(file, "   ");
+			}
+			fprintf(file, " %s\n", text);
+			offset += len;
+			addr += len;
+		}
+	}
+	if (fclose(file) != 0)
+		return DISASM_ERR_FILE_WRITE;
+	return DISASM_OK;
+}
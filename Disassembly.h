@@ -0,0 +1,83 @@
+#ifndef DISASSEMBLY_CODE
+#define DISASSEMBLY_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Disassembly of the whole ROM
+// Follows the code paths of a ROM image from the entry point ($0100) and the RST and interrupt vectors,
+// through every jump, branch and call target it finds, and splits the code into basic blocks: runs of
+// instructions that are only entered at the top and only leave at the bottom. The bytes come from the
+// image, never from the bus, so it can run without a machine or next to a running one.
+//
+// Addresses are a ROM bank and the address the CPU sees, with the banks numbered like RGBDS does
+// ($0000 - $3FFF is bank 0, ROMX of a 32KB ROM is bank 1). A target in $4000 - $7FFF is in the bank of
+// the code that jumps there. From bank 0 it's in the last bank the code selected with a constant
+// (LD A,n then LD ($2000 - $3FFF),A) on the way there, or bank 1 before any. Code in bank 0 that is
+// reached with different banks selected is only followed with the first one. Jumps to RAM and
+// JP (HL) aren't followed.
+//
+// The analysis is kept in a cache file named after the content hash of the ROM (rom_hash64), so the
+// debugger, the profilers and the tools only do it once per ROM.
+
+#define DISASM_NO_BANK 0xFFFF		// Target outside the ROM
+
+// How a block ends
+enum DISASM_EXITS {
+	DISASM_EXIT_FALL = 0,		// Runs into the block after it
+	DISASM_EXIT_JUMP,			// JP, JR: to target
+	DISASM_EXIT_BRANCH,			// JP cc, JR cc: to target or the block after it
+	DISASM_EXIT_CALL,			// CALL, CALL cc, RST: to target, and back to the block after it
+	DISASM_EXIT_RET,			// RET, RETI
+	DISASM_EXIT_RET_COND,		// RET cc: back, or the block after it
+	DISASM_EXIT_INDIRECT,		// JP (HL)
+	DISASM_EXIT_INVALID,		// An opcode the CPU doesn't have
+	DISASM_EXIT_END				// The code runs past the end of its bank
+};
+
+typedef struct {
+	uint16_t bank;
+	uint16_t addr;
+	uint16_t size;				// Bytes
+	uint16_t instructions;
+	uint8_t exit;				// DISASM_EXITS
+	uint16_t target_bank;		// DISASM_NO_BANK for targets in RAM, and exits without a target
+	uint16_t target;
+} DISASM_BLOCK;
+
+// Blocks by bank and address
+typedef struct {
+	uint64_t hash;
+	uint32_t rom_size;
+	DISASM_BLOCK* blocks;
+	int count;
+} DISASM_CFG;
+
+uint8_t disasm_analyze(uint8_t* rom, size_t size, DISASM_CFG** cfg);
+void disasm_free(DISASM_CFG* cfg);
+
+// Cache files. disasm_load fails with DISASM_ERR_STALE if the file is of another ROM.
+uint8_t disasm_save(DISASM_CFG* cfg, char* filename);
+uint8_t disasm_load(char* filename, uint8_t* rom, size_t size, DISASM_CFG** cfg);
+
+// The analysis from cache_dir, or a new one that is saved there (not saved if cache_dir is NULL)
+uint8_t disasm_cached(char* cache_dir, uint8_t* rom, size_t size, DISASM_CFG** cfg);
+
+// The block an address is in, NULL if it isn't known code
+DISASM_BLOCK* disasm_block_at(DISASM_CFG* cfg, uint16_t bank, uint16_t addr);
+
+// Listing of the blocks with their instructions
+uint8_t disasm_write_listing(DISASM_CFG* cfg, uint8_t* rom, char* filename);
+
+enum DISASM_ERRORS {
+	DISASM_OK = 0,
+	DISASM_ERR_ALLOC,
+	DISASM_ERR_FILE_OPEN,
+	DISASM_ERR_FILE_READ,
+	DISASM_ERR_FILE_WRITE,
+	DISASM_ERR_FORMAT,
+	DISASM_ERR_STALE
+};
+
+#endif // DISASSEMBLY_CODE
@@ -6,16 +6,28 @@
 // Static variables
 
 // DMA register
-static uint8_t DMA = 0x00;
+static GB_INSTANCE uint8_t DMA = 0x00;
 
-static uint16_t RA = 0x0000; // Read address
-static uint16_t WA = 0x0000; // Write address
+static GB_INSTANCE uint16_t RA = 0x0000; // Read address
+static GB_INSTANCE uint16_t WA = 0x0000; // Write address
 
 void dma_clock()
 {
 	dma_write(WA++, dma_read(RA++));
 }
 
+// The bulk transfer copied count bytes itself
+void dma_advance(uint8_t count)
+{
+	RA += count;
+	WA += count;
+}
+
+uint16_t dma_source()
+{
+	return RA;
+}
+
 void dma_reset()
 {
 	RA = 0x0000;
@@ -62,3 +74,20 @@ uint8_t dma_register_read(uint16_t addr)
 	else
 		return 0xFF;
 }
+
+
+void dma_state_save(DMA_STATE* state)
+{
+	if (dma_lazy)
+		bus_dma_sync(clock_count);
+	state->RA = RA;
+	state->WA = WA;
+	state->DMA = DMA;
+}
+
+void dma_state_load(DMA_STATE* state)
+{
+	RA = state->RA;
+	WA = state->WA;
+	DMA = state->DMA;
+}
\ No newline at end of file
@@ -3,6 +3,10 @@
 
 void dma_clock();
 void dma_reset();
+
+// Bulk transfers (GB_FAST_BULK_DMA): the address of the next byte, and moving past the bytes the bus copied
+uint16_t dma_source();
+void dma_advance(uint8_t count);
 void dma_init();
 
 uint8_t dma_read(uint16_t addr);
@@ -10,4 +14,15 @@ uint8_t dma_write(uint16_t addr, uint8_t data);
 uint8_t dma_register_write(uint16_t addr, uint8_t data);
 uint8_t dma_register_read(uint16_t addr);
 
+// Save states
+typedef struct {
+	uint16_t RA;
+	uint16_t WA;
+	uint8_t DMA;
+	uint8_t reserved[3];
+} DMA_STATE;
+
+void dma_state_save(DMA_STATE* state);
+void dma_state_load(DMA_STATE* state);
+
 #endif // #ifndef DMA_CODE
\ No newline at end of file
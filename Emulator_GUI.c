@@ -756,7 +756,10 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
                         WCHAR addr_text[20] = { 0 };
                         addr_text[0] = 20; // Set the first word to the size of the buffer
                         SendMessageW(hwndBreakpointEdit, EM_GETLINE, 0, addr_text);
+                        gameboy_breakpoint_set(breakpoint_addr, false);
                         breakpoint_addr = (uint16_t)wcstol(addr_text, NULL, 16);
+                        if (breakpoint_addr != 0x0000)
+                            gameboy_breakpoint_set(breakpoint_addr, true);
 
                         UpdateInfo(hwnd);
                         break;
@@ -764,6 +767,7 @@ LRESULT CALLBACK MainWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
                     case BREAKPOINT_CLEAR_ID:
                     {
                         // Set the breakpoint address to 0x0000
+                        gameboy_breakpoint_set(breakpoint_addr, false);
                         breakpoint_addr = 0x0000;
 
                         UpdateInfo(hwnd);
@@ -1123,26 +1127,8 @@ void game_pause(HWND hwnd)
 
 void UpdateLCD(HWND hwnd) 
 {
-    uint8_t cycles_left = -1;
-    do
-    {
-        gameboy_mclock();
-        gameboy_cpu_stats(
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            &cycles_left,
-            NULL,
-            NULL,
-            NULL,
-            NULL);
-    } 
-    while (cycles_left != 0);
+    // Run one instruction
+    gameboy_run(0, GB_STOP_INSTRUCTION);
     
     //RenderLCDScreen(hwnd, 4, 100, 30);
 }
@@ -1166,7 +1152,7 @@ void UpdateInfo(HWND hwnd)
     WCHAR fetched_text[80] = { 0 };
     WCHAR flags_text[80] = { 0 };
     WCHAR instruction_text[80] = { 0 };
-    WCHAR disassembly_text[80] = { 0 };
+    char disassembly_text[80] = { 0 };
     uint8_t curr_op = 0;
     uint16_t curr_af = 0, curr_bc = 0, curr_de = 0, curr_hl = 0, curr_sp = 0, curr_pc = 0;
     uint8_t curr_fetched, curr_cb_opcode;
@@ -1186,7 +1172,7 @@ void UpdateInfo(HWND hwnd)
         &curr_cb_opcode,
         &curr_stackbase
     );
-    gameboy_cpu_disassemble_inst(curr_pc, disassembly_text, 150);
+    gameboy_cpu_disassemble_inst(curr_pc, disassembly_text, _countof(disassembly_text));
     StringCchPrintfW(opcode_text, _countof(opcode_text), L"Current executing opcode: 0x%02X, current 0xCB opcode: 0x%02X", curr_op, curr_cb_opcode);
     StringCchPrintfW(regs_16_text, _countof(regs_16_text), L"AF: 0x%04X, BC: 0x%04X, DE: 0x%04X, HL: 0x%04X, SP: 0x%04X, PC: 0x%04X", 
         curr_af, curr_bc, curr_de, curr_hl, curr_sp, curr_pc);
@@ -1197,7 +1183,7 @@ void UpdateInfo(HWND hwnd)
         curr_af & (1 << 7) ? 1 : 0, curr_af & (1 << 6) ? 1 : 0, curr_af & (1 << 5) ? 1 : 0, curr_af & (1 << 4) ? 1 : 0);
     StringCchPrintfW(fetched_text, _countof(fetched_text), L"Fetched: 0x%02X, Fetched-16: 0x%04X", 
         curr_fetched, curr_fetched_16);
-    StringCchPrintfW(instruction_text, _countof(instruction_text), L"Next instruction: %s", disassembly_text);
+    StringCchPrintfW(instruction_text, _countof(instruction_text), L"Next instruction: %hs", disassembly_text);
 
     ExtTextOutW(
         hdc,
@@ -1713,51 +1699,16 @@ DWORD WINAPI game_play(HWND hwnd)
     SetWaitableTimer(hTimer, &liDueTime, 0, NULL, NULL, FALSE);
     
 
-    uint16_t current_pc = 0x0000;
-    uint8_t curr_stat = 0x02;
-    while (!bPause && ((current_pc != breakpoint_addr) || current_pc == 0))
+    while (!bPause)
     {
-        UpdateLCD(hwnd);
-        gameboy_cpu_stats(
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            &current_pc,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL
-        );
-
-        // Get PPU stats
-        uint8_t past_stat = curr_stat;
-        gameboy_ppu_stats(
-            NULL,
-            &curr_stat,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL
-        );
+        // Run a frame (a frame's worth of clocks while the LCD is off), unless a breakpoint comes first
+        if (gameboy_run(70224, GB_STOP_FRAME | GB_STOP_BREAKPOINT) == GB_STOP_BREAKPOINT)
+            break;
 
         // When screen buffer is full, display frame and wait for 1/5 sec to pass since the time captured
-        if (((curr_stat & 0x03) == 1) && ((past_stat & 0x03) != 1)) 
-        {
-            RenderLCDScreen(hwnd, screen_buffer, 4, 100, 30);
-            WaitForSingleObject(hTimer, 17);
-            SetWaitableTimer(hTimer, &liDueTime, 0, NULL, NULL, FALSE);
-        }
-        
+        RenderLCDScreen(hwnd, screen_buffer, 4, 100, 30);
+        WaitForSingleObject(hTimer, 17);
+        SetWaitableTimer(hTimer, &liDueTime, 0, NULL, NULL, FALSE);
     }
     CloseHandle(hTimer);
     if (bStop)
@@ -1773,51 +1724,9 @@ DWORD WINAPI game_play(HWND hwnd)
 
 DWORD WINAPI game_step_frame(HWND hwnd)
 {
-    uint16_t current_pc = 0x0000;
-    uint8_t curr_stat = 0x01;
-    while (!bPause && ((current_pc != breakpoint_addr) || current_pc == 0))
-    {
-        gameboy_clock();
-        gameboy_cpu_stats(
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            &current_pc,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL
-        );
-
-        // Get PPU stats
-        uint8_t past_stat = curr_stat;
-        gameboy_ppu_stats(
-            NULL,
-            &curr_stat,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL,
-            NULL
-        );
-
-        // When screen buffer is full, display frame and wait for 1/5 sec to pass since the time captured
-        if (((curr_stat & 0x03) == 1) && ((past_stat & 0x03) != 1))
-        {
-            RenderLCDScreen(hwnd, screen_buffer, 4, 100, 30);
-            break;
-        }
-
-    }
+    // Run to the end of the frame, unless a breakpoint comes first
+    if (gameboy_run(70224, GB_STOP_FRAME | GB_STOP_BREAKPOINT) == GB_STOP_FRAME)
+        RenderLCDScreen(hwnd, screen_buffer, 4, 100, 30);
     game_pause(hwnd);
     UpdateInfo(hwnd);
     return 0;
@@ -0,0 +1,187 @@
+#include "Bus.h"
+#include "Fork.h"
+
+// Taking a fork saves the machine into a scratch buffer (a few microseconds) and compares it page by page
+// with the base, the last fork taken or loaded. Only the pages that differ are copied. Comparing instead
+// of tracking the writes keeps the bus untouched, and catches the pages that changed back too.
+// Freed pages go to a free list, so a search that keeps creating and dropping forks doesn't hit malloc.
+#define FORK_PAGE_SIZE 256
+#define FORK_MAX_FREE_PAGES 4096
+
+typedef struct FORK_PAGE {
+	struct FORK_PAGE* next_free;
+	int refs;
+	uint8_t data[FORK_PAGE_SIZE];
+} FORK_PAGE;
+
+struct MACHINE_FORK {
+	size_t size;
+	int page_count;
+	FORK_PAGE** pages;
+};
+
+static GB_INSTANCE uint8_t* scratch = NULL;
+static GB_INSTANCE size_t scratch_size = 0;
+static GB_INSTANCE MACHINE_FORK base = { 0, 0, NULL };
+static GB_INSTANCE FORK_PAGE* free_pages = NULL;
+static GB_INSTANCE int free_count = 0;
+
+static FORK_PAGE* page_alloc()
+{
+	FORK_PAGE* page = free_pages;
+	if (page != NULL)
+	{
+		free_pages = page->next_free;
+		free_count--;
+	}
+	else
+		page = (FORK_PAGE*)malloc(sizeof(FORK_PAGE));
+	if (page != NULL)
+		page->refs = 1;
+	return page;
+}
+
+static void page_release(FORK_PAGE* page)
+{
+	if (--page->refs > 0)
+		return;
+	if (free_count < FORK_MAX_FREE_PAGES)
+	{
+		page->next_free = free_pages;
+		free_pages = page;
+		free_count++;
+	}
+	else
+		free(page);
+}
+
+static void pages_release(MACHINE_FORK* fork)
+{
+	for (int i = 0; i < fork->page_count; i++)
+		page_release(fork->pages[i]);
+}
+
+// Makes the fork the base of the next fork
+static void base_set(MACHINE_FORK* fork)
+{
+	pages_release(&base);
+	if (base.page_count != fork->page_count)
+	{
+		free(base.pages);
+		base.pages = (FORK_PAGE**)malloc(fork->page_count * sizeof(FORK_PAGE*));
+		if (base.pages == NULL)
+		{
+			// No base, the next fork copies everything
+			base.size = 0;
+			base.page_count = 0;
+			return;
+		}
+	}
+	base.size = fork->size;
+	base.page_count = fork->page_count;
+	for (int i = 0; i < fork->page_count; i++)
+	{
+		base.pages[i] = fork->pages[i];
+		base.pages[i]->refs++;
+	}
+}
+
+// Scratch big enough for whole pages, the tail of the last page stays zero
+static bool scratch_reserve(int page_count)
+{
+	size_t size = (size_t)page_count * FORK_PAGE_SIZE;
+	if (scratch_size >= size)
+		return true;
+	uint8_t* grown = (uint8_t*)realloc(scratch, size);
+	if (grown == NULL)
+		return false;
+	memset(grown + scratch_size, 0, size - scratch_size);
+	scratch = grown;
+	scratch_size = size;
+	return true;
+}
+
+uint8_t fork_create(MACHINE_FORK** fork)
+{
+	size_t size = gameboy_state_size();
+	int page_count = (int)((size + FORK_PAGE_SIZE - 1) / FORK_PAGE_SIZE);
+	if (!scratch_reserve(page_count))
+		return FORK_ERR_ALLOC;
+	memset(scratch + size, 0, (size_t)page_count * FORK_PAGE_SIZE - size);
+	gameboy_state_save(scratch, size);
+
+	MACHINE_FORK* new_fork = (MACHINE_FORK*)malloc(sizeof(MACHINE_FORK));
+	if (new_fork == NULL)
+		return FORK_ERR_ALLOC;
+	new_fork->pages = (FORK_PAGE**)malloc(page_count * sizeof(FORK_PAGE*));
+	if (new_fork->pages == NULL)
+	{
+		free(new_fork);
+		return FORK_ERR_ALLOC;
+	}
+	new_fork->size = size;
+	new_fork->page_count = 0;
+
+	bool same_layout = base.size == size;
+	for (int i = 0; i < page_count; i++)
+	{
+		uint8_t* data = scratch + (size_t)i * FORK_PAGE_SIZE;
+		FORK_PAGE* page = same_layout ? base.pages[i] : NULL;
+		if (page != NULL && memcmp(page->data, data, FORK_PAGE_SIZE) == 0)
+			page->refs++;
+		else
+		{
+			page = page_alloc();
+			if (page == NULL)
+			{
+				fork_free(new_fork);
+				return FORK_ERR_ALLOC;
+			}
+			memcpy(page->data, data, FORK_PAGE_SIZE);
+		}
+		new_fork->pages[i] = page;
+		new_fork->page_count++;
+	}
+
+	base_set(new_fork);
+	*fork = new_fork;
+	return FORK_OK;
+}
+
+uint8_t fork_load(MACHINE_FORK* fork)
+{
+	if (!scratch_reserve(fork->page_count))
+		return FORK_ERR_ALLOC;
+	for (int i = 0; i < fork->page_count; i++)
+		memcpy(scratch + (size_t)i * FORK_PAGE_SIZE, fork->pages[i]->data, FORK_PAGE_SIZE);
+	if (gameboy_state_load(scratch, fork->size) != STATE_OK)
+		return FORK_ERR_STATE;
+
+	base_set(fork);
+	return FORK_OK;
+}
+
+void fork_free(MACHINE_FORK* fork)
+{
+	if (fork == NULL)
+		return;
+	pages_release(fork);
+	free(fork->pages);
+	free(fork);
+}
+
+void fork_pages(MACHINE_FORK* fork, int* total, int* shared)
+{
+	*total = fork->page_count;
+	*shared = 0;
+	for (int i = 0; i < fork->page_count; i++)
+	{
+		// The base's own reference doesn't count
+		FORK_PAGE* page = fork->pages[i];
+		int refs = page->refs;
+		if (i < base.page_count && base.pages[i] == page)
+			refs--;
+		if (refs > 1)
+			(*shared)++;
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef FORK_CODE
+#define FORK_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Forks of the running machine.
+// A fork is a save state split into pages. The pages are reference counted and shared between forks: when a
+// fork is taken, every page that is the same as in the last fork taken or loaded is shared instead of copied,
+// so a fork only pays for the memory that changed since. The ROM is never part of a fork.
+typedef struct MACHINE_FORK MACHINE_FORK;
+
+uint8_t fork_create(MACHINE_FORK** fork);
+uint8_t fork_load(MACHINE_FORK* fork);
+void fork_free(MACHINE_FORK* fork);
+
+// Pages of a fork, and how many of them are shared with other forks
+void fork_pages(MACHINE_FORK* fork, int* total, int* shared);
+
+enum FORK_ERRORS {
+	FORK_OK = 0,
+	FORK_ERR_ALLOC,
+	FORK_ERR_STATE
+};
+
+#endif // FORK_CODE
@@ -0,0 +1,286 @@
+#include "Guest_profile.h"
+#include "Cartridge.h"
+#include <stdio.h>
+#include <string.h>
+
+// Deepest call stack that is followed, calls below it are charged to the function at the limit
+#define GPROF_MAX_DEPTH 256
+#define GPROF_ROOT 0
+
+// A node of the call tree: one function, reached through one path of calls
+typedef struct {
+	uint32_t key;			// ROM bank << 16 | entry address
+	uint32_t parent;
+	uint32_t first_child;	// GPROF_ROOT - none (the root is never a child)
+	uint32_t next_sibling;
+	uint64_t clocks;		// Clocks spent in this function itself
+} GPROF_NODE;
+
+typedef struct {
+	uint32_t node;
+	uint16_t return_sp;		// SP before the return address was pushed, the frame is gone once SP is back there
+} GPROF_FRAME;
+
+typedef struct {
+	uint32_t key;
+	char* name;
+} GPROF_SYMBOL;
+
+GB_INSTANCE bool gprof_enabled = false;
+
+static GB_INSTANCE GPROF_NODE* nodes = NULL;
+static GB_INSTANCE uint32_t node_count = 0;
+static GB_INSTANCE uint32_t node_capacity = 0;
+
+static GB_INSTANCE GPROF_FRAME stack[GPROF_MAX_DEPTH];
+static GB_INSTANCE int depth = 0;
+static GB_INSTANCE uint64_t last_clock = 0;		// Clocks up to here are charged already
+
+static GB_INSTANCE GPROF_SYMBOL* symbols = NULL;
+static GB_INSTANCE int symbol_count = 0;
+
+
+static uint32_t gprof_current()
+{
+	return depth ? stack[depth - 1].node : GPROF_ROOT;
+}
+
+// Charge the clocks up to clock (the end of the instruction that's running) to the current function
+static void gprof_charge(uint64_t clock)
+{
+	if (clock > last_clock)
+	{
+		nodes[gprof_current()].clocks += clock - last_clock;
+		last_clock = clock;
+	}
+}
+
+static uint32_t gprof_child(uint32_t parent, uint32_t key)
+{
+	for (uint32_t i = nodes[parent].first_child; i != GPROF_ROOT; i = nodes[i].next_sibling)
+	{
+		if (nodes[i].key == key)
+			return i;
+	}
+
+	if (node_count == node_capacity)
+	{
+		uint32_t capacity = node_capacity * 2;
+		GPROF_NODE* grown = (GPROF_NODE*)realloc(nodes, capacity * sizeof(GPROF_NODE));
+		if (grown == NULL)
+			return parent;	// Out of memory, keep charging the caller
+		nodes = grown;
+		node_capacity = capacity;
+	}
+
+	GPROF_NODE* node = &nodes[node_count];
+	node->key = key;
+	node->parent = parent;
+	node->first_child = GPROF_ROOT;
+	node->next_sibling = nodes[parent].first_child;
+	node->clocks = 0;
+	nodes[parent].first_child = node_count;
+	return node_count++;
+}
+
+static void gprof_push(uint16_t target, uint16_t return_sp, uint64_t clock)
+{
+	gprof_charge(clock);
+	if (depth == GPROF_MAX_DEPTH)
+		return;
+	uint32_t key = ((uint32_t)cart_mapper_rom_bank(target) << 16) | target;
+	stack[depth].node = gprof_child(gprof_current(), key);
+	stack[depth].return_sp = return_sp;
+	depth++;
+}
+
+uint8_t gprof_start()
+{
+	if (nodes == NULL)
+	{
+		node_capacity = 1024;
+		nodes = (GPROF_NODE*)malloc(node_capacity * sizeof(GPROF_NODE));
+		if (nodes == NULL)
+		{
+			node_capacity = 0;
+			return GPROF_ERR_ALLOC;
+		}
+	}
+	memset(&nodes[GPROF_ROOT], 0, sizeof(GPROF_NODE));
+	node_count = 1;
+	depth = 0;
+	last_clock = clock_count;
+	gprof_enabled = true;
+	return GPROF_OK;
+}
+
+void gprof_stop()
+{
+	if (gprof_enabled)
+		gprof_charge(clock_count);
+	gprof_enabled = false;
+}
+
+void gprof_instruction(uint8_t opcode, uint16_t old_sp, uint16_t sp, uint16_t pc, uint8_t cycles_left)
+{
+	uint64_t clock = clock_count + 4 * (uint64_t)cycles_left;
+	switch (opcode)
+	{
+		case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC:		// CALL
+		case 0xC7: case 0xCF: case 0xD7: case 0xDF:					// RST
+		case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+			// Not taken if nothing was pushed
+			if (sp == (uint16_t)(old_sp - 2))
+				gprof_push(pc, old_sp, clock);
+			break;
+		case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9:	// RET, RETI
+			if (sp == (uint16_t)(old_sp + 2))
+			{
+				// Also drops the frames of functions that left through a jump
+				gprof_charge(clock);
+				while (depth > 0 && stack[depth - 1].return_sp <= sp)
+					depth--;
+			}
+			break;
+	}
+}
+
+void gprof_interrupt(uint16_t vector, uint16_t return_sp, uint8_t cycles_left)
+{
+	gprof_push(vector, return_sp, clock_count + 4 * (uint64_t)cycles_left);
+}
+
+
+// Symbols
+
+static int symbol_compare(const void* a, const void* b)
+{
+	uint32_t ka = ((const GPROF_SYMBOL*)a)->key;
+	uint32_t kb = ((const GPROF_SYMBOL*)b)->key;
+	return ka < kb ? -1 : ka > kb ? 1 : 0;
+}
+
+static void gprof_free_symbols()
+{
+	for (int i = 0; i < symbol_count; i++)
+		free(symbols[i].name);
+	free(symbols);
+	symbols = NULL;
+	symbol_count = 0;
+}
+
+uint8_t gprof_load_symbols(char* filename)
+{
+	FILE* file = fopen(filename, "r");
+	if (file == NULL)
+		return GPROF_ERR_FILE_OPEN;
+
+	gprof_free_symbols();
+	int capacity = 0;
+	char line[512];
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		unsigned int bank, addr;
+		char name[256];
+		char* comment = strchr(line, ';');
+		if (comment != NULL)
+			*comment = '\0';
+		if (sscanf(line, "%x:%x %255s", &bank, &addr, name) != 3 || addr > 0xFFFF)
+			continue;
+
+		if (symbol_count == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 256;
+			GPROF_SYMBOL* grown = (GPROF_SYMBOL*)realloc(symbols, capacity * sizeof(GPROF_SYMBOL));
+			if (grown == NULL)
+			{
+				fclose(file);
+				gprof_free_symbols();
+				return GPROF_ERR_ALLOC;
+			}
+			symbols = grown;
+		}
+		// Only the ROM is banked for the profiler, RAM symbols of any bank match their address
+		symbols[symbol_count].key = addr <= 0x7FFF ? ((bank & 0xFFFF) << 16) | addr : addr;
+		symbols[symbol_count].name = (char*)malloc(strlen(name) + 1);
+		if (symbols[symbol_count].name == NULL)
+		{
+			fclose(file);
+			gprof_free_symbols();
+			return GPROF_ERR_ALLOC;
+		}
+		strcpy(symbols[symbol_count].name, name);
+		symbol_count++;
+	}
+	fclose(file);
+
+	qsort(symbols, symbol_count, sizeof(GPROF_SYMBOL), symbol_compare);
+	return GPROF_OK;
+}
+
+static void gprof_name(uint32_t key, char* name, int len)
+{
+	if ((key & 0xFFFF) > 0x7FFF)
+		key &= 0xFFFF;
+	GPROF_SYMBOL wanted = { key, NULL };
+	GPROF_SYMBOL* symbol = (GPROF_SYMBOL*)bsearch(&wanted, symbols, symbol_count, sizeof(GPROF_SYMBOL), symbol_compare);
+	if (symbol != NULL)
+		snprintf(name, len, "%s", symbol->name);
+	else
+		snprintf(name, len, "%02X:%04X", key >> 16, key & 0xFFFF);
+}
+
+
+// Folded stacks
+
+// Writes the lines of node and everything under it, path holds the names from the root down to the parent
+static bool gprof_write_node(FILE* file, uint32_t node, char* path, size_t path_len, size_t path_size)
+{
+	char name[64];
+	if (node == GPROF_ROOT)
+		snprintf(name, sizeof(name), "[root]");
+	else
+		gprof_name(nodes[node].key, name, sizeof(name));
+
+	size_t name_len = strlen(name);
+	if (path_len + name_len + 2 > path_size)
+		return true;	// Can't happen with GPROF_MAX_DEPTH, but never overflow
+	if (path_len)
+		path[path_len++] = ';';
+	memcpy(path + path_len, name, name_len + 1);
+	path_len += name_len;
+
+	if (nodes[node].clocks && fprintf(file, "%s %llu\n", path, (unsigned long long)nodes[node].clocks) < 0)
+		return false;
+	for (uint32_t i = nodes[node].first_child; i != GPROF_ROOT; i = nodes[i].next_sibling)
+	{
+		if (!gprof_write_node(file, i, path, path_len, path_size))
+			return false;
+	}
+	return true;
+}
+
+uint8_t gprof_write_folded(char* filename)
+{
+	if (node_count == 0)
+		return GPROF_ERR_NOT_STARTED;
+	if (gprof_enabled)
+		gprof_charge(clock_count);
+
+	FILE* file = fopen(filename, "w");
+	if (file == NULL)
+		return GPROF_ERR_FILE_OPEN;
+
+	size_t path_size = (GPROF_MAX_DEPTH + 1) * 64;
+	char* path = (char*)malloc(path_size);
+	if (path == NULL)
+	{
+		fclose(file);
+		return GPROF_ERR_ALLOC;
+	}
+	bool ok = gprof_write_node(file, GPROF_ROOT, path, 0, path_size);
+	free(path);
+	if (fclose(file) != 0 || !ok)
+		return GPROF_ERR_FILE_WRITE;
+	return GPROF_OK;
+}
@@ -0,0 +1,45 @@
+#ifndef GUEST_PROFILE_CODE
+#define GUEST_PROFILE_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Bus.h"
+
+// Guest profiler
+// Follows the emulated call stack (CALL, RST, RET, RETI and the interrupt entries) and charges every
+// clock to the function on top of it. A function is its entry point, as (ROM bank, address), so the same
+// address in two banks is two functions. The result is written as folded stacks ("a;b;c clocks" lines),
+// the input format of flamegraph.pl, inferno and speedscope.
+// Names come from an RGBDS .sym file when one is loaded, the rest show up as BB:AAAA.
+// When it's not running the CPU only checks gprof_enabled once per instruction.
+
+// Is the profiler running? Checked by the CPU before calling the hooks.
+extern GB_INSTANCE bool gprof_enabled;
+
+// Start a new profile from the current clock (the current call stack is unknown, so it starts at the root)
+uint8_t gprof_start();
+void gprof_stop();
+
+// Load names from an RGBDS .sym file ("BB:AAAA Name" lines, ';' starts a comment)
+uint8_t gprof_load_symbols(char* filename);
+
+// Write the folded stacks of the current profile
+uint8_t gprof_write_folded(char* filename);
+
+// CPU hooks
+// Called on the first M-cycle of an instruction, after it ran: its opcode, SP before and after it, the new PC
+// and the M-cycles it has left (they belong to it, so a CALL's cycles are the caller's)
+void gprof_instruction(uint8_t opcode, uint16_t old_sp, uint16_t sp, uint16_t pc, uint8_t cycles_left);
+// After an interrupt entry pushed the return address: the vector, SP before the push and the M-cycles left
+void gprof_interrupt(uint16_t vector, uint16_t return_sp, uint8_t cycles_left);
+
+enum GPROF_ERRORS {
+	GPROF_OK = 0,
+	GPROF_ERR_ALLOC,
+	GPROF_ERR_FILE_OPEN,
+	GPROF_ERR_FILE_WRITE,
+	GPROF_ERR_NOT_STARTED
+};
+
+#endif // GUEST_PROFILE_CODE
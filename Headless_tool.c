@@ -0,0 +1,252 @@
+#include "Bus.h"
+#include "Cartridge.h"
+#include "Movie.h"
+#include "Guest_profile.h"
+#include "Disassembly.h"
+#include "Host_timing.h"
+#include "Trace.h"
+#include "Rom_index.h"
+#include "Recompiler.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <string.h>
+
+// Headless runner, the core without the GUI
+//	gbrun <rom> [-frames N | -cycles N] [-movie file] [-screen file] [-ram file] [-profile file [-sym file]] [-timing file] [-trace file]
+//		[-disasm file [-cache dir]] [-recomp file] [-report]
+// Runs as fast as it can, without pacing to the real frame rate.
+//	-frames:	frames to run (default 60)
+//	-cycles:	clocks (T-cycles) to run instead of frames
+//	-movie:		input movie to play
+//	-screen:	the last frame, binary PPM
+//	-ram:		WRAM followed by the cartridge RAM at the end of the run
+//	-profile:	guest profile of the run, as folded stacks (flamegraph.pl, inferno, speedscope)
+//	-sym:		RGBDS symbol file for the profile's function names
+//	-timing:	host time of the CPU, DMA, timer, PPU and bus per frame, JSON if the name ends with .json, else CSV
+//	-trace:		execution trace of the run, see gbtrace
+//	-disasm:	listing of the code of the whole ROM, written before the run
+//	-cache:		directory the disassembly is cached in
+//	-recomp:	recompiled code of the ROM to run (gbrecomp), only load modules you built yourself
+//	-report:	timing report on stdout
+
+#define CPU_HZ 4194304.0
+
+static int usage()
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "\tgbrun <rom> [-frames N | -cycles N] [-movie file] [-screen file] [-ram file] [-profile file [-sym file]] [-timing file] [-trace file]\n");
+	fprintf(stderr, "\t\t[-disasm file [-cache dir]] [-recomp file] [-report]\n");
+	return 1;
+}
+
+static bool write_screen(char* filename)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+		return false;
+	uint32_t* screen = gameboy_get_screen();
+	uint8_t row[160 * 3];
+	bool ok = fprintf(file, "P6\n160 144\n255\n") > 0;
+	for (int y = 0; ok && y < 144; y++)
+	{
+		// Screen pixels are 0x00BBGGRR
+		for (int x = 0; x < 160; x++)
+		{
+			uint32_t pixel = screen[y * 160 + x];
+			row[x * 3] = (uint8_t)pixel;
+			row[x * 3 + 1] = (uint8_t)(pixel >> 8);
+			row[x * 3 + 2] = (uint8_t)(pixel >> 16);
+		}
+		ok = fwrite(row, 1, sizeof row, file) == sizeof row;
+	}
+	if (fclose(file) != 0)
+		ok = false;
+	return ok;
+}
+
+static bool write_ram(char* filename)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+		return false;
+	BUS_STATE bus;
+	bus_state_save(&bus);
+	bool ok = fwrite(bus.wram, 1, sizeof bus.wram, file) == sizeof bus.wram;
+	uint8_t* cart_rom;
+	uint8_t* cart_ram = NULL;
+	int cart_rom_size;
+	int cart_ram_size = 0;
+	if (ok && cart_mapper_get_memory(&cart_rom, &cart_rom_size, &cart_ram, &cart_ram_size) == 0 && cart_ram != NULL)
+		ok = fwrite(cart_ram, 1, cart_ram_size, file) == (size_t)cart_ram_size;
+	if (fclose(file) != 0)
+		ok = false;
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+		return usage();
+	uint64_t frames = 60;
+	uint64_t cycles = 0;
+	char* movie = NULL;
+	char* screen_out = NULL;
+	char* ram_out = NULL;
+	char* profile_out = NULL;
+	char* sym = NULL;
+	char* timing_out = NULL;
+	char* trace_out = NULL;
+	char* disasm_out = NULL;
+	char* cache_dir = NULL;
+	char* recomp = NULL;
+	bool report = false;
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-report") == 0)
+			report = true;
+		else if (i + 1 >= argc)
+			return usage();
+		else if (strcmp(argv[i], "-frames") == 0)
+		{
+			frames = strtoull(argv[++i], NULL, 0);
+			cycles = 0;
+		}
+		else if (strcmp(argv[i], "-cycles") == 0)
+			cycles = strtoull(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-movie") == 0)
+			movie = argv[++i];
+		else if (strcmp(argv[i], "-screen") == 0)
+			screen_out = argv[++i];
+		else if (strcmp(argv[i], "-ram") == 0)
+			ram_out = argv[++i];
+		else if (strcmp(argv[i], "-profile") == 0)
+			profile_out = argv[++i];
+		else if (strcmp(argv[i], "-sym") == 0)
+			sym = argv[++i];
+		else if (strcmp(argv[i], "-timing") == 0)
+			timing_out = argv[++i];
+		else if (strcmp(argv[i], "-trace") == 0)
+			trace_out = argv[++i];
+		else if (strcmp(argv[i], "-disasm") == 0)
+			disasm_out = argv[++i];
+		else if (strcmp(argv[i], "-cache") == 0)
+			cache_dir = argv[++i];
+		else if (strcmp(argv[i], "-recomp") == 0)
+			recomp = argv[++i];
+		else
+			return usage();
+	}
+
+	uint8_t res = gameboy_cart_load(argv[1]);
+	if (res != 0)
+	{
+		fprintf(stderr, "Loading the cartridge failed: %d\n", res);
+		return 1;
+	}
+	if (recomp != NULL && (res = gameboy_recomp_load(recomp)) != RECOMP_OK)
+	{
+		fprintf(stderr, "Loading the recompiled code failed: %d\n", res);
+		gameboy_cart_unload();
+		return 1;
+	}
+	gameboy_reset(true);
+	if (disasm_out != NULL && (res = gameboy_disassemble(cache_dir, disasm_out)) != DISASM_OK)
+		fprintf(stderr, "Disassembling the ROM failed: %d\n", res);
+	if (movie != NULL && (res = gameboy_movie_play(movie)) != MOVIE_OK)
+	{
+		fprintf(stderr, "Playing the movie failed: %d\n", res);
+		gameboy_cart_unload();
+		return 1;
+	}
+	if (profile_out != NULL)
+	{
+		if (sym != NULL && (res = gameboy_profile_load_symbols(sym)) != GPROF_OK)
+			fprintf(stderr, "Loading the symbols failed: %d\n", res);
+		if ((res = gameboy_profile_start()) != GPROF_OK)
+		{
+			fprintf(stderr, "Starting the profiler failed: %d\n", res);
+			gameboy_movie_stop();
+			gameboy_cart_unload();
+			return 1;
+		}
+	}
+
+	if (timing_out != NULL && (res = gameboy_timing_start(frames > 0 && cycles == 0 ? (int)frames : 100000)) != HTIME_OK)
+	{
+		fprintf(stderr, "Starting the host timing failed: %d\n", res);
+		gameboy_movie_stop();
+		gameboy_cart_unload();
+		return 1;
+	}
+	if (trace_out != NULL && (res = gameboy_trace_start(trace_out, 16)) != TRACE_OK)
+	{
+		fprintf(stderr, "Starting the trace failed: %d\n", res);
+		gameboy_movie_stop();
+		gameboy_cart_unload();
+		return 1;
+	}
+
+	uint64_t start = platform_time_ns();
+	if (cycles > 0)
+	{
+		for (uint64_t i = 0; i < cycles; i++)
+			gameboy_clock();
+	}
+	else
+	{
+		for (uint64_t f = 0; f < frames; f++)
+			gameboy_run_frame();
+	}
+	uint64_t run_ns = platform_time_ns() - start;
+	if (profile_out != NULL)
+		gameboy_profile_stop();
+	if (timing_out != NULL)
+		gameboy_timing_stop();
+
+	int failed = 0;
+	if (trace_out != NULL && (res = gameboy_trace_stop()) != TRACE_OK)
+	{
+		fprintf(stderr, "Writing %s failed: %d\n", trace_out, res);
+		failed++;
+	}
+	if (screen_out != NULL && !write_screen(screen_out))
+	{
+		fprintf(stderr, "Writing %s failed\n", screen_out);
+		failed++;
+	}
+	if (ram_out != NULL && !write_ram(ram_out))
+	{
+		fprintf(stderr, "Writing %s failed\n", ram_out);
+		failed++;
+	}
+	if (profile_out != NULL && gameboy_profile_write(profile_out) != GPROF_OK)
+	{
+		fprintf(stderr, "Writing %s failed\n", profile_out);
+		failed++;
+	}
+	if (timing_out != NULL)
+	{
+		size_t len = strlen(timing_out);
+		uint8_t format = len >= 5 && strcmp(timing_out + len - 5, ".json") == 0 ? HTIME_JSON : HTIME_CSV;
+		if (gameboy_timing_write(timing_out, format) != HTIME_OK)
+		{
+			fprintf(stderr, "Writing %s failed\n", timing_out);
+			failed++;
+		}
+	}
+	if (report)
+	{
+		double seconds = run_ns / 1e9;
+		printf("frames %llu\n", (unsigned long long)frame_count);
+		printf("clocks %llu\n", (unsigned long long)clock_count);
+		printf("run_ms %.3f\n", run_ns / 1e6);
+		printf("emulated_mhz %.3f\n", seconds > 0 ? clock_count / seconds / 1e6 : 0.0);
+		printf("fps %.1f\n", seconds > 0 ? frame_count / seconds : 0.0);
+		printf("speed %.2fx\n", seconds > 0 ? clock_count / CPU_HZ / seconds : 0.0);
+		printf("screen_hash %016llx\n", (unsigned long long)rom_hash64((uint8_t*)gameboy_get_screen(), 160 * 144 * sizeof(uint32_t)));
+	}
+
+	gameboy_movie_stop();
+	gameboy_cart_unload();
+	return failed ? 1 : 0;
+}
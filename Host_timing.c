@@ -0,0 +1,152 @@
+#include "Host_timing.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char* counter_names[HTIME_COUNTERS] = { "cpu", "dma", "timer", "ppu", "bus" };
+
+GB_INSTANCE bool htime_enabled = false;
+GB_INSTANCE uint64_t htime_ticks[HTIME_COUNTERS];
+
+// Ring of the last frames
+static GB_INSTANCE HTIME_FRAME* frames = NULL;
+static GB_INSTANCE int frames_kept = 0;
+static GB_INSTANCE int frames_used = 0;
+static GB_INSTANCE int frames_next = 0;
+
+static GB_INSTANCE HTIME_FRAME totals;
+static GB_INSTANCE uint64_t last_frame_tick = 0;
+static GB_INSTANCE uint64_t last_frame_clock = 0;
+
+// For converting the ticks to time
+static GB_INSTANCE uint64_t start_tick = 0;
+static GB_INSTANCE uint64_t start_ns = 0;
+
+
+uint8_t htime_start(int kept)
+{
+	if (kept < 1)
+		kept = 1;
+	HTIME_FRAME* ring = (HTIME_FRAME*)calloc(kept, sizeof(HTIME_FRAME));
+	if (ring == NULL)
+		return HTIME_ERR_ALLOC;
+
+	free(frames);
+	frames = ring;
+	frames_kept = kept;
+	frames_used = 0;
+	frames_next = 0;
+	memset(&totals, 0, sizeof totals);
+	memset(htime_ticks, 0, sizeof htime_ticks);
+	last_frame_clock = clock_count;
+	start_ns = platform_time_ns();
+	start_tick = HTIME_NOW();
+	last_frame_tick = start_tick;
+	htime_enabled = true;
+	return HTIME_OK;
+}
+
+void htime_stop()
+{
+	// The frames are kept for reading them
+	htime_enabled = false;
+}
+
+void htime_frame()
+{
+	uint64_t now = HTIME_NOW();
+	HTIME_FRAME* frame = &frames[frames_next];
+	frame->frame = frame_count;
+	frame->clocks = clock_count - last_frame_clock;
+	frame->wall = now - last_frame_tick;
+	memcpy(frame->ticks, htime_ticks, sizeof htime_ticks);
+
+	totals.frame = frame_count;
+	totals.clocks += frame->clocks;
+	totals.wall += frame->wall;
+	for (int i = 0; i < HTIME_COUNTERS; i++)
+		totals.ticks[i] += htime_ticks[i];
+
+	memset(htime_ticks, 0, sizeof htime_ticks);
+	last_frame_clock = clock_count;
+	last_frame_tick = now;
+	frames_next = (frames_next + 1) % frames_kept;
+	if (frames_used < frames_kept)
+		frames_used++;
+}
+
+int htime_frames()
+{
+	return frames_used;
+}
+
+uint8_t htime_frame_get(int index, HTIME_FRAME* frame)
+{
+	if (index < 0 || index >= frames_used)
+		return HTIME_ERR_INDEX;
+	*frame = frames[(frames_next - frames_used + index + frames_kept) % frames_kept];
+	return HTIME_OK;
+}
+
+void htime_totals(HTIME_FRAME* out)
+{
+	*out = totals;
+}
+
+double htime_ticks_per_us()
+{
+	uint64_t ns = platform_time_ns() - start_ns;
+	uint64_t ticks = HTIME_NOW() - start_tick;
+	return ns > 0 ? ticks * 1000.0 / ns : 0.0;
+}
+
+uint8_t htime_write(char* filename, uint8_t format)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == NULL)
+		return HTIME_ERR_FILE_OPEN;
+
+	double per_us = htime_ticks_per_us();
+	if (format == HTIME_JSON)
+		fprintf(file, "{\n\t\"ticks_per_us\": %.3f,\n\t\"frames\": [", per_us);
+	else
+	{
+		fprintf(file, "frame,clocks,wall");
+		for (int c = 0; c < HTIME_COUNTERS; c++)
+			fprintf(file, ",%s", counter_names[c]);
+		fprintf(file, ",ticks_per_us\n");
+	}
+
+	for (int i = 0; i < frames_used; i++)
+	{
+		HTIME_FRAME frame;
+		htime_frame_get(i, &frame);
+		if (format == HTIME_JSON)
+		{
+			fprintf(file, "%s\n\t\t{\"frame\": %llu, \"clocks\": %llu, \"wall\": %llu", i ? "," : "",
+				(unsigned long long)frame.frame, (unsigned long long)frame.clocks, (unsigned long long)frame.wall);
+			for (int c = 0; c < HTIME_COUNTERS; c++)
+				fprintf(file, ", \"%s\": %llu", counter_names[c], (unsigned long long)frame.ticks[c]);
+			fprintf(file, "}");
+		}
+		else
+		{
+			fprintf(file, "%llu,%llu,%llu", (unsigned long long)frame.frame, (unsigned long long)frame.clocks,
+				(unsigned long long)frame.wall);
+			for (int c = 0; c < HTIME_COUNTERS; c++)
+				fprintf(file, ",%llu", (unsigned long long)frame.ticks[c]);
+			fprintf(file, ",%.3f\n", per_us);
+		}
+	}
+	if (format == HTIME_JSON)
+		fprintf(file, "\n\t]\n}\n");
+
+	if (ferror(file))
+	{
+		fclose(file);
+		return HTIME_ERR_FILE_WRITE;
+	}
+	if (fclose(file) != 0)
+		return HTIME_ERR_FILE_WRITE;
+	return HTIME_OK;
+}
@@ -0,0 +1,83 @@
+#ifndef HOST_TIMING_CODE
+#define HOST_TIMING_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Bus.h"
+
+// Host timing counters
+// How the host's time splits between the parts of the machine, frame by frame. When it's on, every clock
+// reads the TSC (clock_gettime where there's none) between cpu_clock, dma_clock, timer_clock and
+// ppu_clock, and the bus times its slow paths (the mapper, VRAM, OAM and the IO registers).
+// The bus time is part of the time of whoever made the access, mostly the CPU.
+// The last frames are kept in a ring, and can be read back or written as CSV or JSON.
+// Turning it on and off costs nothing: when it's off the clock and the bus test htime_enabled once.
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define HTIME_NOW() __rdtsc()
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HTIME_NOW() __rdtsc()
+#else
+#include "Platform.h"
+#define HTIME_NOW() platform_time_ns()
+#endif
+
+enum HTIME_COUNTERS {
+	HTIME_CPU = 0,
+	HTIME_DMA,
+	HTIME_TIMER,
+	HTIME_PPU,
+	HTIME_BUS,		// Included in the others
+	HTIME_COUNTERS
+};
+
+// One frame, times in ticks (see htime_ticks_per_us)
+typedef struct {
+	uint64_t frame;						// frame_count at the end of the frame
+	uint64_t clocks;					// Emulated clocks in the frame
+	uint64_t wall;						// From the end of the last frame, including the time outside the core
+	uint64_t ticks[HTIME_COUNTERS];
+} HTIME_FRAME;
+
+extern GB_INSTANCE bool htime_enabled;
+
+// Ticks of the frame that's running, the clock and the bus add to them
+extern GB_INSTANCE uint64_t htime_ticks[HTIME_COUNTERS];
+
+// Start counting from the next frame, keeping the last frames_kept frames
+uint8_t htime_start(int frames_kept);
+void htime_stop();
+
+// Called at the end of every frame while it's on
+void htime_frame();
+
+// Frames kept, index 0 is the oldest
+int htime_frames();
+uint8_t htime_frame_get(int index, HTIME_FRAME* frame);
+
+// All the frames since the start, including the ones that left the ring
+void htime_totals(HTIME_FRAME* totals);
+
+// Ticks per microsecond, measured over the run
+double htime_ticks_per_us();
+
+// Write the kept frames, one row per frame
+uint8_t htime_write(char* filename, uint8_t format);
+
+enum HTIME_FORMATS {
+	HTIME_CSV = 0,
+	HTIME_JSON
+};
+
+enum HTIME_ERRORS {
+	HTIME_OK = 0,
+	HTIME_ERR_ALLOC,
+	HTIME_ERR_INDEX,
+	HTIME_ERR_FILE_OPEN,
+	HTIME_ERR_FILE_WRITE
+};
+
+#endif // HOST_TIMING_CODE
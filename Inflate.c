@@ -0,0 +1,739 @@
+#include "Inflate.h"
+#include <string.h>
+#include <ctype.h>
+
+// DEFLATE (RFC 1951) with gzip (RFC 1952) and zip local file header wrappers.
+// Everything is read through one buffered bit reader, so the compressed file is only read once
+// and the trailers are taken from the same stream. The whole output stays in memory, so back
+// references are copied straight out of the output buffer and no window is needed.
+
+#define INFLATE_CHUNK (16 * 1024)
+#define MAX_BITS 15
+#define FAST_BITS 9
+
+#define GZIP_HEADER_CRC 0x02
+#define GZIP_EXTRA 0x04
+#define GZIP_NAME 0x08
+#define GZIP_COMMENT 0x10
+
+#define ZIP_LOCAL_HEADER 0x04034B50
+#define ZIP_DESCRIPTOR 0x08074B50
+#define ZIP_ENCRYPTED 0x0001
+#define ZIP_HAS_DESCRIPTOR 0x0008
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+#define ZIP_MAX_NAME 256
+#define ZIP64_EXTRA 0x0001
+
+// Canonical Huffman code. Codes up to FAST_BITS long are decoded with a single table lookup,
+// fast holds (length << 9) | symbol and 0 for codes that need the slow path.
+typedef struct {
+	uint16_t count[MAX_BITS + 1];
+	uint16_t symbol[288];
+	uint16_t fast[1 << FAST_BITS];
+} HUFFMAN;
+
+typedef struct {
+	// Input
+	FILE* file;
+	uint8_t in[INFLATE_CHUNK];
+	size_t in_pos;
+	size_t in_len;
+	uint64_t in_left;
+	uint32_t bitbuf;
+	int bitcnt;
+	bool in_error;
+
+	// Output
+	uint8_t* out;
+	size_t out_len;
+	size_t out_cap;
+	size_t max_size;
+	INFLATE_CHECK* check;
+	bool checked;
+
+	uint8_t status;
+	HUFFMAN lencode;
+	HUFFMAN distcode;
+} INFLATE_STATE;
+
+static const uint16_t len_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t len_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const uint8_t code_length_order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// Input
+static void reader_seek(INFLATE_STATE* s, long offset)
+{
+	fseek(s->file, offset, SEEK_SET);
+	s->in_pos = 0;
+	s->in_len = 0;
+	s->in_left = UINT64_MAX;
+	s->bitbuf = 0;
+	s->bitcnt = 0;
+	s->in_error = false;
+}
+
+static int next_byte(INFLATE_STATE* s)
+{
+	if (s->in_pos == s->in_len)
+	{
+		size_t want = INFLATE_CHUNK;
+		if (want > s->in_left)
+			want = (size_t)s->in_left;
+		s->in_pos = 0;
+		s->in_len = want ? fread(s->in, 1, want, s->file) : 0;
+		if (s->in_len == 0)
+			return -1;
+		s->in_left -= s->in_len;
+	}
+	return s->in[s->in_pos++];
+}
+
+static uint32_t bits(INFLATE_STATE* s, int n)
+{
+	while (s->bitcnt < n)
+	{
+		int b = next_byte(s);
+		if (b < 0)
+		{
+			s->in_error = true;
+			b = 0;
+		}
+		s->bitbuf |= (uint32_t)b << s->bitcnt;
+		s->bitcnt += 8;
+	}
+	uint32_t v = s->bitbuf & ((1u << n) - 1);
+	s->bitbuf >>= n;
+	s->bitcnt -= n;
+	return v;
+}
+
+static void align_byte(INFLATE_STATE* s)
+{
+	s->bitbuf >>= s->bitcnt & 7;
+	s->bitcnt -= s->bitcnt & 7;
+}
+
+// Bytes past the first 4 are read and dropped
+static uint32_t read_le(INFLATE_STATE* s, int n_bytes)
+{
+	uint32_t v = 0;
+	for (int i = 0; i < n_bytes; i++)
+	{
+		uint32_t b = bits(s, 8);
+		if (i < 4)
+			v |= b << (8 * i);
+	}
+	return v;
+}
+
+// Output
+static bool out_reserve(INFLATE_STATE* s, size_t n)
+{
+	if (s->out_len + n <= s->out_cap)
+		return true;
+	if (s->out_len + n > s->max_size)
+	{
+		s->status = INFLATE_ERR_SIZE;
+		return false;
+	}
+	size_t cap = s->out_cap ? s->out_cap : 64 * 1024;
+	while (cap < s->out_len + n)
+		cap *= 2;
+	if (cap > s->max_size)
+		cap = s->max_size;
+	uint8_t* out = (uint8_t*)realloc(s->out, cap);
+	if (out == NULL)
+	{
+		s->status = INFLATE_ERR_ALLOC;
+		return false;
+	}
+	s->out = out;
+	s->out_cap = cap;
+	return true;
+}
+
+static void out_check(INFLATE_STATE* s)
+{
+	if (s->checked || s->check == NULL || s->out_len < s->check->size)
+		return;
+	s->checked = true;
+	s->check->result = s->check->func(s->out);
+	if (s->check->result != 0)
+		s->status = INFLATE_ERR_ABORTED;
+}
+
+static uint32_t crc32(uint8_t* data, size_t size)
+{
+	uint32_t table[256];
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++)
+			c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		table[i] = c;
+	}
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFF;
+}
+
+// Huffman codes
+// Returns -1 for an over-subscribed set of lengths, otherwise the number of unused codes
+static int build(HUFFMAN* h, uint8_t* length, int n)
+{
+	uint16_t offs[MAX_BITS + 1];
+	uint16_t next[MAX_BITS + 1];
+
+	memset(h->count, 0, sizeof h->count);
+	memset(h->fast, 0, sizeof h->fast);
+	for (int i = 0; i < n; i++)
+		h->count[length[i]]++;
+	if (h->count[0] == n)
+		return 0;
+
+	int left = 1;
+	for (int len = 1; len <= MAX_BITS; len++)
+	{
+		left <<= 1;
+		left -= h->count[len];
+		if (left < 0)
+			return -1;
+	}
+
+	offs[1] = 0;
+	for (int len = 1; len < MAX_BITS; len++)
+		offs[len + 1] = offs[len] + h->count[len];
+	for (int i = 0; i < n; i++)
+	{
+		if (length[i] != 0)
+			h->symbol[offs[length[i]]++] = (uint16_t)i;
+	}
+
+	// Deflate sends the codes most significant bit first, so the table is indexed by the reversed code
+	int code = 0;
+	next[0] = 0;
+	for (int len = 1; len <= MAX_BITS; len++)
+	{
+		code = (code + (len > 1 ? h->count[len - 1] : 0)) << 1;
+		next[len] = (uint16_t)code;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		int len = length[i];
+		if (len == 0 || len > FAST_BITS)
+			continue;
+		int c = next[len]++;
+		int rev = 0;
+		for (int k = 0; k < len; k++)
+			rev |= ((c >> k) & 1) << (len - 1 - k);
+		for (int j = rev; j < (1 << FAST_BITS); j += 1 << len)
+			h->fast[j] = (uint16_t)((len << 9) | i);
+	}
+	return left;
+}
+
+static int decode(INFLATE_STATE* s, HUFFMAN* h)
+{
+	while (s->bitcnt < FAST_BITS)
+	{
+		int b = next_byte(s);
+		if (b < 0)
+			break;
+		s->bitbuf |= (uint32_t)b << s->bitcnt;
+		s->bitcnt += 8;
+	}
+	uint16_t entry = h->fast[s->bitbuf & ((1 << FAST_BITS) - 1)];
+	if (entry != 0 && (entry >> 9) <= s->bitcnt)
+	{
+		s->bitbuf >>= entry >> 9;
+		s->bitcnt -= entry >> 9;
+		return entry & 0x1FF;
+	}
+
+	// Long codes, one bit at a time
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int len = 1; len <= MAX_BITS; len++)
+	{
+		code |= bits(s, 1);
+		int count = h->count[len];
+		if (code - count < first)
+			return h->symbol[index + (code - first)];
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+// Blocks
+static void stored(INFLATE_STATE* s)
+{
+	align_byte(s);
+	uint32_t len = bits(s, 16);
+	uint32_t nlen = bits(s, 16);
+	if (s->in_error || len != (~nlen & 0xFFFF))
+	{
+		s->status = INFLATE_ERR_DATA;
+		return;
+	}
+	if (!out_reserve(s, len))
+		return;
+	while (len > 0 && s->bitcnt > 0)
+	{
+		s->out[s->out_len++] = (uint8_t)bits(s, 8);
+		len--;
+	}
+	while (len > 0)
+	{
+		int b = next_byte(s);
+		if (b < 0)
+		{
+			s->status = INFLATE_ERR_DATA;
+			return;
+		}
+		s->out[s->out_len++] = (uint8_t)b;
+		len--;
+	}
+	out_check(s);
+}
+
+static void codes(INFLATE_STATE* s)
+{
+	for (;;)
+	{
+		int symbol = decode(s, &s->lencode);
+		if (symbol < 0 || s->in_error)
+		{
+			s->status = INFLATE_ERR_DATA;
+			return;
+		}
+		if (symbol < 256)
+		{
+			if (!out_reserve(s, 1))
+				return;
+			s->out[s->out_len++] = (uint8_t)symbol;
+		}
+		else if (symbol == 256)
+			return;
+		else
+		{
+			symbol -= 257;
+			if (symbol >= 29)
+			{
+				s->status = INFLATE_ERR_DATA;
+				return;
+			}
+			size_t len = len_base[symbol] + bits(s, len_extra[symbol]);
+			int dist_symbol = decode(s, &s->distcode);
+			if (dist_symbol < 0 || dist_symbol >= 30)
+			{
+				s->status = INFLATE_ERR_DATA;
+				return;
+			}
+			size_t dist = dist_base[dist_symbol] + bits(s, dist_extra[dist_symbol]);
+			if (s->in_error || dist > s->out_len)
+			{
+				s->status = INFLATE_ERR_DATA;
+				return;
+			}
+			if (!out_reserve(s, len))
+				return;
+			uint8_t* dst = s->out + s->out_len;
+			uint8_t* src = dst - dist;
+			if (dist >= len)
+				memcpy(dst, src, len);
+			else
+			{
+				// Overlapping copy repeats the last dist bytes
+				for (size_t i = 0; i < len; i++)
+					dst[i] = src[i];
+			}
+			s->out_len += len;
+		}
+		out_check(s);
+		if (s->status != INFLATE_OK)
+			return;
+	}
+}
+
+static void fixed(INFLATE_STATE* s)
+{
+	uint8_t lengths[288];
+	int i = 0;
+	for (; i < 144; i++)
+		lengths[i] = 8;
+	for (; i < 256; i++)
+		lengths[i] = 9;
+	for (; i < 280; i++)
+		lengths[i] = 7;
+	for (; i < 288; i++)
+		lengths[i] = 8;
+	build(&s->lencode, lengths, 288);
+	for (i = 0; i < 30; i++)
+		lengths[i] = 5;
+	build(&s->distcode, lengths, 30);
+	codes(s);
+}
+
+static void dynamic(INFLATE_STATE* s)
+{
+	uint8_t lengths[288 + 32];
+	int nlen = bits(s, 5) + 257;
+	int ndist = bits(s, 5) + 1;
+	int ncode = bits(s, 4) + 4;
+	if (nlen > 286 || ndist > 30)
+	{
+		s->status = INFLATE_ERR_DATA;
+		return;
+	}
+
+	// Code length code
+	memset(lengths, 0, 19);
+	for (int i = 0; i < ncode; i++)
+		lengths[code_length_order[i]] = (uint8_t)bits(s, 3);
+	if (build(&s->lencode, lengths, 19) < 0)
+	{
+		s->status = INFLATE_ERR_DATA;
+		return;
+	}
+
+	// Literal/length and distance code lengths
+	int index = 0;
+	while (index < nlen + ndist)
+	{
+		int symbol = decode(s, &s->lencode);
+		if (symbol < 0 || s->in_error)
+		{
+			s->status = INFLATE_ERR_DATA;
+			return;
+		}
+		if (symbol < 16)
+		{
+			lengths[index++] = (uint8_t)symbol;
+			continue;
+		}
+		uint8_t len = 0;
+		int repeat;
+		if (symbol == 16)
+		{
+			if (index == 0)
+			{
+				s->status = INFLATE_ERR_DATA;
+				return;
+			}
+			len = lengths[index - 1];
+			repeat = 3 + bits(s, 2);
+		}
+		else if (symbol == 17)
+			repeat = 3 + bits(s, 3);
+		else
+			repeat = 11 + bits(s, 7);
+		if (index + repeat > nlen + ndist)
+		{
+			s->status = INFLATE_ERR_DATA;
+			return;
+		}
+		while (repeat--)
+			lengths[index++] = len;
+	}
+
+	// There has to be an end of block code
+	if (lengths[256] == 0 || build(&s->lencode, lengths, nlen) < 0 ||
+		build(&s->distcode, lengths + nlen, ndist) < 0)
+	{
+		s->status = INFLATE_ERR_DATA;
+		return;
+	}
+	codes(s);
+}
+
+static void inflate_stream(INFLATE_STATE* s)
+{
+	bool last;
+	do
+	{
+		last = bits(s, 1) != 0;
+		switch (bits(s, 2))
+		{
+			case 0:
+				stored(s);
+				break;
+			case 1:
+				fixed(s);
+				break;
+			case 2:
+				dynamic(s);
+				break;
+			default:
+				s->status = INFLATE_ERR_DATA;
+				break;
+		}
+		if (s->in_error && s->status == INFLATE_OK)
+			s->status = INFLATE_ERR_DATA;
+	} while (!last && s->status == INFLATE_OK);
+}
+
+// Wrappers
+static void inflate_gzip(INFLATE_STATE* s)
+{
+	// The uncompressed size (mod 2^32) is in the last 4 bytes, use it to allocate the output once
+	uint8_t isize_bytes[4];
+	if (fseek(s->file, -4, SEEK_END) == 0 && fread(isize_bytes, 1, 4, s->file) == 4)
+	{
+		size_t isize = isize_bytes[0] | (isize_bytes[1] << 8) | (isize_bytes[2] << 16) | ((size_t)isize_bytes[3] << 24);
+		if (isize > 0 && isize <= s->max_size)
+			out_reserve(s, isize);
+		s->status = INFLATE_OK;
+	}
+	reader_seek(s, 0);
+
+	uint32_t id = read_le(s, 2);
+	uint8_t method = (uint8_t)bits(s, 8);
+	uint8_t flags = (uint8_t)bits(s, 8);
+	read_le(s, 4); // Modification time
+	read_le(s, 2); // Extra flags and OS
+	if (id != 0x8B1F || method != 8)
+	{
+		s->status = INFLATE_ERR_FORMAT;
+		return;
+	}
+	if (flags & GZIP_EXTRA)
+	{
+		uint32_t xlen = read_le(s, 2);
+		while (xlen-- > 0 && !s->in_error)
+			bits(s, 8);
+	}
+	if (flags & GZIP_NAME)
+		while (bits(s, 8) != 0 && !s->in_error);
+	if (flags & GZIP_COMMENT)
+		while (bits(s, 8) != 0 && !s->in_error);
+	if (flags & GZIP_HEADER_CRC)
+		read_le(s, 2);
+	if (s->in_error)
+	{
+		s->status = INFLATE_ERR_FORMAT;
+		return;
+	}
+
+	inflate_stream(s);
+	if (s->status != INFLATE_OK)
+		return;
+
+	align_byte(s);
+	uint32_t crc = read_le(s, 4);
+	uint32_t isize = read_le(s, 4);
+	if (s->in_error)
+		s->status = INFLATE_ERR_DATA;
+	else if (isize != (uint32_t)s->out_len)
+		s->status = INFLATE_ERR_SIZE;
+	else if (crc != crc32(s->out, s->out_len))
+		s->status = INFLATE_ERR_CRC;
+}
+
+static bool zip_rom_name(char* name)
+{
+	char* ext = strrchr(name, '.');
+	if (ext == NULL)
+		return false;
+	char lower[5] = { 0 };
+	for (int i = 0; i < 4 && ext[i + 1] != 0; i++)
+		lower[i] = (char)tolower((unsigned char)ext[i + 1]);
+	return strcmp(lower, "gb") == 0 || strcmp(lower, "gbc") == 0 || strcmp(lower, "sgb") == 0;
+}
+
+// Inflates the first entry with a ROM file extension, or the first file at all if any_name is set.
+// Entries are walked through the local headers, so the central directory at the end is never read.
+static void inflate_zip(INFLATE_STATE* s, bool any_name)
+{
+	long offset = 0;
+	for (;;)
+	{
+		reader_seek(s, offset);
+		if (read_le(s, 4) != ZIP_LOCAL_HEADER)
+		{
+			s->status = INFLATE_ERR_FORMAT;
+			return;
+		}
+		read_le(s, 2); // Version needed
+		uint16_t flags = (uint16_t)read_le(s, 2);
+		uint16_t method = (uint16_t)read_le(s, 2);
+		read_le(s, 4); // Time and date
+		uint32_t crc = read_le(s, 4);
+		uint32_t csize = read_le(s, 4);
+		uint32_t usize = read_le(s, 4);
+		uint16_t name_len = (uint16_t)read_le(s, 2);
+		uint16_t extra_len = (uint16_t)read_le(s, 2);
+		char name[ZIP_MAX_NAME] = { 0 };
+		for (int i = 0; i < name_len; i++)
+		{
+			char c = (char)bits(s, 8);
+			if (i < ZIP_MAX_NAME - 1)
+				name[i] = c;
+		}
+
+		// A zip64 field holds the real sizes, and the data descriptor will have 8 byte sizes.
+		// ROMs are far below 4GB, so only the low halves are kept.
+		bool zip64 = false;
+		for (int left = extra_len; left >= 4 && !s->in_error;)
+		{
+			uint16_t tag = (uint16_t)read_le(s, 2);
+			uint16_t size = (uint16_t)read_le(s, 2);
+			int used = 0;
+			if (tag == ZIP64_EXTRA)
+			{
+				zip64 = true;
+				if (usize == 0xFFFFFFFF && used + 8 <= size)
+				{
+					usize = read_le(s, 4);
+					read_le(s, 4);
+					used += 8;
+				}
+				if (csize == 0xFFFFFFFF && used + 8 <= size)
+				{
+					csize = read_le(s, 4);
+					read_le(s, 4);
+					used += 8;
+				}
+			}
+			for (; used < size; used++)
+				bits(s, 8);
+			left -= 4 + size;
+		}
+		if (s->in_error)
+		{
+			s->status = INFLATE_ERR_FORMAT;
+			return;
+		}
+
+		long data_offset = offset + 30 + name_len + extra_len;
+		bool is_dir = strlen(name) > 0 && name[strlen(name) - 1] == '/';
+		if (!is_dir && (any_name || zip_rom_name(name)))
+		{
+			if ((flags & ZIP_ENCRYPTED) || (method != ZIP_STORED && method != ZIP_DEFLATED))
+			{
+				s->status = INFLATE_ERR_FORMAT;
+				return;
+			}
+			reader_seek(s, data_offset);
+			if (!(flags & ZIP_HAS_DESCRIPTOR))
+			{
+				s->in_left = csize;
+				if (usize > 0 && !out_reserve(s, usize))
+					return;
+			}
+
+			if (method == ZIP_STORED)
+			{
+				if ((flags & ZIP_HAS_DESCRIPTOR) || !out_reserve(s, csize))
+				{
+					if (s->status == INFLATE_OK)
+						s->status = INFLATE_ERR_FORMAT;
+					return;
+				}
+				s->out_len = fread(s->out, 1, csize, s->file);
+				if (s->out_len != csize)
+				{
+					s->status = INFLATE_ERR_DATA;
+					return;
+				}
+				out_check(s);
+			}
+			else
+				inflate_stream(s);
+			if (s->status != INFLATE_OK)
+				return;
+
+			if (flags & ZIP_HAS_DESCRIPTOR)
+			{
+				align_byte(s);
+				crc = read_le(s, 4);
+				if (crc == ZIP_DESCRIPTOR)
+					crc = read_le(s, 4);
+				read_le(s, zip64 ? 8 : 4); // Compressed size
+				usize = read_le(s, 4);
+				if (s->in_error)
+				{
+					s->status = INFLATE_ERR_DATA;
+					return;
+				}
+			}
+			if (usize != (uint32_t)s->out_len)
+				s->status = INFLATE_ERR_SIZE;
+			else if (crc != crc32(s->out, s->out_len))
+				s->status = INFLATE_ERR_CRC;
+			return;
+		}
+
+		// Entries that were written with a data descriptor don't have their size up front
+		if (flags & ZIP_HAS_DESCRIPTOR)
+		{
+			s->status = INFLATE_ERR_FORMAT;
+			return;
+		}
+		offset = data_offset + csize;
+	}
+}
+
+uint8_t inflate_format(uint8_t* magic, size_t size)
+{
+	if (size >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+		return INFLATE_FORMAT_GZIP;
+	if (size >= 4 && magic[0] == 'P' && magic[1] == 'K' && magic[2] == 0x03 && magic[3] == 0x04)
+		return INFLATE_FORMAT_ZIP;
+	return INFLATE_FORMAT_NONE;
+}
+
+uint8_t inflate_file(FILE* file, size_t max_size, INFLATE_CHECK* check, uint8_t** out, size_t* out_size)
+{
+	*out = NULL;
+	*out_size = 0;
+
+	uint8_t magic[4] = { 0 };
+	rewind(file);
+	size_t magic_len = fread(magic, 1, sizeof magic, file);
+	uint8_t format = inflate_format(magic, magic_len);
+	if (format == INFLATE_FORMAT_NONE)
+		return INFLATE_ERR_FORMAT;
+
+	INFLATE_STATE* s = (INFLATE_STATE*)calloc(1, sizeof(INFLATE_STATE));
+	if (s == NULL)
+		return INFLATE_ERR_ALLOC;
+	s->file = file;
+	s->max_size = max_size;
+	s->check = check;
+	s->status = INFLATE_OK;
+
+	if (format == INFLATE_FORMAT_GZIP)
+		inflate_gzip(s);
+	else
+	{
+		inflate_zip(s, false);
+		if (s->status == INFLATE_ERR_FORMAT && s->out_len == 0)
+		{
+			s->status = INFLATE_OK;
+			inflate_zip(s, true);
+		}
+	}
+
+	uint8_t res = s->status;
+	if (res == INFLATE_OK)
+	{
+		*out = s->out;
+		*out_size = s->out_len;
+	}
+	else
+		free(s->out);
+	free(s);
+	return res;
+}
@@ -0,0 +1,44 @@
+#ifndef INFLATE_CODE
+#define INFLATE_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Small DEFLATE decoder for loading compressed ROMs (gzip and zip) straight into memory.
+// The compressed file is read in chunks and inflated in one pass, there is no temporary file.
+
+enum INFLATE_FORMATS {
+	INFLATE_FORMAT_NONE = 0,
+	INFLATE_FORMAT_GZIP,
+	INFLATE_FORMAT_ZIP
+};
+
+enum INFLATE_ERRORS {
+	INFLATE_OK = 0,
+	INFLATE_ERR_FORMAT,
+	INFLATE_ERR_DATA,
+	INFLATE_ERR_READ,
+	INFLATE_ERR_ALLOC,
+	INFLATE_ERR_SIZE,
+	INFLATE_ERR_CRC,
+	INFLATE_ERR_ABORTED
+};
+
+// Called once as soon as the first size bytes are out, while the rest is still compressed.
+// A non-zero return value stops the decompression and is kept in result.
+typedef struct {
+	size_t size;
+	uint8_t(*func)(uint8_t* data);
+	uint8_t result;
+} INFLATE_CHECK;
+
+// Detect the format from the first bytes of a file
+uint8_t inflate_format(uint8_t* magic, size_t size);
+
+// Decompress a gzip file or the ROM in a zip file into a new buffer (freed by the caller).
+// The output is limited to max_size bytes, check can be NULL.
+uint8_t inflate_file(FILE* file, size_t max_size, INFLATE_CHECK* check, uint8_t** out, size_t* out_size);
+
+#endif // INFLATE_CODE
@@ -1,43 +1,41 @@
 #include "Bus.h"
 #include "Joypad.h"
 
-#define IF_ADDR 0xFF0F
-
 // Static variables
 
 // Joypad port: FF00
 //static uint8_t JOYP = 0x00;
 
 // Buttons
-bool button_up		= false;
-bool button_down	= false;
-bool button_left	= false;
-bool button_right	= false;
-bool button_start	= false;
-bool button_select	= false;
-bool button_b		= false;
-bool button_a		= false;
+GB_INSTANCE bool button_up		= false;
+GB_INSTANCE bool button_down	= false;
+GB_INSTANCE bool button_left	= false;
+GB_INSTANCE bool button_right	= false;
+GB_INSTANCE bool button_start	= false;
+GB_INSTANCE bool button_select	= false;
+GB_INSTANCE bool button_b		= false;
+GB_INSTANCE bool button_a		= false;
 
 // Selects
-bool select_buttons = false;
-bool select_directions = false;
+GB_INSTANCE bool select_buttons = false;
+GB_INSTANCE bool select_directions = false;
 
 void joypad_reset()
 {
 	// All buttons depressed
 	// Buttons
-	bool button_up = false;
-	bool button_down = false;
-	bool button_left = false;
-	bool button_right = false;
-	bool button_start = false;
-	bool button_select = false;
-	bool button_b = false;
-	bool button_a = false;
+	button_up = false;
+	button_down = false;
+	button_left = false;
+	button_right = false;
+	button_start = false;
+	button_select = false;
+	button_b = false;
+	button_a = false;
 
 	// Selects
-	bool select_buttons = false;
-	bool select_directions = false;
+	select_buttons = false;
+	select_directions = false;
 }
 
 uint8_t joypad_register_read(uint16_t addr)
@@ -151,7 +149,36 @@ uint8_t joypad_button_press(uint8_t button, bool bPress)
 	if (req_int)
 	{
 		// Request interrupt if any of the selected buttons is pressed
-		joypad_write(IF_ADDR, joypad_read(IF_ADDR) | INT_JOYPAD);
+		bus_int_request(INT_JOYPAD);
 	}
 	return 0;
 }
+
+
+void joypad_state_save(JOYPAD_STATE* state)
+{
+	state->button_up = button_up;
+	state->button_down = button_down;
+	state->button_left = button_left;
+	state->button_right = button_right;
+	state->button_start = button_start;
+	state->button_select = button_select;
+	state->button_b = button_b;
+	state->button_a = button_a;
+	state->select_buttons = select_buttons;
+	state->select_directions = select_directions;
+}
+
+void joypad_state_load(JOYPAD_STATE* state)
+{
+	button_up = state->button_up;
+	button_down = state->button_down;
+	button_left = state->button_left;
+	button_right = state->button_right;
+	button_start = state->button_start;
+	button_select = state->button_select;
+	button_b = state->button_b;
+	button_a = state->button_a;
+	select_buttons = state->select_buttons;
+	select_directions = state->select_directions;
+}
\ No newline at end of file
@@ -8,6 +8,24 @@ uint8_t joypad_read(uint16_t addr);
 uint8_t joypad_write(uint16_t addr, uint8_t data);
 uint8_t joypad_button_press(uint8_t button, bool bPress);
 
+// Save states
+typedef struct {
+	bool button_up;
+	bool button_down;
+	bool button_left;
+	bool button_right;
+	bool button_start;
+	bool button_select;
+	bool button_b;
+	bool button_a;
+	bool select_buttons;
+	bool select_directions;
+	uint8_t reserved[2];
+} JOYPAD_STATE;
+
+void joypad_state_save(JOYPAD_STATE* state);
+void joypad_state_load(JOYPAD_STATE* state);
+
 enum JOYPAD_FLAGS {
 	JOYPAD_SELECT_BUTTONS		= (1 << 4),
 	JOYPAD_SELECT_DIRECTIONS	= (1 << 5),
@@ -0,0 +1,395 @@
+#include "Bus.h"
+#include "Movie.h"
+#include "Joypad.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <string.h>
+
+// Movie file layout:
+// MOVIE_HEADER
+// MOVIE_EVENT * event_count, sorted by clock
+// (MOVIE_KEYFRAME + save state padded to 8 bytes) * keyframe_count, sorted by clock
+//
+// Keyframe 0 is the state the recording started from. Like the save states everything is little-endian
+// and the save states inside are tied to the cartridge they were recorded with.
+#define MOVIE_MAGIC "GBMV"
+#define MOVIE_VERSION 1
+#define MOVIE_QUEUE_LEN 64
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t header_size;
+	uint32_t state_size;
+	uint32_t keyframe_interval;
+	uint32_t event_count;
+	uint32_t keyframe_count;
+	uint64_t start_clock;
+	uint64_t end_clock;
+} MOVIE_HEADER;
+
+typedef struct {
+	uint64_t clock;
+	uint8_t button;
+	uint8_t pressed;
+	uint8_t reserved[6];
+} MOVIE_EVENT;
+
+typedef struct {
+	uint64_t clock;
+	uint32_t event_index;	// Events before this keyframe
+	uint32_t frame;
+} MOVIE_KEYFRAME;
+
+GB_INSTANCE volatile uint64_t movie_next_clock = UINT64_MAX;
+
+static GB_INSTANCE uint8_t mode = MOVIE_IDLE;
+static GB_INSTANCE bool movie_loaded = false;
+
+// Live input, pushed by the GUI thread and applied by the emulation thread. Protected by movie_lock
+static GB_INSTANCE PLATFORM_MUTEX* movie_lock = NULL;
+static GB_INSTANCE MOVIE_EVENT queue[MOVIE_QUEUE_LEN];
+static GB_INSTANCE int queue_first = 0;
+static GB_INSTANCE int queue_count = 0;
+
+// The movie
+static GB_INSTANCE MOVIE_HEADER header;
+static GB_INSTANCE MOVIE_EVENT* events = NULL;
+static GB_INSTANCE uint32_t event_cap = 0;
+static GB_INSTANCE uint8_t* keyframes = NULL;
+static GB_INSTANCE size_t keyframe_stride = 0;
+static GB_INSTANCE uint32_t keyframe_cap = 0;
+static GB_INSTANCE uint32_t play_event = 0;
+static GB_INSTANCE uint32_t recorded_frames = 0;
+static GB_INSTANCE bool record_failed = false;
+
+static MOVIE_KEYFRAME* keyframe(uint32_t i)
+{
+	return (MOVIE_KEYFRAME*)(keyframes + i * keyframe_stride);
+}
+
+static void movie_free()
+{
+	free(events);
+	free(keyframes);
+	events = NULL;
+	keyframes = NULL;
+	event_cap = 0;
+	keyframe_cap = 0;
+	movie_loaded = false;
+	memset(&header, 0, sizeof header);
+}
+
+// Sets the clock the emulation thread has to call back at. Called with movie_lock held
+static void movie_schedule()
+{
+	if (mode == MOVIE_PLAYING)
+	{
+		uint64_t next = header.end_clock;
+		if (play_event < header.event_count && events[play_event].clock < next)
+			next = events[play_event].clock;
+		movie_next_clock = next;
+	}
+	else
+		movie_next_clock = queue_count > 0 ? 0 : UINT64_MAX;
+}
+
+static void movie_lock_init()
+{
+	if (movie_lock == NULL)
+		movie_lock = platform_mutex_create();
+}
+
+uint8_t movie_input(uint8_t button, bool pressed)
+{
+	if (mode == MOVIE_PLAYING)
+		return MOVIE_ERR_BUSY;
+
+	movie_lock_init();
+	platform_mutex_lock(movie_lock);
+	if (queue_count == MOVIE_QUEUE_LEN)
+	{
+		platform_mutex_unlock(movie_lock);
+		return MOVIE_ERR_QUEUE_FULL;
+	}
+	MOVIE_EVENT* e = &queue[(queue_first + queue_count) % MOVIE_QUEUE_LEN];
+	e->button = button;
+	e->pressed = pressed;
+	queue_count++;
+	movie_next_clock = 0;
+	platform_mutex_unlock(movie_lock);
+	return MOVIE_OK;
+}
+
+static void movie_log(MOVIE_EVENT* e)
+{
+	if (record_failed)
+		return;
+	if (header.event_count == event_cap)
+	{
+		uint32_t cap = event_cap ? event_cap * 2 : 256;
+		MOVIE_EVENT* grown = (MOVIE_EVENT*)realloc(events, cap * sizeof(MOVIE_EVENT));
+		if (grown == NULL)
+		{
+			record_failed = true;
+			return;
+		}
+		events = grown;
+		event_cap = cap;
+	}
+	memset(&events[header.event_count], 0, sizeof(MOVIE_EVENT));
+	events[header.event_count].clock = clock_count;
+	events[header.event_count].button = e->button;
+	events[header.event_count].pressed = e->pressed;
+	header.event_count++;
+}
+
+void movie_clock()
+{
+	if (movie_lock != NULL)
+		platform_mutex_lock(movie_lock);
+
+	if (mode == MOVIE_PLAYING)
+	{
+		while (play_event < header.event_count && events[play_event].clock <= clock_count)
+		{
+			joypad_button_press(events[play_event].button, events[play_event].pressed);
+			play_event++;
+		}
+		if (clock_count >= header.end_clock)
+			mode = MOVIE_IDLE;
+		queue_count = 0;
+	}
+	else
+	{
+		while (queue_count > 0)
+		{
+			MOVIE_EVENT* e = &queue[queue_first];
+			joypad_button_press(e->button, e->pressed);
+			if (mode == MOVIE_RECORDING)
+				movie_log(e);
+			queue_first = (queue_first + 1) % MOVIE_QUEUE_LEN;
+			queue_count--;
+		}
+	}
+	movie_schedule();
+
+	if (movie_lock != NULL)
+		platform_mutex_unlock(movie_lock);
+}
+
+static void movie_keyframe()
+{
+	if (record_failed)
+		return;
+	if (header.keyframe_count == keyframe_cap)
+	{
+		uint32_t cap = keyframe_cap ? keyframe_cap * 2 : 16;
+		uint8_t* grown = (uint8_t*)realloc(keyframes, cap * keyframe_stride);
+		if (grown == NULL)
+		{
+			record_failed = true;
+			return;
+		}
+		keyframes = grown;
+		keyframe_cap = cap;
+	}
+	MOVIE_KEYFRAME* k = keyframe(header.keyframe_count);
+	memset(k, 0, keyframe_stride);
+	k->clock = clock_count;
+	k->event_index = header.event_count;
+	k->frame = recorded_frames;
+	gameboy_state_save((uint8_t*)(k + 1), header.state_size);
+	header.keyframe_count++;
+}
+
+void movie_frame()
+{
+	if (mode != MOVIE_RECORDING)
+		return;
+	recorded_frames++;
+	if (recorded_frames % header.keyframe_interval == 0)
+		movie_keyframe();
+}
+
+static void movie_init_header(uint32_t state_size, uint32_t keyframe_interval)
+{
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, MOVIE_MAGIC, 4);
+	header.version = MOVIE_VERSION;
+	header.header_size = sizeof(MOVIE_HEADER);
+	header.state_size = state_size;
+	header.keyframe_interval = keyframe_interval;
+	keyframe_stride = sizeof(MOVIE_KEYFRAME) + ((state_size + 7) & ~7);
+}
+
+uint8_t movie_record_start(int keyframe_interval)
+{
+	if (mode != MOVIE_IDLE)
+		return MOVIE_ERR_BUSY;
+	movie_lock_init();
+	movie_free();
+
+	movie_init_header((uint32_t)gameboy_state_size(), keyframe_interval > 0 ? keyframe_interval : 1);
+	header.start_clock = clock_count;
+	recorded_frames = 0;
+	record_failed = false;
+	movie_keyframe();
+	if (record_failed)
+	{
+		movie_free();
+		return MOVIE_ERR_ALLOC;
+	}
+
+	platform_mutex_lock(movie_lock);
+	mode = MOVIE_RECORDING;
+	movie_schedule();
+	platform_mutex_unlock(movie_lock);
+	return MOVIE_OK;
+}
+
+uint8_t movie_record_stop(char* filename)
+{
+	if (mode != MOVIE_RECORDING)
+		return MOVIE_ERR_NOT_RECORDING;
+	platform_mutex_lock(movie_lock);
+	mode = MOVIE_IDLE;
+	header.end_clock = clock_count;
+	movie_schedule();
+	platform_mutex_unlock(movie_lock);
+
+	uint8_t res = MOVIE_OK;
+	if (record_failed)
+		res = MOVIE_ERR_ALLOC;
+	else if (filename != NULL)
+	{
+		FILE* movie_file = fopen(filename, "wb");
+		if (movie_file == NULL)
+			res = MOVIE_ERR_FILE_OPEN;
+		else
+		{
+			bool ok = fwrite(&header, 1, sizeof header, movie_file) == sizeof header &&
+				fwrite(events, sizeof(MOVIE_EVENT), header.event_count, movie_file) == header.event_count &&
+				fwrite(keyframes, keyframe_stride, header.keyframe_count, movie_file) == header.keyframe_count;
+			if (fclose(movie_file) != 0)
+				ok = false;
+			if (!ok)
+				res = MOVIE_ERR_FILE_WRITE;
+		}
+	}
+
+	// The recording stays loaded and can be played back with movie_seek
+	if (res == MOVIE_OK)
+		movie_loaded = true;
+	else
+		movie_free();
+	return res;
+}
+
+uint8_t movie_play(char* filename)
+{
+	if (mode != MOVIE_IDLE)
+		return MOVIE_ERR_BUSY;
+	movie_lock_init();
+	movie_free();
+
+	FILE* movie_file = fopen(filename, "rb");
+	if (movie_file == NULL)
+		return MOVIE_ERR_FILE_OPEN;
+
+	MOVIE_HEADER file_header;
+	uint8_t res = MOVIE_OK;
+	if (fread(&file_header, 1, sizeof file_header, movie_file) != sizeof file_header)
+		res = MOVIE_ERR_FILE_READ;
+	else if (memcmp(file_header.magic, MOVIE_MAGIC, 4) != 0 || file_header.version != MOVIE_VERSION ||
+		file_header.header_size != sizeof(MOVIE_HEADER) || file_header.keyframe_count == 0 ||
+		file_header.keyframe_interval == 0 || file_header.start_clock > file_header.end_clock)
+		res = MOVIE_ERR_FORMAT;
+	else if (file_header.state_size != gameboy_state_size())
+		res = MOVIE_ERR_STATE;
+	else
+	{
+		movie_init_header(file_header.state_size, file_header.keyframe_interval);
+		events = (MOVIE_EVENT*)malloc((file_header.event_count ? file_header.event_count : 1) * sizeof(MOVIE_EVENT));
+		keyframes = (uint8_t*)malloc(file_header.keyframe_count * keyframe_stride);
+		if (events == NULL || keyframes == NULL)
+			res = MOVIE_ERR_ALLOC;
+		else if (fread(events, sizeof(MOVIE_EVENT), file_header.event_count, movie_file) != file_header.event_count ||
+			fread(keyframes, keyframe_stride, file_header.keyframe_count, movie_file) != file_header.keyframe_count)
+			res = MOVIE_ERR_FILE_READ;
+	}
+	fclose(movie_file);
+	if (res != MOVIE_OK)
+	{
+		movie_free();
+		return res;
+	}
+	header = file_header;
+	movie_loaded = true;
+
+	return movie_seek(header.start_clock);
+}
+
+uint8_t movie_seek(uint64_t clock)
+{
+	if (mode == MOVIE_RECORDING)
+		return MOVIE_ERR_BUSY;
+	if (!movie_loaded)
+		return MOVIE_ERR_NOT_LOADED;
+	if (clock < header.start_clock || clock > header.end_clock)
+		return MOVIE_ERR_SEEK;
+
+	// Last keyframe at or before the target
+	uint32_t low = 0;
+	uint32_t high = header.keyframe_count - 1;
+	while (low < high)
+	{
+		uint32_t mid = (low + high + 1) / 2;
+		if (keyframe(mid)->clock <= clock)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	MOVIE_KEYFRAME* k = keyframe(low);
+	if (gameboy_state_load((uint8_t*)(k + 1), header.state_size) != STATE_OK)
+	{
+		mode = MOVIE_IDLE;
+		return MOVIE_ERR_STATE;
+	}
+
+	platform_mutex_lock(movie_lock);
+	mode = MOVIE_PLAYING;
+	play_event = k->event_index;
+	queue_count = 0;
+	movie_schedule();
+	platform_mutex_unlock(movie_lock);
+
+	while (clock_count < clock)
+		gameboy_clock();
+	return MOVIE_OK;
+}
+
+void movie_stop()
+{
+	if (mode == MOVIE_RECORDING)
+		movie_record_stop(NULL);
+	if (movie_lock != NULL)
+		platform_mutex_lock(movie_lock);
+	mode = MOVIE_IDLE;
+	movie_free();
+	movie_schedule();
+	if (movie_lock != NULL)
+		platform_mutex_unlock(movie_lock);
+}
+
+uint8_t movie_mode()
+{
+	return mode;
+}
+
+uint64_t movie_length()
+{
+	if (mode == MOVIE_RECORDING)
+		return clock_count - header.start_clock;
+	return header.end_clock - header.start_clock;
+}
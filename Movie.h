@@ -0,0 +1,54 @@
+#ifndef MOVIE_CODE
+#define MOVIE_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Bus.h"
+
+// Input movies.
+// Joypad input from the GUI thread is queued and applied by the emulation thread at the start of a clock,
+// so every button transition happens at a known clock_count. A recording logs the transitions with their
+// clock_count, plus a save state every keyframe_interval frames. A replay starts from the first state and
+// applies the logged transitions at exactly the same clocks, so it runs the same way every time.
+// Seeking loads the closest keyframe before the target and runs the rest of the way.
+//
+// Recording and playing are started and stopped while the emulation is stopped, like the save states.
+
+// The emulation thread calls movie_clock when clock_count reaches movie_next_clock
+extern GB_INSTANCE volatile uint64_t movie_next_clock;
+
+uint8_t movie_input(uint8_t button, bool pressed);
+void movie_clock();
+void movie_frame();
+
+uint8_t movie_record_start(int keyframe_interval);
+uint8_t movie_record_stop(char* filename);
+uint8_t movie_play(char* filename);
+uint8_t movie_seek(uint64_t clock);
+void movie_stop();
+uint8_t movie_mode();
+uint64_t movie_length();
+
+enum MOVIE_MODES {
+	MOVIE_IDLE = 0,
+	MOVIE_RECORDING,
+	MOVIE_PLAYING
+};
+
+enum MOVIE_ERRORS {
+	MOVIE_OK = 0,
+	MOVIE_ERR_BUSY,
+	MOVIE_ERR_NOT_RECORDING,
+	MOVIE_ERR_NOT_LOADED,
+	MOVIE_ERR_QUEUE_FULL,
+	MOVIE_ERR_ALLOC,
+	MOVIE_ERR_STATE,
+	MOVIE_ERR_FILE_OPEN,
+	MOVIE_ERR_FILE_READ,
+	MOVIE_ERR_FILE_WRITE,
+	MOVIE_ERR_FORMAT,
+	MOVIE_ERR_SEEK
+};
+
+#endif // MOVIE_CODE
@@ -0,0 +1,87 @@
+#include "Opcode_profile.h"
+
+#ifdef GAMEBOY_OPCODE_PROFILE
+#include "Sharp_LR35902.h"
+#include <string.h>
+
+typedef struct {
+	uint64_t count;
+	uint64_t host_cycles;
+} OPPROF_ENTRY;
+
+// 0x000 - 0x0FF: primary opcodes, 0x100 - 0x1FF: CB-prefixed opcodes
+static OPPROF_ENTRY entries[512];
+static uint64_t clock_cycles = 0;
+static bool registered = false;
+
+static void opprof_exit()
+{
+	opprof_report(stderr);
+}
+
+void opprof_init()
+{
+	if (!registered)
+	{
+		registered = true;
+		atexit(opprof_exit);
+	}
+}
+
+void opprof_add(uint8_t opcode, uint8_t cb_opcode, uint64_t host_cycles)
+{
+	// The CB-prefixed instructions are counted only in their own table
+	OPPROF_ENTRY* entry = opcode == 0xCB ? &entries[0x100 + cb_opcode] : &entries[opcode];
+	entry->count++;
+	entry->host_cycles += host_cycles;
+}
+
+void opprof_add_clock(uint64_t host_cycles)
+{
+	clock_cycles += host_cycles;
+}
+
+static int entry_compare(const void* a, const void* b)
+{
+	uint64_t ca = entries[*(const int*)a].host_cycles;
+	uint64_t cb = entries[*(const int*)b].host_cycles;
+	return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+void opprof_report(FILE* file)
+{
+	int order[512];
+	int used = 0;
+	uint64_t count = 0;
+	uint64_t handler_cycles = 0;
+	for (int i = 0; i < 512; i++)
+	{
+		if (entries[i].count == 0)
+			continue;
+		order[used++] = i;
+		count += entries[i].count;
+		handler_cycles += entries[i].host_cycles;
+	}
+	qsort(order, used, sizeof(int), entry_compare);
+
+	fprintf(file, "Opcode profile: %llu instructions, %d distinct opcodes\n", (unsigned long long)count, used);
+	fprintf(file, "Host cycles in cpu_clock: %llu, in handlers: %llu (%.1f%%)\n", (unsigned long long)clock_cycles,
+		(unsigned long long)handler_cycles, clock_cycles ? handler_cycles * 100.0 / clock_cycles : 0.0);
+	fprintf(file, "%-6s %-24s %14s %16s %10s %7s\n", "opcode", "instruction", "count", "host cycles", "per exec", "share");
+	for (int i = 0; i < used; i++)
+	{
+		OPPROF_ENTRY* entry = &entries[order[i]];
+		char name[50];
+		char code[8];
+		cpu_opcode_name((uint8_t)order[i], order[i] >= 0x100, name, sizeof name);
+		if (order[i] >= 0x100)
+			snprintf(code, sizeof code, "CB %02X", order[i] & 0xFF);
+		else
+			snprintf(code, sizeof code, "%02X", order[i]);
+		fprintf(file, "%-6s %-24s %14llu %16llu %10.1f %6.2f%%\n", code, name, (unsigned long long)entry->count,
+			(unsigned long long)entry->host_cycles, (double)entry->host_cycles / entry->count,
+			handler_cycles ? entry->host_cycles * 100.0 / handler_cycles : 0.0);
+	}
+}
+
+#endif // GAMEBOY_OPCODE_PROFILE
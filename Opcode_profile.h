@@ -0,0 +1,48 @@
+#ifndef OPCODE_PROFILE_CODE
+#define OPCODE_PROFILE_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Opcode profiler, only in builds with GAMEBOY_OPCODE_PROFILE defined.
+// Counts every primary and CB-prefixed opcode the CPU runs, and the host cycles (TSC) spent in its
+// addressing mode and handler. The time in cpu_clock as a whole is kept too, so the report shows how
+// much of the CPU's time is the handlers and how much is the fetch, the dispatch and the cycle countdown.
+// The report (sorted by host cycles) goes to stderr when the program exits. The counters are shared by
+// the whole process, so it's meant for tools that run one machine.
+// Without GAMEBOY_OPCODE_PROFILE the hooks are empty macros.
+#ifdef GAMEBOY_OPCODE_PROFILE
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define OPPROF_NOW() __rdtsc()
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define OPPROF_NOW() __rdtsc()
+#else
+#include "Platform.h"
+#define OPPROF_NOW() platform_time_ns()
+#endif
+
+void opprof_init();
+void opprof_add(uint8_t opcode, uint8_t cb_opcode, uint64_t host_cycles);
+void opprof_add_clock(uint64_t host_cycles);
+void opprof_report(FILE* file);
+
+#define OPPROF_INIT() opprof_init()
+#define OPPROF_START(name) uint64_t name = OPPROF_NOW()
+#define OPPROF_END(name, opcode, cb_opcode) opprof_add(opcode, cb_opcode, OPPROF_NOW() - name)
+#define OPPROF_END_CLOCK(name) opprof_add_clock(OPPROF_NOW() - name)
+
+#else
+
+#define OPPROF_INIT()
+#define OPPROF_START(name)
+#define OPPROF_END(name, opcode, cb_opcode)
+#define OPPROF_END_CLOCK(name)
+
+#endif // GAMEBOY_OPCODE_PROFILE
+
+#endif // OPCODE_PROFILE_CODE
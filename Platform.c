@@ -0,0 +1,502 @@
+#include "Platform.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <dlfcn.h>
+#endif
+#include <string.h>
+
+#define PLATFORM_MAX_PATH 4096
+
+// Threads get a small trampoline so both Win32 and pthreads can call the same function type
+typedef struct {
+	void(*func)(void* arg);
+	void* arg;
+} THREAD_START;
+
+#ifdef _WIN32
+
+struct PLATFORM_THREAD {
+	HANDLE handle;
+};
+
+struct PLATFORM_MUTEX {
+	CRITICAL_SECTION cs;
+};
+
+struct PLATFORM_COND {
+	CONDITION_VARIABLE cv;
+};
+
+struct PLATFORM_LIBRARY {
+	HMODULE module;
+};
+
+static DWORD WINAPI thread_start(LPVOID param)
+{
+	THREAD_START start = *(THREAD_START*)param;
+	free(param);
+	start.func(start.arg);
+	return 0;
+}
+
+PLATFORM_THREAD* platform_thread_create(void(*func)(void* arg), void* arg)
+{
+	PLATFORM_THREAD* thread = (PLATFORM_THREAD*)malloc(sizeof(PLATFORM_THREAD));
+	THREAD_START* start = (THREAD_START*)malloc(sizeof(THREAD_START));
+	if (thread == NULL || start == NULL)
+	{
+		free(thread);
+		free(start);
+		return NULL;
+	}
+	start->func = func;
+	start->arg = arg;
+	thread->handle = CreateThread(NULL, 0, thread_start, start, 0, NULL);
+	if (thread->handle == NULL)
+	{
+		free(thread);
+		free(start);
+		return NULL;
+	}
+	return thread;
+}
+
+void platform_thread_join(PLATFORM_THREAD* thread)
+{
+	if (thread == NULL)
+		return;
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	free(thread);
+}
+
+PLATFORM_MUTEX* platform_mutex_create()
+{
+	PLATFORM_MUTEX* mutex = (PLATFORM_MUTEX*)malloc(sizeof(PLATFORM_MUTEX));
+	if (mutex != NULL)
+		InitializeCriticalSection(&mutex->cs);
+	return mutex;
+}
+
+void platform_mutex_free(PLATFORM_MUTEX* mutex)
+{
+	if (mutex == NULL)
+		return;
+	DeleteCriticalSection(&mutex->cs);
+	free(mutex);
+}
+
+void platform_mutex_lock(PLATFORM_MUTEX* mutex)
+{
+	EnterCriticalSection(&mutex->cs);
+}
+
+void platform_mutex_unlock(PLATFORM_MUTEX* mutex)
+{
+	LeaveCriticalSection(&mutex->cs);
+}
+
+PLATFORM_COND* platform_cond_create()
+{
+	PLATFORM_COND* cond = (PLATFORM_COND*)malloc(sizeof(PLATFORM_COND));
+	if (cond != NULL)
+		InitializeConditionVariable(&cond->cv);
+	return cond;
+}
+
+void platform_cond_free(PLATFORM_COND* cond)
+{
+	free(cond);
+}
+
+void platform_cond_wait(PLATFORM_COND* cond, PLATFORM_MUTEX* mutex)
+{
+	SleepConditionVariableCS(&cond->cv, &mutex->cs, INFINITE);
+}
+
+void platform_cond_signal(PLATFORM_COND* cond)
+{
+	WakeConditionVariable(&cond->cv);
+}
+
+void platform_cond_broadcast(PLATFORM_COND* cond)
+{
+	WakeAllConditionVariable(&cond->cv);
+}
+
+uint8_t platform_file_sync(FILE* file)
+{
+	if (fflush(file) != 0)
+		return 1;
+	return _commit(_fileno(file)) == 0 ? 0 : 1;
+}
+
+uint8_t platform_file_map(char* filename, PLATFORM_MAP* map)
+{
+	map->data = NULL;
+	map->size = 0;
+	map->handle = NULL;
+
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return 1;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return 1;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file); // The mapping keeps the file open
+	if (mapping == NULL)
+		return 1;
+	map->data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (map->data == NULL)
+	{
+		CloseHandle(mapping);
+		return 1;
+	}
+	map->size = (size_t)size.QuadPart;
+	map->handle = mapping;
+	return 0;
+}
+
+void platform_file_unmap(PLATFORM_MAP* map)
+{
+	if (map->data != NULL)
+		UnmapViewOfFile(map->data);
+	if (map->handle != NULL)
+		CloseHandle((HANDLE)map->handle);
+	map->data = NULL;
+	map->size = 0;
+	map->handle = NULL;
+}
+
+uint8_t platform_dir_list(char* dir, void(*func)(char* path, void* arg), void* arg)
+{
+	char pattern[PLATFORM_MAX_PATH];
+	char path[PLATFORM_MAX_PATH];
+	WIN32_FIND_DATAA find_data;
+
+	if (snprintf(pattern, sizeof pattern, "%s\\*", dir) >= (int)sizeof pattern)
+		return 1;
+	HANDLE find = FindFirstFileA(pattern, &find_data);
+	if (find == INVALID_HANDLE_VALUE)
+		return 1;
+	do
+	{
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		if (snprintf(path, sizeof path, "%s\\%s", dir, find_data.cFileName) < (int)sizeof path)
+			func(path, arg);
+	} while (FindNextFileA(find, &find_data));
+	FindClose(find);
+	return 0;
+}
+
+int platform_cpu_count()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+uint64_t platform_time_ns()
+{
+	static LARGE_INTEGER freq = { 0 };
+	LARGE_INTEGER now;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000ULL +
+		(uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+}
+
+void* platform_aligned_alloc(size_t size, size_t alignment)
+{
+	return _aligned_malloc(size, alignment);
+}
+
+void platform_aligned_free(void* ptr)
+{
+	_aligned_free(ptr);
+}
+
+void* platform_atomic_cas_ptr(void* volatile* target, void* expected, void* desired)
+{
+	return InterlockedCompareExchangePointer(target, desired, expected);
+}
+
+PLATFORM_LIBRARY* platform_library_open(char* filename)
+{
+	HMODULE module = LoadLibraryA(filename);
+	if (module == NULL)
+		return NULL;
+	PLATFORM_LIBRARY* library = (PLATFORM_LIBRARY*)malloc(sizeof(PLATFORM_LIBRARY));
+	if (library == NULL)
+	{
+		FreeLibrary(module);
+		return NULL;
+	}
+	library->module = module;
+	return library;
+}
+
+void* platform_library_symbol(PLATFORM_LIBRARY* library, char* name)
+{
+	return (void*)GetProcAddress(library->module, name);
+}
+
+void platform_library_close(PLATFORM_LIBRARY* library)
+{
+	FreeLibrary(library->module);
+	free(library);
+}
+
+#else
+
+struct PLATFORM_THREAD {
+	pthread_t handle;
+};
+
+struct PLATFORM_MUTEX {
+	pthread_mutex_t m;
+};
+
+struct PLATFORM_COND {
+	pthread_cond_t cv;
+};
+
+struct PLATFORM_LIBRARY {
+	void* handle;
+};
+
+static void* thread_start(void* param)
+{
+	THREAD_START start = *(THREAD_START*)param;
+	free(param);
+	start.func(start.arg);
+	return NULL;
+}
+
+PLATFORM_THREAD* platform_thread_create(void(*func)(void* arg), void* arg)
+{
+	PLATFORM_THREAD* thread = (PLATFORM_THREAD*)malloc(sizeof(PLATFORM_THREAD));
+	THREAD_START* start = (THREAD_START*)malloc(sizeof(THREAD_START));
+	if (thread == NULL || start == NULL)
+	{
+		free(thread);
+		free(start);
+		return NULL;
+	}
+	start->func = func;
+	start->arg = arg;
+	if (pthread_create(&thread->handle, NULL, thread_start, start) != 0)
+	{
+		free(thread);
+		free(start);
+		return NULL;
+	}
+	return thread;
+}
+
+void platform_thread_join(PLATFORM_THREAD* thread)
+{
+	if (thread == NULL)
+		return;
+	pthread_join(thread->handle, NULL);
+	free(thread);
+}
+
+PLATFORM_MUTEX* platform_mutex_create()
+{
+	PLATFORM_MUTEX* mutex = (PLATFORM_MUTEX*)malloc(sizeof(PLATFORM_MUTEX));
+	if (mutex != NULL)
+		pthread_mutex_init(&mutex->m, NULL);
+	return mutex;
+}
+
+void platform_mutex_free(PLATFORM_MUTEX* mutex)
+{
+	if (mutex == NULL)
+		return;
+	pthread_mutex_destroy(&mutex->m);
+	free(mutex);
+}
+
+void platform_mutex_lock(PLATFORM_MUTEX* mutex)
+{
+	pthread_mutex_lock(&mutex->m);
+}
+
+void platform_mutex_unlock(PLATFORM_MUTEX* mutex)
+{
+	pthread_mutex_unlock(&mutex->m);
+}
+
+PLATFORM_COND* platform_cond_create()
+{
+	PLATFORM_COND* cond = (PLATFORM_COND*)malloc(sizeof(PLATFORM_COND));
+	if (cond != NULL)
+		pthread_cond_init(&cond->cv, NULL);
+	return cond;
+}
+
+void platform_cond_free(PLATFORM_COND* cond)
+{
+	if (cond == NULL)
+		return;
+	pthread_cond_destroy(&cond->cv);
+	free(cond);
+}
+
+void platform_cond_wait(PLATFORM_COND* cond, PLATFORM_MUTEX* mutex)
+{
+	pthread_cond_wait(&cond->cv, &mutex->m);
+}
+
+void platform_cond_signal(PLATFORM_COND* cond)
+{
+	pthread_cond_signal(&cond->cv);
+}
+
+void platform_cond_broadcast(PLATFORM_COND* cond)
+{
+	pthread_cond_broadcast(&cond->cv);
+}
+
+uint8_t platform_file_sync(FILE* file)
+{
+	if (fflush(file) != 0)
+		return 1;
+	return fsync(fileno(file)) == 0 ? 0 : 1;
+}
+
+uint8_t platform_file_map(char* filename, PLATFORM_MAP* map)
+{
+	map->data = NULL;
+	map->size = 0;
+	map->handle = NULL;
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return 1;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return 1;
+	}
+	void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping keeps the file open
+	if (data == MAP_FAILED)
+		return 1;
+	map->data = (uint8_t*)data;
+	map->size = (size_t)st.st_size;
+	return 0;
+}
+
+void platform_file_unmap(PLATFORM_MAP* map)
+{
+	if (map->data != NULL)
+		munmap(map->data, map->size);
+	map->data = NULL;
+	map->size = 0;
+	map->handle = NULL;
+}
+
+uint8_t platform_dir_list(char* dir, void(*func)(char* path, void* arg), void* arg)
+{
+	char path[PLATFORM_MAX_PATH];
+	DIR* d = opendir(dir);
+	if (d == NULL)
+		return 1;
+	struct dirent* ent;
+	while ((ent = readdir(d)) != NULL)
+	{
+		if (snprintf(path, sizeof path, "%s/%s", dir, ent->d_name) >= (int)sizeof path)
+			continue;
+		struct stat st;
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+			func(path, arg);
+	}
+	closedir(d);
+	return 0;
+}
+
+int platform_cpu_count()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+uint64_t platform_time_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+void* platform_aligned_alloc(size_t size, size_t alignment)
+{
+	void* ptr;
+	if (posix_memalign(&ptr, alignment, size) != 0)
+		return NULL;
+	return ptr;
+}
+
+void platform_aligned_free(void* ptr)
+{
+	free(ptr);
+}
+
+void* platform_atomic_cas_ptr(void* volatile* target, void* expected, void* desired)
+{
+	return __sync_val_compare_and_swap(target, expected, desired);
+}
+
+PLATFORM_LIBRARY* platform_library_open(char* filename)
+{
+	// dlopen searches the library path for names without a slash
+	char path[PLATFORM_MAX_PATH];
+	if (strchr(filename, '/') == NULL)
+	{
+		snprintf(path, sizeof(path), "./%s", filename);
+		filename = path;
+	}
+	void* handle = dlopen(filename, RTLD_NOW | RTLD_LOCAL);
+	if (handle == NULL)
+		return NULL;
+	PLATFORM_LIBRARY* library = (PLATFORM_LIBRARY*)malloc(sizeof(PLATFORM_LIBRARY));
+	if (library == NULL)
+	{
+		dlclose(handle);
+		return NULL;
+	}
+	library->handle = handle;
+	return library;
+}
+
+void* platform_library_symbol(PLATFORM_LIBRARY* library, char* name)
+{
+	return dlsym(library->handle, name);
+}
+
+void platform_library_close(PLATFORM_LIBRARY* library)
+{
+	dlclose(library->handle);
+	free(library);
+}
+
+#endif // _WIN32
@@ -0,0 +1,69 @@
+#ifndef PLATFORM_CODE
+#define PLATFORM_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Thin wrappers over the OS threading and file primitives, so that the core doesn't have
+// to include windows.h (which also defines an RGB macro that clashes with the CPU's RGB address mode).
+// The handles are opaque and allocated by the create functions.
+typedef struct PLATFORM_THREAD PLATFORM_THREAD;
+typedef struct PLATFORM_MUTEX PLATFORM_MUTEX;
+typedef struct PLATFORM_COND PLATFORM_COND;
+typedef struct PLATFORM_LIBRARY PLATFORM_LIBRARY;
+
+// Threads
+PLATFORM_THREAD* platform_thread_create(void(*func)(void* arg), void* arg);
+void platform_thread_join(PLATFORM_THREAD* thread);
+
+// Mutexes
+PLATFORM_MUTEX* platform_mutex_create();
+void platform_mutex_free(PLATFORM_MUTEX* mutex);
+void platform_mutex_lock(PLATFORM_MUTEX* mutex);
+void platform_mutex_unlock(PLATFORM_MUTEX* mutex);
+
+// Condition variables
+PLATFORM_COND* platform_cond_create();
+void platform_cond_free(PLATFORM_COND* cond);
+void platform_cond_wait(PLATFORM_COND* cond, PLATFORM_MUTEX* mutex);
+void platform_cond_signal(PLATFORM_COND* cond);
+void platform_cond_broadcast(PLATFORM_COND* cond);
+
+// Flush the file to the disk, not only to the OS. Returns 0 on success.
+uint8_t platform_file_sync(FILE* file);
+
+// Read-only memory mapped files
+typedef struct {
+	uint8_t* data;
+	size_t size;
+	void* handle;
+} PLATFORM_MAP;
+
+uint8_t platform_file_map(char* filename, PLATFORM_MAP* map);
+void platform_file_unmap(PLATFORM_MAP* map);
+
+// Calls func with the path of every regular file in the directory (not recursive)
+uint8_t platform_dir_list(char* dir, void(*func)(char* path, void* arg), void* arg);
+
+// Number of logical processors
+int platform_cpu_count();
+
+// Monotonic time in nanoseconds, for measuring
+uint64_t platform_time_ns();
+
+// Memory aligned to alignment (a power of 2), freed with platform_aligned_free
+void* platform_aligned_alloc(size_t size, size_t alignment);
+void platform_aligned_free(void* ptr);
+
+// Atomically sets *target to desired if it is expected. Returns the value *target had.
+void* platform_atomic_cas_ptr(void* volatile* target, void* expected, void* desired);
+
+// Shared libraries (.so, .dll). filename is a path, a name without a directory is in the current one.
+// NULL if it can't be loaded.
+PLATFORM_LIBRARY* platform_library_open(char* filename);
+void* platform_library_symbol(PLATFORM_LIBRARY* library, char* name);
+void platform_library_close(PLATFORM_LIBRARY* library);
+
+#endif // PLATFORM_CODE
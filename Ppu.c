@@ -1,37 +1,36 @@
 #include "Bus.h"
 #include "Ppu.h"
-#include "Emulator_GUI.h"
 #include "Dma.h"
 
 // Initialize static variables
 // LCD control: FF40
-static uint8_t LCDC = 0x00;
+static GB_INSTANCE uint8_t LCDC = 0x00;
 
 // LCD status: FF41
-static uint8_t STAT = 0x00;
+static GB_INSTANCE uint8_t STAT = 0x00;
 
 // Vertica scroll: FF42
-static uint8_t SCY = 0x00;
+static GB_INSTANCE uint8_t SCY = 0x00;
 
 // Horizontal scroll: FF43
-static uint8_t SCX = 0x00;
+static GB_INSTANCE uint8_t SCX = 0x00;
 
 // Scanline: FF44
-static uint8_t LY = 0x00;
+static GB_INSTANCE uint8_t LY = 0x00;
 
 // Scanline compare: FF45
-static uint8_t LYC = 0x00;
+static GB_INSTANCE uint8_t LYC = 0x00;
 
 // Background & window palette: FF47
-static uint8_t BGP = 0x00;
+static GB_INSTANCE uint8_t BGP = 0x00;
 
 // Object palette 0 & 1: FF48, FF49
-static uint8_t OBP0 = 0x00;
-static uint8_t OBP1 = 0x00;
+static GB_INSTANCE uint8_t OBP0 = 0x00;
+static GB_INSTANCE uint8_t OBP1 = 0x00;
 
 // Window X & Y position: FF4A, FF4B
-static uint8_t WY = 0x00;
-static uint8_t WX = 0x00;
+static GB_INSTANCE uint8_t WY = 0x00;
+static GB_INSTANCE uint8_t WX = 0x00;
 
 // Register addresses:
 // LCDC	0xFF40
@@ -75,7 +74,7 @@ static uint8_t WX = 0x00;
 // so the tiles can be selected from addresses $8800 - $97FF.
 // There are 2 tile maps in memory, one is from $9800-$9BFF, the other is from $9C00-$9FFF. The BG and the Window
 // can use either of them.
-static uint8_t vram[8192];
+static GB_INSTANCE uint8_t vram[8192];
 
 // OAM - Object Attribute Memory (Object == Sprite)
 // $FE00 - $FE9F
@@ -92,19 +91,57 @@ static uint8_t vram[8192];
 //		Bit 5: X-flip (0=normal)
 //		Bit 4: Palette number (0=OBP0, 1=OBP1)
 //		Bits 3-0: Unused on DMG
-static uint8_t oam[160];
+static GB_INSTANCE uint8_t oam[160];
 
 // Dot counter for each line
-static uint16_t line_dots = 0x0000;
+static GB_INSTANCE uint16_t line_dots = 0x0000;
 
 
 // Sprite reference
 // This arrray holds 10 X positions of sprites and their index in the OAM.
-static OBJ_REF sprite_ref[10] = { 0 };
+static GB_INSTANCE OBJ_REF sprite_ref[10] = { 0 };
 
 // Interrupt requests
-static uint8_t int_req = 0x00;
-bool int_check = false;
+static GB_INSTANCE uint8_t int_req = 0x00;
+GB_INSTANCE bool int_check = false;
+
+// OAM search state
+static GB_INSTANCE uint8_t sprite_ref_index = 0;
+
+// Data transfer state
+static GB_INSTANCE uint8_t draw_x = 0x00;
+static GB_INSTANCE uint8_t pixel_fetcher_state = 0x00; // PF_STATES
+static GB_INSTANCE uint8_t pixel_fetcher_mode = 0x00;
+static GB_INSTANCE uint8_t pixel_fetcher_obj_state = 0x00; // Sprite state
+static GB_INSTANCE uint16_t pixel_fetcher_tile_map_offset = 0x0000;
+static GB_INSTANCE uint16_t pixel_fetcher_tile_offset = 0x0000;
+static GB_INSTANCE uint16_t pixel_fetcher_obj_tile_offset = 0x0000;
+static GB_INSTANCE uint8_t pixel_fetcher_x = 0x00;
+static GB_INSTANCE uint8_t pixel_fetcher_tile_lo = 0x00;
+static GB_INSTANCE uint8_t pixel_fetcher_tile_hi = 0x00;
+static GB_INSTANCE bool push_stop = false; // True - stop pushing pixels to screen
+static GB_INSTANCE uint8_t scx_counter = 0x00;
+static GB_INSTANCE uint8_t curr_sprite_index = 0;
+static GB_INSTANCE uint8_t sprite_x_index = 0;
+static GB_INSTANCE uint8_t obj_counter = 0;
+static GB_INSTANCE bool push_pixels = false;
+
+// Pixel FIFOs
+// The pixel FIFO can hold 16 pixels. It must have at least 8 pixels in it before it can output
+// a pixel. That is so mixing between the BG and the sprites could be done. Mixing will be done on the high fifo.
+// Every pixel is composed of the color number (2 bits) and the palette (2 bits).
+// It is a queue.
+static GB_INSTANCE uint32_t out_pixel_fifo = 0x00000000;
+static GB_INSTANCE uint32_t out_palette_fifo = 0x00000000;
+static GB_INSTANCE uint8_t obj_pixels_lo = 0x00;
+static GB_INSTANCE uint8_t obj_pixels_hi = 0x00;
+static GB_INSTANCE uint16_t obj_pixels = 0x0000;
+static GB_INSTANCE uint8_t counter = 0;
+static GB_INSTANCE uint8_t none_counter = 0;
+
+// H-Blank and V-Blank entry
+static GB_INSTANCE bool hblank_entered = true;
+static GB_INSTANCE bool vblank_entered = true;
 
 // The PPU is a finite state machine
 // It has 4 modes:
@@ -271,8 +308,9 @@ void ppu_clock()
 #define sprite_bottom(y) (lcdc_getflag(LCDC_OBJ_SIZE) ? y-1 : y-9)
 void oam_search()
 {
-	// Static variables
-	static uint8_t sprite_ref_index = 0;
+	// The DMA step of this clock came before the PPU
+	if (dma_lazy)
+		bus_dma_sync(clock_count + 1);
 
 	// At beginning of OAM search
 	if (line_dots == 0)
@@ -310,37 +348,14 @@ void oam_search()
 
 void data_transfer()
 {
-	// Static variables
-	static uint8_t draw_x = 0x00;
-	static uint8_t pixel_fetcher_state = 0x00; // PF_STATES
-	static uint8_t pixel_fetcher_mode = 0x00;
-	static uint8_t pixel_fetcher_obj_state = 0x00; // Sprite state
-	static uint16_t pixel_fetcher_tile_map_offset = 0x0000;
-	static uint16_t pixel_fetcher_tile_offset = 0x0000;
-	static uint16_t pixel_fetcher_obj_tile_offset = 0x0000;
-	static uint8_t pixel_fetcher_x = 0x00;
-	static uint8_t pixel_fetcher_tile_lo = 0x00;
-	static uint8_t pixel_fetcher_tile_hi = 0x00;
-	static bool push_stop = false; // True - stop pushing pixels to screen
-	static uint8_t scx_counter = 0x00;
-	static uint8_t curr_sprite_index = 0;
-
-	// Pixel FIFOs
-	// The pixel FIFO can hold 16 pixels. It must have at least 8 pixels in it before it can output
-	// a pixel. That is so mixing between the BG and the sprites could be done. Mixing will be done on the high fifo.
-	// Every pixel is composed of the color number (2 bits) and the palette (2 bits).
-	// It is a queue.
-	static uint32_t out_pixel_fifo = 0x00000000;
+	// The DMA step of this clock came before the PPU
+	if (dma_lazy)
+		bus_dma_sync(clock_count + 1);
+
 #define out_pixel_fifo_hi (uint16_t)(out_pixel_fifo >> 8)
 #define out_pixel_fifo_lo (uint16_t)out_pixel_fifo
-	static uint32_t out_palette_fifo = 0x00000000;
 #define out_palette_fifo_hi (uint16_t)(out_palette_fifo >> 8)
 #define out_palette_fifo_lo (uint16_t)out_palette_fifo
-	static uint8_t obj_pixels_lo = 0x00;
-	static uint8_t obj_pixels_hi = 0x00;
-	static uint16_t obj_pixels = 0x0000;
-	static uint8_t counter = 0;
-	static uint8_t none_counter = 0;
 
 	// Reset on the first cycle
 	if (line_dots == 80)
@@ -365,9 +380,6 @@ void data_transfer()
 	// 3. Get tile data high - gets the higher 8 bits of the pixels needed from the tile. Takes two cycles.
 	// 4. Push - attempt to push the 8 pixels to the low part of the fifo. You can only push if it's empty.
 	// The pixel fetcher also has a sprite mode and a window mode.
-	
-	static uint8_t obj_counter = 0;
-	static bool push_pixels = false;
 
 	if (!lcdc_getflag(LCDC_BG_ENABLE))
 	{
@@ -398,8 +410,6 @@ void data_transfer()
 	// Should only push if there are more than 8 pixels in the fifo
 	if (!push_stop)
 	{
-		static uint8_t sprite_x_index = 0;
-
 		// Check for sprites
 		if (lcdc_getflag(LCDC_OBJ_ENABLE) && scx_counter == 0)// && false)
 		{
@@ -782,12 +792,10 @@ void data_transfer()
 
 void hblank()
 {
-	static bool entered = true;
-
 	// entering H-Blank
-	if (entered)
+	if (hblank_entered)
 	{
-		entered = false;
+		hblank_entered = false;
 
 		// Interrupt request
 		int_req_set(STAT_INT_REQ_HBLANK, true);
@@ -796,7 +804,7 @@ void hblank()
 	// Exiting H-Blank
 	if (line_dots == 455)
 	{
-		entered = true;
+		hblank_entered = true;
 		int_req_set(STAT_INT_REQ_HBLANK, false);
 
 		
@@ -810,18 +818,17 @@ void hblank()
 
 void vblank()
 {
-	static bool entered = true;
-
-	if (entered)
+	if (vblank_entered)
 	{
-		entered = false;
+		vblank_entered = false;
 		int_req_set(STAT_INT_REQ_VBLANK, true);
 		cpu_int_req_set(INT_VBLANK, true);
+		bus_frame_end();
 	}
 
 	if (LY == 153 && line_dots == 455)
 	{
-		entered = true;
+		vblank_entered = true;
 		int_req_set(STAT_INT_REQ_VBLANK, false);
 		stat_setmode(STAT_MODE_OAM);
 	}
@@ -845,6 +852,37 @@ int ppu_reset(bool bootskip)
 	WY = 0x00;
 	WX = 0x00;
 
+	// Mode state machine
+	line_dots = 0x0000;
+	memset(sprite_ref, 0, sizeof sprite_ref);
+	int_req = 0x00;
+	int_check = false;
+	sprite_ref_index = 0;
+	draw_x = 0x00;
+	pixel_fetcher_state = 0x00;
+	pixel_fetcher_mode = 0x00;
+	pixel_fetcher_obj_state = 0x00;
+	pixel_fetcher_tile_map_offset = 0x0000;
+	pixel_fetcher_tile_offset = 0x0000;
+	pixel_fetcher_obj_tile_offset = 0x0000;
+	pixel_fetcher_x = 0x00;
+	pixel_fetcher_tile_lo = 0x00;
+	pixel_fetcher_tile_hi = 0x00;
+	push_stop = false;
+	scx_counter = 0x00;
+	curr_sprite_index = 0;
+	sprite_x_index = 0;
+	obj_counter = 0;
+	push_pixels = false;
+	out_pixel_fifo = 0x00000000;
+	out_palette_fifo = 0x00000000;
+	obj_pixels_lo = 0x00;
+	obj_pixels_hi = 0x00;
+	obj_pixels = 0x0000;
+	counter = 0;
+	none_counter = 0;
+	hblank_entered = true;
+	vblank_entered = true;
 
 	if (bootskip)
 	{
@@ -856,6 +894,102 @@ int ppu_reset(bool bootskip)
 	return 0;
 }
 
+void ppu_state_save(PPU_STATE* state)
+{
+	if (dma_lazy)
+		bus_dma_sync(clock_count);
+	memcpy(state->vram, vram, sizeof vram);
+	memcpy(state->oam, oam, sizeof oam);
+	memcpy(state->sprite_ref, sprite_ref, sizeof sprite_ref);
+	state->LCDC = LCDC;
+	state->STAT = STAT;
+	state->SCY = SCY;
+	state->SCX = SCX;
+	state->LY = LY;
+	state->LYC = LYC;
+	state->BGP = BGP;
+	state->OBP0 = OBP0;
+	state->OBP1 = OBP1;
+	state->WY = WY;
+	state->WX = WX;
+	state->int_req = int_req;
+	state->line_dots = line_dots;
+	state->pixel_fetcher_tile_map_offset = pixel_fetcher_tile_map_offset;
+	state->pixel_fetcher_tile_offset = pixel_fetcher_tile_offset;
+	state->pixel_fetcher_obj_tile_offset = pixel_fetcher_obj_tile_offset;
+	state->obj_pixels = obj_pixels;
+	state->out_pixel_fifo = out_pixel_fifo;
+	state->out_palette_fifo = out_palette_fifo;
+	state->sprite_ref_index = sprite_ref_index;
+	state->draw_x = draw_x;
+	state->pixel_fetcher_state = pixel_fetcher_state;
+	state->pixel_fetcher_mode = pixel_fetcher_mode;
+	state->pixel_fetcher_obj_state = pixel_fetcher_obj_state;
+	state->pixel_fetcher_x = pixel_fetcher_x;
+	state->pixel_fetcher_tile_lo = pixel_fetcher_tile_lo;
+	state->pixel_fetcher_tile_hi = pixel_fetcher_tile_hi;
+	state->scx_counter = scx_counter;
+	state->curr_sprite_index = curr_sprite_index;
+	state->sprite_x_index = sprite_x_index;
+	state->obj_counter = obj_counter;
+	state->obj_pixels_lo = obj_pixels_lo;
+	state->obj_pixels_hi = obj_pixels_hi;
+	state->counter = counter;
+	state->none_counter = none_counter;
+	state->push_stop = push_stop;
+	state->push_pixels = push_pixels;
+	state->int_check = int_check;
+	state->hblank_entered = hblank_entered;
+	state->vblank_entered = vblank_entered;
+}
+
+void ppu_state_load(PPU_STATE* state)
+{
+	memcpy(vram, state->vram, sizeof vram);
+	memcpy(oam, state->oam, sizeof oam);
+	memcpy(sprite_ref, state->sprite_ref, sizeof sprite_ref);
+	LCDC = state->LCDC;
+	STAT = state->STAT;
+	SCY = state->SCY;
+	SCX = state->SCX;
+	LY = state->LY;
+	LYC = state->LYC;
+	BGP = state->BGP;
+	OBP0 = state->OBP0;
+	OBP1 = state->OBP1;
+	WY = state->WY;
+	WX = state->WX;
+	int_req = state->int_req;
+	line_dots = state->line_dots;
+	pixel_fetcher_tile_map_offset = state->pixel_fetcher_tile_map_offset;
+	pixel_fetcher_tile_offset = state->pixel_fetcher_tile_offset;
+	pixel_fetcher_obj_tile_offset = state->pixel_fetcher_obj_tile_offset;
+	obj_pixels = state->obj_pixels;
+	out_pixel_fifo = state->out_pixel_fifo;
+	out_palette_fifo = state->out_palette_fifo;
+	sprite_ref_index = state->sprite_ref_index;
+	draw_x = state->draw_x;
+	pixel_fetcher_state = state->pixel_fetcher_state;
+	pixel_fetcher_mode = state->pixel_fetcher_mode;
+	pixel_fetcher_obj_state = state->pixel_fetcher_obj_state;
+	pixel_fetcher_x = state->pixel_fetcher_x;
+	pixel_fetcher_tile_lo = state->pixel_fetcher_tile_lo;
+	pixel_fetcher_tile_hi = state->pixel_fetcher_tile_hi;
+	scx_counter = state->scx_counter;
+	curr_sprite_index = state->curr_sprite_index;
+	sprite_x_index = state->sprite_x_index;
+	obj_counter = state->obj_counter;
+	obj_pixels_lo = state->obj_pixels_lo;
+	obj_pixels_hi = state->obj_pixels_hi;
+	counter = state->counter;
+	none_counter = state->none_counter;
+	push_stop = state->push_stop;
+	push_pixels = state->push_pixels;
+	int_check = state->int_check;
+	hblank_entered = state->hblank_entered;
+	vblank_entered = state->vblank_entered;
+}
+
 uint8_t ppu_write(uint16_t addr, uint8_t data)
 {
 	return bus_write(addr, data, DEV_PPU);
@@ -879,6 +1013,36 @@ uint8_t vram_write(uint16_t addr, uint8_t data)
 	return 0;
 }
 
+uint8_t* vram_span(uint16_t addr)
+{
+	if (addr < 0x8000 || addr > 0x9FFF)
+		return NULL;
+	if (lcdc_getflag(LCDC_LCD_ENABLE) && stat_getmode() == STAT_MODE_DATA)
+		return NULL;
+	return &vram[addr - 0x8000];
+}
+
+// Counts short in mode 3: it ends when 160 pixels are out, and draw_x goes up by at most one a dot
+uint32_t ppu_quiet_clocks()
+{
+	if (!lcdc_getflag(LCDC_LCD_ENABLE))
+		return UINT32_MAX;
+	if (int_check || line_dots == 0)
+		return 0;
+	switch (stat_getmode()) {
+		case STAT_MODE_OAM:
+			return line_dots < 79 ? 79 - line_dots : 0;
+		case STAT_MODE_DATA:
+			if (line_dots == 80)
+				return 159;
+			return draw_x < 159 ? 159 - draw_x : 0;
+		case STAT_MODE_HBLANK:
+			return hblank_entered ? 0 : 455 - line_dots;
+		default:
+			return vblank_entered ? 0 : 455 - line_dots;
+	}
+}
+
 uint8_t vram_read(uint16_t addr)
 {
 	// $8000 - $9FFF
@@ -907,6 +1071,12 @@ uint8_t oam_write(uint16_t addr, uint8_t data, uint8_t device)
 	return 0;
 }
 
+// OAM DMA copying a run of bytes at once
+void oam_dma_copy(uint8_t offset, uint8_t* data, uint8_t size)
+{
+	memcpy(oam + offset, data, size);
+}
+
 uint8_t oam_read(uint16_t addr)
 {
 	if (addr >= 0xFE00 && addr <= 0xFE9F)
@@ -1049,7 +1219,11 @@ uint8_t int_req_set(uint8_t flag, bool bSet)
 
 uint8_t cpu_int_req_set(uint8_t flag, bool bSet)
 {
-	return ppu_write(IF_ADDR, bSet ? ppu_read(IF_ADDR) | flag : ppu_read(IF_ADDR) & ~flag);
+	if (bSet)
+		bus_int_request(flag);
+	else
+		bus_int_acknowledge(flag);
+	return 0;
 }
 
 // Register addresses:
@@ -11,6 +11,15 @@ uint8_t vram_write(uint16_t addr, uint8_t data);
 uint8_t vram_read(uint16_t addr);
 uint8_t oam_write(uint16_t addr, uint8_t data, uint8_t device);
 uint8_t oam_read(uint16_t addr);
+void oam_dma_copy(uint8_t offset, uint8_t* data, uint8_t size);
+
+// VRAM at addr when the CPU can get to it (not in mode 3), NULL otherwise
+uint8_t* vram_span(uint16_t addr);
+
+// Clocks from this one on that the PPU runs without changing LY, STAT or IF or ending the frame, for
+// the fused instructions of the CPU (GB_FAST_FUSED)
+uint32_t ppu_quiet_clocks();
+
 uint8_t ppu_register_write(uint16_t addr, uint8_t data);
 uint8_t ppu_register_read(uint16_t addr);
 
@@ -111,6 +120,57 @@ enum OBJ_ATTRIBUTES {
 
 #define TILE_SIZE 16
 
+// Save states, including the state of the pixel fetcher in the middle of a line
+typedef struct {
+	uint8_t vram[8192];
+	uint8_t oam[160];
+	OBJ_REF sprite_ref[10];
+	uint32_t out_pixel_fifo;
+	uint32_t out_palette_fifo;
+	uint8_t LCDC;
+	uint8_t STAT;
+	uint8_t SCY;
+	uint8_t SCX;
+	uint8_t LY;
+	uint8_t LYC;
+	uint8_t BGP;
+	uint8_t OBP0;
+	uint8_t OBP1;
+	uint8_t WY;
+	uint8_t WX;
+	uint8_t int_req;
+	uint16_t line_dots;
+	uint16_t pixel_fetcher_tile_map_offset;
+	uint16_t pixel_fetcher_tile_offset;
+	uint16_t pixel_fetcher_obj_tile_offset;
+	uint16_t obj_pixels;
+	uint8_t sprite_ref_index;
+	uint8_t draw_x;
+	uint8_t pixel_fetcher_state;
+	uint8_t pixel_fetcher_mode;
+	uint8_t pixel_fetcher_obj_state;
+	uint8_t pixel_fetcher_x;
+	uint8_t pixel_fetcher_tile_lo;
+	uint8_t pixel_fetcher_tile_hi;
+	uint8_t scx_counter;
+	uint8_t curr_sprite_index;
+	uint8_t sprite_x_index;
+	uint8_t obj_counter;
+	uint8_t obj_pixels_lo;
+	uint8_t obj_pixels_hi;
+	uint8_t counter;
+	uint8_t none_counter;
+	bool push_stop;
+	bool push_pixels;
+	bool int_check;
+	bool hblank_entered;
+	bool vblank_entered;
+	uint8_t reserved;
+} PPU_STATE;
+
+void ppu_state_save(PPU_STATE* state);
+void ppu_state_load(PPU_STATE* state);
+
 void ppu_get_stats(uint8_t* lcdc, uint8_t* stat, uint8_t* scy, uint8_t* scx, uint8_t* ly, uint8_t* lyc,
 	uint8_t* bgp, uint8_t* obp0, uint8_t* obp1, uint8_t* wy, uint8_t* wx);
 
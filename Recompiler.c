@@ -0,0 +1,891 @@
+#include "Recompiler.h"
+#include "Sharp_LR35902.h"
+#include "Rom_index.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+GB_INSTANCE const RECOMP_FUNC* recomp_banks = NULL;
+GB_INSTANCE uint32_t recomp_bank_count = 0;
+
+static GB_INSTANCE PLATFORM_LIBRARY* recomp_library = NULL;
+static GB_INSTANCE const RECOMP_MODULE* recomp_module = NULL;
+static GB_INSTANCE bool recomp_enabled = false;
+
+// The start of every generated file: the structures of Recompiler.h, the registers and the flags like
+// the CPU has them, and the instructions that take more than a line. The helpers do what the handlers
+// of Sharp_LR35902.c do, in the same order on the bus.
+static const char* recomp_prelude[] = {
+	"#include <stdint.h>",
+	"",
+	"#ifdef _WIN32",
+	"#define RC_EXPORT __declspec(dllexport)",
+	"#else",
+	"#define RC_EXPORT __attribute__((visibility(\"default\")))",
+	"#endif",
+	"",
+	"typedef struct {",
+	"\tuint16_t af, bc, de, hl, sp, pc;",
+	"\tuint8_t opcode;",
+	"\tuint8_t cb_opcode;",
+	"\tuint8_t(*read)(uint16_t addr);",
+	"\tvoid(*write)(uint16_t addr, uint8_t data);",
+	"} RC_CPU;",
+	"",
+	"typedef uint8_t(*RC_FUNC)(RC_CPU* c, uint16_t pc);",
+	"",
+	"typedef struct {",
+	"\tuint32_t version;",
+	"\tuint64_t rom_hash;",
+	"\tuint32_t bank_count;",
+	"\tconst RC_FUNC* banks;",
+	"} RC_MODULE;",
+	"",
+	"#define A ((uint8_t)(c->af >> 8))",
+	"#define B ((uint8_t)(c->bc >> 8))",
+	"#define C ((uint8_t)c->bc)",
+	"#define D ((uint8_t)(c->de >> 8))",
+	"#define E ((uint8_t)c->de)",
+	"#define H ((uint8_t)(c->hl >> 8))",
+	"#define L ((uint8_t)c->hl)",
+	"#define FZ 0x80",
+	"#define FN 0x40",
+	"#define FH 0x20",
+	"#define FC 0x10",
+	"#define FLAG(f) ((c->af & (f)) != 0)",
+	"#define RD(addr) c->read(addr)",
+	"#define WR(addr, data) c->write(addr, data)",
+	"",
+	"static inline void set_a(RC_CPU* c, uint8_t v) { c->af = (uint16_t)(v << 8 | (c->af & 0x00FF)); }",
+	"static inline void set_b(RC_CPU* c, uint8_t v) { c->bc = (uint16_t)(v << 8 | (c->bc & 0x00FF)); }",
+	"static inline void set_c(RC_CPU* c, uint8_t v) { c->bc = (uint16_t)((c->bc & 0xFF00) | v); }",
+	"static inline void set_d(RC_CPU* c, uint8_t v) { c->de = (uint16_t)(v << 8 | (c->de & 0x00FF)); }",
+	"static inline void set_e(RC_CPU* c, uint8_t v) { c->de = (uint16_t)((c->de & 0xFF00) | v); }",
+	"static inline void set_h(RC_CPU* c, uint8_t v) { c->hl = (uint16_t)(v << 8 | (c->hl & 0x00FF)); }",
+	"static inline void set_l(RC_CPU* c, uint8_t v) { c->hl = (uint16_t)((c->hl & 0xFF00) | v); }",
+	"",
+	"static inline void setf(RC_CPU* c, uint8_t f, int b)",
+	"{",
+	"\tif (b)",
+	"\t\tc->af |= f;",
+	"\telse",
+	"\t\tc->af &= (uint16_t)~f;",
+	"}",
+	"",
+	"static inline void op_add(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tuint16_t t = A + v;",
+	"\tsetf(c, FZ, (t & 0x00FF) == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, (((A & 0x0F) + (v & 0x0F)) & 0x10) > 0);",
+	"\tsetf(c, FC, (t & 0x0100) > 0);",
+	"\tset_a(c, (uint8_t)t);",
+	"}",
+	"",
+	"static inline void op_adc(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tuint8_t cy = FLAG(FC);",
+	"\tuint16_t t = A + v + cy;",
+	"\tsetf(c, FZ, (t & 0x00FF) == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, (((A & 0x0F) + (v & 0x0F) + cy) & 0x10) > 0);",
+	"\tsetf(c, FC, (t & 0x0100) > 0);",
+	"\tset_a(c, (uint8_t)t);",
+	"}",
+	"",
+	"static inline void op_sub(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tsetf(c, FZ, A == v);",
+	"\tsetf(c, FN, 1);",
+	"\tsetf(c, FH, (v & 0x0F) > (A & 0x0F));",
+	"\tsetf(c, FC, v > A);",
+	"\tset_a(c, A - v);",
+	"}",
+	"",
+	"static inline void op_sbc(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tuint8_t cy = FLAG(FC);",
+	"\tuint16_t t = A - v - cy;",
+	"\tsetf(c, FZ, (uint8_t)t == 0);",
+	"\tsetf(c, FN, 1);",
+	"\tsetf(c, FH, ((v & 0x0F) + cy) > (A & 0x0F));",
+	"\tsetf(c, FC, (uint16_t)(v + cy) > A);",
+	"\tset_a(c, (uint8_t)t);",
+	"}",
+	"",
+	"static inline void op_and(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tset_a(c, A & v);",
+	"\tsetf(c, FZ, A == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 1);",
+	"\tsetf(c, FC, 0);",
+	"}",
+	"",
+	"static inline void op_xor(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tset_a(c, A ^ v);",
+	"\tsetf(c, FZ, A == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\tsetf(c, FC, 0);",
+	"}",
+	"",
+	"static inline void op_or(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tset_a(c, A | v);",
+	"\tsetf(c, FZ, A == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\tsetf(c, FC, 0);",
+	"}",
+	"",
+	"static inline void op_cp(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tsetf(c, FZ, A == v);",
+	"\tsetf(c, FN, 1);",
+	"\tsetf(c, FH, (v & 0x0F) > (A & 0x0F));",
+	"\tsetf(c, FC, v > A);",
+	"}",
+	"",
+	"static inline uint8_t op_inc(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tsetf(c, FH, (v & 0x0F) == 0x0F);",
+	"\tv++;",
+	"\tsetf(c, FZ, v == 0);",
+	"\tsetf(c, FN, 0);",
+	"\treturn v;",
+	"}",
+	"",
+	"static inline uint8_t op_dec(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tsetf(c, FH, (v & 0x0F) == 0);",
+	"\tv--;",
+	"\tsetf(c, FZ, v == 0);",
+	"\tsetf(c, FN, 1);",
+	"\treturn v;",
+	"}",
+	"",
+	"static inline void op_inc_hl(RC_CPU* c)",
+	"{",
+	"\tuint8_t t = RD(c->hl);",
+	"\tsetf(c, FH, (t & 0x0F) == 0x0F);",
+	"\tWR(c->hl, t + 1);",
+	"\tsetf(c, FZ, RD(c->hl) == 0);",
+	"\tsetf(c, FN, 0);",
+	"}",
+	"",
+	"static inline void op_dec_hl(RC_CPU* c)",
+	"{",
+	"\tuint8_t t = RD(c->hl);",
+	"\tsetf(c, FH, (t & 0x0F) == 0);",
+	"\tWR(c->hl, t - 1);",
+	"\tsetf(c, FZ, t == 1);",
+	"\tsetf(c, FN, 1);",
+	"}",
+	"",
+	"static inline void op_add_hl(RC_CPU* c, uint16_t v)",
+	"{",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, ((c->hl & 0x0FFF) + (v & 0x0FFF)) > 0x0FFF);",
+	"\tsetf(c, FC, ((int)c->hl + (int)v) > 0xFFFF);",
+	"\tc->hl += v;",
+	"}",
+	"",
+	"static inline void op_sp_flags(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tsetf(c, FH, ((c->sp & 0x0F) + (v & 0x0F)) > 0x0F);",
+	"\tsetf(c, FC, ((c->sp & 0xFF) + v) > 0xFF);",
+	"\tsetf(c, FZ, 0);",
+	"\tsetf(c, FN, 0);",
+	"}",
+	"",
+	"static inline void op_rlca(RC_CPU* c)",
+	"{",
+	"\tuint8_t t = (A & 0x80) >> 7;",
+	"\tset_a(c, (A << 1) | t);",
+	"\tsetf(c, FC, t);",
+	"\tsetf(c, FZ, 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"}",
+	"",
+	"static inline void op_rrca(RC_CPU* c)",
+	"{",
+	"\tuint8_t t = (A & 0x01) << 7;",
+	"\tset_a(c, (A >> 1) | t);",
+	"\tsetf(c, FC, t > 0);",
+	"\tsetf(c, FZ, 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"}",
+	"",
+	"static inline void op_rla(RC_CPU* c)",
+	"{",
+	"\tuint8_t t = FLAG(FC);",
+	"\tsetf(c, FC, (A & 0x80) > 0);",
+	"\tset_a(c, (A << 1) | t);",
+	"\tsetf(c, FZ, 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"}",
+	"",
+	"static inline void op_rra(RC_CPU* c)",
+	"{",
+	"\tuint8_t t = FLAG(FC) << 7;",
+	"\tsetf(c, FC, (A & 0x01) > 0);",
+	"\tset_a(c, (A >> 1) | t);",
+	"\tsetf(c, FZ, 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"}",
+	"",
+	"static inline void op_daa(RC_CPU* c)",
+	"{",
+	"\tif (!FLAG(FN))",
+	"\t{",
+	"\t\tif (FLAG(FC) || A > 0x99)",
+	"\t\t{",
+	"\t\t\tset_a(c, A + 0x60);",
+	"\t\t\tsetf(c, FC, 1);",
+	"\t\t}",
+	"\t\tif (FLAG(FH) || (A & 0x0F) > 9)",
+	"\t\t\tset_a(c, A + 6);",
+	"\t}",
+	"\telse",
+	"\t{",
+	"\t\tif (FLAG(FC))",
+	"\t\t\tset_a(c, A - 0x60);",
+	"\t\tif (FLAG(FH))",
+	"\t\t\tset_a(c, A - 6);",
+	"\t}",
+	"\tsetf(c, FZ, A == 0);",
+	"\tsetf(c, FH, 0);",
+	"}",
+	"",
+	"static inline void op_cpl(RC_CPU* c)",
+	"{",
+	"\tset_a(c, ~A);",
+	"\tsetf(c, FN, 1);",
+	"\tsetf(c, FH, 1);",
+	"}",
+	"",
+	"static inline void op_scf(RC_CPU* c)",
+	"{",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\tsetf(c, FC, 1);",
+	"}",
+	"",
+	"static inline void op_ccf(RC_CPU* c)",
+	"{",
+	"\tsetf(c, FC, !FLAG(FC));",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"}",
+	"",
+	"static inline void push(RC_CPU* c, uint16_t v)",
+	"{",
+	"\tWR(--c->sp, (uint8_t)(v >> 8));",
+	"\tWR(--c->sp, (uint8_t)v);",
+	"}",
+	"",
+	"static inline uint16_t pop(RC_CPU* c)",
+	"{",
+	"\tuint8_t lo = RD(c->sp++);",
+	"\tuint8_t hi = RD(c->sp++);",
+	"\treturn (uint16_t)(hi << 8 | lo);",
+	"}",
+	"",
+	"static inline uint8_t cb_rlc(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tuint8_t t = (v & 0x80) >> 7;",
+	"\tv = (uint8_t)(v << 1) | t;",
+	"\tsetf(c, FZ, v == 0);",
+	"\tsetf(c, FC, t > 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\treturn v;",
+	"}",
+	"",
+	"static inline uint8_t cb_rrc(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tuint8_t t = (v >> 1) | ((v & 0x01) << 7);",
+	"\tsetf(c, FC, (t & 0x80) > 0);",
+	"\tsetf(c, FZ, t == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\treturn t;",
+	"}",
+	"",
+	"static inline uint8_t cb_rl(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tuint8_t t = FLAG(FC);",
+	"\tsetf(c, FC, (v & 0x80) > 0);",
+	"\tv = (uint8_t)(v << 1) | t;",
+	"\tsetf(c, FZ, v == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\treturn v;",
+	"}",
+	"",
+	"static inline uint8_t cb_rr(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tuint8_t t = FLAG(FC) << 7;",
+	"\tsetf(c, FC, (v & 0x01) > 0);",
+	"\tt = (v >> 1) | t;",
+	"\tsetf(c, FZ, t == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\treturn t;",
+	"}",
+	"",
+	"static inline uint8_t cb_sla(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tsetf(c, FC, (v & 0x80) >> 7);",
+	"\tv = (uint8_t)(v << 1);",
+	"\tsetf(c, FZ, v == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\treturn v;",
+	"}",
+	"",
+	"static inline uint8_t cb_sra(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tsetf(c, FZ, v <= 1);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\tsetf(c, FC, v & 0x01);",
+	"\treturn (v & 0x80) | (v >> 1);",
+	"}",
+	"",
+	"static inline uint8_t cb_swap(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tsetf(c, FZ, v == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\tsetf(c, FC, 0);",
+	"\treturn (uint8_t)(v << 4) | (v >> 4);",
+	"}",
+	"",
+	"static inline uint8_t cb_srl(RC_CPU* c, uint8_t v)",
+	"{",
+	"\tsetf(c, FZ, v <= 1);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"\tsetf(c, FC, v & 0x01);",
+	"\treturn v >> 1;",
+	"}",
+	"",
+	"// The rotates of (HL) read it again where the interpreter does",
+	"static inline void cb_rlc_hl(RC_CPU* c)",
+	"{",
+	"\tuint8_t t = (RD(c->hl) & 0x80) >> 7;",
+	"\tWR(c->hl, (uint8_t)(RD(c->hl) << 1) | t);",
+	"\tsetf(c, FZ, RD(c->hl) == 0);",
+	"\tsetf(c, FC, t > 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"}",
+	"",
+	"static inline void cb_rrc_hl(RC_CPU* c)",
+	"{",
+	"\tuint8_t t = (RD(c->hl) & 0x01) << 7;",
+	"\tt = (RD(c->hl) >> 1) | t;",
+	"\tWR(c->hl, t);",
+	"\tsetf(c, FC, (t & 0x80) > 0);",
+	"\tsetf(c, FZ, t == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"}",
+	"",
+	"static inline void cb_rl_hl(RC_CPU* c)",
+	"{",
+	"\tuint8_t t = FLAG(FC);",
+	"\tsetf(c, FC, (RD(c->hl) & 0x80) > 0);",
+	"\tWR(c->hl, (uint8_t)(RD(c->hl) << 1) | t);",
+	"\tsetf(c, FZ, RD(c->hl) == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"}",
+	"",
+	"static inline void cb_rr_hl(RC_CPU* c)",
+	"{",
+	"\tuint8_t t = FLAG(FC) << 7;",
+	"\tsetf(c, FC, (RD(c->hl) & 0x01) > 0);",
+	"\tt = (RD(c->hl) >> 1) | t;",
+	"\tWR(c->hl, t);",
+	"\tsetf(c, FZ, t == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 0);",
+	"}",
+	"",
+	"static inline void bit(RC_CPU* c, uint8_t v, uint8_t mask)",
+	"{",
+	"\tsetf(c, FZ, (v & mask) == 0);",
+	"\tsetf(c, FN, 0);",
+	"\tsetf(c, FH, 1);",
+	"}",
+	NULL
+};
+
+static const char* recomp_r8[8] = { "B", "C", "D", "E", "H", "L", "RD(c->hl)", "A" };
+static const char* recomp_set8[8] = { "set_b", "set_c", "set_d", "set_e", "set_h", "set_l", NULL, "set_a" };
+static const char* recomp_r16[4] = { "c->bc", "c->de", "c->hl", "c->sp" };
+static const char* recomp_alu[8] = { "op_add", "op_adc", "op_sub", "op_sbc", "op_and", "op_xor", "op_or", "op_cp" };
+static const char* recomp_cond[4] = { "!FLAG(FZ)", "FLAG(FZ)", "!FLAG(FC)", "FLAG(FC)" };
+static const char* recomp_cb[8] = { "cb_rlc", "cb_rrc", "cb_rl", "cb_rr", "cb_sla", "cb_sra", "cb_swap", "cb_srl" };
+
+// Instructions left to the interpreter: the ones that change the interrupt and halt state, LD SP (it
+// moves the stack base of the debugger) and the opcodes the CPU doesn't have
+static bool recomp_supported(uint8_t opcode)
+{
+	switch (opcode)
+	{
+	case 0x10: case 0x31: case 0x76: case 0xD9: case 0xF3: case 0xF9: case 0xFB:
+	case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+		return false;
+	default:
+		return true;
+	}
+}
+
+static void recomp_line(FILE* file, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	fputs("\t\t", file);
+	vfprintf(file, format, args);
+	fputs("\n", file);
+	va_end(args);
+}
+
+// Jumps, calls and returns, false if the instruction doesn't change the flow
+static bool recomp_flow(FILE* file, uint8_t* bytes, uint16_t next, uint8_t cycles)
+{
+	uint8_t opcode = bytes[0];
+	uint16_t nn = bytes[1] | (bytes[2] << 8);
+	char taken[64];
+	uint8_t extra = 0;	// Cycles of a taken conditional branch
+	if (opcode == 0x18 || (opcode & 0xE7) == 0x20)
+	{
+		// JR, JR cc
+		snprintf(taken, sizeof(taken), "c->pc = 0x%04X;", (uint16_t)(next + (int8_t)bytes[1]));
+		extra = opcode == 0x18 ? 0 : 1;
+	}
+	else if (opcode == 0xC3 || (opcode & 0xE7) == 0xC2)
+	{
+		// JP, JP cc
+		snprintf(taken, sizeof(taken), "c->pc = 0x%04X;", nn);
+		extra = opcode == 0xC3 ? 0 : 1;
+	}
+	else if (opcode == 0xCD || (opcode & 0xE7) == 0xC4 || (opcode & 0xC7) == 0xC7)
+	{
+		// CALL, CALL cc, RST
+		uint16_t target = (opcode & 0xC7) == 0xC7 ? opcode & 0x38 : nn;
+		snprintf(taken, sizeof(taken), "push(c, 0x%04X); c->pc = 0x%04X;", next, target);
+		extra = (opcode & 0xE7) == 0xC4 ? 3 : 0;
+	}
+	else if (opcode == 0xC9 || (opcode & 0xE7) == 0xC0)
+	{
+		// RET, RET cc
+		snprintf(taken, sizeof(taken), "c->pc = pop(c);");
+		extra = opcode == 0xC9 ? 0 : 3;
+	}
+	else if (opcode == 0xE9)
+		snprintf(taken, sizeof(taken), "c->pc = c->hl;");
+	else
+		return false;
+
+	if (extra == 0)
+	{
+		recomp_line(file, "%s", taken);
+		recomp_line(file, "return %d;", cycles);
+		return true;
+	}
+	// A taken branch goes to the target with the extra cycles, the other way falls through
+	recomp_line(file, "if (%s)", recomp_cond[(opcode >> 3) & 0x03]);
+	recomp_line(file, "{");
+	recomp_line(file, "\t%s", taken);
+	recomp_line(file, "\treturn %d;", cycles + extra);
+	recomp_line(file, "}");
+	recomp_line(file, "c->pc = 0x%04X;", next);
+	recomp_line(file, "return %d;", cycles);
+	return true;
+}
+
+// CB instructions, returns their cycles
+static uint8_t recomp_cb_instruction(FILE* file, uint8_t cb, uint8_t cycles)
+{
+	uint8_t r = cb & 0x07;
+	uint8_t bit = (cb >> 3) & 0x07;
+	recomp_line(file, "c->cb_opcode = 0x%02X;", cb);
+	// (HL) is read before the instruction, like any other operand
+	if (r == 6 && (cb < 0x40 || cb >= 0x80))
+		recomp_line(file, "RD(c->hl);");
+	if (cb < 0x40)
+	{
+		if (r != 6)
+			recomp_line(file, "%s(c, %s(c, %s));", recomp_set8[r], recomp_cb[bit], recomp_r8[r]);
+		else if (bit < 4)
+			recomp_line(file, "%s_hl(c);", recomp_cb[bit]);
+		else
+			recomp_line(file, "WR(c->hl, %s(c, RD(c->hl)));", recomp_cb[bit]);
+	}
+	else if (cb < 0x80)
+		recomp_line(file, "bit(c, %s, 0x%02X);", recomp_r8[r], 1 << bit);
+	else
+	{
+		char* op = cb < 0xC0 ? "&" : "|";
+		uint8_t mask = cb < 0xC0 ? (uint8_t)~(1 << bit) : (uint8_t)(1 << bit);
+		if (r == 6)
+			recomp_line(file, "WR(c->hl, RD(c->hl) %s 0x%02X);", op, mask);
+		else
+			recomp_line(file, "%s(c, %s %s 0x%02X);", recomp_set8[r], recomp_r8[r], op, mask);
+	}
+	return cycles + (r == 6) + (cb >= 0x40 && cb < 0x80);
+}
+
+// What the instruction at addr does, where it goes next and its cycles
+static void recomp_instruction(FILE* file, uint8_t* bytes, uint16_t addr)
+{
+	uint8_t opcode = bytes[0];
+	uint8_t n = bytes[1];
+	uint16_t nn = bytes[1] | (bytes[2] << 8);
+	uint16_t next = addr + cpu_opcode_length(opcode);
+	uint8_t cycles = cpu_opcode_cycles(opcode);
+	uint8_t x = (opcode >> 3) & 0x07;
+	uint8_t z = opcode & 0x07;
+	const char* rr = recomp_r16[(opcode >> 4) & 0x03];
+
+	recomp_line(file, "c->opcode = 0x%02X;", opcode);
+	if (recomp_flow(file, bytes, next, cycles))
+		return;
+	if (opcode >= 0x40 && opcode <= 0x7F)
+	{
+		// LD r,r
+		if (x == 6)
+			recomp_line(file, "WR(c->hl, %s);", recomp_r8[z]);
+		else
+			recomp_line(file, "%s(c, %s);", recomp_set8[x], recomp_r8[z]);
+	}
+	else if (opcode >= 0x80 && opcode <= 0xBF)
+		recomp_line(file, "%s(c, %s);", recomp_alu[x], recomp_r8[z]);
+	else if (opcode >= 0xC0 && z == 6)
+		recomp_line(file, "%s(c, 0x%02X);", recomp_alu[x], n);
+	else if (opcode < 0x40 && z == 6)
+	{
+		// LD r,n
+		if (x == 6)
+			recomp_line(file, "WR(c->hl, 0x%02X);", n);
+		else
+			recomp_line(file, "%s(c, 0x%02X);", recomp_set8[x], n);
+	}
+	else if (opcode < 0x40 && (z == 4 || z == 5))
+	{
+		// INC r, DEC r
+		char* op = z == 4 ? "op_inc" : "op_dec";
+		if (x == 6)
+			recomp_line(file, "%s_hl(c);", op);
+		else
+			recomp_line(file, "%s(c, %s(c, %s));", recomp_set8[x], op, recomp_r8[x]);
+	}
+	else
+	{
+		switch (opcode)
+		{
+		case 0x00:
+			break;
+		case 0x01: case 0x11: case 0x21:
+			recomp_line(file, "%s = 0x%04X;", rr, nn);
+			break;
+		case 0x03: case 0x13: case 0x23: case 0x33:
+			recomp_line(file, "%s++;", rr);
+			break;
+		case 0x0B: case 0x1B: case 0x2B: case 0x3B:
+			recomp_line(file, "%s--;", rr);
+			break;
+		case 0x09: case 0x19: case 0x29: case 0x39:
+			recomp_line(file, "op_add_hl(c, %s);", rr);
+			break;
+		case 0x02: case 0x12:
+			recomp_line(file, "WR(%s, A);", rr);
+			break;
+		case 0x0A: case 0x1A:
+			recomp_line(file, "set_a(c, RD(%s));", rr);
+			break;
+		case 0x22: case 0x32:
+			recomp_line(file, "WR(c->hl, A);");
+			recomp_line(file, opcode == 0x22 ? "c->hl++;" : "c->hl--;");
+			break;
+		case 0x2A: case 0x3A:
+			recomp_line(file, "set_a(c, RD(c->hl));");
+			recomp_line(file, opcode == 0x2A ? "c->hl++;" : "c->hl--;");
+			break;
+		case 0x07:
+			recomp_line(file, "op_rlca(c);");
+			break;
+		case 0x0F:
+			recomp_line(file, "op_rrca(c);");
+			break;
+		case 0x17:
+			recomp_line(file, "op_rla(c);");
+			break;
+		case 0x1F:
+			recomp_line(file, "op_rra(c);");
+			break;
+		case 0x27:
+			recomp_line(file, "op_daa(c);");
+			break;
+		case 0x2F:
+			recomp_line(file, "op_cpl(c);");
+			break;
+		case 0x37:
+			recomp_line(file, "op_scf(c);");
+			break;
+		case 0x3F:
+			recomp_line(file, "op_ccf(c);");
+			break;
+		case 0x08:
+			recomp_line(file, "WR(0x%04X, (uint8_t)c->sp);", nn);
+			recomp_line(file, "WR(0x%04X, (uint8_t)(c->sp >> 8));", (uint16_t)(nn + 1));
+			break;
+		case 0xC1: case 0xD1: case 0xE1:
+			recomp_line(file, "%s = pop(c);", rr);
+			break;
+		case 0xF1:
+			recomp_line(file, "c->af = pop(c) & 0xFFF0;");
+			break;
+		case 0xC5: case 0xD5: case 0xE5:
+			recomp_line(file, "push(c, %s);", rr);
+			break;
+		case 0xF5:
+			recomp_line(file, "push(c, c->af);");
+			break;
+		case 0xE0:
+			recomp_line(file, "WR(0x%04X, A);", 0xFF00 | n);
+			break;
+		case 0xF0:
+			recomp_line(file, "set_a(c, RD(0x%04X));", 0xFF00 | n);
+			break;
+		case 0xE2:
+			recomp_line(file, "WR(0xFF00 | C, A);");
+			break;
+		case 0xF2:
+			recomp_line(file, "set_a(c, RD(0xFF00 | C));");
+			break;
+		case 0xEA:
+			recomp_line(file, "WR(0x%04X, A);", nn);
+			break;
+		case 0xFA:
+			recomp_line(file, "set_a(c, RD(0x%04X));", nn);
+			break;
+		case 0xE8:
+			recomp_line(file, "op_sp_flags(c, 0x%02X);", n);
+			recomp_line(file, "c->sp += %d;", (int8_t)n);
+			break;
+		case 0xF8:
+			recomp_line(file, "op_sp_flags(c, 0x%02X);", n);
+			recomp_line(file, "c->hl = c->sp + %d;", (int8_t)n);
+			break;
+		case 0xCB:
+			cycles = recomp_cb_instruction(file, n, cycles);
+			break;
+		}
+	}
+	recomp_line(file, "c->pc = 0x%04X;", next);
+	recomp_line(file, "return %d;", cycles);
+}
+
+static long recomp_offset(uint16_t bank, uint16_t addr)
+{
+	return addr < 0x4000 ? addr : (long)bank * 0x4000 + (addr - 0x4000);
+}
+
+// One function per block, with a case for every instruction the compiled code has. Returns false if
+// the block has none.
+static bool recomp_block(FILE* file, DISASM_BLOCK* block, uint8_t* rom)
+{
+	long offset = recomp_offset(block->bank, block->addr);
+	uint16_t addr = block->addr;
+	int count = 0;
+	int cycles = 0;
+	for (int i = 0; i < block->instructions; i++)
+	{
+		uint8_t opcode = rom[offset + (addr - block->addr)];
+		count += recomp_supported(opcode);
+		cycles += cpu_opcode_cycles(opcode);
+		addr += cpu_opcode_length(opcode);
+	}
+	if (count == 0)
+		return false;
+
+	// The cycles of the block are those of the way through it, without taken branches and CB instructions
+	fprintf(file, "// %02X:%04X, %d instructions, %d cycles\n", block->bank, block->addr, block->instructions, cycles);
+	fprintf(file, "static uint8_t block_%02X_%04X(RC_CPU* c, uint16_t pc)\n{\n\tswitch (pc)\n\t{\n", block->bank, block->addr);
+	addr = block->addr;
+	for (int i = 0; i < block->instructions; i++)
+	{
+		uint8_t* bytes = &rom[offset + (addr - block->addr)];
+		if (recomp_supported(bytes[0]))
+		{
+			char text[64];
+			disassemble_bytes(bytes, addr, text, sizeof(text));
+			fprintf(file, "\tcase 0x%04X:\t// %s\n", addr, text);
+			recomp_instruction(file, bytes, addr);
+		}
+		addr += cpu_opcode_length(bytes[0]);
+	}
+	fprintf(file, "\t}\n\treturn 0;\n}\n\n");
+	return true;
+}
+
+// The switch of a bank that sends the address of each instruction to its block
+static void recomp_bank(FILE* file, DISASM_BLOCK* blocks, bool* compiled, int count, uint8_t* rom)
+{
+	fprintf(file, "static uint8_t bank_%02X(RC_CPU* c, uint16_t pc)\n{\n\tswitch (pc)\n\t{\n", blocks[0].bank);
+	for (int i = 0; i < count; i++)
+	{
+		if (!compiled[i])
+			continue;
+		DISASM_BLOCK* block = &blocks[i];
+		long offset = recomp_offset(block->bank, block->addr);
+		uint16_t addr = block->addr;
+		int cases = 0;
+		for (int j = 0; j < block->instructions; j++)
+		{
+			uint8_t opcode = rom[offset + (addr - block->addr)];
+			if (recomp_supported(opcode))
+				fprintf(file, "%scase 0x%04X:", cases++ % 8 == 0 ? "\t" : " ", addr);
+			if (cases % 8 == 0)
+				fprintf(file, "\n");
+			addr += cpu_opcode_length(opcode);
+		}
+		if (cases % 8 != 0)
+			fprintf(file, "\n");
+		fprintf(file, "\t\treturn block_%02X_%04X(c, pc);\n", block->bank, block->addr);
+	}
+	fprintf(file, "\t}\n\treturn 0;\n}\n\n");
+}
+
+uint8_t recomp_generate(DISASM_CFG* cfg, uint8_t* rom, char* filename)
+{
+	FILE* file = fopen(filename, "w");
+	if (file == NULL)
+		return RECOMP_ERR_FILE_OPEN;
+	uint32_t bank_count = (cfg->rom_size + 0x3FFF) / 0x4000;
+	bool* compiled = calloc(cfg->count + 1, sizeof(bool));
+	bool* bank_compiled = calloc(bank_count + 1, sizeof(bool));
+	if (compiled == NULL || bank_compiled == NULL)
+	{
+		free(compiled);
+		free(bank_compiled);
+		fclose(file);
+		return RECOMP_ERR_FILE_WRITE;
+	}
+
+	fprintf(file, "// Recompiled code of the ROM %016llx (%d blocks), made by gbrecomp.\n", (unsigned long long)cfg->hash, cfg->count);
+	fprintf(file, "// Build it with full optimisation into <rom>%s, see Recompiler.h.\n", RECOMP_EXTENSION);
+	for (int i = 0; recomp_prelude[i] != NULL; i++)
+		fprintf(file, "%s\n", recomp_prelude[i]);
+	fprintf(file, "\n");
+
+	// The blocks are by bank and address, a bank at a time
+	for (int first = 0; first < cfg->count;)
+	{
+		int last = first;
+		while (last < cfg->count && cfg->blocks[last].bank == cfg->blocks[first].bank)
+			last++;
+		uint16_t bank = cfg->blocks[first].bank;
+		fprintf(file, "// Bank %02X\n\n", bank);
+		for (int i = first; i < last; i++)
+		{
+			compiled[i] = recomp_block(file, &cfg->blocks[i], rom);
+			bank_compiled[bank] |= compiled[i];
+		}
+		if (bank_compiled[bank])
+			recomp_bank(file, &cfg->blocks[first], &compiled[first], last - first, rom);
+		first = last;
+	}
+
+	fprintf(file, "static const RC_FUNC banks[%u] = {\n", bank_count);
+	for (uint32_t bank = 0; bank < bank_count; bank++)
+	{
+		if (bank_compiled[bank])
+			fprintf(file, "\tbank_%02X,\n", bank);
+		else
+			fprintf(file, "\t0,\n");
+	}
+	fprintf(file, "};\n\n");
+	fprintf(file, "RC_EXPORT const RC_MODULE %s = { %d, 0x%016llxULL, %u, banks };\n", RECOMP_SYMBOL, RECOMP_VERSION,
+		(unsigned long long)cfg->hash, bank_count);
+
+	free(compiled);
+	free(bank_compiled);
+	bool failed = ferror(file) != 0;
+	if (fclose(file) != 0 || failed)
+		return RECOMP_ERR_FILE_WRITE;
+	return RECOMP_OK;
+}
+
+void recomp_module_name(char* rom_filename, char* name, size_t len)
+{
+	snprintf(name, len, "%s%s", rom_filename, RECOMP_EXTENSION);
+}
+
+static void recomp_update()
+{
+	if (recomp_enabled && recomp_module != NULL)
+	{
+		recomp_banks = recomp_module->banks;
+		recomp_bank_count = recomp_module->bank_count;
+	}
+	else
+	{
+		recomp_banks = NULL;
+		recomp_bank_count = 0;
+	}
+}
+
+uint8_t recomp_load(char* filename, uint8_t* rom, size_t size)
+{
+	recomp_unload();
+	PLATFORM_LIBRARY* library = platform_library_open(filename);
+	if (library == NULL)
+		return RECOMP_ERR_NO_MODULE;
+
+	// A module made from another version of the ROM would run the wrong code
+	const RECOMP_MODULE* module = platform_library_symbol(library, RECOMP_SYMBOL);
+	uint8_t res = RECOMP_OK;
+	if (module == NULL)
+		res = RECOMP_ERR_SYMBOL;
+	else if (module->version != RECOMP_VERSION)
+		res = RECOMP_ERR_VERSION;
+	else if (module->rom_hash != rom_hash64(rom, size))
+		res = RECOMP_ERR_STALE;
+	if (res != RECOMP_OK)
+	{
+		platform_library_close(library);
+		return res;
+	}
+	recomp_library = library;
+	recomp_module = module;
+	recomp_update();
+	return RECOMP_OK;
+}
+
+void recomp_unload()
+{
+	if (recomp_library != NULL)
+		platform_library_close(recomp_library);
+	recomp_library = NULL;
+	recomp_module = NULL;
+	recomp_update();
+}
+
+void recomp_enable(bool enable)
+{
+	recomp_enabled = enable;
+	recomp_update();
+}
@@ -0,0 +1,94 @@
+#ifndef RECOMPILER_CODE
+#define RECOMPILER_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "Bus.h"
+#include "Cartridge.h"
+#include "Disassembly.h"
+
+// Ahead of time recompilation of the ROM to C (GB_FAST_RECOMPILED)
+// gbrecomp turns every basic block the disassembly found (Disassembly.h) into a C function with the
+// instructions of the block, their operands and their cycles worked out in advance, and a switch per bank
+// that finds the block of an address. The file is built with full optimisation into a shared object
+// (<rom>.rc.so, <rom>.rc.dll on Windows by default). Modules are never picked up on their own: opening a
+// library runs its code before anything in it can be checked, so the front end loads one only when it's
+// named (gbrun -recomp, recomp= in a gbbatch manifest, gameboy_recomp_load), and it's then only used if
+// it was made from the ROM in the cartridge.
+//
+// The CPU still starts one instruction at a time, on the same clock as the interpreter, so the PPU, the
+// timer and the interrupts see the same machine: the compiled code only saves the fetch from the bus,
+// the decoding and the calls through the opcode table. The interpreter runs what the compiled code
+// doesn't have: code in RAM, addresses that aren't the start of a known instruction, the instructions
+// that change the interrupt or halt state (EI, DI, RETI, HALT, STOP), LD SP and the invalid opcodes.
+// It also runs everything while the boot ROM is mapped, while there are debugger watches, and while the
+// trace or the guest profiler look at the instructions one by one.
+//
+// The generated file doesn't include anything from here, it has its own copy of the structures below
+// and they are matched by RECOMP_VERSION.
+#define RECOMP_VERSION 1
+#define RECOMP_SYMBOL "gb_recomp_module"
+#ifdef _WIN32
+#define RECOMP_EXTENSION ".rc.dll"
+#else
+#define RECOMP_EXTENSION ".rc.so"
+#endif
+
+// Registers in and out of the compiled code, and the bus it uses
+typedef struct {
+	uint16_t af, bc, de, hl, sp, pc;
+	uint8_t opcode;
+	uint8_t cb_opcode;
+	uint8_t(*read)(uint16_t addr);
+	void(*write)(uint16_t addr, uint8_t data);
+} RECOMP_CPU;
+
+// Runs the instruction at pc, returns its cycles or 0 if it isn't in the compiled code
+typedef uint8_t(*RECOMP_FUNC)(RECOMP_CPU* cpu, uint16_t pc);
+
+typedef struct {
+	uint32_t version;
+	uint64_t rom_hash;
+	uint32_t bank_count;
+	const RECOMP_FUNC* banks;	// By ROM bank, NULL for banks without code
+} RECOMP_MODULE;
+
+// Banks of the loaded module while the CPU may use it, NULL otherwise
+extern GB_INSTANCE const RECOMP_FUNC* recomp_banks;
+extern GB_INSTANCE uint32_t recomp_bank_count;
+
+// The compiled code for the bank mapped at pc, NULL if there's none
+static inline RECOMP_FUNC recomp_find(uint16_t pc)
+{
+	if (pc > 0x7FFF)
+		return NULL;
+	uint16_t bank = cart_mapper_rom_bank(pc);
+	return bank < recomp_bank_count ? recomp_banks[bank] : NULL;
+}
+
+// Write the C file for the blocks of the ROM
+uint8_t recomp_generate(DISASM_CFG* cfg, uint8_t* rom, char* filename);
+
+// Default name of the module of a ROM file
+void recomp_module_name(char* rom_filename, char* name, size_t len);
+
+// Load a module, it's only kept if it was made from this ROM. Unloaded with the cartridge.
+uint8_t recomp_load(char* filename, uint8_t* rom, size_t size);
+void recomp_unload();
+
+// Whether the CPU may use the module, set by the bus (GB_FAST_RECOMPILED, no watches, boot ROM unmapped)
+void recomp_enable(bool enable);
+
+enum RECOMP_ERRORS {
+	RECOMP_OK = 0,
+	RECOMP_ERR_FILE_OPEN,
+	RECOMP_ERR_FILE_WRITE,
+	RECOMP_ERR_NO_MODULE,
+	RECOMP_ERR_SYMBOL,
+	RECOMP_ERR_VERSION,
+	RECOMP_ERR_STALE,
+	RECOMP_ERR_NO_CART
+};
+
+#endif // RECOMPILER_CODE
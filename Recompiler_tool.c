@@ -0,0 +1,78 @@
+#include "Bus.h"
+#include "Cartridge.h"
+#include "Disassembly.h"
+#include "Recompiler.h"
+#include <stdio.h>
+#include <string.h>
+
+// Static recompiler, writes the C file of the code of a ROM (see Recompiler.h)
+//	gbrecomp <rom> [-o file] [-cache dir]
+//	-o:		the C file (default <rom>.rc.c)
+//	-cache:	directory of the disassembly cache (Disassembly.h)
+// The file is then built into the module next to the ROM, make <rom>.rc.so does both, and it's run
+// with gbrun -recomp <rom>.rc.so.
+
+static int usage()
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "\tgbrecomp <rom> [-o file] [-cache dir]\n");
+	return 2;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+		return usage();
+	char* out = NULL;
+	char* cache_dir = NULL;
+	for (int i = 2; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+			return usage();
+		else if (strcmp(argv[i], "-o") == 0)
+			out = argv[++i];
+		else if (strcmp(argv[i], "-cache") == 0)
+			cache_dir = argv[++i];
+		else
+			return usage();
+	}
+	char default_out[1024];
+	if (out == NULL)
+	{
+		snprintf(default_out, sizeof(default_out), "%s.rc.c", argv[1]);
+		out = default_out;
+	}
+
+	uint8_t res = cart_load(argv[1]);
+	if (res != 0)
+	{
+		fprintf(stderr, "Loading the cartridge failed: %d\n", res);
+		return 2;
+	}
+	uint8_t* rom;
+	int rom_size;
+	uint8_t* ram;
+	int ram_size;
+	cart_mapper_get_memory(&rom, &rom_size, &ram, &ram_size);
+
+	DISASM_CFG* cfg;
+	if ((res = disasm_cached(cache_dir, rom, rom_size, &cfg)) != DISASM_OK)
+	{
+		fprintf(stderr, "Disassembling the ROM failed: %d\n", res);
+		cart_unload();
+		return 2;
+	}
+	res = recomp_generate(cfg, rom, out);
+	if (res != RECOMP_OK)
+		fprintf(stderr, "Writing %s failed: %d\n", out, res);
+	else
+	{
+		char module[1024];
+		recomp_module_name(argv[1], module, sizeof(module));
+		printf("%d blocks written to %s, build it into %s\n", cfg->count, out, module);
+	}
+
+	disasm_free(cfg);
+	cart_unload();
+	return res == RECOMP_OK ? 0 : 1;
+}
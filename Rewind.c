@@ -0,0 +1,416 @@
+#include "Bus.h"
+#include "Rewind.h"
+
+// Every frame is a vector of 32-bit words: the save state (padded to a whole word) followed by the screen.
+// A history record holds the delta (this frame XOR the previous one) and, on keyframes, the frame itself.
+// Both are run-length encoded with the tokens below, most of a delta is zero runs.
+// Because XOR is its own inverse, stepping back applies the deltas to the newest frame, newest first.
+// A keyframe lets a jump start from the keyframe instead of going through every frame after it.
+//
+// RLE token: varint (count << 2 | kind)
+//		RLE_ZERO:		count zero words
+//		RLE_REPEAT:		count copies of the word that follows
+//		RLE_LITERAL:	count words follow
+#define RLE_ZERO 0
+#define RLE_REPEAT 1
+#define RLE_LITERAL 2
+
+#define REWIND_SCREEN_SIZE (160 * 144 * sizeof(uint32_t))
+#define REWIND_BYTES_PER_ENTRY 512	// Expected average record size, sets the number of index entries
+
+typedef struct {
+	size_t offset;
+	uint32_t delta_size;	// 0 - first frame, nothing to go back to from here
+	uint32_t key_size;		// 0 - not a keyframe
+} REWIND_ENTRY;
+
+static GB_INSTANCE bool rewind_active = false;
+static GB_INSTANCE size_t rewind_budget = 0;
+static GB_INSTANCE int rewind_interval = 0;
+static GB_INSTANCE int since_keyframe = 0;
+
+// Frames
+static GB_INSTANCE size_t state_bytes = 0;
+static GB_INSTANCE size_t frame_words = 0;
+static GB_INSTANCE uint32_t* current = NULL;	// Newest frame
+static GB_INSTANCE uint32_t* next = NULL;
+static GB_INSTANCE bool have_current = false;
+static GB_INSTANCE uint64_t current_clock = 0;	// clock_count of the newest frame
+
+// Encoding buffers
+static GB_INSTANCE uint8_t* delta_buf = NULL;
+static GB_INSTANCE uint8_t* key_buf = NULL;
+static GB_INSTANCE size_t encode_cap = 0;
+
+// Ring buffer of records and their index
+static GB_INSTANCE uint8_t* ring = NULL;
+static GB_INSTANCE size_t ring_size = 0;
+static GB_INSTANCE size_t ring_head = 0;
+static GB_INSTANCE REWIND_ENTRY* entries = NULL;
+static GB_INSTANCE int entry_cap = 0;
+static GB_INSTANCE int entry_first = 0;
+static GB_INSTANCE int entry_count = 0;
+static GB_INSTANCE size_t history_bytes = 0;
+
+static uint8_t* put_varint(uint8_t* p, size_t v)
+{
+	while (v >= 0x80)
+	{
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static uint8_t* get_varint(uint8_t* p, size_t* v)
+{
+	size_t result = 0;
+	int shift = 0;
+	while (*p & 0x80)
+	{
+		result |= (size_t)(*p++ & 0x7F) << shift;
+		shift += 7;
+	}
+	*v = result | ((size_t)*p++ << shift);
+	return p;
+}
+
+static uint32_t rle_word(uint32_t* a, uint32_t* b, size_t i)
+{
+	return b != NULL ? a[i] ^ b[i] : a[i];
+}
+
+// Encodes a XOR b, or just a when b is NULL
+static size_t rle_encode(uint32_t* a, uint32_t* b, size_t n, uint8_t* out)
+{
+	uint8_t* p = out;
+	size_t i = 0;
+	while (i < n)
+	{
+		uint32_t w = rle_word(a, b, i);
+		size_t run = 1;
+		while (i + run < n && rle_word(a, b, i + run) == w)
+			run++;
+
+		if (w == 0)
+			p = put_varint(p, (run << 2) | RLE_ZERO);
+		else if (run >= 2)
+		{
+			p = put_varint(p, (run << 2) | RLE_REPEAT);
+			memcpy(p, &w, sizeof w);
+			p += sizeof w;
+		}
+		else
+		{
+			// Literal words up to the next zero or repeated word
+			size_t start = i;
+			run = 1;
+			while (i + run < n)
+			{
+				uint32_t x = rle_word(a, b, i + run);
+				if (x == 0 || (i + run + 1 < n && rle_word(a, b, i + run + 1) == x))
+					break;
+				run++;
+			}
+			p = put_varint(p, (run << 2) | RLE_LITERAL);
+			for (size_t j = start; j < start + run; j++)
+			{
+				uint32_t x = rle_word(a, b, j);
+				memcpy(p, &x, sizeof x);
+				p += sizeof x;
+			}
+		}
+		i += run;
+	}
+	return p - out;
+}
+
+// Decodes into dst, XORing the words into it or overwriting them
+static void rle_decode(uint8_t* in, size_t size, uint32_t* dst, bool xor)
+{
+	uint8_t* end = in + size;
+	size_t i = 0;
+	while (in < end)
+	{
+		size_t token;
+		in = get_varint(in, &token);
+		size_t count = token >> 2;
+		switch (token & 0x03)
+		{
+			case RLE_ZERO:
+				if (!xor)
+					memset(dst + i, 0, count * sizeof(uint32_t));
+				break;
+			case RLE_REPEAT:
+			{
+				uint32_t w;
+				memcpy(&w, in, sizeof w);
+				in += sizeof w;
+				for (size_t j = i; j < i + count; j++)
+					dst[j] = xor ? dst[j] ^ w : w;
+				break;
+			}
+			case RLE_LITERAL:
+				for (size_t j = i; j < i + count; j++)
+				{
+					uint32_t w;
+					memcpy(&w, in, sizeof w);
+					in += sizeof w;
+					dst[j] = xor ? dst[j] ^ w : w;
+				}
+				break;
+		}
+		i += count;
+	}
+}
+
+static REWIND_ENTRY* entry(int i)
+{
+	return &entries[(entry_first + i) % entry_cap];
+}
+
+static void evict_oldest()
+{
+	REWIND_ENTRY* e = entry(0);
+	history_bytes -= e->delta_size + e->key_size;
+	entry_first = (entry_first + 1) % entry_cap;
+	entry_count--;
+}
+
+static bool overlaps(REWIND_ENTRY* e, size_t start, size_t len)
+{
+	size_t e_len = e->delta_size + e->key_size;
+	return e->offset < start + len && start < e->offset + e_len;
+}
+
+// Makes room for a record, dropping the oldest ones
+static bool ring_alloc(size_t len, size_t* pos)
+{
+	if (len > ring_size)
+		return false;
+	size_t start = ring_head;
+	if (start + len > ring_size)
+	{
+		// The records after the head are the oldest, the tail of the ring is skipped
+		while (entry_count > 0 && entry(0)->offset >= ring_head)
+			evict_oldest();
+		start = 0;
+	}
+	while (entry_count > 0 && overlaps(entry(0), start, len))
+		evict_oldest();
+	if (entry_count == entry_cap)
+		evict_oldest();
+	*pos = start;
+	ring_head = start + len;
+	return true;
+}
+
+// Drops every record, the next frame starts the history over
+static void history_clear()
+{
+	ring_head = 0;
+	entry_first = 0;
+	entry_count = 0;
+	history_bytes = 0;
+	have_current = false;
+	since_keyframe = 0;
+}
+
+static void capture(uint32_t* frame)
+{
+	gameboy_state_save((uint8_t*)frame, state_bytes);
+	memcpy(frame + frame_words - REWIND_SCREEN_SIZE / sizeof(uint32_t), gameboy_get_screen(), REWIND_SCREEN_SIZE);
+}
+
+static uint8_t restore(uint32_t* frame)
+{
+	uint8_t res = gameboy_state_load((uint8_t*)frame, state_bytes);
+	if (res == STATE_OK)
+		memcpy(gameboy_get_screen(), frame + frame_words - REWIND_SCREEN_SIZE / sizeof(uint32_t), REWIND_SCREEN_SIZE);
+	return res;
+}
+
+static void rewind_free()
+{
+	free(current);
+	free(next);
+	free(delta_buf);
+	free(key_buf);
+	free(ring);
+	free(entries);
+	current = NULL;
+	next = NULL;
+	delta_buf = NULL;
+	key_buf = NULL;
+	ring = NULL;
+	entries = NULL;
+}
+
+// Sizes everything for the current state size
+static uint8_t rewind_setup()
+{
+	rewind_free();
+	state_bytes = gameboy_state_size();
+	frame_words = (state_bytes + sizeof(uint32_t) - 1) / sizeof(uint32_t) + REWIND_SCREEN_SIZE / sizeof(uint32_t);
+	size_t frame_bytes = frame_words * sizeof(uint32_t);
+
+	// Worst case of the encoding is a 1 byte token for every literal word
+	encode_cap = frame_bytes + frame_bytes / 4 + 16;
+	size_t fixed = 2 * frame_bytes + 2 * encode_cap;
+	if (rewind_budget < fixed)
+		return REWIND_ERR_BUDGET;
+	size_t rest = rewind_budget - fixed;
+	entry_cap = (int)(rest / REWIND_BYTES_PER_ENTRY);
+	if (entry_cap < 16)
+		entry_cap = 16;
+
+	// The ring has to hold the biggest record there can be, a delta and a keyframe
+	size_t index_bytes = entry_cap * sizeof(REWIND_ENTRY);
+	if (rest < index_bytes + 2 * encode_cap)
+		return REWIND_ERR_BUDGET;
+	ring_size = rest - index_bytes;
+
+	current = (uint32_t*)calloc(frame_words, sizeof(uint32_t));
+	next = (uint32_t*)calloc(frame_words, sizeof(uint32_t));
+	delta_buf = (uint8_t*)malloc(encode_cap);
+	key_buf = (uint8_t*)malloc(encode_cap);
+	ring = (uint8_t*)malloc(ring_size);
+	entries = (REWIND_ENTRY*)malloc(entry_cap * sizeof(REWIND_ENTRY));
+	if (current == NULL || next == NULL || delta_buf == NULL || key_buf == NULL || ring == NULL || entries == NULL)
+	{
+		rewind_free();
+		return REWIND_ERR_ALLOC;
+	}
+
+	history_clear();
+	return REWIND_OK;
+}
+
+uint8_t rewind_start(size_t budget, int keyframe_interval)
+{
+	if (rewind_active)
+		return REWIND_ERR_RUNNING;
+	rewind_budget = budget;
+	rewind_interval = keyframe_interval > 0 ? keyframe_interval : 1;
+	uint8_t res = rewind_setup();
+	if (res == REWIND_OK)
+		rewind_active = true;
+	return res;
+}
+
+void rewind_stop()
+{
+	rewind_active = false;
+	rewind_free();
+}
+
+void rewind_frame()
+{
+	if (!rewind_active)
+		return;
+
+	// A different cartridge changes the state size, start over
+	if (gameboy_state_size() != state_bytes && rewind_setup() != REWIND_OK)
+	{
+		rewind_stop();
+		return;
+	}
+
+	capture(next);
+	bool key = !have_current || since_keyframe + 1 >= rewind_interval;
+	size_t delta_size = have_current ? rle_encode(next, current, frame_words, delta_buf) : 0;
+	size_t key_size = key ? rle_encode(next, NULL, frame_words, key_buf) : 0;
+
+	// Without its record the next delta would be taken against a frame that isn't in the history, and
+	// stepping back over the gap would restore a wrong state
+	size_t pos;
+	if (!ring_alloc(delta_size + key_size, &pos))
+	{
+		history_clear();
+		return;
+	}
+	memcpy(ring + pos, delta_buf, delta_size);
+	memcpy(ring + pos + delta_size, key_buf, key_size);
+	REWIND_ENTRY* e = &entries[(entry_first + entry_count) % entry_cap];
+	e->offset = pos;
+	e->delta_size = (uint32_t)delta_size;
+	e->key_size = (uint32_t)key_size;
+	entry_count++;
+	history_bytes += delta_size + key_size;
+	since_keyframe = key ? 0 : since_keyframe + 1;
+
+	uint32_t* swap = current;
+	current = next;
+	next = swap;
+	have_current = true;
+	current_clock = clock_count;
+}
+
+int rewind_available()
+{
+	if (!rewind_active || entry_count == 0)
+		return 0;
+	return entry_count - 1 + (clock_count != current_clock ? 1 : 0);
+}
+
+uint8_t rewind_step_back(int frames)
+{
+	if (!rewind_active)
+		return REWIND_ERR_NOT_RUNNING;
+	if (frames <= 0)
+		return REWIND_OK;
+	if (frames > rewind_available())
+		return REWIND_ERR_EMPTY;
+
+	// The machine moved on from the newest frame, going back to it is the first step
+	if (clock_count != current_clock)
+		frames--;
+
+	int newest = entry_count - 1;
+	int target = newest - frames;
+	if (frames > 0)
+	{
+		// Start from the keyframe closest to the target if there's one on the way
+		int start = newest;
+		for (int i = target; i < newest; i++)
+		{
+			if (entry(i)->key_size != 0)
+			{
+				start = i;
+				break;
+			}
+		}
+		if (start != newest)
+		{
+			REWIND_ENTRY* e = entry(start);
+			rle_decode(ring + e->offset + e->delta_size, e->key_size, current, false);
+		}
+		for (int i = start; i > target; i--)
+		{
+			REWIND_ENTRY* e = entry(i);
+			rle_decode(ring + e->offset, e->delta_size, current, true);
+			history_bytes -= e->delta_size + e->key_size;
+		}
+		for (int i = newest; i > start; i--)
+			history_bytes -= entry(i)->delta_size + entry(i)->key_size;
+
+		REWIND_ENTRY* t = entry(target);
+		entry_count = target + 1;
+		ring_head = t->offset + t->delta_size + t->key_size;
+		since_keyframe = 0;
+		for (int i = target; i > 0 && entry(i)->key_size == 0; i--)
+			since_keyframe++;
+	}
+
+	uint8_t res = restore(current);
+	if (res != STATE_OK)
+		return REWIND_ERR_STATE;
+	current_clock = clock_count;
+	return REWIND_OK;
+}
+
+size_t rewind_history_size()
+{
+	return history_bytes;
+}
@@ -0,0 +1,37 @@
+#ifndef REWIND_CODE
+#define REWIND_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Rewind history.
+// At the end of every frame the machine state (and the screen) is captured and stored as the XOR
+// against the previous frame, run-length encoded, in a ring buffer of a fixed size. Every
+// keyframe_interval frames the full state is stored too, so going back many frames at once only
+// needs a few deltas. The oldest frames are dropped when the buffer is full.
+uint8_t rewind_start(size_t budget, int keyframe_interval);
+void rewind_stop();
+void rewind_frame();
+
+// Number of frames that can be stepped back
+int rewind_available();
+
+// Restore the machine to the end of an earlier frame and forget the frames after it.
+// If the machine ran since the last captured frame, going back 1 frame restores that frame.
+uint8_t rewind_step_back(int frames);
+
+// Bytes used by the encoded history
+size_t rewind_history_size();
+
+enum REWIND_ERRORS {
+	REWIND_OK = 0,
+	REWIND_ERR_RUNNING,
+	REWIND_ERR_NOT_RUNNING,
+	REWIND_ERR_BUDGET,
+	REWIND_ERR_ALLOC,
+	REWIND_ERR_EMPTY,
+	REWIND_ERR_STATE
+};
+
+#endif // REWIND_CODE
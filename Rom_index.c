@@ -0,0 +1,488 @@
+#include "Rom_index.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ROM_INDEX_SSE2
+#endif
+
+// Index file format, everything is little-endian:
+// 0x00 - 0x03: "GBIX"
+// 0x04 - 0x05: Version
+// 0x06 - 0x07: Reserved
+// 0x08 - 0x0B: Number of records
+// Records, one after the other:
+//		+0x00: Content hash (8 bytes)
+//		+0x08: File size (4 bytes)
+//		+0x0C: Computed global checksum (2 bytes)
+//		+0x0E: Type, ROM size, RAM size, destination, CGB flag, SGB flag (1 byte each)
+//		+0x14: Flags - bit 0: header checksum ok, bit 1: global checksum ok
+//		+0x15: Title (16 bytes, zero padded)
+//		+0x25: Path length (2 bytes)
+//		+0x27: Path (not zero terminated)
+#define ROM_INDEX_MAGIC "GBIX"
+#define ROM_INDEX_VERSION 1
+#define ROM_INDEX_RECORD_SIZE 0x27
+#define ROM_INDEX_MIN_SIZE 0x150
+
+// XXH64 primes
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define rotl64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+// The reads assume a little-endian host, like the rest of the emulator
+static uint64_t read64(uint8_t* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof v);
+	return v;
+}
+
+static uint32_t read32(uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof v);
+	return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t rom_hash64(uint8_t* data, size_t size)
+{
+	uint8_t* p = data;
+	uint8_t* end = data + size;
+	uint64_t h;
+
+	if (size >= 32)
+	{
+		uint64_t v1 = PRIME64_1 + PRIME64_2;
+		uint64_t v2 = PRIME64_2;
+		uint64_t v3 = 0;
+		uint64_t v4 = 0 - PRIME64_1;
+		do
+		{
+			v1 = xxh64_round(v1, read64(p));
+			v2 = xxh64_round(v2, read64(p + 8));
+			v3 = xxh64_round(v3, read64(p + 16));
+			v4 = xxh64_round(v4, read64(p + 24));
+			p += 32;
+		} while (p + 32 <= end);
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = xxh64_merge(h, v1);
+		h = xxh64_merge(h, v2);
+		h = xxh64_merge(h, v3);
+		h = xxh64_merge(h, v4);
+	}
+	else
+		h = PRIME64_5;
+
+	h += (uint64_t)size;
+	while (p + 8 <= end)
+	{
+		h ^= xxh64_round(0, read64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= (uint64_t)read32(p) * PRIME64_1;
+		h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	while (p < end)
+	{
+		h ^= (*p) * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint16_t rom_global_checksum(uint8_t* data, size_t size)
+{
+	uint64_t sum = 0;
+	size_t i = 0;
+
+#ifdef ROM_INDEX_SSE2
+	// PSADBW against zero adds up 8 bytes into each 64-bit half, 16 bytes per instruction
+	__m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16)
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((__m128i*)(data + i)), zero));
+	uint64_t halves[2];
+	_mm_storeu_si128((__m128i*)halves, acc);
+	sum = halves[0] + halves[1];
+#endif
+	for (; i < size; i++)
+		sum += data[i];
+
+	// The checksum bytes themselves are not part of the sum
+	if (size > 0x014F)
+		sum -= data[0x014E] + data[0x014F];
+	return (uint16_t)sum;
+}
+
+uint8_t rom_index_parse(uint8_t* data, size_t size, ROM_INDEX_ENTRY* entry)
+{
+	if (size < ROM_INDEX_MIN_SIZE)
+		return ROMIDX_ERR_FORMAT;
+
+	memset(entry->title, 0, sizeof entry->title);
+	for (int i = 0; i < 16 && data[0x0134 + i] != 0; i++)
+		entry->title[i] = data[0x0134 + i];
+	entry->type = data[0x0147];
+	entry->rom_size = data[0x0148];
+	entry->ram_size = data[0x0149];
+	entry->japan = data[0x014A];
+	entry->cgb_flag = data[0x0143];
+	entry->sgb_flag = data[0x0146];
+
+	// Same as cart_get_stats
+	uint8_t checksum = 0;
+	for (int i = 0x0134; i <= 0x014C; i++)
+		checksum = checksum - data[i] - 1;
+	entry->header_chck = (checksum == data[0x014D]);
+
+	entry->global_checksum = rom_global_checksum(data, size);
+	entry->global_chck = (entry->global_checksum == (uint16_t)((data[0x014E] << 8) | data[0x014F]));
+	entry->file_size = (uint32_t)size;
+	entry->hash = rom_hash64(data, size);
+	return ROMIDX_OK;
+}
+
+// Scanning
+typedef struct {
+	char** paths;
+	int path_count;
+	int path_capacity;
+	bool alloc_error;
+
+	ROM_INDEX_ENTRY* results;
+	bool* valid;
+	PLATFORM_MUTEX* lock;
+	int next;
+} ROM_SCAN;
+
+static void scan_add_path(char* path, void* arg)
+{
+	ROM_SCAN* scan = (ROM_SCAN*)arg;
+	if (scan->path_count == scan->path_capacity)
+	{
+		int capacity = scan->path_capacity ? scan->path_capacity * 2 : 256;
+		char** paths = (char**)realloc(scan->paths, capacity * sizeof(char*));
+		if (paths == NULL)
+		{
+			scan->alloc_error = true;
+			return;
+		}
+		scan->paths = paths;
+		scan->path_capacity = capacity;
+	}
+	char* copy = (char*)malloc(strlen(path) + 1);
+	if (copy == NULL)
+	{
+		scan->alloc_error = true;
+		return;
+	}
+	strcpy(copy, path);
+	scan->paths[scan->path_count++] = copy;
+}
+
+static void scan_worker(void* arg)
+{
+	ROM_SCAN* scan = (ROM_SCAN*)arg;
+	for (;;)
+	{
+		platform_mutex_lock(scan->lock);
+		int i = scan->next++;
+		platform_mutex_unlock(scan->lock);
+		if (i >= scan->path_count)
+			break;
+
+		PLATFORM_MAP map;
+		if (platform_file_map(scan->paths[i], &map) != 0)
+			continue;
+		scan->valid[i] = (rom_index_parse(map.data, map.size, &scan->results[i]) == ROMIDX_OK);
+		platform_file_unmap(&map);
+	}
+}
+
+static int entry_compare(const void* a, const void* b)
+{
+	return strcmp(((ROM_INDEX_ENTRY*)a)->path, ((ROM_INDEX_ENTRY*)b)->path);
+}
+
+uint8_t rom_index_scan(char* dir, int n_threads, ROM_INDEX* index)
+{
+	ROM_SCAN scan = { 0 };
+	uint8_t res = ROMIDX_OK;
+
+	index->entries = NULL;
+	index->count = 0;
+	index->capacity = 0;
+
+	if (platform_dir_list(dir, scan_add_path, &scan) != 0)
+		return ROMIDX_ERR_DIR;
+	if (scan.alloc_error)
+	{
+		res = ROMIDX_ERR_ALLOC;
+		goto done;
+	}
+	if (scan.path_count == 0)
+		goto done;
+
+	scan.results = (ROM_INDEX_ENTRY*)calloc(scan.path_count, sizeof(ROM_INDEX_ENTRY));
+	scan.valid = (bool*)calloc(scan.path_count, sizeof(bool));
+	scan.lock = platform_mutex_create();
+	if (scan.results == NULL || scan.valid == NULL || scan.lock == NULL)
+	{
+		res = ROMIDX_ERR_ALLOC;
+		goto done;
+	}
+
+	if (n_threads <= 0)
+		n_threads = platform_cpu_count();
+	if (n_threads > scan.path_count)
+		n_threads = scan.path_count;
+	PLATFORM_THREAD** threads = (PLATFORM_THREAD**)calloc(n_threads, sizeof(PLATFORM_THREAD*));
+	if (threads == NULL)
+	{
+		res = ROMIDX_ERR_ALLOC;
+		goto done;
+	}
+	int started = 0;
+	for (int i = 0; i < n_threads; i++)
+	{
+		threads[i] = platform_thread_create(scan_worker, &scan);
+		if (threads[i] != NULL)
+			started++;
+	}
+	// If no thread could be started, do the work here
+	if (started == 0)
+		scan_worker(&scan);
+	for (int i = 0; i < n_threads; i++)
+		platform_thread_join(threads[i]);
+	free(threads);
+
+	// Keep only the ROMs, the entries take ownership of their paths
+	index->entries = scan.results;
+	index->capacity = scan.path_count;
+	for (int i = 0; i < scan.path_count; i++)
+	{
+		if (scan.valid[i])
+		{
+			index->entries[index->count] = scan.results[i];
+			index->entries[index->count].path = scan.paths[i];
+			index->count++;
+		}
+		else
+			free(scan.paths[i]);
+	}
+	scan.results = NULL;
+	scan.path_count = 0;
+	qsort(index->entries, index->count, sizeof(ROM_INDEX_ENTRY), entry_compare);
+
+done:
+	for (int i = 0; i < scan.path_count; i++)
+		free(scan.paths[i]);
+	free(scan.paths);
+	free(scan.results);
+	free(scan.valid);
+	platform_mutex_free(scan.lock);
+	return res;
+}
+
+void rom_index_free(ROM_INDEX* index)
+{
+	for (int i = 0; i < index->count; i++)
+		free(index->entries[i].path);
+	free(index->entries);
+	index->entries = NULL;
+	index->count = 0;
+	index->capacity = 0;
+}
+
+// Little-endian helpers for the index file
+static void put16(uint8_t* p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+	put16(p, (uint16_t)v);
+	put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put64(uint8_t* p, uint64_t v)
+{
+	put32(p, (uint32_t)v);
+	put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint16_t get16(uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(uint8_t* p)
+{
+	return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static uint64_t get64(uint8_t* p)
+{
+	return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+uint8_t rom_index_save(char* filename, ROM_INDEX* index)
+{
+	FILE* index_file = fopen(filename, "wb");
+	if (index_file == NULL)
+		return ROMIDX_ERR_FILE_OPEN;
+
+	uint8_t header[12] = { 0 };
+	memcpy(header, ROM_INDEX_MAGIC, 4);
+	put16(header + 4, ROM_INDEX_VERSION);
+	put32(header + 8, (uint32_t)index->count);
+	bool ok = fwrite(header, 1, sizeof header, index_file) == sizeof header;
+
+	for (int i = 0; ok && i < index->count; i++)
+	{
+		ROM_INDEX_ENTRY* e = &index->entries[i];
+		uint8_t rec[ROM_INDEX_RECORD_SIZE] = { 0 };
+		size_t path_len = strlen(e->path);
+		if (path_len > 0xFFFF)
+			path_len = 0xFFFF;
+		put64(rec + 0x00, e->hash);
+		put32(rec + 0x08, e->file_size);
+		put16(rec + 0x0C, e->global_checksum);
+		rec[0x0E] = e->type;
+		rec[0x0F] = e->rom_size;
+		rec[0x10] = e->ram_size;
+		rec[0x11] = e->japan;
+		rec[0x12] = e->cgb_flag;
+		rec[0x13] = e->sgb_flag;
+		rec[0x14] = (e->header_chck ? 0x01 : 0x00) | (e->global_chck ? 0x02 : 0x00);
+		memcpy(rec + 0x15, e->title, 16);
+		put16(rec + 0x25, (uint16_t)path_len);
+		ok = fwrite(rec, 1, sizeof rec, index_file) == sizeof rec &&
+			fwrite(e->path, 1, path_len, index_file) == path_len;
+	}
+	if (fclose(index_file) != 0)
+		ok = false;
+	return ok ? ROMIDX_OK : ROMIDX_ERR_FILE_WRITE;
+}
+
+uint8_t rom_index_load(char* filename, ROM_INDEX* index)
+{
+	index->entries = NULL;
+	index->count = 0;
+	index->capacity = 0;
+
+	FILE* index_file = fopen(filename, "rb");
+	if (index_file == NULL)
+		return ROMIDX_ERR_FILE_OPEN;
+
+	uint8_t header[12];
+	if (fread(header, 1, sizeof header, index_file) != sizeof header)
+	{
+		fclose(index_file);
+		return ROMIDX_ERR_FILE_READ;
+	}
+	if (memcmp(header, ROM_INDEX_MAGIC, 4) != 0 || get16(header + 4) != ROM_INDEX_VERSION)
+	{
+		fclose(index_file);
+		return ROMIDX_ERR_FORMAT;
+	}
+	uint32_t count = get32(header + 8);
+	if (count > 0)
+	{
+		index->entries = (ROM_INDEX_ENTRY*)calloc(count, sizeof(ROM_INDEX_ENTRY));
+		if (index->entries == NULL)
+		{
+			fclose(index_file);
+			return ROMIDX_ERR_ALLOC;
+		}
+		index->capacity = (int)count;
+	}
+
+	uint8_t res = ROMIDX_OK;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint8_t rec[ROM_INDEX_RECORD_SIZE];
+		if (fread(rec, 1, sizeof rec, index_file) != sizeof rec)
+		{
+			res = ROMIDX_ERR_FILE_READ;
+			break;
+		}
+		ROM_INDEX_ENTRY* e = &index->entries[i];
+		uint16_t path_len = get16(rec + 0x25);
+		e->path = (char*)malloc(path_len + 1);
+		if (e->path == NULL)
+		{
+			res = ROMIDX_ERR_ALLOC;
+			break;
+		}
+		index->count++;
+		if (fread(e->path, 1, path_len, index_file) != path_len)
+		{
+			res = ROMIDX_ERR_FILE_READ;
+			break;
+		}
+		e->path[path_len] = 0;
+		e->hash = get64(rec + 0x00);
+		e->file_size = get32(rec + 0x08);
+		e->global_checksum = get16(rec + 0x0C);
+		e->type = rec[0x0E];
+		e->rom_size = rec[0x0F];
+		e->ram_size = rec[0x10];
+		e->japan = rec[0x11];
+		e->cgb_flag = rec[0x12];
+		e->sgb_flag = rec[0x13];
+		e->header_chck = (rec[0x14] & 0x01) != 0;
+		e->global_chck = (rec[0x14] & 0x02) != 0;
+		memcpy(e->title, rec + 0x15, 16);
+		e->title[16] = 0;
+	}
+	fclose(index_file);
+	if (res != ROMIDX_OK)
+		rom_index_free(index);
+	return res;
+}
+
+int rom_index_find(ROM_INDEX* index, int start, int type, int ram_size, int japan)
+{
+	for (int i = start < 0 ? 0 : start; i < index->count; i++)
+	{
+		ROM_INDEX_ENTRY* e = &index->entries[i];
+		if ((type < 0 || e->type == type) && (ram_size < 0 || e->ram_size == ram_size) &&
+			(japan < 0 || e->japan == japan))
+			return i;
+	}
+	return -1;
+}
@@ -0,0 +1,67 @@
+#ifndef ROM_INDEX_CODE
+#define ROM_INDEX_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// ROM library indexer
+// Scans a directory of ROM files in parallel without loading them into the emulator, and keeps the
+// header information, the checksums and a content hash of every ROM in a compact index file.
+
+typedef struct {
+	char* path;
+	char title[17];
+	uint8_t type;				// GAMEBOY_CART_TYPES
+	uint8_t rom_size;			// GAMEBOT_CART_ROM_SIZE
+	uint8_t ram_size;			// GAMEBOY_CART_RAM_SIZE
+	uint8_t japan;				// Destination code, $00 - Japan
+	uint8_t cgb_flag;
+	uint8_t sgb_flag;
+	bool header_chck;
+	bool global_chck;
+	uint16_t global_checksum;	// Computed over the file
+	uint32_t file_size;
+	uint64_t hash;				// Content hash of the whole file
+} ROM_INDEX_ENTRY;
+
+typedef struct {
+	ROM_INDEX_ENTRY* entries;
+	int count;
+	int capacity;
+} ROM_INDEX;
+
+enum ROM_INDEX_ERRORS {
+	ROMIDX_OK = 0,
+	ROMIDX_ERR_DIR,
+	ROMIDX_ERR_ALLOC,
+	ROMIDX_ERR_THREAD,
+	ROMIDX_ERR_FILE_OPEN,
+	ROMIDX_ERR_FILE_WRITE,
+	ROMIDX_ERR_FILE_READ,
+	ROMIDX_ERR_FORMAT
+};
+
+// Scan every file in the directory with n_threads workers (0 - one per core).
+// Files that are too small to have a header are skipped.
+uint8_t rom_index_scan(char* dir, int n_threads, ROM_INDEX* index);
+void rom_index_free(ROM_INDEX* index);
+
+// Index file
+uint8_t rom_index_save(char* filename, ROM_INDEX* index);
+uint8_t rom_index_load(char* filename, ROM_INDEX* index);
+
+// Search the index from entry start on. -1 matches any value.
+// Returns the position of the first matching entry or -1 if there is none.
+int rom_index_find(ROM_INDEX* index, int start, int type, int ram_size, int japan);
+
+// Parse the header of a ROM image that is already in memory
+uint8_t rom_index_parse(uint8_t* data, size_t size, ROM_INDEX_ENTRY* entry);
+
+// Sum of all the bytes except the global checksum itself ($014E - $014F)
+uint16_t rom_global_checksum(uint8_t* data, size_t size);
+
+// 64-bit content hash (XXH64 with seed 0)
+uint64_t rom_hash64(uint8_t* data, size_t size);
+
+#endif // ROM_INDEX_CODE
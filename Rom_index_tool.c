@@ -0,0 +1,86 @@
+#include "Rom_index.h"
+#include <stdio.h>
+#include <string.h>
+
+// Command line front end for the ROM library indexer
+//	romindex scan <directory> <index file> [threads]
+//	romindex list <index file> [-mapper N] [-ram N] [-region N]
+
+static int usage()
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "\tromindex scan <directory> <index file> [threads]\n");
+	fprintf(stderr, "\tromindex list <index file> [-mapper N] [-ram N] [-region N]\n");
+	return 1;
+}
+
+static int cmd_scan(int argc, char** argv)
+{
+	if (argc < 4)
+		return usage();
+	int n_threads = argc > 4 ? atoi(argv[4]) : 0;
+
+	ROM_INDEX index;
+	uint8_t res = rom_index_scan(argv[2], n_threads, &index);
+	if (res != ROMIDX_OK)
+	{
+		fprintf(stderr, "Scan failed: %d\n", res);
+		return 1;
+	}
+	res = rom_index_save(argv[3], &index);
+	if (res != ROMIDX_OK)
+		fprintf(stderr, "Saving the index failed: %d\n", res);
+	else
+		printf("Indexed %d ROMs\n", index.count);
+	rom_index_free(&index);
+	return res == ROMIDX_OK ? 0 : 1;
+}
+
+static int cmd_list(int argc, char** argv)
+{
+	if (argc < 3)
+		return usage();
+	int type = -1, ram_size = -1, japan = -1;
+	for (int i = 3; i + 1 < argc; i += 2)
+	{
+		int value = (int)strtol(argv[i + 1], NULL, 0);
+		if (strcmp(argv[i], "-mapper") == 0)
+			type = value;
+		else if (strcmp(argv[i], "-ram") == 0)
+			ram_size = value;
+		else if (strcmp(argv[i], "-region") == 0)
+			japan = value;
+		else
+			return usage();
+	}
+
+	ROM_INDEX index;
+	uint8_t res = rom_index_load(argv[2], &index);
+	if (res != ROMIDX_OK)
+	{
+		fprintf(stderr, "Loading the index failed: %d\n", res);
+		return 1;
+	}
+	printf("hash\ttype\trom\tram\tregion\theader\tglobal\ttitle\tpath\n");
+	for (int i = rom_index_find(&index, 0, type, ram_size, japan); i >= 0;
+		i = rom_index_find(&index, i + 1, type, ram_size, japan))
+	{
+		ROM_INDEX_ENTRY* e = &index.entries[i];
+		printf("%016llx\t%02X\t%02X\t%02X\t%02X\t%s\t%s\t%s\t%s\n", (unsigned long long)e->hash, e->type,
+			e->rom_size, e->ram_size, e->japan, e->header_chck ? "ok" : "bad", e->global_chck ? "ok" : "bad",
+			e->title, e->path);
+	}
+	rom_index_free(&index);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+		return usage();
+	if (strcmp(argv[1], "scan") == 0)
+		return cmd_scan(argc, argv);
+	if (strcmp(argv[1], "list") == 0)
+		return cmd_list(argc, argv);
+	return usage();
+}
@@ -0,0 +1,114 @@
+#include "Rom_registry.h"
+#include "Rom_index.h"
+#include "Platform.h"
+#include <string.h>
+
+// Few distinct ROMs are loaded at a time, so the registry is a list. The lock is created by the first
+// caller, which may be any of the worker threads.
+static ROM_IMAGE* images = NULL;
+static PLATFORM_MUTEX* volatile registry_lock = NULL;
+
+static PLATFORM_MUTEX* registry_get_lock()
+{
+	PLATFORM_MUTEX* lock = registry_lock;
+	if (lock != NULL)
+		return lock;
+	lock = platform_mutex_create();
+	if (lock == NULL)
+		return NULL;
+	PLATFORM_MUTEX* other = (PLATFORM_MUTEX*)platform_atomic_cas_ptr((void* volatile*)&registry_lock, NULL, lock);
+	if (other != NULL)
+	{
+		// Another thread got there first
+		platform_mutex_free(lock);
+		return other;
+	}
+	return lock;
+}
+
+uint8_t rom_registry_acquire(uint8_t* data, size_t size, ROM_IMAGE** image)
+{
+	PLATFORM_MUTEX* lock = registry_get_lock();
+	if (lock == NULL)
+		return ROMREG_ERR_ALLOC;
+
+	// Hashed outside the lock, a 2MB ROM takes a while
+	uint64_t hash = rom_hash64(data, size);
+	platform_mutex_lock(lock);
+	for (ROM_IMAGE* it = images; it != NULL; it = it->next)
+	{
+		if (it->hash == hash && it->size == size && memcmp(it->data, data, size) == 0)
+		{
+			it->refs++;
+			platform_mutex_unlock(lock);
+			*image = it;
+			return ROMREG_OK;
+		}
+	}
+
+	ROM_IMAGE* new_image = (ROM_IMAGE*)malloc(sizeof(ROM_IMAGE));
+	uint8_t* copy = (uint8_t*)platform_aligned_alloc(size, ROM_REGISTRY_ALIGNMENT);
+	if (new_image == NULL || copy == NULL)
+	{
+		platform_mutex_unlock(lock);
+		free(new_image);
+		platform_aligned_free(copy);
+		return ROMREG_ERR_ALLOC;
+	}
+	memcpy(copy, data, size);
+	new_image->data = copy;
+	new_image->size = size;
+	new_image->hash = hash;
+	new_image->refs = 1;
+	new_image->next = images;
+	images = new_image;
+	platform_mutex_unlock(lock);
+	*image = new_image;
+	return ROMREG_OK;
+}
+
+void rom_registry_release(ROM_IMAGE* image)
+{
+	if (image == NULL)
+		return;
+	PLATFORM_MUTEX* lock = registry_lock;
+	platform_mutex_lock(lock);
+	if (--image->refs > 0)
+	{
+		platform_mutex_unlock(lock);
+		return;
+	}
+	ROM_IMAGE** link = &images;
+	while (*link != image)
+		link = &(*link)->next;
+	*link = image->next;
+	platform_mutex_unlock(lock);
+	platform_aligned_free(image->data);
+	free(image);
+}
+
+int rom_registry_count()
+{
+	PLATFORM_MUTEX* lock = registry_get_lock();
+	if (lock == NULL)
+		return 0;
+	int count = 0;
+	platform_mutex_lock(lock);
+	for (ROM_IMAGE* it = images; it != NULL; it = it->next)
+		count++;
+	platform_mutex_unlock(lock);
+	return count;
+}
+
+size_t rom_registry_bytes()
+{
+	PLATFORM_MUTEX* lock = registry_get_lock();
+	if (lock == NULL)
+		return 0;
+	size_t bytes = 0;
+	platform_mutex_lock(lock);
+	for (ROM_IMAGE* it = images; it != NULL; it = it->next)
+		bytes += it->size;
+	platform_mutex_unlock(lock);
+	return bytes;
+}
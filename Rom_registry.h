@@ -0,0 +1,36 @@
+#ifndef ROM_REGISTRY_CODE
+#define ROM_REGISTRY_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// ROM image registry.
+// Keeps one read-only copy of every distinct ROM loaded in the process, keyed by its content hash, so
+// machines running the same game (on other threads, or forks) share it. Only the
+// mapper registers and the cartridge RAM are per machine. Images are reference counted and freed when
+// the last machine unloads them. The data is aligned to 64 bytes and must never be written.
+typedef struct ROM_IMAGE {
+	uint8_t* data;
+	size_t size;
+	uint64_t hash;
+	int refs;
+	struct ROM_IMAGE* next;
+} ROM_IMAGE;
+
+// Finds the image with the same content as data, or adds a copy of it
+uint8_t rom_registry_acquire(uint8_t* data, size_t size, ROM_IMAGE** image);
+void rom_registry_release(ROM_IMAGE* image);
+
+// Number of images and the bytes they take, for statistics
+int rom_registry_count();
+size_t rom_registry_bytes();
+
+#define ROM_REGISTRY_ALIGNMENT 64
+
+enum ROM_REGISTRY_ERRORS {
+	ROMREG_OK = 0,
+	ROMREG_ERR_ALLOC
+};
+
+#endif // ROM_REGISTRY_CODE
@@ -0,0 +1,138 @@
+#include "Bus.h"
+#include "Savestate.h"
+#include "Sharp_LR35902.h"
+#include "Ppu.h"
+#include "Timer.h"
+#include "Dma.h"
+#include "Joypad.h"
+#include "Cartridge.h"
+#include <stddef.h>
+
+// State layout:
+// STATE_HEADER
+// MACHINE_STATE
+// Mapper registers and cartridge RAM (size depends on the mapper)
+//
+// Everything is little-endian, which is what the emulator runs on. The machine section is the raw
+// device structs, so STATE_VERSION has to be bumped whenever one of them changes. The sizes in the
+// header catch a forgotten bump.
+#define STATE_MAGIC "GBST"
+#define STATE_VERSION 1
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t header_size;
+	uint32_t machine_size;
+	uint32_t cart_size;
+
+	// Cartridge the state belongs to, from its header
+	uint8_t cart_type;
+	uint8_t cart_rom_size;
+	uint8_t cart_ram_size;
+	uint8_t header_checksum;
+	uint8_t global_checksum[2];
+	uint8_t reserved[2];
+} STATE_HEADER;
+
+typedef struct {
+	CPU_STATE cpu;
+	PPU_STATE ppu;
+	BUS_STATE bus;
+	TIMER_STATE timer;
+	DMA_STATE dma;
+	JOYPAD_STATE joypad;
+} MACHINE_STATE;
+
+static void state_header_fill(STATE_HEADER* header)
+{
+	memset(header, 0, sizeof(STATE_HEADER));
+	memcpy(header->magic, STATE_MAGIC, 4);
+	header->version = STATE_VERSION;
+	header->header_size = sizeof(STATE_HEADER);
+	header->machine_size = sizeof(MACHINE_STATE);
+	header->cart_size = cart_mapper_state_size();
+
+	uint8_t* rom;
+	if (cart_mapper_get_memory(&rom, NULL, NULL, NULL) == 0)
+	{
+		header->cart_type = rom[0x0147];
+		header->cart_rom_size = rom[0x0148];
+		header->cart_ram_size = rom[0x0149];
+		header->header_checksum = rom[0x014D];
+		header->global_checksum[0] = rom[0x014E];
+		header->global_checksum[1] = rom[0x014F];
+	}
+}
+
+size_t state_size()
+{
+	return sizeof(STATE_HEADER) + sizeof(MACHINE_STATE) + cart_mapper_state_size();
+}
+
+uint8_t state_save(uint8_t* buffer, size_t size)
+{
+	if (buffer == NULL || size < state_size())
+		return STATE_ERR_SIZE;
+
+	STATE_HEADER header;
+	state_header_fill(&header);
+	memcpy(buffer, &header, sizeof header);
+
+	// Write the devices straight into the buffer when it's aligned, otherwise go through the stack
+	MACHINE_STATE local;
+	uint8_t* section = buffer + sizeof(STATE_HEADER);
+	MACHINE_STATE* machine = ((uintptr_t)section % sizeof(uint64_t) == 0) ? (MACHINE_STATE*)section : &local;
+
+	// Zeroed first so the reserved bytes are always the same, states are compared and diffed byte by byte
+	memset(machine, 0, sizeof(MACHINE_STATE));
+	cpu_state_save(&machine->cpu);
+	ppu_state_save(&machine->ppu);
+	bus_state_save(&machine->bus);
+	timer_state_save(&machine->timer);
+	dma_state_save(&machine->dma);
+	joypad_state_save(&machine->joypad);
+	if (machine == &local)
+		memcpy(section, &local, sizeof local);
+
+	cart_mapper_state_save(section + sizeof(MACHINE_STATE));
+	return STATE_OK;
+}
+
+uint8_t state_load(uint8_t* buffer, size_t size)
+{
+	if (buffer == NULL || size < sizeof(STATE_HEADER))
+		return STATE_ERR_SIZE;
+
+	STATE_HEADER header;
+	STATE_HEADER current;
+	memcpy(&header, buffer, sizeof header);
+	state_header_fill(&current);
+	if (memcmp(header.magic, STATE_MAGIC, 4) != 0)
+		return STATE_ERR_FORMAT;
+	if (header.version != STATE_VERSION || header.header_size != current.header_size ||
+		header.machine_size != current.machine_size)
+		return STATE_ERR_VERSION;
+	if (memcmp(&header.cart_size, &current.cart_size, sizeof header - offsetof(STATE_HEADER, cart_size)) != 0)
+		return STATE_ERR_CART;
+	if (size < state_size())
+		return STATE_ERR_SIZE;
+
+	MACHINE_STATE local;
+	uint8_t* section = buffer + sizeof(STATE_HEADER);
+	MACHINE_STATE* machine = (MACHINE_STATE*)section;
+	if ((uintptr_t)section % sizeof(uint64_t) != 0)
+	{
+		memcpy(&local, section, sizeof local);
+		machine = &local;
+	}
+
+	cpu_state_load(&machine->cpu);
+	ppu_state_load(&machine->ppu);
+	bus_state_load(&machine->bus);
+	timer_state_load(&machine->timer);
+	dma_state_load(&machine->dma);
+	joypad_state_load(&machine->joypad);
+	cart_mapper_state_load(section + sizeof(MACHINE_STATE));
+	return STATE_OK;
+}
@@ -0,0 +1,14 @@
+#ifndef SAVESTATE_CODE
+#define SAVESTATE_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Full machine snapshots. Every device copies its statics into a plain struct, and the structs are
+// copied into the blob as they are, so saving or loading is a handful of memcpys.
+size_t state_size();
+uint8_t state_save(uint8_t* buffer, size_t size);
+uint8_t state_load(uint8_t* buffer, size_t size);
+
+#endif // SAVESTATE_CODE
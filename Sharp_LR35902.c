@@ -1,5 +1,11 @@
 #include "Bus.h"
 #include "Sharp_LR35902.h"
+#include "Opcode_profile.h"
+#include "Guest_profile.h"
+#include "Trace.h"
+#include "Recompiler.h"
+#include <stdio.h>
+#include <string.h>
 
 // 8-bit registers
 #define A ((uint8_t) (AF >> 8))
@@ -15,61 +21,98 @@
 // Static variables
 // Define registers and flags
 // 16-bit registers
-static uint16_t AF = 0x0000;	// Accumulator and flags
-static uint16_t BC = 0x0000;
-static uint16_t DE = 0x0000;
-static uint16_t HL = 0x0000;
-static uint16_t SP = 0x0000;	// Stack Pointer
-static uint16_t PC = 0x0000;	// Program Counter
-
-static bool IME = false;			// Interrupt Master Enable flag
-static uint8_t enable_int = 0x00;	// Needed for enabling the interrupt one instruction later
-
-static uint8_t  opcode		= 0x00;
-uint8_t	cb_opcode	= 0x00;			// This is not static ON PURPOSE! If it's static it causes a weird bug
-static uint8_t  cycles		= 0x00;
-static uint8_t	fetched		= 0x00;
-static uint16_t fetched_16	= 0x0000;
-
+static GB_INSTANCE uint16_t AF = 0x0000;	// Accumulator and flags
+static GB_INSTANCE uint16_t BC = 0x0000;
+static GB_INSTANCE uint16_t DE = 0x0000;
+static GB_INSTANCE uint16_t HL = 0x0000;
+static GB_INSTANCE uint16_t SP = 0x0000;	// Stack Pointer
+static GB_INSTANCE uint16_t PC = 0x0000;	// Program Counter
+
+static GB_INSTANCE bool IME = false;			// Interrupt Master Enable flag
+static GB_INSTANCE uint8_t enable_int = 0x00;	// Needed for enabling the interrupt one instruction later
+
+static GB_INSTANCE uint8_t  opcode		= 0x00;
+GB_INSTANCE uint8_t	cb_opcode	= 0x00;			// This is not static ON PURPOSE! If it's static it causes a weird bug
+static GB_INSTANCE uint8_t  cycles		= 0x00;
+static GB_INSTANCE uint8_t	fetched		= 0x00;
+static GB_INSTANCE uint16_t fetched_16	= 0x0000;
+
+
+static GB_INSTANCE uint8_t  temp = 0x00;		// Used for many operations
+static GB_INSTANCE uint16_t temp_16 = 0x0000;
+static GB_INSTANCE uint32_t temp_32 = 0x00000000;
+
+// Interrupt routines by bit in IF, and the lowest set bit of the pending interrupts
+static const uint16_t INT_VECTORS[5] = { INT_VBLANK_RTN, INT_LEDSTAT_RTN, INT_TIMER_RTN, INT_SERIAL_RTN, INT_JOYPAD_RTN };
+#ifdef _MSC_VER
+#include <intrin.h>
+static __forceinline uint8_t int_lowest(uint8_t pending)
+{
+	unsigned long bit;
+	_BitScanForward(&bit, pending);
+	return (uint8_t)bit;
+}
+#else
+#define int_lowest(pending) ((uint8_t)__builtin_ctz(pending))
+#endif
 
-static uint8_t  temp = 0x00;		// Used for many operations
-static uint16_t temp_16 = 0x0000;
-static uint32_t temp_32 = 0x00000000;
+static GB_INSTANCE bool halt_bug = false;		// Used for the HALT bug
+static GB_INSTANCE bool halt_occured = false;
 
-static bool halt_bug = false;		// Used for the HALT bug
-static bool halt_occured = false;
+// Registers handed to the recompiled code of the game (Recompiler.h)
+static GB_INSTANCE RECOMP_CPU recomp_cpu = { 0, 0, 0, 0, 0, 0, 0, 0, cpu_read, cpu_write };
 
-uint16_t stack_base = 0x0000;	// For debug purposes
+GB_INSTANCE uint16_t stack_base = 0x0000;	// For debug purposes
 								// I think the only functions that would be used to change the stack base
 								// would be LD SP,d16 and LD SP,HL.
 								// There are also INC SP, DEC SP and ADD SP,r8, but I think they would only
 								// really be used when implementing PUSH and POP by your self.
 
-static INSTRUCTION optable[16 * 16] = {
-	{NOP, IMP, 1, L"NOP", 1},					{LDBC_16, IMM_16, 3, L"LD BC,$%04x", 3},	{LDBC, RGA, 2, L"LD (BC),A", 1},		{INBC_16, IMP, 2, L"INC BC", 1},	{INB, IMP, 1, L"INC B", 1},					{DECB, IMP, 1, L"DEC B", 1},		{LDB, IMM, 2, L"LD B,$%02x", 2},		{RLCA, IMP, 1, L"RLC A", 1},		{LDASP_16, IMM_16, 5, L"LD ($%04x),SP", 3},		{ADDHL_16, RGBC_16, 2, L"ADD HL,BC", 1},	{LDA, RGBC, 2, L"LD A,(BC)", 1},		{DECBC_16, IMP, 2, L"DEC BC", 1},	{INC, IMP, 1, L"INC C", 1},				{DECC, IMP, 1, L"DEC C", 1},			{LDC, IMM, 2, L"LD C,$%02x", 2},		{RRCA, IMP, 1, L"RRCA", 1},
-	{STOP, IMP, 0XFF, L"STOP", 1},				{LDDE_16, IMM_16, 3, L"LD DE,$%04x", 3},	{LDDE, RGA, 2, L"LD (DE),A", 1},		{INDE_16, IMP, 2, L"INC DE", 1},	{IND, IMP, 1, L"INC D", 1},					{DECD, IMP, 1, L"DEC D", 1},		{LDD, IMM, 2, L"LD D,$%02x", 2},		{RLA, IMP, 1, L"RL A", 1},			{JR, IMM, 3, L"JR $%02x", 2},					{ADDHL_16, RGDE_16, 2, L"ADD HL,DE", 1},	{LDA, RGDE, 2, L"LD A,(DE)", 1},		{DECDE_16, IMP, 2, L"DEC DE", 1},	{INE, IMP, 1, L"INC E", 1},				{DECE, IMP, 1, L"DEC E", 1},			{LDE, IMM, 2, L"LD E,$%02x", 2},		{RRA, IMP, 1, L"RRA", 1},
-	{JRNZ, IMM, 2, L"JR NZ,$%02x", 2},			{LDHL_16, IMM_16, 3, L"LD HL,$%04x", 3},	{LDINC, IMP, 2, L"LD (HL+),A", 1},		{INHL_16, IMP, 2, L"INC HL", 1},	{INH, IMP, 1, L"INC H", 1},					{DECH, IMP, 1, L"DEC H", 1},		{LDH, IMM, 2, L"LD H,$%02x", 2},		{DAA, IMP, 1, L"DAA", 1},			{JRZ, IMM, 2, L"JR Z,$%02x", 2},				{ADDHL_16, RGHL_16, 2, L"ADD HL,HL", 1},	{LDAINC, IMP, 2, L"LD A,(HL+)", 1},		{DECHL_16, IMP, 2, L"DEC HL", 1},	{INL, IMP, 1, L"INC L", 1},				{DECL, IMP, 1, L"DEC L", 1},			{LDL, IMM, 2, L"LD L,$%02x", 2},		{CPL, IMP, 1, L"CPL", 1},
-	{JRNC, IMM, 2, L"JR NC,$%02x", 2},			{LDSP_16, IMM_16, 3, L"LD SP,$%04x", 3},	{LDDEC, IMP, 2, L"LD (HL-),A", 1},		{INSP_16, IMP, 2, L"INC SP", 1},	{INHL, IMP, 3, L"INC (HL)", 1},				{DECHL, IMP, 3, L"DEC (HL)", 1},	{LDHL, IMM, 3, L"LD (HL),$%02x", 2},	{SCF, IMP, 1, L"SCF", 1},			{JRC, IMM, 2, L"JR C,$%02x", 2},				{ADDHL_16, RGSP_16, 2, L"ADD HL,SP", 1},	{LDADEC, IMP, 2, L"LD A,(HL-)", 1},		{DECSP_16, IMP, 2, L"DEC SP", 1},	{INA, IMP, 1, L"INC A", 1},				{DECA, IMP, 1, L"DEC A", 1},			{LDA, IMM, 2, L"LD A,$%02x", 2},		{CCF, IMP, 1, L"CCF", 1},
-	{LDB, RGB, 1, L"LD B,B", 1},				{LDB, RGC, 1, L"LD B,C", 1},				{LDB, RGD, 1, L"LD B,D", 1},			{LDB, RGE, 1, L"LD B,E", 1},		{LDB, RGH, 1, L"LD B,H", 1},				{LDB, RGL, 1, L"LD B,L", 1},		{LDB, RGHL, 2, L"LD B,(HL)", 1},		{LDB, RGA, 1, L"LD B,A", 1},		{LDC, RGB, 1, L"LD C,B", 1},					{LDC, RGC, 1, L"LD C,C", 1},				{LDC, RGD, 1, L"LD C,D", 1},			{LDC, RGE, 1, L"LD C,E", 1},		{LDC, RGH, 1, L"LD C,H", 1},			{LDC, RGL, 1, L"LD C,L", 1},			{LDC, RGHL, 2, L"LD C,(HL)", 1},		{LDC, RGA, 1, L"LD C,A", 1},
-	{LDD, RGB, 1, L"LD D,B", 1},				{LDD, RGC, 1, L"LD D,C", 1},				{LDD, RGD, 1, L"LD D,D", 1},			{LDD, RGE, 1, L"LD D,E", 1},		{LDD, RGH, 1, L"LD D,H", 1},				{LDD, RGL, 1, L"LD D,L", 1},		{LDD, RGHL, 2, L"LD D,(HL)", 1},		{LDD, RGA, 1, L"LD D,A", 1},		{LDE, RGB, 1, L"LD E,B", 1},					{LDE, RGC, 1, L"LD E,C", 1},				{LDE, RGD, 1, L"LD E,D", 1},			{LDE, RGE, 1, L"LD E,E", 1},		{LDE, RGH, 1, L"LD E,H", 1},			{LDE, RGL, 1, L"LD E,L", 1},			{LDE, RGHL, 2, L"LD E,(HL)", 1},		{LDE, RGA, 1, L"LD E,A", 1},
-	{LDH, RGB, 1, L"LD H,B", 1},				{LDH, RGC, 1, L"LD H,C", 1},				{LDH, RGD, 1, L"LD H,D", 1},			{LDH, RGE, 1, L"LD H,E", 1},		{LDH, RGH, 1, L"LD H,H", 1},				{LDH, RGL, 1, L"LD H,L", 1},		{LDH, RGHL, 2, L"LD H,(HL)", 1},		{LDH, RGA, 1, L"LD H,A", 1},		{LDL, RGB, 1, L"LD L,B", 1},					{LDL, RGC, 1, L"LD L,C", 1},				{LDL, RGD, 1, L"LD L,D", 1},			{LDL, RGE, 1, L"LD L,E", 1},		{LDL, RGH, 1, L"LD L,H", 1},			{LDL, RGL, 1, L"LD L,L", 1},			{LDL, RGHL, 2, L"LD L,(HL)", 1},		{LDL, RGA, 1, L"LD L,A", 1},
-	{LDHL, RGB, 2, L"LD (HL),B", 1},			{LDHL, RGC, 2, L"LD (HL),C", 1},			{LDHL, RGD, 2, L"LD (HL),D", 1},		{LDHL, RGE, 2, L"LD (HL),E", 1},	{LDHL, RGH, 2, L"LD (HL),H", 1},			{LDHL, RGL, 2, L"LD (HL),L", 1},	{HALT, IMP, 1, L"HALT", 1},				{LDHL, RGA, 2, L"LD (HL),A", 1},	{LDA, RGB, 1, L"LD A,B", 1},					{LDA, RGC, 1, L"LD A,C", 1},				{LDA, RGD, 1, L"LD A,D", 1},			{LDA, RGE, 1, L"LD A,E", 1},		{LDA, RGH, 1, L"LD A,H", 1},			{LDA, RGL, 1, L"LD A,L", 1},			{LDA, RGHL, 2, L"LD A,(HL)", 1},		{LDA, RGA, 1, L"LD A,A", 1},
-	{ADD, RGB, 1, L"ADD A,B", 1},				{ADD, RGC, 1, L"ADD A,C", 1},				{ADD, RGD, 1, L"ADD A,D", 1},			{ADD, RGE, 1, L"ADD A,E", 1},		{ADD, RGH, 1, L"ADD A,H", 1},				{ADD, RGL, 1, L"ADD A,L", 1},		{ADD, RGHL, 2, L"ADD A,(HL)", 1},		{ADD, RGA, 1, L"ADD A,A", 1},		{ADC, RGB, 1, L"ADC A,B", 1},					{ADC, RGC, 1, L"ADC A,C", 1},				{ADC, RGD, 1, L"ADC A,D", 1},			{ADC, RGE, 1, L"ADC A,E", 1},		{ADC, RGH, 1, L"ADC A,H", 1},			{ADC, RGL, 1, L"ADC A,L", 1},			{ADC, RGHL, 2, L"ADC A,(HL)", 1},		{ADC, RGA, 1, L"ADC A,A", 1},
-	{SUB, RGB, 1, L"SUB B", 1},					{SUB, RGC, 1, L"SUB C", 1},					{SUB, RGD, 1, L"SUB D", 1},				{SUB, RGE, 1, L"SUB E", 1},			{SUB, RGH, 1, L"SUB H", 1},					{SUB, RGL, 1, L"SUB L", 1},			{SUB, RGHL, 2, L"SUB (HL)", 1},			{SUB, RGA, 1, L"SUB A", 1},			{SBC, RGB, 1, L"SBC A,B", 1},					{SBC, RGC, 1, L"SBC A,C", 1},				{SBC, RGD, 1, L"SBC A,D", 1},			{SBC, RGE, 1, L"SBC A,E", 1},		{SBC, RGH, 1, L"SBC A,H", 1},			{SBC, RGL, 1, L"SBC A,L", 1},			{SBC, RGHL, 2, L"SBC A,(HL)", 1},		{SBC, RGA, 1, L"SBC A,A", 1},
-	{AND, RGB, 1, L"AND B", 1},					{AND, RGC, 1, L"AND C", 1},					{AND, RGD, 1, L"AND D", 1},				{AND, RGE, 1, L"AND E", 1},			{AND, RGH, 1, L"AND H", 1},					{AND, RGL, 1, L"AND L", 1},			{AND, RGHL, 2, L"AND (HL)", 1},			{AND, RGA, 1, L"AND A", 1},			{XOR, RGB, 1, L"XOR B", 1},						{XOR, RGC, 1, L"XOR C", 1},					{XOR, RGD, 1, L"XOR D", 1},				{XOR, RGE, 1, L"XOR E", 1},			{XOR, RGH, 1, L"XOR H", 1},				{XOR, RGL, 1, L"XOR L", 1},				{XOR, RGHL, 2, L"XOR (HL)", 1},			{XOR, RGA, 1, L"XOR A", 1},
-	{OR, RGB, 1, L"OR B", 1},					{OR, RGC, 1, L"OR C", 1},					{OR, RGD, 1, L"OR D", 1},				{OR, RGE, 1, L"OR E", 1},			{OR, RGH, 1, L"OR H", 1},					{OR, RGL, 1, L"OR L", 1},			{OR, RGHL, 2, L"OR (HL)", 1},			{OR, RGA, 1, L"OR A", 1},			{CP, RGB, 1, L"CP B", 1},						{CP, RGC, 1, L"CP C", 1},					{CP, RGD, 1, L"CP D", 1},				{CP, RGE, 1, L"CP E", 1},			{CP, RGH, 1, L"CP H", 1},				{CP, RGL, 1, L"CP L", 1},				{CP, RGHL, 2, L"CP (HL)", 1},			{CP, RGA, 1, L"CP A", 1},
-	{RETNZ, IMP, 2, L"RET NZ", 1},				{POPBC, IMP, 3, L"POP BC", 1},				{JPNZ, IMM_16, 3, L"JP NZ,$%04x", 3},	{JP, IMM_16, 4, L"JP $%04x", 3},	{CALLNZ, IMM_16, 3, L"CALL NZ,$%04x", 3},	{PUSHBC, IMP, 4, L"PUSH BC", 1},	{ADD, IMM, 2, L"ADD A,$%02x", 2},		{RST00, IMP, 4, L"RST 00", 1},		{RETZ, IMP, 2, L"RET Z", 1},					{RET, IMP, 4, L"RET", 1},					{JPZ, IMM_16, 3, L"JP Z,$%04x", 3},		{PRECB, IMM, 2, L"PREFIX", 2},		{CALLZ, IMM_16, 3, L"CALL Z,$%04x", 3},	{CALL, IMM_16, 6, L"CALL $%04x", 3},	{ADC, IMM, 2, L"ADC A,$%02x", 2},		{RST08, IMP, 4, L"RST 08", 1},
-	{RETNC, IMP, 2, L"RET NC", 1},				{POPDE, IMP, 3, L"POP DE", 1},				{JPNC, IMM_16, 3, L"JP NC,$%04x", 3},	{XXX, IMP, 1, L"???", 1},			{CALLNC, IMM_16, 3, L"CALL NC,$%04x", 3},	{PUSHDE, IMP, 4, L"PUSH DE", 1},	{SUB, IMM, 2, L"SUB $%02x", 2 },		{RST10, IMP, 4, L"RST 10", 1},		{RETC, IMP, 2, L"RET C", 1},					{RETI, IMP, 4, L"RETI", 1},					{JPC, IMM_16, 3, L"JP C,$%04x", 3},		{XXX, IMP, 1, L"???", 1},			{CALLC, IMM_16, 3, L"CALL C,$%04x", 3},	{XXX, IMP, 1, L"???", 1},				{SBC, IMM, 2, L"SBC A,$%02x", 2},		{RST18, IMP, 4, L"RST 18", 1},
-	{LDION, IMM, 3, L"LD ($ff00+$%02x),A", 2},	{POPHL, IMP, 3, L"POP HL", 1},				{LDIOC, RGA, 2, L"LD ($ff00+C),A", 1},	{XXX, IMP, 1, L"???", 1},			{XXX, IMP, 1, L"???", 1},					{PUSHHL, IMP, 4, L"PUSH HL", 1},	{AND, IMM, 2, L"AND $%02x", 2},			{RST20, IMP, 4, L"RST 20", 1},		{ADDSP_16, IMM, 4, L"ADD SP,$%02x", 2},			{JPHL, IMP, 1, L"JP HL", 1},				{LDN, IMM_16, 4, L"LD ($%04x),A", 3},	{XXX, IMP, 1, L"???", 1},			{XXX, IMP, 1, L"???", 1},				{XXX, IMP, 1, L"???", 1},				{XOR, IMM, 2, L"XOR $%02x", 2},			{RST28, IMP, 4, L"RST 28", 1},
-	{LDA, PTRIO, 3, L"LD A,($ff00+$%02x)", 2},	{POPAF, IMP, 3, L"POP AF", 1},				{LDA, RGCIO, 2, L"LD A,($ff00+C)", 1},	{DI, IMP, 1, L"DI", 1},				{XXX, IMP, 1, L"???", 1},					{PUSHAF, IMP, 4, L"PUSH AF", 1},	{OR, IMM, 2, L"OR $%02x", 2},			{RST30, IMP, 4, L"RST 30", 1},		{LDHLSP_16, IMM, 3, L"LD HL,SP+$%02x", 2},		{LDSP_16, RGHL_16, 2, L"LD SP,HL", 1},		{LDA, PTR, 4, L"LD A,($%04x)", 3},		{EI, IMP, 1, L"EI", 1},				{XXX, IMP, 1, L"???", 1},				{XXX, IMP, 1, L"???", 1},				{CP, IMM, 2, L"CP $%02x", 2},			{RST38, IMP, 4, L"RST 38", 1}
+static const INSTRUCTION optable[16 * 16] = {
+	{NOP, IMP, 1, 1}, {LDBC_16, IMM_16, 3, 3}, {LDBC, RGA, 2, 1}, {INBC_16, IMP, 2, 1}, {INB, IMP, 1, 1}, {DECB, IMP, 1, 1}, {LDB, IMM, 2, 2}, {RLCA, IMP, 1, 1}, {LDASP_16, IMM_16, 5, 3}, {ADDHL_16, RGBC_16, 2, 1}, {LDA, RGBC, 2, 1}, {DECBC_16, IMP, 2, 1}, {INC, IMP, 1, 1}, {DECC, IMP, 1, 1}, {LDC, IMM, 2, 2}, {RRCA, IMP, 1, 1},
+	{STOP, IMP, 0XFF, 1}, {LDDE_16, IMM_16, 3, 3}, {LDDE, RGA, 2, 1}, {INDE_16, IMP, 2, 1}, {IND, IMP, 1, 1}, {DECD, IMP, 1, 1}, {LDD, IMM, 2, 2}, {RLA, IMP, 1, 1}, {JR, IMM, 3, 2}, {ADDHL_16, RGDE_16, 2, 1}, {LDA, RGDE, 2, 1}, {DECDE_16, IMP, 2, 1}, {INE, IMP, 1, 1}, {DECE, IMP, 1, 1}, {LDE, IMM, 2, 2}, {RRA, IMP, 1, 1},
+	{JRNZ, IMM, 2, 2}, {LDHL_16, IMM_16, 3, 3}, {LDINC, IMP, 2, 1}, {INHL_16, IMP, 2, 1}, {INH, IMP, 1, 1}, {DECH, IMP, 1, 1}, {LDH, IMM, 2, 2}, {DAA, IMP, 1, 1}, {JRZ, IMM, 2, 2}, {ADDHL_16, RGHL_16, 2, 1}, {LDAINC, IMP, 2, 1}, {DECHL_16, IMP, 2, 1}, {INL, IMP, 1, 1}, {DECL, IMP, 1, 1}, {LDL, IMM, 2, 2}, {CPL, IMP, 1, 1},
+	{JRNC, IMM, 2, 2}, {LDSP_16, IMM_16, 3, 3}, {LDDEC, IMP, 2, 1}, {INSP_16, IMP, 2, 1}, {INHL, IMP, 3, 1}, {DECHL, IMP, 3, 1}, {LDHL, IMM, 3, 2}, {SCF, IMP, 1, 1}, {JRC, IMM, 2, 2}, {ADDHL_16, RGSP_16, 2, 1}, {LDADEC, IMP, 2, 1}, {DECSP_16, IMP, 2, 1}, {INA, IMP, 1, 1}, {DECA, IMP, 1, 1}, {LDA, IMM, 2, 2}, {CCF, IMP, 1, 1},
+	{LDB, RGB, 1, 1}, {LDB, RGC, 1, 1}, {LDB, RGD, 1, 1}, {LDB, RGE, 1, 1}, {LDB, RGH, 1, 1}, {LDB, RGL, 1, 1}, {LDB, RGHL, 2, 1}, {LDB, RGA, 1, 1}, {LDC, RGB, 1, 1}, {LDC, RGC, 1, 1}, {LDC, RGD, 1, 1}, {LDC, RGE, 1, 1}, {LDC, RGH, 1, 1}, {LDC, RGL, 1, 1}, {LDC, RGHL, 2, 1}, {LDC, RGA, 1, 1},
+	{LDD, RGB, 1, 1}, {LDD, RGC, 1, 1}, {LDD, RGD, 1, 1}, {LDD, RGE, 1, 1}, {LDD, RGH, 1, 1}, {LDD, RGL, 1, 1}, {LDD, RGHL, 2, 1}, {LDD, RGA, 1, 1}, {LDE, RGB, 1, 1}, {LDE, RGC, 1, 1}, {LDE, RGD, 1, 1}, {LDE, RGE, 1, 1}, {LDE, RGH, 1, 1}, {LDE, RGL, 1, 1}, {LDE, RGHL, 2, 1}, {LDE, RGA, 1, 1},
+	{LDH, RGB, 1, 1}, {LDH, RGC, 1, 1}, {LDH, RGD, 1, 1}, {LDH, RGE, 1, 1}, {LDH, RGH, 1, 1}, {LDH, RGL, 1, 1}, {LDH, RGHL, 2, 1}, {LDH, RGA, 1, 1}, {LDL, RGB, 1, 1}, {LDL, RGC, 1, 1}, {LDL, RGD, 1, 1}, {LDL, RGE, 1, 1}, {LDL, RGH, 1, 1}, {LDL, RGL, 1, 1}, {LDL, RGHL, 2, 1}, {LDL, RGA, 1, 1},
+	{LDHL, RGB, 2, 1}, {LDHL, RGC, 2, 1}, {LDHL, RGD, 2, 1}, {LDHL, RGE, 2, 1}, {LDHL, RGH, 2, 1}, {LDHL, RGL, 2, 1}, {HALT, IMP, 1, 1}, {LDHL, RGA, 2, 1}, {LDA, RGB, 1, 1}, {LDA, RGC, 1, 1}, {LDA, RGD, 1, 1}, {LDA, RGE, 1, 1}, {LDA, RGH, 1, 1}, {LDA, RGL, 1, 1}, {LDA, RGHL, 2, 1}, {LDA, RGA, 1, 1},
+	{ADD, RGB, 1, 1}, {ADD, RGC, 1, 1}, {ADD, RGD, 1, 1}, {ADD, RGE, 1, 1}, {ADD, RGH, 1, 1}, {ADD, RGL, 1, 1}, {ADD, RGHL, 2, 1}, {ADD, RGA, 1, 1}, {ADC, RGB, 1, 1}, {ADC, RGC, 1, 1}, {ADC, RGD, 1, 1}, {ADC, RGE, 1, 1}, {ADC, RGH, 1, 1}, {ADC, RGL, 1, 1}, {ADC, RGHL, 2, 1}, {ADC, RGA, 1, 1},
+	{SUB, RGB, 1, 1}, {SUB, RGC, 1, 1}, {SUB, RGD, 1, 1}, {SUB, RGE, 1, 1}, {SUB, RGH, 1, 1}, {SUB, RGL, 1, 1}, {SUB, RGHL, 2, 1}, {SUB, RGA, 1, 1}, {SBC, RGB, 1, 1}, {SBC, RGC, 1, 1}, {SBC, RGD, 1, 1}, {SBC, RGE, 1, 1}, {SBC, RGH, 1, 1}, {SBC, RGL, 1, 1}, {SBC, RGHL, 2, 1}, {SBC, RGA, 1, 1},
+	{AND, RGB, 1, 1}, {AND, RGC, 1, 1}, {AND, RGD, 1, 1}, {AND, RGE, 1, 1}, {AND, RGH, 1, 1}, {AND, RGL, 1, 1}, {AND, RGHL, 2, 1}, {AND, RGA, 1, 1}, {XOR, RGB, 1, 1}, {XOR, RGC, 1, 1}, {XOR, RGD, 1, 1}, {XOR, RGE, 1, 1}, {XOR, RGH, 1, 1}, {XOR, RGL, 1, 1}, {XOR, RGHL, 2, 1}, {XOR, RGA, 1, 1},
+	{OR, RGB, 1, 1}, {OR, RGC, 1, 1}, {OR, RGD, 1, 1}, {OR, RGE, 1, 1}, {OR, RGH, 1, 1}, {OR, RGL, 1, 1}, {OR, RGHL, 2, 1}, {OR, RGA, 1, 1}, {CP, RGB, 1, 1}, {CP, RGC, 1, 1}, {CP, RGD, 1, 1}, {CP, RGE, 1, 1}, {CP, RGH, 1, 1}, {CP, RGL, 1, 1}, {CP, RGHL, 2, 1}, {CP, RGA, 1, 1},
+	{RETNZ, IMP, 2, 1}, {POPBC, IMP, 3, 1}, {JPNZ, IMM_16, 3, 3}, {JP, IMM_16, 4, 3}, {CALLNZ, IMM_16, 3, 3}, {PUSHBC, IMP, 4, 1}, {ADD, IMM, 2, 2}, {RST00, IMP, 4, 1}, {RETZ, IMP, 2, 1}, {RET, IMP, 4, 1}, {JPZ, IMM_16, 3, 3}, {PRECB, IMM, 2, 2}, {CALLZ, IMM_16, 3, 3}, {CALL, IMM_16, 6, 3}, {ADC, IMM, 2, 2}, {RST08, IMP, 4, 1},
+	{RETNC, IMP, 2, 1}, {POPDE, IMP, 3, 1}, {JPNC, IMM_16, 3, 3}, {XXX, IMP, 1, 1}, {CALLNC, IMM_16, 3, 3}, {PUSHDE, IMP, 4, 1}, {SUB, IMM, 2, 2}, {RST10, IMP, 4, 1}, {RETC, IMP, 2, 1}, {RETI, IMP, 4, 1}, {JPC, IMM_16, 3, 3}, {XXX, IMP, 1, 1}, {CALLC, IMM_16, 3, 3}, {XXX, IMP, 1, 1}, {SBC, IMM, 2, 2}, {RST18, IMP, 4, 1},
+	{LDION, IMM, 3, 2}, {POPHL, IMP, 3, 1}, {LDIOC, RGA, 2, 1}, {XXX, IMP, 1, 1}, {XXX, IMP, 1, 1}, {PUSHHL, IMP, 4, 1}, {AND, IMM, 2, 2}, {RST20, IMP, 4, 1}, {ADDSP_16, IMM, 4, 2}, {JPHL, IMP, 1, 1}, {LDN, IMM_16, 4, 3}, {XXX, IMP, 1, 1}, {XXX, IMP, 1, 1}, {XXX, IMP, 1, 1}, {XOR, IMM, 2, 2}, {RST28, IMP, 4, 1},
+	{LDA, PTRIO, 3, 2}, {POPAF, IMP, 3, 1}, {LDA, RGCIO, 2, 1}, {DI, IMP, 1, 1}, {XXX, IMP, 1, 1}, {PUSHAF, IMP, 4, 1}, {OR, IMM, 2, 2}, {RST30, IMP, 4, 1}, {LDHLSP_16, IMM, 3, 2}, {LDSP_16, RGHL_16, 2, 1}, {LDA, PTR, 4, 3}, {EI, IMP, 1, 1}, {XXX, IMP, 1, 1}, {XXX, IMP, 1, 1}, {CP, IMM, 2, 2}, {RST38, IMP, 4, 1}
+};
+
+// The text of every opcode for the disassembly, apart from optable so the CPU only touches the part it runs
+static const char* optable_repr[16 * 16] = {
+	"NOP", "LD BC,$%04x", "LD (BC),A", "INC BC", "INC B", "DEC B", "LD B,$%02x", "RLC A", "LD ($%04x),SP", "ADD HL,BC", "LD A,(BC)", "DEC BC", "INC C", "DEC C", "LD C,$%02x", "RRCA",
+	"STOP", "LD DE,$%04x", "LD (DE),A", "INC DE", "INC D", "DEC D", "LD D,$%02x", "RL A", "JR $%02x", "ADD HL,DE", "LD A,(DE)", "DEC DE", "INC E", "DEC E", "LD E,$%02x", "RRA",
+	"JR NZ,$%02x", "LD HL,$%04x", "LD (HL+),A", "INC HL", "INC H", "DEC H", "LD H,$%02x", "DAA", "JR Z,$%02x", "ADD HL,HL", "LD A,(HL+)", "DEC HL", "INC L", "DEC L", "LD L,$%02x", "CPL",
+	"JR NC,$%02x", "LD SP,$%04x", "LD (HL-),A", "INC SP", "INC (HL)", "DEC (HL)", "LD (HL),$%02x", "SCF", "JR C,$%02x", "ADD HL,SP", "LD A,(HL-)", "DEC SP", "INC A", "DEC A", "LD A,$%02x", "CCF",
+	"LD B,B", "LD B,C", "LD B,D", "LD B,E", "LD B,H", "LD B,L", "LD B,(HL)", "LD B,A", "LD C,B", "LD C,C", "LD C,D", "LD C,E", "LD C,H", "LD C,L", "LD C,(HL)", "LD C,A",
+	"LD D,B", "LD D,C", "LD D,D", "LD D,E", "LD D,H", "LD D,L", "LD D,(HL)", "LD D,A", "LD E,B", "LD E,C", "LD E,D", "LD E,E", "LD E,H", "LD E,L", "LD E,(HL)", "LD E,A",
+	"LD H,B", "LD H,C", "LD H,D", "LD H,E", "LD H,H", "LD H,L", "LD H,(HL)", "LD H,A", "LD L,B", "LD L,C", "LD L,D", "LD L,E", "LD L,H", "LD L,L", "LD L,(HL)", "LD L,A",
+	"LD (HL),B", "LD (HL),C", "LD (HL),D", "LD (HL),E", "LD (HL),H", "LD (HL),L", "HALT", "LD (HL),A", "LD A,B", "LD A,C", "LD A,D", "LD A,E", "LD A,H", "LD A,L", "LD A,(HL)", "LD A,A",
+	"ADD A,B", "ADD A,C", "ADD A,D", "ADD A,E", "ADD A,H", "ADD A,L", "ADD A,(HL)", "ADD A,A", "ADC A,B", "ADC A,C", "ADC A,D", "ADC A,E", "ADC A,H", "ADC A,L", "ADC A,(HL)", "ADC A,A",
+	"SUB B", "SUB C", "SUB D", "SUB E", "SUB H", "SUB L", "SUB (HL)", "SUB A", "SBC A,B", "SBC A,C", "SBC A,D", "SBC A,E", "SBC A,H", "SBC A,L", "SBC A,(HL)", "SBC A,A",
+	"AND B", "AND C", "AND D", "AND E", "AND H", "AND L", "AND (HL)", "AND A", "XOR B", "XOR C", "XOR D", "XOR E", "XOR H", "XOR L", "XOR (HL)", "XOR A",
+	"OR B", "OR C", "OR D", "OR E", "OR H", "OR L", "OR (HL)", "OR A", "CP B", "CP C", "CP D", "CP E", "CP H", "CP L", "CP (HL)", "CP A",
+	"RET NZ", "POP BC", "JP NZ,$%04x", "JP $%04x", "CALL NZ,$%04x", "PUSH BC", "ADD A,$%02x", "RST 00", "RET Z", "RET", "JP Z,$%04x", "PREFIX", "CALL Z,$%04x", "CALL $%04x", "ADC A,$%02x", "RST 08",
+	"RET NC", "POP DE", "JP NC,$%04x", "???", "CALL NC,$%04x", "PUSH DE", "SUB $%02x", "RST 10", "RET C", "RETI", "JP C,$%04x", "???", "CALL C,$%04x", "???", "SBC A,$%02x", "RST 18",
+	"LD ($ff00+$%02x),A", "POP HL", "LD ($ff00+C),A", "???", "???", "PUSH HL", "AND $%02x", "RST 20", "ADD SP,$%02x", "JP HL", "LD ($%04x),A", "???", "???", "???", "XOR $%02x", "RST 28",
+	"LD A,($ff00+$%02x)", "POP AF", "LD A,($ff00+C)", "DI", "???", "PUSH AF", "OR $%02x", "RST 30", "LD HL,SP+$%02x", "LD SP,HL", "LD A,($%04x)", "EI", "???", "???", "CP $%02x", "RST 38"
 };
 static uint8_t(*precbtable[32])() = {
 	RLC,  RRC,  RL,   RR,   SLA,  SRA,  SWAP, SRL,  BIT0, BIT1, BIT2, BIT3, BIT4, BIT5, BIT6, BIT7,
 	RES0, RES1, RES2, RES3, RES4, RES5, RES6, RES7, SET0, SET1, SET2, SET3, SET4, SET5, SET6, SET7
 };
-static wchar_t dis_precb[32][15] = {
-	L"RLC %s", L"RRC %s", L"RL %s", L"RR %s", L"SLA %s", L"SRA %s", L"SWAP %s", L"SRL %s", L"BIT 0,%s", L"BIT 1,%s", L"BIT 2,%s", L"BIT 3,%s", L"BIT 4,%s", L"BIT 5,%s", L"BIT 6,%s", L"BIT 7,%s",
-	L"RES 0,%s", L"RES 1,%s", L"RES 2,%s", L"RES 3,%s", L"RES 4,%s", L"RES 5,%s", L"RES 6,%s", L"RES 7,%s", L"SET 0,%s", L"SET 1,%s", L"SET 2,%s", L"SET 3,%s", L"SET 4,%s", L"SET 5,%s", L"SET 6,%s", L"SET 7,%s"
+static char dis_precb[32][15] = {
+	"RLC %s", "RRC %s", "RL %s", "RR %s", "SLA %s", "SRA %s", "SWAP %s", "SRL %s", "BIT 0,%s", "BIT 1,%s", "BIT 2,%s", "BIT 3,%s", "BIT 4,%s", "BIT 5,%s", "BIT 6,%s", "BIT 7,%s",
+	"RES 0,%s", "RES 1,%s", "RES 2,%s", "RES 3,%s", "RES 4,%s", "RES 5,%s", "RES 6,%s", "RES 7,%s", "SET 0,%s", "SET 1,%s", "SET 2,%s", "SET 3,%s", "SET 4,%s", "SET 5,%s", "SET 6,%s", "SET 7,%s"
 };
 
 
@@ -127,87 +170,291 @@ void cpu_set_f(uint8_t data)
 	AF = (AF & 0xFF00) | (data & 0xF0);
 }
 
+// Runs the instruction at PC from the recompiled code, if it has it and nothing looks at the
+// instructions one by one. The scratch variables (fetched, temp) aren't set.
+static inline bool cpu_recompiled()
+{
+#ifndef GAMEBOY_OPCODE_PROFILE
+	if (recomp_banks == NULL || halt_bug || trace_enabled || gprof_enabled)
+		return false;
+	RECOMP_FUNC run = recomp_find(PC);
+	if (run == NULL)
+		return false;
+	recomp_cpu.af = AF;
+	recomp_cpu.bc = BC;
+	recomp_cpu.de = DE;
+	recomp_cpu.hl = HL;
+	recomp_cpu.sp = SP;
+	uint8_t instruction_cycles = run(&recomp_cpu, PC);
+	if (instruction_cycles == 0)
+		return false;
+	AF = recomp_cpu.af;
+	BC = recomp_cpu.bc;
+	DE = recomp_cpu.de;
+	HL = recomp_cpu.hl;
+	SP = recomp_cpu.sp;
+	PC = recomp_cpu.pc;
+	opcode = recomp_cpu.opcode;
+	cb_opcode = recomp_cpu.cb_opcode;
+	cycles = instruction_cycles - 1;
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Fused instructions (GB_FAST_FUSED)
+// Most of the time games run a few sequences: copy loops (LD A,(HL+) / LD (DE),A / INC DE / DEC BC /
+// LD A,B / OR C / JR NZ), clear loops (LD (HL+),A / DEC B or C / JR NZ, with or without XOR A at the
+// top), waits for a line (LDH A,($44) / CP n / JR NZ) and bit tests (BIT n,r / JR Z or NZ). Once the CPU
+// ran the JR NZ back to the top of one of these loops, it runs as many rounds of it as it can in one go,
+// with memmove and memset when the addresses are plain memory (bus_plain_memory), and once it ran a BIT
+// it runs the JR after it. The registers, the flags and the memory end up as the instructions one by one
+// leave them, and their cycles are added to the instruction that ran, so the next one starts on the same
+// clock.
+// The effects of the instructions come before their clocks, so this only happens up to bus_quiet_until:
+// no interrupt can come on the way, LY stays the same, and the run doesn't stop. A round of a loop that
+// doesn't fit is left to the interpreter. The code has to be in ROM, where the loops can't write over
+// themselves, and the cycles in flight fit in the 8 bits of the save states.
+static uint32_t cpu_fuse_budget()
+{
+	uint64_t until = bus_quiet_until();
+	uint64_t next = clock_count + 4 * ((uint64_t)cycles + 1);
+	if (until <= next)
+		return 0;
+	uint64_t budget = (until - next) / 4;
+	return budget < (uint64_t)(UINT8_MAX - cycles) ? (uint32_t)budget : UINT8_MAX - cycles;
+}
+
+// Rounds of a loop that fit in budget M-cycles, out of the left ones. The last one is a cycle shorter,
+// its JR NZ isn't taken.
+static uint32_t cpu_fuse_rounds(uint32_t left, uint32_t round, uint32_t budget)
+{
+	if (left * round - 1 <= budget)
+		return left;
+	return budget / round;
+}
+
+// Input from the GUI waits for the instructions to end
+static void cpu_fuse_hold()
+{
+	bus_quiet_hold(clock_count + 4 * ((uint64_t)cycles + 1));
+}
+
+// The rounds ran, after the one that just ended with the JR NZ at end - 2
+static void cpu_fuse_end(uint32_t rounds, uint32_t round, bool last, uint16_t end)
+{
+	cycles += rounds * round - last;
+	if (last)
+		PC = end;
+	cpu_fuse_hold();
+}
+
+static void cpu_fuse_copy(uint16_t end, uint32_t budget)
+{
+	uint32_t round = optable[0x2A].cycles + optable[0x12].cycles + optable[0x13].cycles + optable[0x0B].cycles +
+		optable[0x78].cycles + optable[0xB1].cycles + optable[0x20].cycles + 1;
+	uint32_t rounds = cpu_fuse_rounds(BC, round, budget);
+
+	// Into plain memory, from plain memory or the ROM
+	uint16_t dst_len, src_len;
+	uint8_t* dst = bus_plain_memory(DE, &dst_len);
+	if (dst == NULL)
+		return;
+	uint8_t* src = bus_plain_memory(HL, &src_len);
+	if (src == NULL)
+	{
+		if (HL > 0x7FFF)
+			return;
+		src_len = 0x8000 - HL;
+	}
+	if (rounds > dst_len)
+		rounds = dst_len;
+	if (rounds > src_len)
+		rounds = src_len;
+	if (rounds == 0)
+		return;
+
+	if (src == NULL)
+	{
+		for (uint32_t i = 0; i < rounds; i++)
+			dst[i] = bus_peek(HL + i);
+	}
+	else if (DE > HL && DE < HL + rounds)
+	{
+		// Byte by byte, the bytes written come around to be read again
+		for (uint32_t i = 0; i < rounds; i++)
+			dst[i] = src[i];
+	}
+	else
+		memmove(dst, src, rounds);
+
+	bool last = rounds == BC;
+	HL += rounds;
+	DE += rounds;
+	BC -= rounds;
+	AF = (uint16_t)(B | C) << 8 | ((B | C) == 0 ? Z : 0);
+	cpu_fuse_end(rounds, round, last, end);
+}
+
+// xor_a: XOR A at the top of the loop, counter: DEC B ($05) or DEC C ($0D)
+static void cpu_fuse_clear(uint16_t end, bool xor_a, uint8_t counter, uint32_t budget)
+{
+	uint32_t round = (xor_a ? optable[0xAF].cycles : 0) + optable[0x22].cycles + optable[counter].cycles +
+		optable[0x20].cycles + 1;
+	uint8_t left = counter == 0x05 ? B : C;
+	uint32_t rounds = cpu_fuse_rounds(left, round, budget);
+
+	uint16_t dst_len;
+	uint8_t* dst = bus_plain_memory(HL, &dst_len);
+	if (dst == NULL)
+		return;
+	if (rounds > dst_len)
+		rounds = dst_len;
+	if (rounds == 0)
+		return;
+
+	memset(dst, A, rounds);
+	HL += rounds;
+	uint8_t old = (uint8_t)(left - rounds + 1);
+	if (counter == 0x05)
+		cpu_set_b(old - 1);
+	else
+		cpu_set_c(old - 1);
+
+	// The flags of the last DEC, XOR A clears the carry before it
+	uint8_t flags = N | ((old & 0x0F) == 0 ? Hc : 0) | (old == 1 ? Z : 0);
+	if (!xor_a)
+		flags |= F & Cy;
+	cpu_set_f(flags);
+	cpu_fuse_end(rounds, round, rounds == left, end);
+}
+
+// LY doesn't change, so the loop goes on for all of the rounds or none
+static void cpu_fuse_line_wait(uint8_t line, uint32_t budget)
+{
+	uint32_t round = optable[0xF0].cycles + optable[0xFE].cycles + optable[0x20].cycles + 1;
+	uint32_t rounds = budget / round;
+	if (rounds == 0)
+		return;
+	uint8_t ly = bus_peek(0xFF44);
+	if (ly == line)
+		return;
+
+	// The flags of CP
+	cpu_set_a(ly);
+	cpu_set_f(N | ((line & 0x0F) > (ly & 0x0F) ? Hc : 0) | (line > ly ? Cy : 0));
+	cpu_fuse_end(rounds, round, false, 0);
+}
+
+static void cpu_fuse_bit_branch(uint32_t budget)
+{
+	if (PC > 0x7FFE)
+		return;
+	uint8_t next = bus_peek(PC);
+	if (next != 0x20 && next != 0x28)
+		return;
+	bool taken = (next == 0x28) == (cpu_getflag(Z) != 0);
+	uint8_t branch_cycles = optable[next].cycles + taken;
+	if (budget < branch_cycles)
+		return;
+
+	opcode = next;
+	fetched = bus_peek(PC + 1);
+	PC += 2;
+	if (taken)
+		PC += (int8_t)fetched;
+	cycles += branch_cycles;
+	cpu_fuse_hold();
+}
+
+// After the instruction at inst_pc ran. Only the registers are looked at until there's room for the
+// fused instructions, and the code is then peeked at, the program didn't read it.
+static void cpu_fuse(uint16_t inst_pc)
+{
+#ifndef GAMEBOY_OPCODE_PROFILE
+	if (halt_bug || trace_enabled || gprof_enabled || enable_int != INT_NO_CHANGE || inst_pc > 0x7FFF)
+		return;
+	if (opcode == 0xCB)
+	{
+		if (cb_opcode < 0x40 || cb_opcode >= 0x80 || (cb_opcode & 0x07) == 6)
+			return;
+		uint32_t budget = cpu_fuse_budget();
+		if (budget != 0)
+			cpu_fuse_bit_branch(budget);
+		return;
+	}
+
+	// JR NZ taken back to the top of a loop
+	if (PC >= inst_pc || inst_pc - PC > 6 || inst_pc - PC == 5)
+		return;
+	uint32_t budget = cpu_fuse_budget();
+	if (budget == 0)
+		return;
+	uint16_t end = inst_pc + 2;
+	switch (inst_pc - PC)
+	{
+	case 6:
+		if (bus_peek(PC) == 0x2A && bus_peek(PC + 1) == 0x12 && bus_peek(PC + 2) == 0x13 &&
+			bus_peek(PC + 3) == 0x0B && bus_peek(PC + 4) == 0x78 && bus_peek(PC + 5) == 0xB1)
+			cpu_fuse_copy(end, budget);
+		break;
+	case 2:
+	case 3:
+	{
+		bool xor_a = inst_pc - PC == 3;
+		uint8_t counter = bus_peek(inst_pc - 1);
+		if ((counter == 0x05 || counter == 0x0D) && bus_peek(inst_pc - 2) == 0x22 && (!xor_a || bus_peek(PC) == 0xAF))
+			cpu_fuse_clear(end, xor_a, counter, budget);
+		break;
+	}
+	case 4:
+		if (bus_peek(PC) == 0xF0 && bus_peek(PC + 1) == 0x44 && bus_peek(PC + 2) == 0xFE)
+			cpu_fuse_line_wait(bus_peek(PC + 3), budget);
+		break;
+	}
+#endif
+}
+
 void cpu_clock()
 {
 	// Interrupt check routine
 	if (cpu_int_check)
 	{
 		cpu_int_check = false;
-		temp = cpu_read(IF_ADDR);
-		uint8_t temp2 = cpu_read(IE_ADDR);
+		uint8_t pending = int_pending;
 		if (IME)
 		{
-			if (temp & temp2)
+			if (pending)
 			{
 				if (halt_occured)
 					halt_occured = false;
 
-				// Check each interrupt starting from the 0 bit
-				if (temp & INT_VBLANK & temp2)
+				// The lowest bit has the highest priority
+				if (pending & INT_ALL)
 				{
-					// Clear bit
-					cpu_write(IF_ADDR, temp & ~INT_VBLANK);
+					uint8_t interrupt = int_lowest(pending);
 
-					// Disable IME
+					// Clear the bit and disable IME
+					bus_int_acknowledge(1 << interrupt);
 					enable_int = INT_DISABLE;
 
-					// Call VBlank routine
-					// Push PC to the stack
+					// Push PC to the stack and jump to the routine
 					cpu_write(--SP, (uint8_t)(PC >> 8));
 					cpu_write(--SP, (uint8_t)PC);
-
-					// Jump to VBlank routine
-					PC = INT_VBLANK_RTN;
+					PC = INT_VECTORS[interrupt];
 
 					// This whole operation should take 5 cycles
 					cycles += 5;
-					return;
-				}
-				else if (temp & INT_LCDSTAT & temp2)
-				{
-					cpu_write(IF_ADDR, temp & ~INT_LCDSTAT);
-					enable_int = INT_DISABLE;
-					cpu_write(--SP, (uint8_t)(PC >> 8));
-					cpu_write(--SP, (uint8_t)PC);
-					PC = INT_LEDSTAT_RTN;
-					cycles += 5;
-					return;
-				}
-				else if (temp & INT_TIMER & temp2)
-				{
-					cpu_write(IF_ADDR, temp & ~INT_TIMER);
-					enable_int = INT_DISABLE;
-					cpu_write(--SP, (uint8_t)(PC >> 8));
-					cpu_write(--SP, (uint8_t)PC);
-					PC = INT_TIMER_RTN;
-					cycles += 5;
-					return;
-				}
-				else if (temp & INT_SERIAL & temp2)
-				{
-					cpu_write(IF_ADDR, temp & ~INT_SERIAL);
-					enable_int = INT_DISABLE;
-					cpu_write(--SP, (uint8_t)(PC >> 8));
-					cpu_write(--SP, (uint8_t)PC);
-					PC = INT_SERIAL_RTN;
-					cycles += 5;
-					return;
-				}
-				else if (temp & INT_JOYPAD & temp2)
-				{
-					cpu_write(IF_ADDR, temp & ~INT_JOYPAD);
-					enable_int = INT_DISABLE;
-					cpu_write(--SP, (uint8_t)(PC >> 8));
-					cpu_write(--SP, (uint8_t)PC);
-					PC = INT_JOYPAD_RTN;
-					cycles += 5;
+					if (gprof_enabled)
+						gprof_interrupt(PC, SP + 2, cycles);
 					return;
 				}
 			}
 		}
 		else
 		{
-			if (temp & temp2)
+			if (pending)
 			{
 				// Halt bug
 				if (halt_occured)
@@ -224,21 +471,30 @@ void cpu_clock()
 	}
 	if (cycles == 0) 
 	{
-		
-
-		opcode = cpu_read(PC);
-
-		// Halt bug - the PC doesn't progress once after the HALT instruction
-		if (!halt_bug)
-			PC++;
-		else
-			halt_bug = false;
-
-		cycles = optable[opcode].cycles - 1; // This is the first cycle so only n-1 left
-		(*optable[opcode].addrmode)();
-		(*optable[opcode].func)();
-
-		
+		uint16_t inst_pc = PC;
+		if (!cpu_recompiled())
+		{
+			opcode = cpu_read(PC);
+			if (trace_enabled)
+				trace_instruction(PC, opcode, AF, BC, DE, HL, SP);
+
+			// Halt bug - the PC doesn't progress once after the HALT instruction
+			if (!halt_bug)
+				PC++;
+			else
+				halt_bug = false;
+
+			cycles = optable[opcode].cycles - 1; // This is the first cycle so only n-1 left
+			uint16_t old_sp = SP;
+			OPPROF_START(handler_start);
+			(*optable[opcode].addrmode)();
+			(*optable[opcode].func)();
+			OPPROF_END(handler_start, opcode, cb_opcode);
+			if (gprof_enabled)
+				gprof_instruction(opcode, old_sp, SP, PC, cycles);
+		}
+		if ((opcode == 0x20 || opcode == 0xCB) && (fast_paths & GB_FAST_FUSED))
+			cpu_fuse(inst_pc);
 
 		// Make sure that when enabling interrupts it only enables after the next instruction
 		if (enable_int == INT_ENABLE)
@@ -278,6 +534,16 @@ void cpu_reset(bool bootskip)
 	halt_bug = false;
 	halt_occured = false;
 
+	// Instruction in flight
+	opcode = 0x00;
+	cb_opcode = 0x00;
+	cycles = 0x00;
+	fetched = 0x00;
+	fetched_16 = 0x0000;
+	temp = 0x00;
+	temp_16 = 0x0000;
+	temp_32 = 0x00000000;
+
 	// For testing purposes
 	if (bootskip)
 	{
@@ -298,9 +564,21 @@ uint8_t cpu_read(uint16_t addr)
 
 void cpu_write(uint16_t addr, uint8_t data)
 {
+	if (trace_enabled)
+		trace_write(addr, data);
 	bus_write(addr, data, DEV_CPU);
 }
 
+uint8_t cpu_cycles_left()
+{
+	return cycles;
+}
+
+uint16_t cpu_get_pc()
+{
+	return PC;
+}
+
 void cpu_get_stats(uint16_t* af, uint16_t* bc, uint16_t* de, uint16_t* hl, uint16_t* sp, uint16_t* pc, 
 	bool* ime, uint8_t* stat_opcode, uint8_t* stat_cycles, uint8_t* stat_fetched, uint16_t* stat_fetched16, 
 	uint8_t* cb_op, uint16_t* stat_stackbase)
@@ -333,6 +611,52 @@ void cpu_get_stats(uint16_t* af, uint16_t* bc, uint16_t* de, uint16_t* hl, uint1
 		*stat_stackbase = stack_base;
 }
 
+void cpu_state_save(CPU_STATE* state)
+{
+	state->AF = AF;
+	state->BC = BC;
+	state->DE = DE;
+	state->HL = HL;
+	state->SP = SP;
+	state->PC = PC;
+	state->fetched_16 = fetched_16;
+	state->temp_16 = temp_16;
+	state->temp_32 = temp_32;
+	state->stack_base = stack_base;
+	state->enable_int = enable_int;
+	state->opcode = opcode;
+	state->cb_opcode = cb_opcode;
+	state->cycles = cycles;
+	state->fetched = fetched;
+	state->temp = temp;
+	state->IME = IME;
+	state->halt_bug = halt_bug;
+	state->halt_occured = halt_occured;
+}
+
+void cpu_state_load(CPU_STATE* state)
+{
+	AF = state->AF;
+	BC = state->BC;
+	DE = state->DE;
+	HL = state->HL;
+	SP = state->SP;
+	PC = state->PC;
+	fetched_16 = state->fetched_16;
+	temp_16 = state->temp_16;
+	temp_32 = state->temp_32;
+	stack_base = state->stack_base;
+	enable_int = state->enable_int;
+	opcode = state->opcode;
+	cb_opcode = state->cb_opcode;
+	cycles = state->cycles;
+	fetched = state->fetched;
+	temp = state->temp;
+	IME = state->IME;
+	halt_bug = state->halt_bug;
+	halt_occured = state->halt_occured;
+}
+
 
 // 8-bit Address modes
 uint8_t IMP()
@@ -2607,41 +2931,82 @@ uint8_t LDASP_16()
 	return 0;
 }
 
-uint8_t disassemble_inst(uint16_t inst_pointer, wchar_t* disassembled_inst, int strlen)
+static char cb_op_regs[8][10] = {
+	"B", "C", "D", "E", "H", "L", "(HL)", "A"
+};
+
+void cpu_opcode_name(uint8_t opcode, bool cb, char* name, int len)
+{
+	if (cb)
+	{
+		snprintf(name, len, dis_precb[opcode >> 3], cb_op_regs[opcode & 0x7]);
+		return;
+	}
+	const char* repr = optable_repr[opcode];
+	int out = 0;
+	while (*repr != '\0' && out < len - 1)
+	{
+		if (repr[0] == '%' && repr[1] == '0' && (repr[2] == '2' || repr[2] == '4') && repr[3] == 'x')
+		{
+			for (int i = 0; i < repr[2] - '0' && out < len - 1; i++)
+				name[out++] = 'n';
+			repr += 4;
+		}
+		else
+			name[out++] = *repr++;
+	}
+	name[out] = '\0';
+}
+
+uint8_t cpu_opcode_length(uint8_t opcode)
 {
-	wchar_t cb_op_regs[8][10] = {
-		L"B", L"C", L"D", L"E", L"H", L"L", L"(HL)", L"A"
-	};
+	return optable[opcode].inst_len;
+}
 
-	// Get opcode from pointer
-	uint8_t dis_opcode = cpu_read(inst_pointer);
+uint8_t cpu_opcode_cycles(uint8_t opcode)
+{
+	return optable[opcode].cycles;
+}
+
+uint8_t disassemble_inst(uint16_t inst_pointer, char* disassembled_inst, int len)
+{
+	uint8_t bytes[3] = { cpu_read(inst_pointer), 0x00, 0x00 };
+	for (int i = 1; i < optable[bytes[0]].inst_len; i++)
+		bytes[i] = cpu_read(inst_pointer + i);
+	return disassemble_bytes(bytes, inst_pointer, disassembled_inst, len);
+}
+
+uint8_t disassemble_bytes(uint8_t* bytes, uint16_t inst_pointer, char* disassembled_inst, int len)
+{
+	// Get opcode from the bytes
+	uint8_t dis_opcode = bytes[0];
 	uint8_t dis_fetched = 0x00;
 	uint16_t dis_fetched_16 = 0x0000;
 	uint8_t dis_cb_opcode = 0x00;
 
 	// Get instruction length and string
 	uint8_t inst_len = optable[dis_opcode].inst_len;
-	wchar_t* dis_inst = optable[dis_opcode].repr;
-	wchar_t dis_inst_temp[150] = { 0 };
+	const char* dis_inst = optable_repr[dis_opcode];
+	char dis_inst_temp[150] = { 0 };
 
 	if (inst_len == 1)
-		wcscpy_s(dis_inst_temp, 150, dis_inst);
+		snprintf(dis_inst_temp, sizeof dis_inst_temp, "%s", dis_inst);
 	if (inst_len == 2) 
 	{
-		dis_fetched = cpu_read(inst_pointer + 1);
+		dis_fetched = bytes[1];
 
 		// Handle CB prefix
 		if (dis_opcode == 0xCB)
 		{
 			dis_inst = dis_precb[dis_fetched >> 3];
-			StringCchPrintfW(dis_inst_temp, 150, dis_inst, cb_op_regs[dis_fetched & 0x7]);
+			snprintf(dis_inst_temp, sizeof dis_inst_temp, dis_inst, cb_op_regs[dis_fetched & 0x7]);
 		}
 		else
 		{
-			StringCchPrintfW(dis_inst_temp, 150, dis_inst, dis_fetched);
+			snprintf(dis_inst_temp, sizeof dis_inst_temp, dis_inst, dis_fetched);
 
 			// Add useful comments for relative jumps
-			wchar_t dis_comment[80] = { 0 };
+			char dis_comment[80] = { 0 };
 			switch (dis_opcode) 
 			{
 				case 0x18:
@@ -2650,15 +3015,15 @@ uint8_t disassemble_inst(uint16_t inst_pointer, wchar_t* disassembled_inst, int
 				case 0x30:
 				case 0x38:
 				{
-					StringCchPrintfW(dis_comment, 80, L"    ; Absolute address: $%04x", inst_pointer + (int8_t)dis_fetched + inst_len);
-					wcscat_s(dis_inst_temp, 150, dis_comment);
+					snprintf(dis_comment, sizeof dis_comment, "    ; Absolute address: $%04x", inst_pointer + (int8_t)dis_fetched + inst_len);
+					strncat(dis_inst_temp, dis_comment, sizeof dis_inst_temp - strlen(dis_inst_temp) - 1);
 					break;
 				}
 				case 0xE8:
 				case 0xF8:
 				{
-					StringCchPrintfW(dis_comment, 80, L"    ; Signed number: %d", (int8_t)dis_fetched);
-					wcscat_s(dis_inst_temp, 150, dis_comment);
+					snprintf(dis_comment, sizeof dis_comment, "    ; Signed number: %d", (int8_t)dis_fetched);
+					strncat(dis_inst_temp, dis_comment, sizeof dis_inst_temp - strlen(dis_inst_temp) - 1);
 					break;
 				}
 			}
@@ -2666,12 +3031,12 @@ uint8_t disassemble_inst(uint16_t inst_pointer, wchar_t* disassembled_inst, int
 	}
 	else if (inst_len == 3)
 	{
-		dis_fetched_16 = cpu_read(inst_pointer+2) << 8 | cpu_read(inst_pointer+1);
-		StringCchPrintfW(dis_inst_temp, 150, dis_inst, dis_fetched_16);
+		dis_fetched_16 = bytes[2] << 8 | bytes[1];
+		snprintf(dis_inst_temp, sizeof dis_inst_temp, dis_inst, dis_fetched_16);
 	}
 
 	// Copy string to output string
-	wcscpy_s(disassembled_inst, strlen, dis_inst_temp);
+	snprintf(disassembled_inst, len, "%s", dis_inst_temp);
 
 	return inst_len;
 }
@@ -4,7 +4,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <strsafe.h>
+#include "Bus.h"
 
 // Flags
 typedef enum
@@ -15,7 +15,7 @@ typedef enum
 	Z = (1 << 7),	// Zero
 } FLAGSLR35902;
 
-extern bool cpu_int_check;			// Do you need to check for an interrupt?
+extern GB_INSTANCE bool cpu_int_check;			// Do you need to check for an interrupt?
 
 // Interrupt enable states
 enum INT_STATES {
@@ -50,6 +50,10 @@ void cpu_set_f(uint8_t data);
 void cpu_clock();
 void cpu_reset(bool bootskip);
 
+// For the run loop: M-cycles left of the current instruction (0 - the next one starts on the next M-cycle)
+uint8_t cpu_cycles_left();
+uint16_t cpu_get_pc();
+
 uint8_t cpu_read(uint16_t addr);
 void cpu_write(uint16_t addr, uint8_t data);
 
@@ -232,21 +236,60 @@ uint8_t LDHLSP_16();
 uint8_t LDSP_16();
 uint8_t LDASP_16();	// Load to address from SP
 
-// Instruction data
+// Instruction data, only what running the opcode needs (24 bytes, so the table stays in the cache).
+// The strings for the disassembly are in their own table.
 typedef struct {
 	uint8_t(*func)();
 	uint8_t(*addrmode)();
 	uint8_t cycles;
-	// Adding string and length for disassembly
-	wchar_t repr[50];
 	uint8_t inst_len;
 } INSTRUCTION;
 
+// Save states
+typedef struct {
+	uint16_t AF;
+	uint16_t BC;
+	uint16_t DE;
+	uint16_t HL;
+	uint16_t SP;
+	uint16_t PC;
+	uint16_t fetched_16;
+	uint16_t temp_16;
+	uint32_t temp_32;
+	uint16_t stack_base;
+	uint8_t enable_int;
+	uint8_t opcode;
+	uint8_t cb_opcode;
+	uint8_t cycles;
+	uint8_t fetched;
+	uint8_t temp;
+	bool IME;
+	bool halt_bug;
+	bool halt_occured;
+	uint8_t reserved;
+} CPU_STATE;
+
+void cpu_state_save(CPU_STATE* state);
+void cpu_state_load(CPU_STATE* state);
+
 // Debugging
 // This function gets a pointer to RAM, disassembles the instruction and outputs the disassembled
 // string. Returns number of bytes the instruction takes.
-uint8_t disassemble_inst(uint16_t inst_pointer, wchar_t* disassembled_inst, int strlen);
+uint8_t disassemble_inst(uint16_t inst_pointer, char* disassembled_inst, int len);
+
+// The same for an instruction that isn't read through the bus: bytes holds the opcode and its operands,
+// inst_pointer is only used for the comments (the absolute address of relative jumps)
+uint8_t disassemble_bytes(uint8_t* bytes, uint16_t inst_pointer, char* disassembled_inst, int len);
+
+// Instruction of an opcode, with nn/nnnn in place of the operands
+void cpu_opcode_name(uint8_t opcode, bool cb, char* name, int len);
+
+// Bytes an instruction takes with its operands (CB instructions are 2)
+uint8_t cpu_opcode_length(uint8_t opcode);
+
+// M-cycles of an opcode, without the extra ones of a taken branch or a CB instruction
+uint8_t cpu_opcode_cycles(uint8_t opcode);
 
-// TODO: Disassemble the entire ROM by following the code paths
+// The whole ROM, by following the code paths, is disassembled by Disassembly.h
 
 #endif // CPU_CODE
\ No newline at end of file
@@ -1,33 +1,149 @@
 #include "Bus.h"
 #include "Timer.h"
 
-#define IF_ADDR 0xFF0F
-
 // Static variables
 
 // Divider register: FF04
-static uint16_t DIV = 0x0000;
-static uint16_t prev_DIV = 0x0000;
+static GB_INSTANCE uint16_t DIV = 0x0000;
+static GB_INSTANCE uint16_t prev_DIV = 0x0000;
 
 // Timer counter: FF05
-static uint8_t TIMA = 0x00;
+static GB_INSTANCE uint8_t TIMA = 0x00;
 
 // Timer modulo: FF06
-static uint8_t TMA = 0x00;
+static GB_INSTANCE uint8_t TMA = 0x00;
 
 // Timer control: FF07
-static uint8_t TAC = 0x00;
+static GB_INSTANCE uint8_t TAC = 0x00;
 
 // Global variables
 const uint16_t TIMER_FREQS[4] = {0x0200, 0x0008, 0x0020, 0x0080};
-uint8_t counter = 0xFF;
+GB_INSTANCE uint8_t counter = 0xFF;
+
+// Lazy timer (GB_FAST_LAZY_TIMER)
+// The registers above are only brought up to date when they're used: they hold the state after the clocks
+// before timer_sync_clock. DIV just counts, and TIMA goes up on the falling edges of the selected DIV
+// bit, so both are worked out from the number of clocks that passed. The only thing the timer does on
+// its own is the reload with the interrupt, which is worked out ahead of time and is the one clock
+// timer_clock is called on. Every glitch is kept: the register writes still run the same code, on
+// registers that were brought up to date first.
+// Not lazy, timer_next_clock stays 0 so timer_clock runs on every clock.
+#define TIMER_NEVER UINT64_MAX
+
+static GB_INSTANCE bool lazy = false;
+static GB_INSTANCE uint64_t timer_sync_clock = 0;
+GB_INSTANCE uint64_t timer_next_clock = 0;
+
+static void timer_schedule();
 
 void timer_reset() 
 {
 	DIV = 0x00;
+	prev_DIV = 0x00;
 	TIMA = 0x00;
 	TMA = 0x00;
 	TAC = 0x00;
+	counter = 0xFF;
+	lazy = (fast_paths & GB_FAST_LAZY_TIMER) != 0;
+	timer_sync_clock = clock_count;
+	timer_schedule();
+}
+
+// Clocks from timer_sync_clock (1 - the clock at timer_sync_clock) to the first TIMA increment
+static uint64_t timer_first_edge()
+{
+	// A falling edge of the selected bit is when DIV becomes a multiple of twice that bit
+	uint16_t period = TIMER_FREQS[TAC & 0x03] << 1;
+	return period - (DIV & (period - 1));
+}
+
+// Clocks from timer_sync_clock to the reload of TIMA, counted like timer_first_edge, or TIMER_NEVER
+static uint64_t timer_reload_offset()
+{
+	if (!(TAC & TAC_ENABLE))
+		return TIMER_NEVER;
+	uint64_t period = TIMER_FREQS[TAC & 0x03] << 1;
+	uint64_t first = timer_first_edge();
+
+	// Waiting for a reload: it happens once counter runs out, unless TIMA goes up before that
+	if (TIMA == 0)
+	{
+		uint64_t reload = counter > 0 ? counter : 1;
+		if (reload < first)
+			return reload;
+	}
+
+	// The reload is 3 clocks after the overflow, no other edge can come in between
+	uint64_t edges = TIMA == 0 ? 256 : 256 - TIMA;
+	return first + (edges - 1) * period + 3;
+}
+
+// Run n clocks at once, with no reload in them
+static void timer_skip(uint64_t n)
+{
+	if (TAC & TAC_ENABLE)
+	{
+		uint64_t period = TIMER_FREQS[TAC & 0x03] << 1;
+		uint64_t edges = (DIV + n) / period - DIV / period;
+		uint64_t to_overflow = TIMA == 0 ? 256 : 256 - TIMA;
+		if (edges >= to_overflow)
+		{
+			// The overflow set counter to 4, and it went down on the same clock
+			uint64_t overflow = timer_first_edge() + (to_overflow - 1) * period;
+			counter = (uint8_t)(3 - (n - overflow));
+		}
+		else
+			counter = counter > n ? (uint8_t)(counter - n) : 0;
+		TIMA = (uint8_t)(TIMA + edges);
+	}
+	DIV = (uint16_t)(DIV + n);
+}
+
+static void timer_reload()
+{
+	TIMA = TMA;
+	counter = 0xFF;
+	bus_int_request(INT_TIMER);
+}
+
+// Bring the registers up to date for the clocks before clock
+static void timer_sync(uint64_t clock)
+{
+	while (timer_sync_clock < clock)
+	{
+		uint64_t reload = timer_reload_offset();
+		if (reload != TIMER_NEVER && timer_sync_clock + reload <= clock)
+		{
+			timer_skip(reload);
+			timer_sync_clock += reload;
+			timer_reload();
+		}
+		else
+		{
+			timer_skip(clock - timer_sync_clock);
+			timer_sync_clock = clock;
+		}
+	}
+}
+
+static void timer_schedule()
+{
+	if (!lazy)
+	{
+		timer_next_clock = 0;
+		return;
+	}
+	uint64_t reload = timer_reload_offset();
+	timer_next_clock = reload == TIMER_NEVER ? TIMER_NEVER : timer_sync_clock + reload - 1;
+}
+
+void timer_set_lazy(bool enabled)
+{
+	if (lazy)
+		timer_sync(clock_count);
+	lazy = enabled;
+	timer_sync_clock = clock_count;
+	timer_schedule();
 }
 
 // Registers:
@@ -56,6 +172,14 @@ void timer_reset()
 // 
 void timer_clock()
 {
+	if (lazy)
+	{
+		// The clock of the reload
+		timer_sync(clock_count + 1);
+		timer_schedule();
+		return;
+	}
+
 	if (TAC & TAC_ENABLE)
 	{
 		
@@ -75,7 +199,7 @@ void timer_clock()
 			counter = 0xFF;
 
 			// Request interrupt
-			timer_write(IF_ADDR, timer_read(IF_ADDR) | INT_TIMER);
+			bus_int_request(INT_TIMER);
 		}
 	}
 	else
@@ -84,6 +208,8 @@ void timer_clock()
 
 uint8_t timer_register_write(uint16_t addr, uint8_t data)
 {
+	if (lazy)
+		timer_sync(clock_count);
 	switch (addr)
 	{
 	case 0xFF04:
@@ -114,11 +240,14 @@ uint8_t timer_register_write(uint16_t addr, uint8_t data)
 		break;
 	}
 	}
+	timer_schedule();
 	return 0;
 }
 
 uint8_t timer_register_read(uint16_t addr)
 {
+	if (lazy)
+		timer_sync(clock_count);
 	switch (addr)
 	{
 		case 0xFF04:
@@ -142,4 +271,29 @@ uint8_t timer_read(uint16_t addr)
 uint8_t timer_write(uint16_t addr, uint8_t data) 
 {
 	return bus_write(addr, data, DEV_TIMER);
+}
+
+void timer_state_save(TIMER_STATE* state)
+{
+	// Saved as the accurate timer would have it
+	if (lazy)
+		timer_sync(clock_count);
+	state->DIV = DIV;
+	state->prev_DIV = prev_DIV;
+	state->TIMA = TIMA;
+	state->TMA = TMA;
+	state->TAC = TAC;
+	state->counter = counter;
+}
+
+void timer_state_load(TIMER_STATE* state)
+{
+	DIV = state->DIV;
+	prev_DIV = state->prev_DIV;
+	TIMA = state->TIMA;
+	TMA = state->TMA;
+	TAC = state->TAC;
+	counter = state->counter;
+	timer_sync_clock = clock_count;
+	timer_schedule();
 }
\ No newline at end of file
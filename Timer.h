@@ -2,12 +2,31 @@
 #define TIMER_CODE
 
 void timer_reset();
+
+// Called on the clocks from timer_next_clock on. The lazy timer (GB_FAST_LAZY_TIMER) only needs the
+// clocks it has something to do on, otherwise timer_next_clock is 0.
 void timer_clock();
+extern GB_INSTANCE uint64_t timer_next_clock;
+void timer_set_lazy(bool enabled);
+
 uint8_t timer_register_read(uint16_t addr);
 uint8_t timer_register_write(uint16_t addr, uint8_t data);
 uint8_t timer_read(uint16_t addr);
 uint8_t timer_write(uint16_t addr, uint8_t data);
 
+// Save states
+typedef struct {
+	uint16_t DIV;
+	uint16_t prev_DIV;
+	uint8_t TIMA;
+	uint8_t TMA;
+	uint8_t TAC;
+	uint8_t counter;
+} TIMER_STATE;
+
+void timer_state_save(TIMER_STATE* state);
+void timer_state_load(TIMER_STATE* state);
+
 enum TAC_FLAGS{
 	TAC_FREQ_SELECT_LO = (1 << 0),
 	TAC_FREQ_SELECT_HI = (1 << 1),
@@ -0,0 +1,559 @@
+#include "Trace.h"
+#include "Bus.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <string.h>
+
+// Records. The first byte tells the kind:
+//	Instruction:	0b000RRRRR - R: AF, BC, DE, HL, SP changed (bit 0 - AF)
+//					opcode, clock delta, PC delta, then the delta of each changed register
+//	Write:			0x80, address delta, data
+// Deltas are from the last record of the chunk (from 0 for the first one), PC, register and address deltas
+// are signed 16-bit deltas in zigzag form, and all of them are LEB128 varints.
+
+#define TRACE_WRITE_TAG 0x80
+#define TRACE_REGS 5
+#define TRACE_MAX_RECORD 32
+// Room left for the instruction and the writes it makes (at most 2) when a chunk is handed off
+#define TRACE_CHUNK_ROOM (TRACE_MAX_RECORD * 4)
+#define TRACE_MAX_CHUNK (16 * 1024 * 1024)
+
+static const uint8_t trace_magic[8] = { 'G', 'B', 'T', 'R', 'A', 'C', 'E', 1 };
+
+typedef struct {
+	uint8_t* data;
+	uint32_t size;
+	uint64_t first_index;
+} TRACE_CHUNK;
+
+// Static variables
+// Emulation thread side
+bool trace_enabled = false;
+static TRACE_CHUNK* chunk = NULL;	// The one being filled
+static uint64_t trace_index = 0;
+static uint64_t last_clock = 0;
+static uint16_t last_pc = 0;
+static uint16_t last_regs[TRACE_REGS];
+static uint16_t last_addr = 0;
+
+// Shared, protected by trace_lock
+static PLATFORM_MUTEX* trace_lock = NULL;
+static PLATFORM_COND* trace_wake = NULL;	// Worker has something to do
+static PLATFORM_COND* trace_space = NULL;	// A chunk was written
+static TRACE_CHUNK* ring = NULL;
+static int ring_len = 0;
+static int ring_head = 0;		// Oldest full chunk
+static int ring_count = 0;		// Full chunks, the one after them is being filled
+static bool trace_stop_req = false;
+static uint8_t trace_error = TRACE_OK;
+
+// Worker side
+static PLATFORM_THREAD* trace_thread = NULL;
+static FILE* trace_file = NULL;
+
+
+static uint8_t* put_varint(uint8_t* p, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		*p++ = (uint8_t)value | 0x80;
+		value >>= 7;
+	}
+	*p++ = (uint8_t)value;
+	return p;
+}
+
+static uint16_t zigzag16(uint16_t to, uint16_t from)
+{
+	int16_t delta = (int16_t)(uint16_t)(to - from);
+	return (uint16_t)((delta << 1) ^ (delta >> 15));
+}
+
+static uint16_t unzigzag16(uint16_t from, uint64_t z)
+{
+	return (uint16_t)(from + (uint16_t)((z >> 1) ^ (0 - (z & 1))));
+}
+
+static void put_le(uint8_t* p, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t get_le(uint8_t* p, int bytes)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= (uint64_t)p[i] << (8 * i);
+	return value;
+}
+
+static bool trace_write_chunk(FILE* file, TRACE_CHUNK* c)
+{
+	uint8_t header[12];
+	put_le(header, c->size, 4);
+	put_le(header + 4, c->first_index, 8);
+	return fwrite(header, 1, sizeof header, file) == sizeof header &&
+		fwrite(c->data, 1, c->size, file) == c->size;
+}
+
+// Start filling the chunk after the full ones, from zero
+static void trace_chunk_begin()
+{
+	chunk = &ring[(ring_head + ring_count) % ring_len];
+	chunk->size = 0;
+	chunk->first_index = trace_index;
+	last_clock = 0;
+	last_pc = 0;
+	memset(last_regs, 0, sizeof last_regs);
+	last_addr = 0;
+}
+
+static void trace_worker(void* arg)
+{
+	platform_mutex_lock(trace_lock);
+	while (true)
+	{
+		while (ring_count == 0 && !trace_stop_req)
+			platform_cond_wait(trace_wake, trace_lock);
+		if (ring_count == 0)
+			break;
+
+		// The chunk stays in the ring until it's written, so the CPU can't refill it
+		TRACE_CHUNK* c = &ring[ring_head];
+		platform_mutex_unlock(trace_lock);
+		bool ok = trace_write_chunk(trace_file, c);
+		platform_mutex_lock(trace_lock);
+		ring_head = (ring_head + 1) % ring_len;
+		ring_count--;
+		platform_cond_broadcast(trace_space);
+		if (!ok)
+		{
+			trace_error = TRACE_ERR_FILE_WRITE;
+			break;
+		}
+	}
+	// Don't leave the CPU waiting for space if writing failed
+	ring_count = 0;
+	platform_cond_broadcast(trace_space);
+	platform_mutex_unlock(trace_lock);
+}
+
+// The chunk is full: hand it to the worker, or in memory drop the oldest one
+static void trace_hand_off()
+{
+	if (trace_thread == NULL)
+	{
+		if (ring_count == ring_len - 1)
+		{
+			ring_head = (ring_head + 1) % ring_len;
+			ring_count--;
+		}
+		ring_count++;
+	}
+	else
+	{
+		platform_mutex_lock(trace_lock);
+		if (trace_error == TRACE_OK)
+		{
+			ring_count++;
+			platform_cond_signal(trace_wake);
+			while (ring_count == ring_len && trace_error == TRACE_OK)
+				platform_cond_wait(trace_space, trace_lock);
+		}
+		platform_mutex_unlock(trace_lock);
+	}
+	trace_chunk_begin();
+}
+
+static void trace_free()
+{
+	if (ring != NULL)
+	{
+		for (int i = 0; i < ring_len; i++)
+			free(ring[i].data);
+		free(ring);
+	}
+	ring = NULL;
+	ring_len = 0;
+	chunk = NULL;
+	platform_cond_free(trace_wake);
+	platform_cond_free(trace_space);
+	platform_mutex_free(trace_lock);
+	trace_wake = NULL;
+	trace_space = NULL;
+	trace_lock = NULL;
+}
+
+uint8_t trace_start(char* filename, int chunks)
+{
+	if (trace_enabled)
+		return TRACE_ERR_RUNNING;
+	trace_free();	// A stopped trace in memory that was never saved
+	if (chunks < 2)
+		chunks = 2;
+
+	// Allocate everything up front, the CPU never allocates
+	bool alloc_ok = true;
+	ring = (TRACE_CHUNK*)calloc(chunks, sizeof(TRACE_CHUNK));
+	ring_len = chunks;
+	if (ring == NULL)
+		alloc_ok = false;
+	for (int i = 0; alloc_ok && i < chunks; i++)
+	{
+		ring[i].data = (uint8_t*)malloc(TRACE_CHUNK_SIZE);
+		if (ring[i].data == NULL)
+			alloc_ok = false;
+	}
+	if (filename != NULL)
+	{
+		trace_lock = platform_mutex_create();
+		trace_wake = platform_cond_create();
+		trace_space = platform_cond_create();
+		if (trace_lock == NULL || trace_wake == NULL || trace_space == NULL)
+			alloc_ok = false;
+	}
+	if (!alloc_ok)
+	{
+		trace_free();
+		return TRACE_ERR_ALLOC;
+	}
+
+	ring_head = 0;
+	ring_count = 0;
+	trace_stop_req = false;
+	trace_error = TRACE_OK;
+	trace_index = 0;
+	if (filename != NULL)
+	{
+		trace_file = fopen(filename, "wb");
+		if (trace_file == NULL)
+		{
+			trace_free();
+			return TRACE_ERR_FILE_OPEN;
+		}
+		if (fwrite(trace_magic, 1, sizeof trace_magic, trace_file) != sizeof trace_magic)
+		{
+			fclose(trace_file);
+			trace_file = NULL;
+			trace_free();
+			return TRACE_ERR_FILE_WRITE;
+		}
+		trace_thread = platform_thread_create(trace_worker, NULL);
+		if (trace_thread == NULL)
+		{
+			fclose(trace_file);
+			trace_file = NULL;
+			trace_free();
+			return TRACE_ERR_THREAD;
+		}
+	}
+	trace_chunk_begin();
+	trace_enabled = true;
+	return TRACE_OK;
+}
+
+uint8_t trace_stop()
+{
+	if (chunk == NULL)
+		return TRACE_ERR_NOT_RUNNING;
+	trace_enabled = false;
+	if (trace_thread == NULL)
+		return TRACE_OK;	// The chunks stay for trace_save until the next start
+
+	// Final flush, here it's fine to wait for the disk
+	platform_mutex_lock(trace_lock);
+	if (chunk->size > 0 && trace_error == TRACE_OK)
+		ring_count++;
+	trace_stop_req = true;
+	platform_cond_signal(trace_wake);
+	platform_mutex_unlock(trace_lock);
+
+	platform_thread_join(trace_thread);
+	trace_thread = NULL;
+	uint8_t res = trace_error;
+	if (fclose(trace_file) != 0 && res == TRACE_OK)
+		res = TRACE_ERR_FILE_WRITE;
+	trace_file = NULL;
+	trace_free();
+	return res;
+}
+
+uint8_t trace_save(char* filename)
+{
+	if (chunk == NULL || trace_thread != NULL)
+		return TRACE_ERR_NOT_RUNNING;
+
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL)
+		return TRACE_ERR_FILE_OPEN;
+	bool ok = fwrite(trace_magic, 1, sizeof trace_magic, file) == sizeof trace_magic;
+	for (int i = 0; ok && i < ring_count; i++)
+		ok = trace_write_chunk(file, &ring[(ring_head + i) % ring_len]);
+	if (ok && chunk->size > 0)
+		ok = trace_write_chunk(file, chunk);
+	if (fclose(file) != 0)
+		ok = false;
+	if (!trace_enabled)
+		trace_free();	// Stopped already, the chunks aren't needed any more
+	return ok ? TRACE_OK : TRACE_ERR_FILE_WRITE;
+}
+
+void trace_instruction(uint16_t pc, uint8_t opcode, uint16_t af, uint16_t bc, uint16_t de, uint16_t hl, uint16_t sp)
+{
+	if (chunk->size + TRACE_CHUNK_ROOM > TRACE_CHUNK_SIZE)
+		trace_hand_off();
+
+	uint16_t regs[TRACE_REGS] = { af, bc, de, hl, sp };
+	uint8_t* start = chunk->data + chunk->size;
+	uint8_t* p = start + 1;
+	uint8_t mask = 0;
+	*p++ = opcode;
+	p = put_varint(p, clock_count - last_clock);
+	p = put_varint(p, zigzag16(pc, last_pc));
+	for (int i = 0; i < TRACE_REGS; i++)
+	{
+		if (regs[i] != last_regs[i])
+		{
+			mask |= 1 << i;
+			p = put_varint(p, zigzag16(regs[i], last_regs[i]));
+			last_regs[i] = regs[i];
+		}
+	}
+	*start = mask;
+	chunk->size += (uint32_t)(p - start);
+	last_clock = clock_count;
+	last_pc = pc;
+	trace_index++;
+}
+
+void trace_write(uint16_t addr, uint8_t data)
+{
+	// Can only happen to an instruction that wrote more than the room that was left for it
+	if (chunk->size + TRACE_MAX_RECORD > TRACE_CHUNK_SIZE)
+		trace_hand_off();
+
+	uint8_t* start = chunk->data + chunk->size;
+	uint8_t* p = start;
+	*p++ = TRACE_WRITE_TAG;
+	p = put_varint(p, zigzag16(addr, last_addr));
+	*p++ = data;
+	chunk->size += (uint32_t)(p - start);
+	last_addr = addr;
+}
+
+
+// Reading
+
+struct TRACE_READER {
+	FILE* file;
+	uint8_t* data;
+	uint32_t size;
+	uint32_t pos;
+	uint64_t index;
+	uint64_t clock;
+	uint16_t pc;
+	uint16_t regs[TRACE_REGS];
+	uint16_t addr;
+};
+
+uint8_t trace_reader_open(char* filename, TRACE_READER** reader)
+{
+	uint8_t magic[sizeof trace_magic];
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+		return TRACE_ERR_FILE_OPEN;
+	if (fread(magic, 1, sizeof magic, file) != sizeof magic || memcmp(magic, trace_magic, sizeof magic) != 0)
+	{
+		fclose(file);
+		return TRACE_ERR_FORMAT;
+	}
+	TRACE_READER* r = (TRACE_READER*)calloc(1, sizeof(TRACE_READER));
+	if (r == NULL)
+	{
+		fclose(file);
+		return TRACE_ERR_ALLOC;
+	}
+	r->file = file;
+	*reader = r;
+	return TRACE_OK;
+}
+
+void trace_reader_close(TRACE_READER* reader)
+{
+	if (reader == NULL)
+		return;
+	fclose(reader->file);
+	free(reader->data);
+	free(reader);
+}
+
+static bool get_varint(TRACE_READER* r, uint64_t* value)
+{
+	*value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		if (r->pos >= r->size)
+			return false;
+		uint8_t byte = r->data[r->pos++];
+		*value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+// Load the next chunk, false at the end of the file
+static uint8_t trace_reader_chunk(TRACE_READER* r, bool* end)
+{
+	uint8_t header[12];
+	size_t got = fread(header, 1, sizeof header, r->file);
+	*end = got == 0;
+	if (got == 0)
+		return ferror(r->file) ? TRACE_ERR_FILE_READ : TRACE_OK;
+	if (got != sizeof header)
+		return TRACE_ERR_FORMAT;
+
+	uint32_t size = (uint32_t)get_le(header, 4);
+	if (size > TRACE_MAX_CHUNK)
+		return TRACE_ERR_FORMAT;
+	uint8_t* data = (uint8_t*)realloc(r->data, size ? size : 1);
+	if (data == NULL)
+		return TRACE_ERR_ALLOC;
+	r->data = data;
+	if (fread(r->data, 1, size, r->file) != size)
+		return TRACE_ERR_FORMAT;
+	r->size = size;
+	r->pos = 0;
+	r->index = get_le(header + 4, 8);
+	r->clock = 0;
+	r->pc = 0;
+	memset(r->regs, 0, sizeof r->regs);
+	r->addr = 0;
+	return TRACE_OK;
+}
+
+uint8_t trace_reader_next(TRACE_READER* r, TRACE_EVENT* event)
+{
+	memset(event, 0, sizeof(TRACE_EVENT));
+	while (r->pos >= r->size)
+	{
+		bool end;
+		uint8_t res = trace_reader_chunk(r, &end);
+		if (res != TRACE_OK)
+			return res;
+		if (end)
+			return TRACE_OK;	// TRACE_EVENT_END
+	}
+
+	uint8_t tag = r->data[r->pos++];
+	uint64_t value;
+	if (tag == TRACE_WRITE_TAG)
+	{
+		if (!get_varint(r, &value) || r->pos >= r->size)
+			return TRACE_ERR_FORMAT;
+		r->addr = unzigzag16(r->addr, value);
+		event->kind = TRACE_EVENT_WRITE;
+		event->addr = r->addr;
+		event->data = r->data[r->pos++];
+		event->index = r->index ? r->index - 1 : 0;
+	}
+	else if (tag < (1 << TRACE_REGS))
+	{
+		if (r->pos >= r->size)
+			return TRACE_ERR_FORMAT;
+		event->opcode = r->data[r->pos++];
+		if (!get_varint(r, &value))
+			return TRACE_ERR_FORMAT;
+		r->clock += value;
+		if (!get_varint(r, &value))
+			return TRACE_ERR_FORMAT;
+		r->pc = unzigzag16(r->pc, value);
+		for (int i = 0; i < TRACE_REGS; i++)
+		{
+			if (tag & (1 << i))
+			{
+				if (!get_varint(r, &value))
+					return TRACE_ERR_FORMAT;
+				r->regs[i] = unzigzag16(r->regs[i], value);
+			}
+		}
+		event->kind = TRACE_EVENT_INSTRUCTION;
+		event->index = r->index++;
+		event->pc = r->pc;
+		event->af = r->regs[0];
+		event->bc = r->regs[1];
+		event->de = r->regs[2];
+		event->hl = r->regs[3];
+		event->sp = r->regs[4];
+	}
+	else
+		return TRACE_ERR_FORMAT;
+	event->clock = r->clock;
+	return TRACE_OK;
+}
+
+static bool trace_event_equal(TRACE_EVENT* a, TRACE_EVENT* b)
+{
+	if (a->kind != b->kind)
+		return false;
+	if (a->kind == TRACE_EVENT_WRITE)
+		return a->addr == b->addr && a->data == b->data;
+	return a->index == b->index && a->clock == b->clock && a->pc == b->pc && a->opcode == b->opcode &&
+		a->af == b->af && a->bc == b->bc && a->de == b->de && a->hl == b->hl && a->sp == b->sp;
+}
+
+// Skip to the first instruction at or after index
+static uint8_t trace_skip_to(TRACE_READER* r, TRACE_EVENT* event, uint64_t index)
+{
+	uint8_t res = TRACE_OK;
+	while (res == TRACE_OK && event->kind != TRACE_EVENT_END &&
+		(event->kind != TRACE_EVENT_INSTRUCTION || event->index < index))
+		res = trace_reader_next(r, event);
+	return res;
+}
+
+uint8_t trace_diff(char* filename_a, char* filename_b, TRACE_DIFF* diff)
+{
+	TRACE_READER* a = NULL;
+	TRACE_READER* b = NULL;
+	memset(diff, 0, sizeof(TRACE_DIFF));
+	uint8_t res = trace_reader_open(filename_a, &a);
+	if (res == TRACE_OK)
+		res = trace_reader_open(filename_b, &b);
+	if (res == TRACE_OK)
+		res = trace_reader_next(a, &diff->a);
+	if (res == TRACE_OK)
+		res = trace_reader_next(b, &diff->b);
+
+	// Line up the starts
+	if (res == TRACE_OK)
+		res = trace_skip_to(a, &diff->a, 0);
+	if (res == TRACE_OK)
+		res = trace_skip_to(b, &diff->b, 0);
+	if (res == TRACE_OK && diff->a.kind != TRACE_EVENT_END && diff->b.kind != TRACE_EVENT_END)
+	{
+		if (diff->a.index < diff->b.index)
+			res = trace_skip_to(a, &diff->a, diff->b.index);
+		else
+			res = trace_skip_to(b, &diff->b, diff->a.index);
+	}
+
+	while (res == TRACE_OK)
+	{
+		if (!trace_event_equal(&diff->a, &diff->b))
+		{
+			diff->diverged = true;
+			break;
+		}
+		if (diff->a.kind == TRACE_EVENT_END)
+			break;
+		diff->events++;
+		res = trace_reader_next(a, &diff->a);
+		if (res == TRACE_OK)
+			res = trace_reader_next(b, &diff->b);
+	}
+	trace_reader_close(a);
+	trace_reader_close(b);
+	return res;
+}
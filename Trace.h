@@ -0,0 +1,89 @@
+#ifndef TRACE_CODE
+#define TRACE_CODE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Execution traces
+// Logs every instruction the CPU starts (PC, opcode, registers and clock_count) and every byte the CPU
+// writes, in a compact binary form: each record holds only the registers that changed, as deltas, in
+// variable length numbers. A typical instruction takes 4 - 6 bytes.
+// The records go into chunks of TRACE_CHUNK_SIZE bytes, and each chunk starts from zero so it can be
+// read on its own. Full chunks are handed to a worker thread that writes them to the file, the CPU only
+// waits if the worker falls behind by the whole ring. Without a file the ring keeps the last chunks in
+// memory (a flight recorder), and trace_save writes them out when they're needed.
+// The trace state is shared by the whole process, so it's meant for tools that run one machine.
+//
+// File: "GBTRACE" and a version byte, then the chunks, each one a little endian uint32 size and uint64
+// instruction index followed by the records.
+
+#define TRACE_CHUNK_SIZE (64 * 1024)
+
+// Is a trace recording? Checked by the CPU before calling the hooks.
+extern bool trace_enabled;
+
+// filename NULL - keep the last chunks in memory only. chunks is the size of the ring (at least 2).
+uint8_t trace_start(char* filename, int chunks);
+uint8_t trace_stop();
+
+// Write the chunks in memory (the oldest first), for traces without a file
+uint8_t trace_save(char* filename);
+
+// CPU hooks: an instruction is starting (before its PC moved), and a write by the CPU
+void trace_instruction(uint16_t pc, uint8_t opcode, uint16_t af, uint16_t bc, uint16_t de, uint16_t hl, uint16_t sp);
+void trace_write(uint16_t addr, uint8_t data);
+
+// Reading traces
+typedef struct {
+	uint8_t kind;		// TRACE_EVENT_*
+	uint64_t index;		// Instructions since the trace started, a write belongs to the last instruction
+	uint64_t clock;
+	uint16_t pc;
+	uint16_t af;
+	uint16_t bc;
+	uint16_t de;
+	uint16_t hl;
+	uint16_t sp;
+	uint8_t opcode;
+	uint16_t addr;		// Writes
+	uint8_t data;
+} TRACE_EVENT;
+
+enum TRACE_EVENT_KINDS {
+	TRACE_EVENT_END = 0,
+	TRACE_EVENT_INSTRUCTION,
+	TRACE_EVENT_WRITE
+};
+
+typedef struct TRACE_READER TRACE_READER;
+
+uint8_t trace_reader_open(char* filename, TRACE_READER** reader);
+// TRACE_OK with event->kind TRACE_EVENT_END at the end of the trace
+uint8_t trace_reader_next(TRACE_READER* reader, TRACE_EVENT* event);
+void trace_reader_close(TRACE_READER* reader);
+
+// First difference between two traces, in one pass over both. Traces that start at different
+// instructions (flight recorder traces) are compared from the first instruction they both have.
+typedef struct {
+	bool diverged;
+	TRACE_EVENT a;		// The events that differ, TRACE_EVENT_END if one trace ended first
+	TRACE_EVENT b;
+	uint64_t events;	// Events that matched before it
+} TRACE_DIFF;
+
+uint8_t trace_diff(char* filename_a, char* filename_b, TRACE_DIFF* diff);
+
+enum TRACE_ERRORS {
+	TRACE_OK = 0,
+	TRACE_ERR_RUNNING,
+	TRACE_ERR_NOT_RUNNING,
+	TRACE_ERR_ALLOC,
+	TRACE_ERR_THREAD,
+	TRACE_ERR_FILE_OPEN,
+	TRACE_ERR_FILE_READ,
+	TRACE_ERR_FILE_WRITE,
+	TRACE_ERR_FORMAT
+};
+
+#endif // TRACE_CODE
@@ -0,0 +1,110 @@
+#include "Trace.h"
+#include "Sharp_LR35902.h"
+#include <stdio.h>
+#include <string.h>
+
+// Command line front end for the execution traces (gbrun -trace)
+//	gbtrace dump <trace> [-from N] [-count N]
+//	gbtrace diff <trace a> <trace b>
+// dump prints the events from instruction N on, diff prints the first event where the traces differ and
+// exits with 1 if they do.
+
+static int usage()
+{
+	fprintf(stderr, "Usage:\n");
+	fprintf(stderr, "\tgbtrace dump <trace> [-from N] [-count N]\n");
+	fprintf(stderr, "\tgbtrace diff <trace a> <trace b>\n");
+	return 2;
+}
+
+static void print_event(char* prefix, TRACE_EVENT* e)
+{
+	if (e->kind == TRACE_EVENT_END)
+		printf("%send of trace\n", prefix);
+	else if (e->kind == TRACE_EVENT_WRITE)
+		printf("%s%12s  write  (%04X) <- %02X\n", prefix, "", e->addr, e->data);
+	else
+	{
+		char name[32];
+		cpu_opcode_name(e->opcode, false, name, sizeof(name));
+		printf("%s%12llu  %10llu  %04X  %02X %-16s AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X\n", prefix,
+			(unsigned long long)e->index, (unsigned long long)e->clock, e->pc, e->opcode, name,
+			e->af, e->bc, e->de, e->hl, e->sp);
+	}
+}
+
+static int cmd_dump(int argc, char** argv)
+{
+	if (argc < 3)
+		return usage();
+	uint64_t from = 0;
+	uint64_t count = UINT64_MAX;
+	for (int i = 3; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "-from") == 0)
+			from = strtoull(argv[i + 1], NULL, 0);
+		else if (strcmp(argv[i], "-count") == 0)
+			count = strtoull(argv[i + 1], NULL, 0);
+		else
+			return usage();
+	}
+
+	TRACE_READER* reader;
+	uint8_t res = trace_reader_open(argv[2], &reader);
+	if (res != TRACE_OK)
+	{
+		fprintf(stderr, "Opening %s failed: %d\n", argv[2], res);
+		return 2;
+	}
+	printf("%12s  %10s  %-4s  %s\n", "instruction", "clock", "pc", "opcode");
+	TRACE_EVENT e;
+	uint64_t printed = 0;
+	while ((res = trace_reader_next(reader, &e)) == TRACE_OK && e.kind != TRACE_EVENT_END)
+	{
+		if (e.index < from)
+			continue;
+		if (e.kind == TRACE_EVENT_INSTRUCTION && printed++ == count)
+			break;
+		print_event("", &e);
+	}
+	trace_reader_close(reader);
+	if (res != TRACE_OK)
+	{
+		fprintf(stderr, "Reading %s failed: %d\n", argv[2], res);
+		return 2;
+	}
+	return 0;
+}
+
+static int cmd_diff(int argc, char** argv)
+{
+	if (argc < 4)
+		return usage();
+	TRACE_DIFF diff;
+	uint8_t res = trace_diff(argv[2], argv[3], &diff);
+	if (res != TRACE_OK)
+	{
+		fprintf(stderr, "Reading the traces failed: %d\n", res);
+		return 2;
+	}
+	if (!diff.diverged)
+	{
+		printf("Same, %llu events\n", (unsigned long long)diff.events);
+		return 0;
+	}
+	printf("First difference after %llu matching events:\n", (unsigned long long)diff.events);
+	print_event("a: ", &diff.a);
+	print_event("b: ", &diff.b);
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+		return usage();
+	if (strcmp(argv[1], "dump") == 0)
+		return cmd_dump(argc, argv);
+	if (strcmp(argv[1], "diff") == 0)
+		return cmd_diff(argc, argv);
+	return usage();
+}